@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// allocationcounter.cpp
+// ============
+// count the heap allocations made by the threads of the render loop, so the
+// profiler can show that a steady frame makes none
+///////////////////////////////////////////////////////////////////////////////
+
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// declaration of global variables and defines
+namespace
+{
+	// allocations of the counted threads since the start
+	std::atomic<long long> g_Allocations(0);
+	// whether the allocations of the thread are counted
+	thread_local bool g_bCountedThread = false;
+
+#ifdef COUNT_ALLOCATIONS
+	/***********************************************************
+	 *  CountedAllocate()
+	 *
+	 *  This function is used for allocating the memory of every
+	 *  replaced operator new, counting it when the thread is
+	 *  counted.  A failed allocation throws like the operator
+	 *  it replaces.
+	 ***********************************************************/
+	void* CountedAllocate(size_t size, bool bThrow)
+	{
+		if (g_bCountedThread)
+		{
+			g_Allocations.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void* pMemory = malloc((0 == size) ? 1 : size);
+		if ((NULL == pMemory) && bThrow)
+		{
+			throw std::bad_alloc();
+		}
+
+		return(pMemory);
+	}
+#endif
+}
+
+#ifdef COUNT_ALLOCATIONS
+// the replaced allocation operators, which every other form
+// of operator new and delete of the standard library ends in
+void* operator new(size_t size) { return(CountedAllocate(size, true)); }
+void* operator new[](size_t size) { return(CountedAllocate(size, true)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return(CountedAllocate(size, false)); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return(CountedAllocate(size, false)); }
+void operator delete(void* pMemory) noexcept { free(pMemory); }
+void operator delete[](void* pMemory) noexcept { free(pMemory); }
+void operator delete(void* pMemory, size_t) noexcept { free(pMemory); }
+void operator delete[](void* pMemory, size_t) noexcept { free(pMemory); }
+void operator delete(void* pMemory, const std::nothrow_t&) noexcept { free(pMemory); }
+void operator delete[](void* pMemory, const std::nothrow_t&) noexcept { free(pMemory); }
+#endif
+
+/***********************************************************
+ *  IsEnabled()
+ *
+ *  This method is used for telling whether the replaced
+ *  operators are built in, so a count of zero means none
+ *  were made.
+ ***********************************************************/
+bool AllocationCounter::IsEnabled()
+{
+#ifdef COUNT_ALLOCATIONS
+	return(true);
+#else
+	return(false);
+#endif
+}
+
+/***********************************************************
+ *  CountThread()
+ *
+ *  This method is used for counting the allocations of the
+ *  calling thread from now on.
+ ***********************************************************/
+void AllocationCounter::CountThread()
+{
+	g_bCountedThread = true;
+}
+
+/***********************************************************
+ *  GetCount()
+ *
+ *  This method is used for reading the allocations of all
+ *  the counted threads so far, which the profiler takes the
+ *  difference of over a frame.
+ ***********************************************************/
+long long AllocationCounter::GetCount()
+{
+	return(g_Allocations.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,38 @@
+///////////////////////////////////////////////////////////////////////////////
+// allocationcounter.h
+// ============
+// count the heap allocations made by the threads of the render loop, so the
+// profiler can show that a steady frame makes none
+//
+//	The global operator new is replaced, in debug builds or when
+//	COUNT_ALLOCATIONS is defined, by one that counts every allocation of a
+//	thread that asked to be counted - the render thread and the workers of
+//	the job system - before passing it on to malloc.  The loader and
+//	simulation threads are left out, since they allocate on purpose while
+//	the frames go on.  Allocations made by OpenGL, GLFW or the C runtime
+//	do not go through operator new and are not counted.  Without the
+//	counter nothing is replaced and the count is always zero.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#if defined(_DEBUG) && !defined(COUNT_ALLOCATIONS)
+#define COUNT_ALLOCATIONS
+#endif
+
+/***********************************************************
+ *  AllocationCounter
+ *
+ *  This class contains the code for marking the threads
+ *  whose allocations are counted and reading the count.
+ ***********************************************************/
+class AllocationCounter
+{
+public:
+	// whether the allocations are counted in this build
+	static bool IsEnabled();
+	// count the allocations of the calling thread from now on
+	static void CountThread();
+	// allocations of the counted threads since the start
+	static long long GetCount();
+};
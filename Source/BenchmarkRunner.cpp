@@ -0,0 +1,450 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmarkrunner.cpp
+// ============
+// draw the scene offscreen along a scripted camera path for a fixed number of
+// frames, and write the frame time statistics as JSON
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BenchmarkRunner.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// defaults of the benchmark options
+	const int g_DefaultWidth = 1920;
+	const int g_DefaultHeight = 1080;
+	const int g_DefaultFrames = 1000;
+	const int g_DefaultWarmupFrames = 120;
+	const char* g_DefaultOutputFile = "benchmark.json";
+
+	// parts of the camera path
+	enum PATH_SEGMENT
+	{
+		PATH_ORBIT = 0,
+		PATH_DOLLY,
+		PATH_FRONT,
+		PATH_SIDE,
+		PATH_TOP
+	};
+
+	// share of the measured frames spent in every part of the
+	// camera path, in order
+	const struct
+	{
+		PATH_SEGMENT segment;
+		float share;
+	} g_CameraPath[] = {
+		{ PATH_ORBIT, 0.4f },
+		{ PATH_DOLLY, 0.15f },
+		{ PATH_FRONT, 0.15f },
+		{ PATH_SIDE, 0.15f },
+		{ PATH_TOP, 0.15f } };
+	const int g_TotalPathSegments = sizeof(g_CameraPath) / sizeof(g_CameraPath[0]);
+
+	// point the perspective parts of the path look at, and the
+	// orbit around it
+	const glm::vec3 g_PathTarget(0.0f, 2.0f, 0.0f);
+	const float g_OrbitRadius = 9.0f;
+	const float g_OrbitHeight = 5.8f;
+	const float g_OrbitAngle = glm::radians(60.0f);
+	// start and end of the dolly towards the objects
+	const glm::vec3 g_DollyStart(0.0f, 6.0f, 14.0f);
+	const glm::vec3 g_DollyEnd(1.0f, 3.5f, 4.0f);
+
+	/***********************************************************
+	 *  ReadIntArgument()
+	 *
+	 *  This function is used for reading the whole number after
+	 *  an option, keeping the passed in value when it is
+	 *  missing or not positive.
+	 ***********************************************************/
+	int ReadIntArgument(int argc, char* argv[], int& i, int value)
+	{
+		if (i + 1 >= argc)
+		{
+			return(value);
+		}
+
+		i++;
+		int argument = atoi(argv[i]);
+		if (argument <= 0)
+		{
+			std::cout << "Ignoring benchmark option value " << argv[i] << std::endl;
+			return(value);
+		}
+		return(argument);
+	}
+
+	/***********************************************************
+	 *  WriteJSONNumber()
+	 *
+	 *  This function is used for writing a timing into the JSON
+	 *  file, or null when it was never measured.
+	 ***********************************************************/
+	void WriteJSONNumber(std::ofstream& file, double value)
+	{
+		if (value < 0.0)
+		{
+			file << "null";
+		}
+		else
+		{
+			file << value;
+		}
+	}
+}
+
+/***********************************************************
+ *  BenchmarkRunner()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+BenchmarkRunner::BenchmarkRunner(const BENCHMARK_SETTINGS& settings)
+{
+	m_settings = settings;
+	m_framebuffer = 0;
+	m_colorBuffer = 0;
+	m_depthBuffer = 0;
+	m_frameTimes.reserve(settings.frames);
+}
+
+/***********************************************************
+ *  ~BenchmarkRunner()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+BenchmarkRunner::~BenchmarkRunner()
+{
+	if (0 != m_framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (0 != m_colorBuffer)
+	{
+		glDeleteRenderbuffers(1, &m_colorBuffer);
+		m_colorBuffer = 0;
+	}
+	if (0 != m_depthBuffer)
+	{
+		glDeleteRenderbuffers(1, &m_depthBuffer);
+		m_depthBuffer = 0;
+	}
+}
+
+/***********************************************************
+ *  ParseArguments()
+ *
+ *  This method is used for reading the benchmark options
+ *  from the command line into the passed in settings, which
+ *  keep their defaults for the options that are not passed.
+ *  It returns whether --benchmark was passed.
+ ***********************************************************/
+bool BenchmarkRunner::ParseArguments(int argc, char* argv[], BENCHMARK_SETTINGS& settings)
+{
+	bool bBenchmark = false;
+
+	settings.width = g_DefaultWidth;
+	settings.height = g_DefaultHeight;
+	settings.frames = g_DefaultFrames;
+	settings.warmupFrames = g_DefaultWarmupFrames;
+	settings.replicas = 1;
+	settings.bDeferred = false;
+	settings.bOcclusionCulling = true;
+	settings.outputFile = g_DefaultOutputFile;
+	settings.captureFile.clear();
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			bBenchmark = true;
+		}
+		else if (strcmp(argv[i], "--width") == 0)
+		{
+			settings.width = ReadIntArgument(argc, argv, i, settings.width);
+		}
+		else if (strcmp(argv[i], "--height") == 0)
+		{
+			settings.height = ReadIntArgument(argc, argv, i, settings.height);
+		}
+		else if (strcmp(argv[i], "--frames") == 0)
+		{
+			settings.frames = ReadIntArgument(argc, argv, i, settings.frames);
+		}
+		else if (strcmp(argv[i], "--warmup") == 0)
+		{
+			settings.warmupFrames = ReadIntArgument(argc, argv, i, settings.warmupFrames);
+		}
+		else if (strcmp(argv[i], "--deferred") == 0)
+		{
+			settings.bDeferred = true;
+		}
+		else if (strcmp(argv[i], "--no-occlusion") == 0)
+		{
+			settings.bOcclusionCulling = false;
+		}
+		else if (strcmp(argv[i], "--replicas") == 0)
+		{
+			settings.replicas = ReadIntArgument(argc, argv, i, settings.replicas);
+		}
+		else if ((strcmp(argv[i], "--output") == 0) && (i + 1 < argc))
+		{
+			i++;
+			settings.outputFile = argv[i];
+		}
+		else if ((strcmp(argv[i], "--capture") == 0) && (i + 1 < argc))
+		{
+			i++;
+			settings.captureFile = argv[i];
+		}
+	}
+
+	return(bBenchmark);
+}
+
+/***********************************************************
+ *  CreateTarget()
+ *
+ *  This method is used for creating the framebuffer object
+ *  that the benchmark frames are drawn into.
+ ***********************************************************/
+bool BenchmarkRunner::CreateTarget()
+{
+	glGenRenderbuffers(1, &m_colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_settings.width, m_settings.height);
+
+	glGenRenderbuffers(1, &m_depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_settings.width, m_settings.height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+	{
+		std::cout << "Benchmark framebuffer is not complete: " << status << std::endl;
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  BindTarget()
+ *
+ *  This method is used for drawing the following passes
+ *  into the offscreen framebuffer.
+ ***********************************************************/
+void BenchmarkRunner::BindTarget() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, m_settings.width, m_settings.height);
+}
+
+/***********************************************************
+ *  PlaceCamera()
+ *
+ *  This method is used for moving the camera to its place on
+ *  the scripted path for a measured frame.  The path only
+ *  depends on the frame number, never on the time, so every
+ *  run draws the same views.
+ ***********************************************************/
+void BenchmarkRunner::PlaceCamera(ViewManager* pViewManager, int frame) const
+{
+	if (NULL == pViewManager)
+	{
+		return;
+	}
+
+	// find the part of the path and how far along it the frame is
+	float pathPosition = (float)frame / (float)std::max(1, m_settings.frames);
+	int segment = 0;
+	while ((segment < g_TotalPathSegments - 1) && (pathPosition >= g_CameraPath[segment].share))
+	{
+		pathPosition -= g_CameraPath[segment].share;
+		segment++;
+	}
+	float t = glm::clamp(pathPosition / g_CameraPath[segment].share, 0.0f, 1.0f);
+
+	switch (g_CameraPath[segment].segment)
+	{
+	case PATH_ORBIT:
+	{
+		float angle = glm::mix(-g_OrbitAngle, g_OrbitAngle, t);
+		glm::vec3 position(
+			g_OrbitRadius * std::sin(angle),
+			g_OrbitHeight,
+			g_OrbitRadius * std::cos(angle));
+		pViewManager->SetCameraPose(position, g_PathTarget - position);
+		break;
+	}
+	case PATH_DOLLY:
+	{
+		glm::vec3 position = glm::mix(g_DollyStart, g_DollyEnd, t);
+		pViewManager->SetCameraPose(position, g_PathTarget - position);
+		break;
+	}
+	case PATH_FRONT:
+		pViewManager->SetViewPreset(ViewManager::VIEW_FRONT);
+		break;
+	case PATH_SIDE:
+		pViewManager->SetViewPreset(ViewManager::VIEW_SIDE);
+		break;
+	default:
+		pViewManager->SetViewPreset(ViewManager::VIEW_TOP);
+		break;
+	}
+}
+
+/***********************************************************
+ *  RecordFrameTime()
+ *
+ *  This method is used for keeping the time of a measured
+ *  frame for the statistics.
+ ***********************************************************/
+void BenchmarkRunner::RecordFrameTime(double milliseconds)
+{
+	m_frameTimes.push_back(milliseconds);
+}
+
+/***********************************************************
+ *  WriteResults()
+ *
+ *  This method is used for writing the minimum, mean, 99th
+ *  percentile and maximum frame times, the counters of the
+ *  last frame and the mean timings of every profiled pass
+ *  into the JSON output file.
+ ***********************************************************/
+bool BenchmarkRunner::WriteResults(const FrameProfiler* pProfiler) const
+{
+	std::ofstream file(m_settings.outputFile.c_str(), std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open benchmark file:" << m_settings.outputFile << std::endl;
+		return(false);
+	}
+
+	double minimum = 0.0;
+	double average = 0.0;
+	double percentile = 0.0;
+	double maximum = 0.0;
+	if (m_frameTimes.empty() == false)
+	{
+		std::vector<double> sorted = m_frameTimes;
+		std::sort(sorted.begin(), sorted.end());
+		minimum = sorted.front();
+		maximum = sorted.back();
+		for (size_t i = 0; i < sorted.size(); i++)
+		{
+			average += sorted[i];
+		}
+		average /= (double)sorted.size();
+		size_t percentileIndex = (size_t)std::ceil(sorted.size() * 0.99) - 1;
+		percentile = sorted[std::min(percentileIndex, sorted.size() - 1)];
+	}
+
+	file << std::fixed << std::setprecision(4);
+	file << "{\n";
+	file << "  \"width\": " << m_settings.width << ",\n";
+	file << "  \"height\": " << m_settings.height << ",\n";
+	file << "  \"frames\": " << m_frameTimes.size() << ",\n";
+	file << "  \"warmup_frames\": " << m_settings.warmupFrames << ",\n";
+	file << "  \"replicas\": " << m_settings.replicas << ",\n";
+	file << "  \"render_path\": \"" << (m_settings.bDeferred ? "deferred" : "forward") << "\",\n";
+	file << "  \"occlusion_culling\": " << (m_settings.bOcclusionCulling ? "true" : "false") << ",\n";
+	file << "  \"frame_ms\": { \"min\": " << minimum << ", \"avg\": " << average
+		<< ", \"p99\": " << percentile << ", \"max\": " << maximum << " }";
+
+	if (NULL != pProfiler)
+	{
+		const FrameProfiler::FRAME_COUNTERS& counters = pProfiler->GetLastCounters();
+		file << ",\n  \"counters\": { \"draw_calls\": " << counters.drawCalls
+			<< ", \"triangles\": " << counters.triangles
+			<< ", \"state_changes\": " << counters.stateChanges
+			<< ", \"uniform_uploads\": " << counters.uniformUploads
+			<< ", \"upload_bytes\": " << counters.uploadBytes
+			<< ", \"stream_bytes\": " << counters.streamBytes
+			<< ", \"stream_stalls\": " << counters.streamStalls
+			<< ", \"heap_allocations\": ";
+		// null when the build does not count the allocations
+		WriteJSONNumber(file, (double)counters.heapAllocations);
+		file << " },\n";
+
+		file << "  \"passes\": [";
+		for (int i = 0; i < pProfiler->GetScopeCount(); i++)
+		{
+			file << ((i == 0) ? "\n" : ",\n");
+			file << "    { \"name\": \"" << pProfiler->GetScopeName(i) << "\", \"cpu_ms\": ";
+			WriteJSONNumber(file, pProfiler->GetMeanCPU(i));
+			file << ", \"gpu_ms\": ";
+			WriteJSONNumber(file, pProfiler->GetMeanGPU(i));
+			file << " }";
+		}
+		file << "\n  ]";
+	}
+	file << "\n}\n";
+
+	std::cout << "Benchmark: " << m_frameTimes.size() << " frames, avg " << average
+		<< " ms, p99 " << percentile << " ms, written to " << m_settings.outputFile << std::endl;
+	return(true);
+}
+
+/***********************************************************
+ *  WriteCapture()
+ *
+ *  This method is used for reading back the color of the
+ *  offscreen framebuffer after the last frame and writing it
+ *  as a binary PPM image, top row first, into the capture
+ *  file.  Nothing is written when no capture file is set.
+ ***********************************************************/
+bool BenchmarkRunner::WriteCapture() const
+{
+	if ((m_settings.captureFile.empty()) || (0 == m_framebuffer))
+	{
+		return(false);
+	}
+
+	int rowSize = m_settings.width * 3;
+	std::vector<unsigned char> pixels((size_t)rowSize * m_settings.height);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, m_settings.width, m_settings.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	std::ofstream file(m_settings.captureFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open benchmark capture file:" << m_settings.captureFile << std::endl;
+		return(false);
+	}
+
+	// the framebuffer rows start at the bottom, the image rows at
+	// the top
+	file << "P6\n" << m_settings.width << " " << m_settings.height << "\n255\n";
+	for (int row = m_settings.height - 1; row >= 0; row--)
+	{
+		file.write((const char*)&pixels[(size_t)row * rowSize], rowSize);
+	}
+
+	std::cout << "Benchmark: last frame written to " << m_settings.captureFile << std::endl;
+	return(true);
+}
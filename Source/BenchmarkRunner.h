@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmarkrunner.h
+// ============
+// draw the scene offscreen along a scripted camera path for a fixed number of
+// frames, and write the frame time statistics as JSON
+//
+//	The benchmark is started with --benchmark on the command line.  The view
+//	is drawn into a framebuffer object of the requested size with vsync off,
+//	and the camera flies the same path every run - an orbit and a dolly in
+//	perspective, then the front, side and top orthographic views of the
+//	number keys - so the numbers of two builds can be compared.  With
+//	--capture <file> the last frame is also read back and written as a
+//	binary PPM, so the images of two builds can be compared as well.
+//	--deferred draws the opaque parts with the deferred path, to find the
+//	faster path for a scene.  --no-occlusion draws every part without
+//	culling the hidden ones, to measure what the culling saves.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FrameProfiler.h"
+#include "ViewManager.h"
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  BenchmarkRunner
+ *
+ *  This class contains the code for reading the benchmark
+ *  options, holding the offscreen framebuffer, placing the
+ *  camera of every frame and writing the results.
+ ***********************************************************/
+class BenchmarkRunner
+{
+public:
+	// options of a benchmark run
+	struct BENCHMARK_SETTINGS
+	{
+		int width;
+		int height;
+		// frames that are measured, after the warm-up frames
+		int frames;
+		int warmupFrames;
+		// copies of the scene objects for a stress scene
+		int replicas;
+		// whether the opaque parts are drawn with the deferred path
+		bool bDeferred;
+		// whether the hidden parts are culled on the GPU
+		bool bOcclusionCulling;
+		std::string outputFile;
+		// image of the last frame, empty for none
+		std::string captureFile;
+	};
+
+	// constructor
+	BenchmarkRunner(const BENCHMARK_SETTINGS& settings);
+	// destructor
+	~BenchmarkRunner();
+
+	// read the benchmark options from the command line - returns
+	// whether --benchmark was passed
+	static bool ParseArguments(int argc, char* argv[], BENCHMARK_SETTINGS& settings);
+
+	// create the offscreen framebuffer
+	bool CreateTarget();
+	// draw into the offscreen framebuffer
+	void BindTarget() const;
+	// move the camera to its place on the path for a frame
+	void PlaceCamera(ViewManager* pViewManager, int frame) const;
+	// keep the time of a measured frame
+	void RecordFrameTime(double milliseconds);
+	// write the frame statistics and pass timings as JSON
+	bool WriteResults(const FrameProfiler* pProfiler) const;
+	// read back the offscreen framebuffer and write it as an image
+	bool WriteCapture() const;
+
+	const BENCHMARK_SETTINGS& GetSettings() const { return m_settings; }
+
+private:
+	BENCHMARK_SETTINGS m_settings;
+	// offscreen framebuffer and its color and depth storage
+	GLuint m_framebuffer;
+	GLuint m_colorBuffer;
+	GLuint m_depthBuffer;
+	// time of every measured frame in milliseconds
+	std::vector<double> m_frameTimes;
+};
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+// bufferupload.cpp
+// ============
+// write the changed elements of an array into the GPU buffer that holds a
+// copy of it, with one write for every run of neighboring elements
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BufferUpload.h"
+#include "FrameProfiler.h"
+
+#include <algorithm>
+
+/***********************************************************
+ *  WriteChangedElements()
+ *
+ *  This method is used for writing every run of neighboring
+ *  changed elements into the buffer with one update.  The
+ *  part of a run past the end of the buffer is left out.
+ ***********************************************************/
+void BufferUpload::WriteChangedElements(
+	GLenum target,
+	GLuint buffer,
+	const void* pElements,
+	size_t elementSize,
+	int nElements,
+	std::vector<int>& indices)
+{
+	if ((0 == buffer) || indices.empty())
+	{
+		return;
+	}
+
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+	const unsigned char* pBytes = (const unsigned char*)pElements;
+	glBindBuffer(target, buffer);
+	size_t first = 0;
+	while (first < indices.size())
+	{
+		size_t last = first + 1;
+		while ((last < indices.size()) && (indices[last] == indices[last - 1] + 1))
+		{
+			last++;
+		}
+
+		int firstElement = indices[first];
+		if ((firstElement >= 0) && (firstElement < nElements))
+		{
+			int count = std::min((int)(last - first), nElements - firstElement);
+			glBufferSubData(target,
+				firstElement * elementSize,
+				count * elementSize,
+				pBytes + firstElement * elementSize);
+			FrameProfiler::CountUniformUpload(count * elementSize);
+		}
+		first = last;
+	}
+	glBindBuffer(target, 0);
+}
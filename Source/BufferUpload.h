@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+// bufferupload.h
+// ============
+// write the changed elements of an array into the GPU buffer that holds a
+// copy of it, with one write for every run of neighboring elements
+//
+//	The lights and the materials change a few elements at a time, and keep
+//	the indices of the changed ones until they are uploaded.  The indices
+//	are sorted and made unique in place, then every run of neighboring
+//	indices is written with one buffer update and counted by the profiler.
+//	Indices outside the buffer are skipped.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+/***********************************************************
+ *  BufferUpload
+ *
+ *  This class contains the code for writing the changed
+ *  elements of an array into a buffer.
+ ***********************************************************/
+class BufferUpload
+{
+public:
+	// write the elements with the passed in indices from the
+	// array into the buffer, which holds the passed in number of
+	// elements - the indices are sorted in place
+	static void WriteChangedElements(
+		GLenum target,
+		GLuint buffer,
+		const void* pElements,
+		size_t elementSize,
+		int nElements,
+		std::vector<int>& indices);
+};
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// changehistory.cpp
+// ============
+// keep the animation changes of the simulation steps the render thread has
+// not acknowledged yet, so every snapshot carries all of them
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ChangeHistory.h"
+
+// declaration of global variables and defines
+namespace
+{
+	/***********************************************************
+	 *  ClearChanges()
+	 *
+	 *  This function is used for emptying the lists of changes
+	 *  while keeping their room, so the steady steps do not
+	 *  allocate.
+	 ***********************************************************/
+	void ClearChanges(SceneAnimator::ANIMATION_CHANGES& changes)
+	{
+		changes.lights.clear();
+		changes.materials.clear();
+		changes.parts.clear();
+	}
+}
+
+/***********************************************************
+ *  ChangeHistory()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ChangeHistory::ChangeHistory()
+{
+	Clear();
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing every kept step.
+ ***********************************************************/
+void ChangeHistory::Clear()
+{
+	for (int i = 0; i < CHANGE_HISTORY_STEPS; i++)
+	{
+		m_steps[i].step = -1;
+		ClearChanges(m_steps[i].changes);
+	}
+	m_first = 0;
+	m_count = 0;
+}
+
+/***********************************************************
+ *  AddStep()
+ *
+ *  This method is used for keeping the changes of a new
+ *  step.  A step without changes is not kept.  When the ring
+ *  is full, the changes are merged into the newest record,
+ *  which then stands for every step up to the new one.
+ ***********************************************************/
+void ChangeHistory::AddStep(long long step, const SceneAnimator::ANIMATION_CHANGES& changes)
+{
+	if (changes.lights.empty() && changes.materials.empty() && changes.parts.empty())
+	{
+		return;
+	}
+
+	if (m_count == CHANGE_HISTORY_STEPS)
+	{
+		STEP_CHANGES& newest = m_steps[(m_first + m_count - 1) % CHANGE_HISTORY_STEPS];
+		SceneAnimator::MergeChanges(newest.changes, changes);
+		newest.step = step;
+		return;
+	}
+
+	STEP_CHANGES& record = m_steps[(m_first + m_count) % CHANGE_HISTORY_STEPS];
+	ClearChanges(record.changes);
+	SceneAnimator::MergeChanges(record.changes, changes);
+	record.step = step;
+	m_count++;
+}
+
+/***********************************************************
+ *  Acknowledge()
+ *
+ *  This method is used for dropping the oldest steps, up to
+ *  and with the passed in one.
+ ***********************************************************/
+void ChangeHistory::Acknowledge(long long step)
+{
+	while ((m_count > 0) && (m_steps[m_first].step <= step))
+	{
+		m_first = (m_first + 1) % CHANGE_HISTORY_STEPS;
+		m_count--;
+	}
+}
+
+/***********************************************************
+ *  CollectChanges()
+ *
+ *  This method is used for merging the changes of the kept
+ *  steps from the oldest to the newest, so every entry ends
+ *  up with the newest value it was given.
+ ***********************************************************/
+void ChangeHistory::CollectChanges(SceneAnimator::ANIMATION_CHANGES& changes) const
+{
+	ClearChanges(changes);
+	for (int i = 0; i < m_count; i++)
+	{
+		SceneAnimator::MergeChanges(changes, m_steps[(m_first + i) % CHANGE_HISTORY_STEPS].changes);
+	}
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// changehistory.h
+// ============
+// keep the animation changes of the simulation steps the render thread has
+// not acknowledged yet, so every snapshot carries all of them
+//
+//	The render thread can skip snapshots, and the one it skipped may be
+//	older than one it took, so the changes of a skipped snapshot can not
+//	simply be carried into the next one.  Instead the changes of every step
+//	are kept until the render thread acknowledges a step at least as new,
+//	and every snapshot holds all the changes kept, merged from the oldest
+//	to the newest.  An entry changed in a step the render thread already
+//	drew is then either dropped or sent again with its newest value, and
+//	never with an older one.  The steps are kept in a ring of
+//	CHANGE_HISTORY_STEPS records, and a render thread that falls further
+//	behind has the newest steps merged into the last record.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneAnimator.h"
+
+// number of unacknowledged steps kept apart
+#define CHANGE_HISTORY_STEPS 8
+
+/***********************************************************
+ *  ChangeHistory
+ *
+ *  This class contains the code for the ring of the changes
+ *  of the unacknowledged steps.
+ ***********************************************************/
+class ChangeHistory
+{
+public:
+	// constructor
+	ChangeHistory();
+
+	// remove every kept step
+	void Clear();
+	// keep the changes of the passed in step, which is newer
+	// than the steps kept before
+	void AddStep(long long step, const SceneAnimator::ANIMATION_CHANGES& changes);
+	// drop the steps up to the passed in one, whose changes the
+	// render thread has
+	void Acknowledge(long long step);
+	// write the changes of every kept step into the passed in
+	// changes, the newest value of every entry last
+	void CollectChanges(SceneAnimator::ANIMATION_CHANGES& changes) const;
+
+private:
+	// changes of a step, or of a run of steps up to the newest
+	struct STEP_CHANGES
+	{
+		long long step;
+		SceneAnimator::ANIMATION_CHANGES changes;
+	};
+
+	// ring of the kept steps, oldest first from the first one
+	STEP_CHANGES m_steps[CHANGE_HISTORY_STEPS];
+	int m_first;
+	int m_count;
+};
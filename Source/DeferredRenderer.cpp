@@ -0,0 +1,276 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferredrenderer.cpp
+// ============
+// own the G-buffer of the deferred render path and draw its lighting pass
+///////////////////////////////////////////////////////////////////////////////
+
+#include "DeferredRenderer.h"
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// size of the G-buffer before the first frame sets it
+	const int g_InitialSize = 16;
+
+	/***********************************************************
+	 *  CreateTargetTexture()
+	 *
+	 *  This function is used for creating a G-buffer texture on
+	 *  its texture unit, read without filtering.
+	 ***********************************************************/
+	GLuint CreateTargetTexture(int unit)
+	{
+		GLuint texture = 0;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return(texture);
+	}
+}
+
+/***********************************************************
+ *  DeferredRenderer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+DeferredRenderer::DeferredRenderer()
+{
+	m_framebuffer = 0;
+	m_albedoTexture = 0;
+	m_normalTexture = 0;
+	m_depthTexture = 0;
+	m_vao = 0;
+	m_width = 0;
+	m_height = 0;
+	m_targetFramebuffer = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		m_targetViewport[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~DeferredRenderer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+DeferredRenderer::~DeferredRenderer()
+{
+	DestroyResources();
+}
+
+/***********************************************************
+ *  CreateResources()
+ *
+ *  This method is used for creating the G-buffer textures,
+ *  the framebuffer drawing into them and the vertex array of
+ *  the lighting pass.  The textures get their real size on
+ *  the first frame drawn with the deferred path.
+ ***********************************************************/
+bool DeferredRenderer::CreateResources()
+{
+	// the textures are created on their own units, so the
+	// texture arrays on the first units stay bound
+	m_albedoTexture = CreateTargetTexture(UNIT_GBUFFER_ALBEDO);
+	m_normalTexture = CreateTargetTexture(UNIT_GBUFFER_NORMAL);
+	m_depthTexture = CreateTargetTexture(UNIT_GBUFFER_DEPTH);
+	glActiveTexture(GL_TEXTURE0);
+	ResizeTextures(g_InitialSize, g_InitialSize);
+
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+	{
+		std::cout << "Could not create the G-buffer, the scene is drawn forward only" << std::endl;
+		DestroyResources();
+		return(false);
+	}
+
+	// the full-screen triangle is made from the vertex index,
+	// but a vertex array still has to be bound to draw it
+	glGenVertexArrays(1, &m_vao);
+
+	return(true);
+}
+
+/***********************************************************
+ *  DestroyResources()
+ *
+ *  This method is used for freeing the G-buffer textures,
+ *  its framebuffer and the vertex array.
+ ***********************************************************/
+void DeferredRenderer::DestroyResources()
+{
+	if (0 != m_framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (0 != m_albedoTexture)
+	{
+		glDeleteTextures(1, &m_albedoTexture);
+		m_albedoTexture = 0;
+	}
+	if (0 != m_normalTexture)
+	{
+		glDeleteTextures(1, &m_normalTexture);
+		m_normalTexture = 0;
+	}
+	if (0 != m_depthTexture)
+	{
+		glDeleteTextures(1, &m_depthTexture);
+		m_depthTexture = 0;
+	}
+	if (0 != m_vao)
+	{
+		glDeleteVertexArrays(1, &m_vao);
+		m_vao = 0;
+	}
+	m_width = 0;
+	m_height = 0;
+}
+
+/***********************************************************
+ *  ResizeTextures()
+ *
+ *  This method is used for giving the G-buffer textures new
+ *  storage of the passed in size.  The texture objects stay
+ *  the same, so they stay attached and bound to their units.
+ *  The normal keeps half floats, which hold the material
+ *  index exactly.
+ ***********************************************************/
+void DeferredRenderer::ResizeTextures(int width, int height)
+{
+	glActiveTexture(GL_TEXTURE0 + UNIT_GBUFFER_ALBEDO);
+	glBindTexture(GL_TEXTURE_2D, m_albedoTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_GBUFFER_NORMAL);
+	glBindTexture(GL_TEXTURE_2D, m_normalTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_GBUFFER_DEPTH);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glActiveTexture(GL_TEXTURE0);
+
+	m_width = width;
+	m_height = height;
+}
+
+/***********************************************************
+ *  BindTextures()
+ *
+ *  This method is used for binding the G-buffer textures to
+ *  the texture units read by the lighting pass.
+ ***********************************************************/
+void DeferredRenderer::BindTextures() const
+{
+	if (0 == m_framebuffer)
+	{
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_GBUFFER_ALBEDO);
+	glBindTexture(GL_TEXTURE_2D, m_albedoTexture);
+	glActiveTexture(GL_TEXTURE0 + UNIT_GBUFFER_NORMAL);
+	glBindTexture(GL_TEXTURE_2D, m_normalTexture);
+	glActiveTexture(GL_TEXTURE0 + UNIT_GBUFFER_DEPTH);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  BeginGeometryPass()
+ *
+ *  This method is used for keeping the framebuffer and
+ *  viewport of the frame, growing the G-buffer to hold the
+ *  viewport and clearing it for the opaque parts.  It never
+ *  shrinks, so a view drawn at a changing scale does not
+ *  reallocate it.  The parts are drawn without blending,
+ *  since the normal target holds the material index in its
+ *  alpha.
+ ***********************************************************/
+void DeferredRenderer::BeginGeometryPass()
+{
+	glGetIntegerv(GL_VIEWPORT, m_targetViewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_targetFramebuffer);
+
+	int width = m_targetViewport[0] + m_targetViewport[2];
+	int height = m_targetViewport[1] + m_targetViewport[3];
+	if ((width > m_width) || (height > m_height))
+	{
+		ResizeTextures(std::max(width, m_width), std::max(height, m_height));
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glDisable(GL_BLEND);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	FrameProfiler::CountStateChange();
+	FrameProfiler::CountStateChange();
+}
+
+/***********************************************************
+ *  EndGeometryPass()
+ *
+ *  This method is used for drawing into the framebuffer and
+ *  viewport of the frame again once the G-buffer is filled.
+ ***********************************************************/
+void DeferredRenderer::EndGeometryPass() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_targetFramebuffer);
+	glViewport(m_targetViewport[0], m_targetViewport[1], m_targetViewport[2], m_targetViewport[3]);
+	FrameProfiler::CountStateChange();
+}
+
+/***********************************************************
+ *  DrawLighting()
+ *
+ *  This method is used for lighting the G-buffer with one
+ *  full-screen triangle.  Every pixel passes the depth test
+ *  and writes the opaque depth it shades, so the forward
+ *  transparent pass that follows is tested against it.
+ ***********************************************************/
+void DeferredRenderer::DrawLighting(GLuint program) const
+{
+	if ((0 == m_framebuffer) || (0 == program))
+	{
+		return;
+	}
+
+	glUseProgram(program);
+	glDisable(GL_BLEND);
+	glDepthFunc(GL_ALWAYS);
+	glDepthMask(GL_TRUE);
+	FrameProfiler::CountStateChange();
+	FrameProfiler::CountStateChange();
+
+	glBindVertexArray(m_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	FrameProfiler::CountDrawCall(1);
+
+	glDepthFunc(GL_LESS);
+	FrameProfiler::CountStateChange();
+}
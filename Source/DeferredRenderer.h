@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// deferredrenderer.h
+// ============
+// own the G-buffer of the deferred render path and draw its lighting pass
+//
+//	The deferred path draws the opaque parts once into the G-buffer - the
+//	color, the normal with the material index, and the depth - and then
+//	lights every pixel of the view a single time with a full-screen
+//	triangle, so the stacked parts under many lights are not shaded again
+//	for every layer of overdraw.  The lighting pass writes the opaque depth
+//	into the framebuffer of the frame, so the transparent parts are drawn
+//	over it by the forward pass as before.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+/***********************************************************
+ *  DeferredRenderer
+ *
+ *  This class contains the code for owning the G-buffer,
+ *  keeping it the size of the view and drawing the pass
+ *  that lights it.
+ ***********************************************************/
+class DeferredRenderer
+{
+public:
+	// constructor
+	DeferredRenderer();
+	// destructor
+	~DeferredRenderer();
+
+	// texture units of the G-buffer, above the units of the
+	// shadow maps
+	enum GBUFFER_UNIT
+	{
+		UNIT_GBUFFER_ALBEDO = 12,
+		UNIT_GBUFFER_NORMAL = 13,
+		UNIT_GBUFFER_DEPTH = 14
+	};
+
+	// create the G-buffer textures and framebuffer - returns
+	// false when the deferred path can not be used
+	bool CreateResources();
+	// whether the G-buffer was created
+	bool IsAvailable() const { return(0 != m_framebuffer); }
+	// bind the G-buffer textures to their texture units
+	void BindTextures() const;
+
+	// start drawing the opaque parts into the G-buffer, sized to
+	// the viewport of the frame
+	void BeginGeometryPass();
+	// put the framebuffer and viewport of the frame back
+	void EndGeometryPass() const;
+	// light the G-buffer into the framebuffer of the frame with
+	// the passed in lighting program
+	void DrawLighting(GLuint program) const;
+
+private:
+	// framebuffer drawing into the G-buffer textures
+	GLuint m_framebuffer;
+	// color, normal with material index, and depth of the
+	// opaque parts
+	GLuint m_albedoTexture;
+	GLuint m_normalTexture;
+	GLuint m_depthTexture;
+	// empty vertex array of the full-screen triangle
+	GLuint m_vao;
+	// size of the G-buffer textures
+	int m_width;
+	int m_height;
+	// framebuffer and viewport the frame is drawn into
+	GLint m_targetFramebuffer;
+	GLint m_targetViewport[4];
+
+	// give the G-buffer textures storage of the passed in size
+	void ResizeTextures(int width, int height);
+	// free the G-buffer textures and framebuffer
+	void DestroyResources();
+};
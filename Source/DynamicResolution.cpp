@@ -0,0 +1,436 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.cpp
+// ============
+// draw the view into an offscreen target whose resolution follows the GPU
+// load, upscale it to the window, and pace the frames to a target time
+///////////////////////////////////////////////////////////////////////////////
+
+#include "DynamicResolution.h"
+#include "FrameProfiler.h"
+#include "ShaderCompiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// declaration of global variables and defines
+namespace
+{
+	// frame time aimed for unless another one is set, which is
+	// one refresh of a 60 Hz display
+	const double g_DefaultFrameTime = 1000.0 / 60.0;
+
+	// smallest and largest share of the window the view is drawn
+	// at, and the steps the scale moves in
+	const float g_MinScale = 0.5f;
+	const float g_MaxScale = 1.0f;
+	const float g_ScaleStep = 0.05f;
+	// largest drop of the scale in one change
+	const float g_MaxScaleDrop = 0.15f;
+	// share of the target a frame may take before the scale drops,
+	// and below which it grows again
+	const double g_OverBudget = 1.0;
+	const double g_UnderBudget = 0.8;
+	// share of the target the scale aims for when it drops
+	const double g_BudgetHeadroom = 0.9;
+	// frames measured after a change before the next one, long
+	// enough for the timings of the new scale to be read back
+	const int g_ChangeInterval = PROFILER_FRAME_LATENCY * 2;
+	// weight of a new GPU time in the smoothed time
+	const double g_GPUTimeBlend = 0.25;
+
+	// sharpening of the upscale at the smallest scale, fading out
+	// towards the full size of the window
+	const float g_MaxSharpness = 0.6f;
+
+	// time left to the swap at the end of a paced frame, so a
+	// late wake-up does not miss a display refresh
+	const double g_PacingSlack = 1.0;
+
+	const char* g_SourceImageName = "sourceImage";
+	const char* g_SourceRegionName = "sourceRegion";
+	const char* g_SourceTexelName = "sourceTexel";
+	const char* g_SharpnessName = "sharpness";
+}
+
+/***********************************************************
+ *  DynamicResolution()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+DynamicResolution::DynamicResolution()
+{
+	m_framebuffer = 0;
+	m_colorTexture = 0;
+	m_depthBuffer = 0;
+	m_targetWidth = 0;
+	m_targetHeight = 0;
+	m_outputWidth = 1;
+	m_outputHeight = 1;
+	m_program = 0;
+	m_vao = 0;
+	m_bEnabled = true;
+	m_scale = g_MaxScale;
+	m_targetFrameTime = g_DefaultFrameTime;
+	m_averageGPUTime = -1.0;
+	m_framesSinceChange = 0;
+	m_frameStart = std::chrono::steady_clock::now();
+}
+
+/***********************************************************
+ *  ~DynamicResolution()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+DynamicResolution::~DynamicResolution()
+{
+	DestroyTarget();
+	if (0 != m_vao)
+	{
+		glDeleteVertexArrays(1, &m_vao);
+		m_vao = 0;
+	}
+	if (0 != m_program)
+	{
+		glDeleteProgram(m_program);
+		m_program = 0;
+	}
+}
+
+/***********************************************************
+ *  CreateResources()
+ *
+ *  This method is used for creating the upscale program and
+ *  the vertex array of its full-screen triangle.  The target
+ *  is allocated on the first frame, at the size of the
+ *  window.
+ ***********************************************************/
+bool DynamicResolution::CreateResources(const char* vertexShaderFile, const char* fragmentShaderFile)
+{
+	if (CreateProgram(vertexShaderFile, fragmentShaderFile) == false)
+	{
+		std::cout << "The view is drawn at the size of the window" << std::endl;
+		return(false);
+	}
+
+	// the triangle is made from the vertex index, but a vertex
+	// array still has to be bound to draw it
+	glGenVertexArrays(1, &m_vao);
+	return(true);
+}
+
+/***********************************************************
+ *  CreateProgram()
+ *
+ *  This method is used for compiling and linking the program
+ *  of the sharpened upscale, and pointing its sampler at the
+ *  unit the scaled view is bound to.
+ ***********************************************************/
+bool DynamicResolution::CreateProgram(const char* vertexShaderFile, const char* fragmentShaderFile)
+{
+	GLuint program = ShaderCompiler::CreateProgram(vertexShaderFile, fragmentShaderFile);
+	if (0 == program)
+	{
+		return(false);
+	}
+
+	m_program = program;
+	m_uniforms.ResolveUniforms(program);
+	m_sourceRegionUniform = m_uniforms.GetUniform<glm::vec2>(g_SourceRegionName);
+	m_sourceTexelUniform = m_uniforms.GetUniform<glm::vec2>(g_SourceTexelName);
+	m_sharpnessUniform = m_uniforms.GetUniform<float>(g_SharpnessName);
+
+	// the sampler only has to be set once, with the program that
+	// was in use put back afterwards
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glUseProgram(program);
+	m_uniforms.SetValue(m_uniforms.GetUniform<int>(g_SourceImageName), (int)UNIT_UPSCALE_SOURCE);
+	glUseProgram(previousProgram);
+
+	return(true);
+}
+
+/***********************************************************
+ *  AllocateTarget()
+ *
+ *  This method is used for giving the target color texture
+ *  and depth storage the passed in size, creating them the
+ *  first time.  The texture is filtered bilinearly for the
+ *  upscale.
+ ***********************************************************/
+bool DynamicResolution::AllocateTarget(int width, int height)
+{
+	if (0 == m_framebuffer)
+	{
+		glGenTextures(1, &m_colorTexture);
+		glGenRenderbuffers(1, &m_depthBuffer);
+		glGenFramebuffers(1, &m_framebuffer);
+	}
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_UPSCALE_SOURCE);
+	glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+	{
+		std::cout << "Could not create the scaled render target: " << status << std::endl;
+		DestroyTarget();
+		return(false);
+	}
+
+	m_targetWidth = width;
+	m_targetHeight = height;
+	return(true);
+}
+
+/***********************************************************
+ *  DestroyTarget()
+ *
+ *  This method is used for freeing the target framebuffer
+ *  and its storage.
+ ***********************************************************/
+void DynamicResolution::DestroyTarget()
+{
+	if (0 != m_framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (0 != m_colorTexture)
+	{
+		glDeleteTextures(1, &m_colorTexture);
+		m_colorTexture = 0;
+	}
+	if (0 != m_depthBuffer)
+	{
+		glDeleteRenderbuffers(1, &m_depthBuffer);
+		m_depthBuffer = 0;
+	}
+	m_targetWidth = 0;
+	m_targetHeight = 0;
+}
+
+/***********************************************************
+ *  SetTargetFrameTime()
+ *
+ *  This method is used for setting the frame time in
+ *  milliseconds that the scale and the pacing aim for.  A
+ *  time of zero turns the pacing off.
+ ***********************************************************/
+void DynamicResolution::SetTargetFrameTime(double milliseconds)
+{
+	m_targetFrameTime = std::max(0.0, milliseconds);
+	m_averageGPUTime = -1.0;
+	m_framesSinceChange = 0;
+}
+
+/***********************************************************
+ *  SetEnabled()
+ *
+ *  This method is used for turning the scaling on or off.
+ *  The governor starts over from the current scale when it
+ *  is turned back on.
+ ***********************************************************/
+void DynamicResolution::SetEnabled(bool bEnabled)
+{
+	if (bEnabled != m_bEnabled)
+	{
+		m_averageGPUTime = -1.0;
+		m_framesSinceChange = 0;
+	}
+	m_bEnabled = bEnabled;
+}
+
+/***********************************************************
+ *  SetOutputSize()
+ *
+ *  This method is used for setting the size of the window
+ *  the view is upscaled to, from the framebuffer size of the
+ *  window.  The target follows it on the next frame.
+ ***********************************************************/
+void DynamicResolution::SetOutputSize(int width, int height)
+{
+	m_outputWidth = std::max(1, width);
+	m_outputHeight = std::max(1, height);
+}
+
+/***********************************************************
+ *  UpdateScale()
+ *
+ *  This method is used for moving the scale towards the
+ *  target frame time from the GPU time of a finished frame.
+ *  The pixel count follows the GPU time, so a frame over the
+ *  target drops the scale by the square root of the overrun
+ *  at once, while a frame well under it grows the scale one
+ *  step.  After a change the timings of the old scale are
+ *  dropped and a few frames of the new one are waited for.
+ ***********************************************************/
+void DynamicResolution::UpdateScale(double gpuMilliseconds)
+{
+	if ((m_bEnabled == false) || (gpuMilliseconds <= 0.0) || (m_targetFrameTime <= 0.0))
+	{
+		return;
+	}
+
+	if (m_averageGPUTime < 0.0)
+	{
+		m_averageGPUTime = gpuMilliseconds;
+	}
+	else
+	{
+		m_averageGPUTime += (gpuMilliseconds - m_averageGPUTime) * g_GPUTimeBlend;
+	}
+
+	m_framesSinceChange++;
+	if (m_framesSinceChange < g_ChangeInterval)
+	{
+		return;
+	}
+
+	double load = m_averageGPUTime / m_targetFrameTime;
+	float scale = m_scale;
+	if (load > g_OverBudget)
+	{
+		float wanted = m_scale * (float)std::sqrt(g_BudgetHeadroom / load);
+		scale = std::floor(std::max(wanted, m_scale - g_MaxScaleDrop) / g_ScaleStep) * g_ScaleStep;
+	}
+	else if (load < g_UnderBudget)
+	{
+		scale = std::floor((m_scale + g_ScaleStep) / g_ScaleStep + 0.5f) * g_ScaleStep;
+	}
+	scale = glm::clamp(scale, g_MinScale, g_MaxScale);
+
+	if (std::fabs(scale - m_scale) > g_ScaleStep * 0.5f)
+	{
+		m_scale = scale;
+		m_averageGPUTime = -1.0;
+		m_framesSinceChange = 0;
+	}
+}
+
+/***********************************************************
+ *  GetRenderWidth()
+ *
+ *  This method is used for getting the width the view is
+ *  drawn at in the current frame.
+ ***********************************************************/
+int DynamicResolution::GetRenderWidth() const
+{
+	return(std::max(1, (int)(m_outputWidth * GetScale() + 0.5f)));
+}
+
+/***********************************************************
+ *  GetRenderHeight()
+ *
+ *  This method is used for getting the height the view is
+ *  drawn at in the current frame.
+ ***********************************************************/
+int DynamicResolution::GetRenderHeight() const
+{
+	return(std::max(1, (int)(m_outputHeight * GetScale() + 0.5f)));
+}
+
+/***********************************************************
+ *  BindTarget()
+ *
+ *  This method is used for drawing the following passes into
+ *  the lower left of the target at the current scale.  The
+ *  target is allocated again when the window changed size.
+ ***********************************************************/
+void DynamicResolution::BindTarget()
+{
+	if ((m_targetWidth != m_outputWidth) || (m_targetHeight != m_outputHeight))
+	{
+		AllocateTarget(m_outputWidth, m_outputHeight);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, GetRenderWidth(), GetRenderHeight());
+	FrameProfiler::CountStateChange();
+}
+
+/***********************************************************
+ *  DrawUpscale()
+ *
+ *  This method is used for drawing the scaled view over the
+ *  whole window with one full-screen triangle.  The depth
+ *  test and blending are turned off for the triangle and
+ *  turned back on afterwards.
+ ***********************************************************/
+void DynamicResolution::DrawUpscale() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, m_outputWidth, m_outputHeight);
+	if ((0 == m_framebuffer) || (0 == m_program))
+	{
+		return;
+	}
+
+	glUseProgram(m_program);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	FrameProfiler::CountStateChange();
+	FrameProfiler::CountStateChange();
+
+	float scale = GetScale();
+	m_uniforms.SetValue(m_sourceRegionUniform, glm::vec2(
+		(float)GetRenderWidth() / (float)m_targetWidth,
+		(float)GetRenderHeight() / (float)m_targetHeight));
+	m_uniforms.SetValue(m_sourceTexelUniform, glm::vec2(
+		1.0f / (float)m_targetWidth,
+		1.0f / (float)m_targetHeight));
+	m_uniforms.SetValue(m_sharpnessUniform,
+		g_MaxSharpness * glm::clamp((g_MaxScale - scale) / (g_MaxScale - g_MinScale), 0.0f, 1.0f));
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_UPSCALE_SOURCE);
+	glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(m_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	FrameProfiler::CountDrawCall(1);
+
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	FrameProfiler::CountStateChange();
+}
+
+/***********************************************************
+ *  PaceFrame()
+ *
+ *  This method is used for waiting out the rest of the
+ *  target time of the frame before the swap, less a little
+ *  slack for the wake-up, and starting the time of the next
+ *  frame.  A frame over the target does not wait.
+ ***********************************************************/
+void DynamicResolution::PaceFrame()
+{
+	if (m_targetFrameTime > g_PacingSlack)
+	{
+		std::chrono::steady_clock::time_point frameEnd = m_frameStart +
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double, std::milli>(m_targetFrameTime - g_PacingSlack));
+		if (std::chrono::steady_clock::now() < frameEnd)
+		{
+			std::this_thread::sleep_until(frameEnd);
+		}
+	}
+	m_frameStart = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.h
+// ============
+// draw the view into an offscreen target whose resolution follows the GPU
+// load, upscale it to the window, and pace the frames to a target time
+//
+//	The target is allocated at the size of the window and the view is drawn
+//	into its lower left corner at the current scale, so changing the scale
+//	never reallocates.  The governor reads the summed GPU time of the
+//	profiled passes, which arrives a few frames late, and moves the scale
+//	in steps towards the target frame time - down quickly when a frame runs
+//	over, up slowly when there is room, and only every few frames so every
+//	step is measured before the next.  The upscale to the window filters
+//	bilinearly and sharpens the edges back with contrast adaptive
+//	sharpening.  Frames that finish early wait out the rest of the target
+//	time, so the frame rate stays even.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShaderUniforms.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+
+/***********************************************************
+ *  DynamicResolution
+ *
+ *  This class contains the code for owning the scaled render
+ *  target, choosing its scale from the frame timings, drawing
+ *  the sharpened upscale and pacing the frames.
+ ***********************************************************/
+class DynamicResolution
+{
+public:
+	// constructor
+	DynamicResolution();
+	// destructor
+	~DynamicResolution();
+
+	// texture unit the scaled view is read from by the upscale,
+	// above the units of the G-buffer
+	enum UPSCALE_UNIT
+	{
+		UNIT_UPSCALE_SOURCE = 15
+	};
+
+	// create the upscale program - returns false when the view is
+	// drawn straight into the window
+	bool CreateResources(const char* vertexShaderFile, const char* fragmentShaderFile);
+	// whether the upscale program was created
+	bool IsAvailable() const { return(0 != m_program); }
+
+	// set the frame time the scale and the pacing aim for
+	void SetTargetFrameTime(double milliseconds);
+	// turn the scaling on or off - the view is drawn at the full
+	// size of the window while it is off
+	void SetEnabled(bool bEnabled);
+	// set the size of the window the view is upscaled to
+	void SetOutputSize(int width, int height);
+	// move the scale towards the target from the GPU time of a
+	// finished frame
+	void UpdateScale(double gpuMilliseconds);
+
+	// size the view is drawn at in the current frame
+	int GetRenderWidth() const;
+	int GetRenderHeight() const;
+	float GetScale() const { return(m_bEnabled ? m_scale : 1.0f); }
+
+	// draw the following passes into the scaled target
+	void BindTarget();
+	// draw the scaled view over the whole window
+	void DrawUpscale() const;
+	// wait for the rest of the target time of the frame
+	void PaceFrame();
+
+private:
+	// framebuffer of the scaled view, with its color texture and
+	// depth storage
+	GLuint m_framebuffer;
+	GLuint m_colorTexture;
+	GLuint m_depthBuffer;
+	// size the target was allocated at
+	int m_targetWidth;
+	int m_targetHeight;
+	// size of the window
+	int m_outputWidth;
+	int m_outputHeight;
+
+	// program of the sharpened upscale and its values
+	GLuint m_program;
+	GLuint m_vao;
+	ShaderUniforms m_uniforms;
+	ShaderUniforms::UNIFORM<glm::vec2> m_sourceRegionUniform;
+	ShaderUniforms::UNIFORM<glm::vec2> m_sourceTexelUniform;
+	ShaderUniforms::UNIFORM<float> m_sharpnessUniform;
+
+	// whether the scale follows the frame time
+	bool m_bEnabled;
+	// share of the window size the view is drawn at
+	float m_scale;
+	// frame time the governor aims for, in milliseconds
+	double m_targetFrameTime;
+	// smoothed GPU time of the recent frames
+	double m_averageGPUTime;
+	// frames measured since the scale last changed
+	int m_framesSinceChange;
+	// time the current frame started, for the pacing
+	std::chrono::steady_clock::time_point m_frameStart;
+
+	// compile and link the upscale program
+	bool CreateProgram(const char* vertexShaderFile, const char* fragmentShaderFile);
+	// allocate the target at the size of the window
+	bool AllocateTarget(int width, int height);
+	// free the target storage
+	void DestroyTarget();
+};
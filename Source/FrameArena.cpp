@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+// framearena.cpp
+// ============
+// hand out the scratch memory of one frame from blocks that are kept from
+// frame to frame, so the render loop does not go to the heap for it
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+// declaration of global variables and defines
+namespace
+{
+	// bytes of the first block, before any frame asked for more
+	const size_t g_InitialBlockSize = 256 * 1024;
+	// room left when the blocks are replaced, so a frame that
+	// keeps growing slowly does not replace them every frame
+	const float g_GrowthFactor = 1.5f;
+}
+
+/***********************************************************
+ *  FrameArena()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameArena::FrameArena()
+{
+	m_used = 0;
+	m_frameBytes = 0;
+	m_largestFrame = 0;
+	AddBlock(g_InitialBlockSize);
+}
+
+/***********************************************************
+ *  ~FrameArena()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameArena::~FrameArena()
+{
+	FreeBlocks();
+}
+
+/***********************************************************
+ *  Reset()
+ *
+ *  This method is used for making everything handed out
+ *  free again.  When the last frame needed more than one
+ *  block, the blocks are replaced by a single one with room
+ *  for the largest frame so far.
+ ***********************************************************/
+void FrameArena::Reset()
+{
+	m_largestFrame = std::max(m_largestFrame, m_frameBytes);
+	if (m_blocks.size() > 1)
+	{
+		FreeBlocks();
+		AddBlock((size_t)(m_largestFrame * g_GrowthFactor));
+	}
+
+	m_used = 0;
+	m_frameBytes = 0;
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This method is used for handing out the next aligned
+ *  bytes of the current block, starting another block when
+ *  they do not fit.
+ ***********************************************************/
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	alignment = std::max<size_t>(alignment, 1);
+	m_frameBytes += size + alignment - 1;
+
+	ARENA_BLOCK* pBlock = &m_blocks.back();
+	uintptr_t address = (uintptr_t)(pBlock->pData + m_used);
+	size_t padding = (size_t)((alignment - (address & (alignment - 1))) & (alignment - 1));
+	if (m_used + padding + size > pBlock->size)
+	{
+		AddBlock(std::max(size + alignment - 1, pBlock->size));
+		pBlock = &m_blocks.back();
+		address = (uintptr_t)pBlock->pData;
+		padding = (size_t)((alignment - (address & (alignment - 1))) & (alignment - 1));
+	}
+
+	void* pMemory = pBlock->pData + m_used + padding;
+	m_used += padding + size;
+
+	return(pMemory);
+}
+
+/***********************************************************
+ *  GetCapacity()
+ *
+ *  This method is used for adding up the bytes of all the
+ *  blocks of the arena.
+ ***********************************************************/
+size_t FrameArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		capacity += m_blocks[i].size;
+	}
+
+	return(capacity);
+}
+
+/***********************************************************
+ *  AddBlock()
+ *
+ *  This method is used for adding a block to hand out from,
+ *  starting at its first byte.
+ ***********************************************************/
+void FrameArena::AddBlock(size_t size)
+{
+	ARENA_BLOCK block;
+	block.size = std::max(size, g_InitialBlockSize);
+	block.pData = new unsigned char[block.size];
+	m_blocks.push_back(block);
+	m_used = 0;
+}
+
+/***********************************************************
+ *  FreeBlocks()
+ *
+ *  This method is used for freeing all the blocks of the
+ *  arena.
+ ***********************************************************/
+void FrameArena::FreeBlocks()
+{
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		delete[] m_blocks[i].pData;
+	}
+	m_blocks.clear();
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+// framearena.h
+// ============
+// hand out the scratch memory of one frame from blocks that are kept from
+// frame to frame, so the render loop does not go to the heap for it
+//
+//	Memory is handed out by moving an offset through the current block and
+//	is never freed on its own - resetting the arena at the start of a frame
+//	makes all of it free again.  A frame that needs more than the blocks
+//	hold gets another block, and the next reset replaces all of them with
+//	one block large enough for the largest frame so far, so once the frames
+//	stop growing the arena allocates nothing.  Only the render thread
+//	allocates from the arena, while the jobs it starts may write into the
+//	memory handed out.  Nothing handed out is constructed or destroyed, so
+//	it only holds plain values.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/***********************************************************
+ *  FrameArena
+ *
+ *  This class contains the code for the blocks of the arena
+ *  and handing out aligned memory from them.
+ ***********************************************************/
+class FrameArena
+{
+public:
+	// constructor
+	FrameArena();
+	// destructor
+	~FrameArena();
+
+	// free everything handed out, at the start of a frame
+	void Reset();
+	// hand out the passed in number of bytes with the passed in
+	// alignment, a power of two
+	void* Allocate(size_t size, size_t alignment);
+	// hand out an array of the passed in number of values
+	template<typename T>
+	T* AllocateArray(size_t count) { return((T*)Allocate(count * sizeof(T), alignof(T))); }
+
+	// bytes handed out since the last reset
+	size_t GetUsedBytes() const { return(m_frameBytes); }
+	// bytes of all the blocks
+	size_t GetCapacity() const;
+
+private:
+	// memory the arena hands out from
+	struct ARENA_BLOCK
+	{
+		unsigned char* pData;
+		size_t size;
+	};
+
+	// blocks of the frame, the last one handed out from, and
+	// the bytes of it that are used
+	std::vector<ARENA_BLOCK> m_blocks;
+	size_t m_used;
+	// bytes handed out since the last reset, counting the
+	// alignment, and the most any frame was handed
+	size_t m_frameBytes;
+	size_t m_largestFrame;
+
+	// add a block of at least the passed in number of bytes
+	void AddBlock(size_t size);
+	// free all the blocks
+	void FreeBlocks();
+};
@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepipeline.cpp
+// ============
+// run the input, camera and animation updates at a fixed rate on their own
+// thread, handing every step to the render thread as a frame snapshot
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FramePipeline.h"
+
+#include "GLFW/glfw3.h"
+
+#include <chrono>
+
+// declaration of global variables and defines
+namespace
+{
+	// simulation steps per second, above the refresh rate of most
+	// displays so every frame has a step of its own
+	const int g_StepsPerSecond = 120;
+	// seconds simulated by every step
+	const double g_StepTime = 1.0 / g_StepsPerSecond;
+	// steps the simulation may fall behind before the missed
+	// ones are dropped instead of run back to back
+	const int g_MaxBehindSteps = 30;
+}
+
+/***********************************************************
+ *  FramePipeline()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FramePipeline::FramePipeline(ViewManager* pViewManager, SceneAnimator* pSceneAnimator)
+{
+	m_pViewManager = pViewManager;
+	m_pSceneAnimator = pSceneAnimator;
+	m_acknowledgedStep = -1;
+	m_step = 0;
+	m_startTime = 0.0;
+	m_bRunning = false;
+}
+
+/***********************************************************
+ *  ~FramePipeline()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FramePipeline::~FramePipeline()
+{
+	Stop();
+	m_pViewManager = NULL;
+	m_pSceneAnimator = NULL;
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method is used for running the first step on the
+ *  calling thread, so a snapshot is ready for the first
+ *  frame, and starting the simulation thread.  The scene
+ *  has to be prepared before, since the thread then owns the
+ *  camera and the animator.
+ ***********************************************************/
+void FramePipeline::Start()
+{
+	if (m_bRunning)
+	{
+		return;
+	}
+
+	m_startTime = glfwGetTime();
+	m_step = 0;
+	m_acknowledgedStep = -1;
+	m_changeHistory.Clear();
+	Step();
+
+	m_bRunning = true;
+	m_thread = std::thread(&FramePipeline::SimulationLoop, this);
+}
+
+/***********************************************************
+ *  Stop()
+ *
+ *  This method is used for stopping the simulation thread
+ *  after its current step, and waiting for it to finish.
+ ***********************************************************/
+void FramePipeline::Stop()
+{
+	m_bRunning = false;
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+/***********************************************************
+ *  AcquireSnapshot()
+ *
+ *  This method is used for taking the newest snapshot on the
+ *  render thread, and letting the simulation thread know the
+ *  changes up to its step have been taken.
+ ***********************************************************/
+bool FramePipeline::AcquireSnapshot()
+{
+	if (m_snapshots.Acquire() == false)
+	{
+		return(false);
+	}
+
+	m_acknowledgedStep.store(m_snapshots.GetFront().step, std::memory_order_release);
+	return(true);
+}
+
+/***********************************************************
+ *  SimulationLoop()
+ *
+ *  This method is run by the simulation thread, stepping at
+ *  the fixed rate.  A step that wakes up late is followed by
+ *  the missed ones right away, so the simulated time keeps
+ *  up with the real one, unless the thread fell so far
+ *  behind that it drops them.
+ ***********************************************************/
+void FramePipeline::SimulationLoop()
+{
+	const std::chrono::steady_clock::duration stepDuration =
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(g_StepTime));
+	std::chrono::steady_clock::time_point nextStep = std::chrono::steady_clock::now();
+
+	while (m_bRunning)
+	{
+		nextStep += stepDuration;
+		std::this_thread::sleep_until(nextStep);
+		Step();
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - nextStep > stepDuration * g_MaxBehindSteps)
+		{
+			nextStep = now;
+		}
+	}
+}
+
+/***********************************************************
+ *  Step()
+ *
+ *  This method is used for moving the camera by the input
+ *  recorded since the last step, evaluating the animated
+ *  values for the time of the step and publishing both as a
+ *  snapshot.  The snapshot holds the changes of every step
+ *  the render thread has not acknowledged, whether the
+ *  snapshots that carried them were taken or skipped.
+ ***********************************************************/
+void FramePipeline::Step()
+{
+	double time = m_startTime + m_step * g_StepTime;
+	m_pViewManager->UpdateView(static_cast<float>(g_StepTime));
+	m_pSceneAnimator->Update(static_cast<float>(time));
+
+	m_changeHistory.Acknowledge(m_acknowledgedStep.load(std::memory_order_acquire));
+	m_changeHistory.AddStep(m_step, m_pSceneAnimator->GetChanges());
+
+	FRAME_SNAPSHOT& snapshot = m_snapshots.GetBack();
+	snapshot.step = m_step;
+	snapshot.time = time;
+	m_pViewManager->GetViewState(snapshot.view);
+	m_changeHistory.CollectChanges(snapshot.changes);
+
+	m_snapshots.Publish();
+	m_step++;
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepipeline.h
+// ============
+// run the input, camera and animation updates at a fixed rate on their own
+// thread, handing every step to the render thread as a frame snapshot
+//
+//	The simulation thread steps the camera by the recorded input and
+//	evaluates the animated lights, materials and parts, then publishes the
+//	view state and the changed values as a snapshot through a triple
+//	buffer.  The render thread takes the newest snapshot at the start of
+//	every frame and never touches the camera or the animator, so the
+//	camera moves the same at any frame rate, and the next step is prepared
+//	while the GPU draws the current frame.  The render thread acknowledges
+//	the step of every snapshot it takes, and every snapshot carries the
+//	changes of all the steps after the last acknowledged one, so the
+//	changes of a skipped snapshot are not lost and an older value never
+//	follows a newer one.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ChangeHistory.h"
+#include "SceneAnimator.h"
+#include "TripleBuffer.h"
+#include "ViewManager.h"
+
+#include <atomic>
+#include <thread>
+
+/***********************************************************
+ *  FramePipeline
+ *
+ *  This class contains the code for the simulation thread,
+ *  its fixed steps and the snapshots it hands to the render
+ *  thread.
+ ***********************************************************/
+class FramePipeline
+{
+public:
+	// constructor
+	FramePipeline(ViewManager* pViewManager, SceneAnimator* pSceneAnimator);
+	// destructor
+	~FramePipeline();
+
+	// values of one simulation step, drawn by the render thread
+	struct FRAME_SNAPSHOT
+	{
+		// number and time in seconds of the step
+		long long step;
+		double time;
+		// camera and view settings of the step
+		ViewManager::VIEW_STATE view;
+		// lights, materials and parts changed after the last
+		// step the render thread acknowledged
+		SceneAnimator::ANIMATION_CHANGES changes;
+	};
+
+	// run the first step and start the simulation thread
+	void Start();
+	// stop the simulation thread and wait for it to finish
+	void Stop();
+
+	// take the newest snapshot and acknowledge its step - returns
+	// false when no step was published since the last call
+	bool AcquireSnapshot();
+	// snapshot the render thread took last
+	const FRAME_SNAPSHOT& GetSnapshot() const { return(m_snapshots.GetFront()); }
+
+private:
+	// pointer to the view manager whose camera is simulated
+	ViewManager* m_pViewManager;
+	// pointer to the animated values of the scene
+	SceneAnimator* m_pSceneAnimator;
+	// snapshots handed from the simulation to the render thread
+	TripleBuffer<FRAME_SNAPSHOT> m_snapshots;
+	// changes of the steps the render thread may not have, and
+	// the newest step it took
+	ChangeHistory m_changeHistory;
+	std::atomic<long long> m_acknowledgedStep;
+	// number of the next step, and the time of the first step
+	long long m_step;
+	double m_startTime;
+	// simulation thread and whether it keeps running
+	std::thread m_thread;
+	std::atomic<bool> m_bRunning;
+
+	// run the simulation steps at the fixed rate until stopped
+	void SimulationLoop();
+	// update the camera and animated values and publish them
+	void Step();
+};
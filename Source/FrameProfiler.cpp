@@ -0,0 +1,541 @@
+///////////////////////////////////////////////////////////////////////////////
+// frameprofiler.cpp
+// ============
+// time the passes of every frame on the CPU and the GPU, count the work
+// submitted to OpenGL, and show or record the results
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameProfiler.h"
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// counters of the frame being recorded
+	FrameProfiler::FRAME_COUNTERS g_FrameCounters;
+
+	// weight of the newest frame in the averaged timings
+	const double g_AverageBlend = 0.1;
+
+	// layout of the overlay bars in pixels
+	const int g_OverlayMargin = 10;
+	const int g_BarHeight = 6;
+	const int g_BarGap = 3;
+	const double g_PixelsPerMillisecond = 20.0;
+	// frame time the overlay marks, for 60 frames per second
+	const double g_FrameBudget = 1000.0 / 60.0;
+
+	// bar colors of the scopes, repeated after the last one
+	const float g_ScopeColors[][3] = {
+		{ 0.9f, 0.3f, 0.3f }, { 0.3f, 0.9f, 0.3f }, { 0.3f, 0.5f, 1.0f },
+		{ 0.9f, 0.9f, 0.3f }, { 0.9f, 0.3f, 0.9f }, { 0.3f, 0.9f, 0.9f },
+		{ 1.0f, 0.6f, 0.2f }, { 0.7f, 0.7f, 0.7f } };
+	const int g_TotalScopeColors = sizeof(g_ScopeColors) / sizeof(g_ScopeColors[0]);
+
+	/***********************************************************
+	 *  GetMilliseconds()
+	 *
+	 *  This function is used for getting the milliseconds from
+	 *  a start time until now.
+	 ***********************************************************/
+	double GetMilliseconds(const std::chrono::steady_clock::time_point& start)
+	{
+		return(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	/***********************************************************
+	 *  FillRectangle()
+	 *
+	 *  This function is used for filling a rectangle of the
+	 *  framebuffer with a color, through a scissored clear so
+	 *  no shader program is needed.
+	 ***********************************************************/
+	void FillRectangle(int x, int y, int width, int height, float red, float green, float blue)
+	{
+		if ((width <= 0) || (height <= 0))
+		{
+			return;
+		}
+		glScissor(x, y, width, height);
+		glClearColor(red, green, blue, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+}
+
+/***********************************************************
+ *  FrameProfiler()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameProfiler::FrameProfiler()
+{
+	glGenQueries(PROFILER_FRAME_LATENCY * MAX_PROFILER_SCOPES, &m_queries[0][0]);
+	memset((void*)m_records, 0, sizeof(m_records));
+	memset((void*)&g_FrameCounters, 0, sizeof(g_FrameCounters));
+	memset((void*)&m_lastCounters, 0, sizeof(m_lastCounters));
+	m_frameAllocations = 0;
+	m_bCheckAllocations = false;
+	m_summary[0] = '\0';
+	m_frameNumber = 0;
+	m_slot = 0;
+	m_averageFrameTime = 0.0;
+	m_lastFrameGPU = -1.0;
+	m_lastFrameNumber = -1;
+	m_bWriteHeader = false;
+}
+
+/***********************************************************
+ *  ~FrameProfiler()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameProfiler::~FrameProfiler()
+{
+	glDeleteQueries(PROFILER_FRAME_LATENCY * MAX_PROFILER_SCOPES, &m_queries[0][0]);
+	if (m_csvFile.is_open())
+	{
+		m_csvFile.close();
+	}
+}
+
+/***********************************************************
+ *  AddScope()
+ *
+ *  This method is used for registering a named scope.  Only
+ *  scopes that do not nest inside each other can be timed
+ *  on the GPU.
+ ***********************************************************/
+int FrameProfiler::AddScope(const char* name, bool bTimeGPU)
+{
+	if (m_scopes.size() >= MAX_PROFILER_SCOPES)
+	{
+		std::cout << "Only " << MAX_PROFILER_SCOPES << " profiler scopes can be registered" << std::endl;
+		return(-1);
+	}
+
+	PROFILER_SCOPE scope;
+	scope.name = name;
+	scope.bTimeGPU = bTimeGPU;
+	scope.averageCPU = 0.0;
+	scope.averageGPU = 0.0;
+	scope.totalCPU = 0.0;
+	scope.totalGPU = 0.0;
+	scope.nCPUSamples = 0;
+	scope.nGPUSamples = 0;
+	m_scopes.push_back(scope);
+
+	return((int)m_scopes.size() - 1);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting a frame.  The frame that
+ *  used the same ring slot is read back first, which is far
+ *  enough behind for its queries to be finished.
+ ***********************************************************/
+void FrameProfiler::BeginFrame()
+{
+	m_slot = (int)(m_frameNumber % PROFILER_FRAME_LATENCY);
+	FRAME_RECORD& record = m_records[m_slot];
+	if (record.bPending)
+	{
+		ReadBackFrame(record);
+	}
+
+	memset((void*)&record, 0, sizeof(record));
+	record.frameNumber = m_frameNumber;
+	memset((void*)&g_FrameCounters, 0, sizeof(g_FrameCounters));
+	// the last frame is read back first, so writing its line is
+	// not counted as an allocation of this frame
+	m_frameAllocations = AllocationCounter::GetCount();
+	m_frameStart = std::chrono::steady_clock::now();
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for finishing a frame, keeping its
+ *  timings and counters until its queries are read back.
+ *  When the allocations are checked, a frame that made any
+ *  stops a debug build here.
+ ***********************************************************/
+void FrameProfiler::EndFrame()
+{
+	FRAME_RECORD& record = m_records[m_slot];
+	record.frameTime = GetMilliseconds(m_frameStart);
+	record.counters = g_FrameCounters;
+	record.counters.heapAllocations = AllocationCounter::IsEnabled() ?
+		AllocationCounter::GetCount() - m_frameAllocations : -1;
+	assert((m_bCheckAllocations == false) || (record.counters.heapAllocations <= 0));
+	record.bPending = true;
+	m_frameNumber++;
+}
+
+/***********************************************************
+ *  BeginScope()
+ *
+ *  This method is used for starting the timers of a scope.
+ ***********************************************************/
+void FrameProfiler::BeginScope(int scope)
+{
+	if ((scope < 0) || (scope >= (int)m_scopes.size()))
+	{
+		return;
+	}
+
+	FRAME_RECORD& record = m_records[m_slot];
+	if (m_scopes[scope].bTimeGPU && (record.bIssued[scope] == false))
+	{
+		glBeginQuery(GL_TIME_ELAPSED, m_queries[m_slot][scope]);
+		record.bIssued[scope] = true;
+	}
+	m_scopeStarts[scope] = std::chrono::steady_clock::now();
+}
+
+/***********************************************************
+ *  EndScope()
+ *
+ *  This method is used for stopping the timers of a scope.
+ *  A scope entered several times in a frame adds up its CPU
+ *  times, only its first entry is timed on the GPU.
+ ***********************************************************/
+void FrameProfiler::EndScope(int scope)
+{
+	if ((scope < 0) || (scope >= (int)m_scopes.size()))
+	{
+		return;
+	}
+
+	FRAME_RECORD& record = m_records[m_slot];
+	record.cpuTimes[scope] += GetMilliseconds(m_scopeStarts[scope]);
+	if (record.bIssued[scope] && (record.bEnded[scope] == false))
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		record.bEnded[scope] = true;
+	}
+}
+
+/***********************************************************
+ *  CountDrawCall()
+ *
+ *  This method is used for counting a draw call and the
+ *  triangles it draws into the current frame.
+ ***********************************************************/
+void FrameProfiler::CountDrawCall(long long triangles)
+{
+	g_FrameCounters.drawCalls++;
+	g_FrameCounters.triangles += triangles;
+}
+
+/***********************************************************
+ *  CountStateChange()
+ *
+ *  This method is used for counting a change of the render
+ *  state, a program or a framebuffer into the current frame.
+ ***********************************************************/
+void FrameProfiler::CountStateChange()
+{
+	g_FrameCounters.stateChanges++;
+}
+
+/***********************************************************
+ *  CountUniformUpload()
+ *
+ *  This method is used for counting a write of uniform or
+ *  shader buffer values into the current frame.
+ ***********************************************************/
+void FrameProfiler::CountUniformUpload(long long bytes)
+{
+	g_FrameCounters.uniformUploads++;
+	g_FrameCounters.uploadBytes += bytes;
+}
+
+/***********************************************************
+ *  CountStreamUpload()
+ *
+ *  This method is used for counting the bytes of a range of
+ *  the stream buffer handed out in the current frame.
+ ***********************************************************/
+void FrameProfiler::CountStreamUpload(long long bytes)
+{
+	g_FrameCounters.streamBytes += bytes;
+}
+
+/***********************************************************
+ *  CountStreamStall()
+ *
+ *  This method is used for counting a wait for the GPU to
+ *  finish reading a region of the stream buffer.
+ ***********************************************************/
+void FrameProfiler::CountStreamStall()
+{
+	g_FrameCounters.streamStalls++;
+}
+
+/***********************************************************
+ *  Flush()
+ *
+ *  This method is used for waiting until the GPU finished
+ *  the recorded frames and reading them all back, oldest
+ *  first, so the last frames of a run are not lost.
+ ***********************************************************/
+void FrameProfiler::Flush()
+{
+	glFinish();
+
+	long long firstFrame = std::max(0LL, m_frameNumber - PROFILER_FRAME_LATENCY);
+	for (long long frame = firstFrame; frame < m_frameNumber; frame++)
+	{
+		m_slot = (int)(frame % PROFILER_FRAME_LATENCY);
+		if (m_records[m_slot].bPending)
+		{
+			ReadBackFrame(m_records[m_slot]);
+		}
+	}
+}
+
+/***********************************************************
+ *  ResetTotals()
+ *
+ *  This method is used for starting the run totals of the
+ *  scopes again, such as after the warm-up frames.
+ ***********************************************************/
+void FrameProfiler::ResetTotals()
+{
+	for (size_t i = 0; i < m_scopes.size(); i++)
+	{
+		m_scopes[i].totalCPU = 0.0;
+		m_scopes[i].totalGPU = 0.0;
+		m_scopes[i].nCPUSamples = 0;
+		m_scopes[i].nGPUSamples = 0;
+	}
+}
+
+/***********************************************************
+ *  GetMeanCPU()
+ *
+ *  This method is used for getting the mean CPU time of a
+ *  scope over the read back frames of the run.
+ ***********************************************************/
+double FrameProfiler::GetMeanCPU(int scope) const
+{
+	if ((scope < 0) || (scope >= (int)m_scopes.size()) || (m_scopes[scope].nCPUSamples == 0))
+	{
+		return(-1.0);
+	}
+
+	return(m_scopes[scope].totalCPU / m_scopes[scope].nCPUSamples);
+}
+
+/***********************************************************
+ *  GetMeanGPU()
+ *
+ *  This method is used for getting the mean GPU time of a
+ *  scope over the read back frames of the run.
+ ***********************************************************/
+double FrameProfiler::GetMeanGPU(int scope) const
+{
+	if ((scope < 0) || (scope >= (int)m_scopes.size()) || (m_scopes[scope].nGPUSamples == 0))
+	{
+		return(-1.0);
+	}
+
+	return(m_scopes[scope].totalGPU / m_scopes[scope].nGPUSamples);
+}
+
+/***********************************************************
+ *  OpenCSV()
+ *
+ *  This method is used for opening the file that a line is
+ *  written into for every frame once it is read back.
+ ***********************************************************/
+bool FrameProfiler::OpenCSV(const char* filename)
+{
+	m_csvFile.open(filename, std::ios::out | std::ios::trunc);
+	if (!m_csvFile.is_open())
+	{
+		std::cout << "Could not open profile file:" << filename << std::endl;
+		return(false);
+	}
+
+	// the columns of the scopes are known once they are added
+	m_bWriteHeader = true;
+	return(true);
+}
+
+/***********************************************************
+ *  ReadBackFrame()
+ *
+ *  This method is used for reading the GPU timings of a
+ *  recorded frame, adding the frame into the averages and
+ *  writing its line into the CSV file.  A query that is
+ *  still not finished is skipped instead of waited for.
+ ***********************************************************/
+void FrameProfiler::ReadBackFrame(FRAME_RECORD& record)
+{
+	double gpuTimes[MAX_PROFILER_SCOPES];
+	double frameGPU = -1.0;
+	for (size_t i = 0; i < m_scopes.size(); i++)
+	{
+		gpuTimes[i] = -1.0;
+		if (record.bEnded[i])
+		{
+			GLuint query = m_queries[m_slot][i];
+			GLint bAvailable = GL_FALSE;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &bAvailable);
+			if (GL_FALSE != bAvailable)
+			{
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+				gpuTimes[i] = nanoseconds / 1000000.0;
+			}
+		}
+
+		PROFILER_SCOPE& scope = m_scopes[i];
+		scope.averageCPU += (record.cpuTimes[i] - scope.averageCPU) * g_AverageBlend;
+		scope.totalCPU += record.cpuTimes[i];
+		scope.nCPUSamples++;
+		if (gpuTimes[i] >= 0.0)
+		{
+			scope.averageGPU += (gpuTimes[i] - scope.averageGPU) * g_AverageBlend;
+			scope.totalGPU += gpuTimes[i];
+			scope.nGPUSamples++;
+			frameGPU = std::max(frameGPU, 0.0) + gpuTimes[i];
+		}
+	}
+	m_averageFrameTime += (record.frameTime - m_averageFrameTime) * g_AverageBlend;
+	m_lastCounters = record.counters;
+	m_lastFrameGPU = frameGPU;
+	m_lastFrameNumber = record.frameNumber;
+	record.bPending = false;
+
+	if (!m_csvFile.is_open())
+	{
+		return;
+	}
+
+	if (m_bWriteHeader)
+	{
+		m_csvFile << "frame,frame_ms,draw_calls,triangles,state_changes,uniform_uploads,upload_bytes,stream_bytes,stream_stalls,heap_allocations";
+		for (size_t i = 0; i < m_scopes.size(); i++)
+		{
+			m_csvFile << "," << m_scopes[i].name << "_cpu_ms," << m_scopes[i].name << "_gpu_ms";
+		}
+		m_csvFile << "\n";
+		m_bWriteHeader = false;
+	}
+
+	m_csvFile << record.frameNumber << "," << record.frameTime << ","
+		<< record.counters.drawCalls << "," << record.counters.triangles << ","
+		<< record.counters.stateChanges << "," << record.counters.uniformUploads << ","
+		<< record.counters.uploadBytes << "," << record.counters.streamBytes << ","
+		<< record.counters.streamStalls << "," << record.counters.heapAllocations;
+	for (size_t i = 0; i < m_scopes.size(); i++)
+	{
+		// scopes without a GPU timing leave the column empty
+		m_csvFile << "," << record.cpuTimes[i] << ",";
+		if (gpuTimes[i] >= 0.0)
+		{
+			m_csvFile << gpuTimes[i];
+		}
+	}
+	m_csvFile << "\n";
+}
+
+/***********************************************************
+ *  DrawOverlay()
+ *
+ *  This method is used for drawing a pair of bars for every
+ *  scope in the corner of the view - the CPU time in the
+ *  color of the scope, the GPU time darker below it - with
+ *  a mark at the budget of a 60 frames per second frame.
+ ***********************************************************/
+void FrameProfiler::DrawOverlay(int width, int height) const
+{
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glEnable(GL_SCISSOR_TEST);
+
+	const int rowHeight = 2 * g_BarHeight + g_BarGap;
+	const int budgetWidth = (int)(g_FrameBudget * g_PixelsPerMillisecond);
+	int top = height - g_OverlayMargin;
+	int bottom = top - (int)m_scopes.size() * rowHeight;
+	FillRectangle(g_OverlayMargin, bottom, budgetWidth, top - bottom, 0.1f, 0.1f, 0.1f);
+
+	for (size_t i = 0; i < m_scopes.size(); i++)
+	{
+		const float* color = g_ScopeColors[i % g_TotalScopeColors];
+		int rowTop = top - (int)i * rowHeight;
+		int cpuWidth = (int)(m_scopes[i].averageCPU * g_PixelsPerMillisecond);
+		int gpuWidth = (int)(m_scopes[i].averageGPU * g_PixelsPerMillisecond);
+
+		FillRectangle(g_OverlayMargin, rowTop - g_BarHeight,
+			std::min(cpuWidth, width - g_OverlayMargin), g_BarHeight,
+			color[0], color[1], color[2]);
+		if (m_scopes[i].bTimeGPU)
+		{
+			FillRectangle(g_OverlayMargin, rowTop - 2 * g_BarHeight,
+				std::min(gpuWidth, width - g_OverlayMargin), g_BarHeight,
+				color[0] * 0.5f, color[1] * 0.5f, color[2] * 0.5f);
+		}
+	}
+
+	// the whole frame, and the mark of the frame budget
+	int frameWidth = (int)(m_averageFrameTime * g_PixelsPerMillisecond);
+	FillRectangle(g_OverlayMargin, bottom - g_BarHeight,
+		std::min(frameWidth, width - g_OverlayMargin), g_BarHeight, 1.0f, 1.0f, 1.0f);
+	FillRectangle(g_OverlayMargin + budgetWidth, bottom - g_BarHeight, 2, top - bottom + g_BarHeight,
+		1.0f, 0.0f, 0.0f);
+
+	glDisable(GL_SCISSOR_TEST);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+}
+
+/***********************************************************
+ *  GetSummary()
+ *
+ *  This method is used for getting a line of text with the
+ *  averaged frame time, the counters of the last read back
+ *  frame, and the averaged timings of every scope.  The text
+ *  is written into a buffer of the profiler, so showing it
+ *  every so often does not allocate.
+ ***********************************************************/
+const char* FrameProfiler::GetSummary()
+{
+	// the length stops short of the end of the buffer, where
+	// snprintf cuts off anything longer
+	const int size = (int)sizeof(m_summary);
+	int length = snprintf(m_summary, size,
+		"%.2f ms | %d draws | %lld tris | %d states | %d uploads | %lld KB streamed",
+		m_averageFrameTime, m_lastCounters.drawCalls, m_lastCounters.triangles,
+		m_lastCounters.stateChanges, m_lastCounters.uniformUploads,
+		m_lastCounters.streamBytes / 1024);
+	length = std::min(std::max(length, 0), size - 1);
+	if (m_lastCounters.heapAllocations >= 0)
+	{
+		length += snprintf(m_summary + length, size - length, " | %lld allocs",
+			m_lastCounters.heapAllocations);
+		length = std::min(length, size - 1);
+	}
+
+	for (size_t i = 0; i < m_scopes.size(); i++)
+	{
+		length += snprintf(m_summary + length, size - length, " | %s %.2f",
+			m_scopes[i].name.c_str(), m_scopes[i].averageCPU);
+		length = std::min(length, size - 1);
+		if (m_scopes[i].bTimeGPU)
+		{
+			length += snprintf(m_summary + length, size - length, "/%.2f", m_scopes[i].averageGPU);
+			length = std::min(length, size - 1);
+		}
+	}
+
+	return(m_summary);
+}
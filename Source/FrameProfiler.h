@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+// frameprofiler.h
+// ============
+// time the passes of every frame on the CPU and the GPU, count the work
+// submitted to OpenGL, and show or record the results
+//
+//	Every pass is a named scope.  The CPU time of a scope is measured with
+//	a steady clock and its GPU time with a GL_TIME_ELAPSED query.  The
+//	queries of a frame are kept in a ring of PROFILER_FRAME_LATENCY frames
+//	and only read back when their ring slot comes around again, so reading
+//	them never waits for the GPU.  Scopes that time the GPU must not nest.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// number of frames the GPU timings are read back after
+#define PROFILER_FRAME_LATENCY 4
+// number of scopes that can be registered
+#define MAX_PROFILER_SCOPES 16
+
+/***********************************************************
+ *  FrameProfiler
+ *
+ *  This class contains the code for timing the scopes of
+ *  every frame, collecting the frame counters, drawing the
+ *  timing overlay and writing the per-frame CSV file.
+ ***********************************************************/
+class FrameProfiler
+{
+public:
+	// constructor - needs the OpenGL context for the queries
+	FrameProfiler();
+	// destructor
+	~FrameProfiler();
+
+	// work submitted to OpenGL during a frame
+	struct FRAME_COUNTERS
+	{
+		int drawCalls;
+		long long triangles;
+		int stateChanges;
+		int uniformUploads;
+		long long uploadBytes;
+		// bytes written into the stream buffer, and the frames
+		// that had to wait for the GPU to free its region
+		long long streamBytes;
+		int streamStalls;
+		// heap allocations of the render loop threads, negative
+		// when the build does not count them
+		long long heapAllocations;
+	};
+
+	// register a named scope, timed on the GPU as well when
+	// asked - returns the scope handle, or -1 when full
+	int AddScope(const char* name, bool bTimeGPU);
+
+	// start and finish a frame
+	void BeginFrame();
+	void EndFrame();
+	// start and finish a registered scope within the frame
+	void BeginScope(int scope);
+	void EndScope(int scope);
+
+	// count the work of the frame from anywhere in the renderer
+	static void CountDrawCall(long long triangles);
+	static void CountStateChange();
+	static void CountUniformUpload(long long bytes);
+	static void CountStreamUpload(long long bytes);
+	static void CountStreamStall();
+
+	// write a line for every frame into a CSV file
+	bool OpenCSV(const char* filename);
+	// draw bars of the scope timings in the corner of the view
+	void DrawOverlay(int width, int height) const;
+	// short text of the averaged timings and counters, kept
+	// until the next call
+	const char* GetSummary();
+	// stop at the end of any frame that allocated, once the
+	// frames are expected to stay steady
+	void SetAllocationCheck(bool bCheck) { m_bCheckAllocations = bCheck; }
+
+	// wait for the GPU and read back every recorded frame
+	void Flush();
+	// start the run totals again, dropping the frames so far
+	void ResetTotals();
+	// registered scopes and their mean timings over the run,
+	// negative for a GPU time that was never measured
+	int GetScopeCount() const { return (int)m_scopes.size(); }
+	const std::string& GetScopeName(int scope) const { return m_scopes[scope].name; }
+	double GetMeanCPU(int scope) const;
+	double GetMeanGPU(int scope) const;
+	// counters of the last read back frame
+	const FRAME_COUNTERS& GetLastCounters() const { return m_lastCounters; }
+	// summed GPU time of the scopes of the last read back frame,
+	// negative when none was measured, and the number of that
+	// frame to tell a new reading from the last one
+	double GetLastFrameGPU() const { return m_lastFrameGPU; }
+	long long GetLastFrameNumber() const { return m_lastFrameNumber; }
+
+private:
+	// a registered scope and its averaged timings
+	struct PROFILER_SCOPE
+	{
+		std::string name;
+		bool bTimeGPU;
+		double averageCPU;
+		double averageGPU;
+		// sums over the run for the mean timings
+		double totalCPU;
+		double totalGPU;
+		int nCPUSamples;
+		int nGPUSamples;
+	};
+
+	// timings of one frame, kept until its queries are read
+	struct FRAME_RECORD
+	{
+		long long frameNumber;
+		bool bPending;
+		double cpuTimes[MAX_PROFILER_SCOPES];
+		// whether the query of a scope was started and ended
+		bool bIssued[MAX_PROFILER_SCOPES];
+		bool bEnded[MAX_PROFILER_SCOPES];
+		double frameTime;
+		FRAME_COUNTERS counters;
+	};
+
+	std::vector<PROFILER_SCOPE> m_scopes;
+	// time elapsed queries of every scope in every ring slot
+	GLuint m_queries[PROFILER_FRAME_LATENCY][MAX_PROFILER_SCOPES];
+	FRAME_RECORD m_records[PROFILER_FRAME_LATENCY];
+	// start times of the open scopes and of the frame
+	std::chrono::steady_clock::time_point m_scopeStarts[MAX_PROFILER_SCOPES];
+	std::chrono::steady_clock::time_point m_frameStart;
+	long long m_frameNumber;
+	int m_slot;
+
+	// averaged frame values of the read back frames
+	double m_averageFrameTime;
+	FRAME_COUNTERS m_lastCounters;
+	double m_lastFrameGPU;
+	long long m_lastFrameNumber;
+
+	// allocation count at the start of the frame, and whether
+	// a frame that allocated is an error
+	long long m_frameAllocations;
+	bool m_bCheckAllocations;
+	// text of the last summary
+	char m_summary[512];
+
+	// file the frame lines are written into
+	std::ofstream m_csvFile;
+	// whether the column names still need to be written
+	bool m_bWriteHeader;
+
+	// read the queries of the frame in the current ring slot
+	void ReadBackFrame(FRAME_RECORD& record);
+};
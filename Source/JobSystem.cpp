@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.cpp
+// ============
+// split loops over many objects into jobs run by a pool of worker threads,
+// which take work from each other when their own runs out
+///////////////////////////////////////////////////////////////////////////////
+
+#include "JobSystem.h"
+#include "AllocationCounter.h"
+
+#include <algorithm>
+
+// declaration of global variables and defines
+namespace
+{
+	// most worker threads started, on top of the calling thread
+	const unsigned int g_MaxWorkers = 15;
+}
+
+/***********************************************************
+ *  JobSystem()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+JobSystem::JobSystem()
+{
+	m_queuedJobs = 0;
+	m_bStopping = false;
+
+	// the calling thread runs chunks as well, so one core is
+	// left to it
+	unsigned int nWorkers = std::thread::hardware_concurrency();
+	nWorkers = (nWorkers > 1) ? std::min(nWorkers - 1, g_MaxWorkers) : 0;
+
+	for (unsigned int i = 0; i <= nWorkers; i++)
+	{
+		m_queues.push_back(std::unique_ptr<JOB_QUEUE>(new JOB_QUEUE()));
+		m_queues.back()->head = 0;
+	}
+	for (unsigned int i = 0; i < nWorkers; i++)
+	{
+		m_workers.push_back(std::thread(&JobSystem::WorkerLoop, this, (int)i));
+	}
+}
+
+/***********************************************************
+ *  ~JobSystem()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_bStopping = true;
+	}
+	m_jobsQueued.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+}
+
+/***********************************************************
+ *  RunParallel()
+ *
+ *  This method is used for running a job over a range of
+ *  indices, cut into chunks of the passed in size.  Every
+ *  thread gets a contiguous share of the chunks, and the
+ *  calling thread takes chunks with the workers until all of
+ *  them are finished.  A range of one chunk is run right
+ *  away on the calling thread.
+ ***********************************************************/
+void JobSystem::RunParallel(size_t count, size_t chunkSize, const RANGE_JOB& job)
+{
+	chunkSize = std::max<size_t>(chunkSize, 1);
+	if ((count <= chunkSize) || m_workers.empty())
+	{
+		if (count > 0)
+		{
+			job.pRun(job.pContext, 0, count);
+		}
+		return;
+	}
+
+	size_t nChunks = (count + chunkSize - 1) / chunkSize;
+	size_t nQueues = m_queues.size();
+	std::atomic<size_t> remaining(nChunks);
+
+	// the chunks are counted before they are queued, so a worker
+	// never takes one that is not counted yet
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queuedJobs += nChunks;
+	}
+
+	size_t chunk = 0;
+	for (size_t queue = 0; queue < nQueues; queue++)
+	{
+		size_t lastChunk = nChunks * (queue + 1) / nQueues;
+		std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+		for (; chunk < lastChunk; chunk++)
+		{
+			JOB chunkJob;
+			chunkJob.pJob = &job;
+			chunkJob.first = chunk * chunkSize;
+			chunkJob.last = std::min(count, chunkJob.first + chunkSize);
+			chunkJob.pRemaining = &remaining;
+			m_queues[queue]->jobs.push_back(chunkJob);
+		}
+	}
+	m_jobsQueued.notify_all();
+
+	// the calling thread works through its share and then steals,
+	// and only waits once the last chunks are being run
+	int callerQueue = (int)nQueues - 1;
+	while (remaining.load(std::memory_order_acquire) > 0)
+	{
+		JOB chunkJob;
+		if (TakeJob(callerQueue, chunkJob))
+		{
+			RunJob(chunkJob);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+/***********************************************************
+ *  TakeJob()
+ *
+ *  This method is used for taking the next chunk of a thread
+ *  from the back of its own queue, or stealing one from the
+ *  front of the other queues when it is empty.
+ ***********************************************************/
+bool JobSystem::TakeJob(int queueIndex, JOB& job)
+{
+	int nQueues = (int)m_queues.size();
+	for (int i = 0; i < nQueues; i++)
+	{
+		JOB_QUEUE& queue = *m_queues[(queueIndex + i) % nQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.head == queue.jobs.size())
+		{
+			continue;
+		}
+
+		if (0 == i)
+		{
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}
+		else
+		{
+			job = queue.jobs[queue.head];
+			queue.head++;
+		}
+		if (queue.head == queue.jobs.size())
+		{
+			queue.jobs.clear();
+			queue.head = 0;
+		}
+		m_queuedJobs--;
+		return(true);
+	}
+
+	return(false);
+}
+
+/***********************************************************
+ *  RunJob()
+ *
+ *  This method is used for running a chunk and counting it
+ *  as finished, which the thread that started the loop
+ *  waits on.
+ ***********************************************************/
+void JobSystem::RunJob(const JOB& job)
+{
+	job.pJob->pRun(job.pJob->pContext, job.first, job.last);
+	job.pRemaining->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method is run by every worker thread, taking chunks
+ *  while there are any and sleeping until the next loop
+ *  queues more.  The chunks run as part of the frame, so
+ *  their allocations are counted.
+ ***********************************************************/
+void JobSystem::WorkerLoop(int queueIndex)
+{
+	AllocationCounter::CountThread();
+	while (true)
+	{
+		JOB job;
+		if (TakeJob(queueIndex, job))
+		{
+			RunJob(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_jobsQueued.wait(lock, [this] { return(m_bStopping || (m_queuedJobs > 0)); });
+		if (m_bStopping)
+		{
+			return;
+		}
+	}
+}
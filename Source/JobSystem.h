@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.h
+// ============
+// split loops over many objects into jobs run by a pool of worker threads,
+// which take work from each other when their own runs out
+//
+//	A parallel loop is cut into chunks of contiguous indices, and every
+//	thread is handed an even share of the chunks in its own queue.  A
+//	thread takes its next chunk from the back of its queue, and once it is
+//	empty it steals from the front of the queue of another thread, so
+//	uneven chunks even out without one shared queue that every thread
+//	waits on.  The calling thread runs chunks as well until the loop is
+//	done.  Jobs must not start another parallel loop.  Queuing a loop
+//	allocates nothing once the queues have grown to the most chunks any
+//	loop used - the job is passed by pointer instead of copied into a
+//	function object, and the queues keep their storage when they empty.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  JobSystem
+ *
+ *  This class contains the code for the worker threads, the
+ *  job queue of every thread and the parallel loops.
+ ***********************************************************/
+class JobSystem
+{
+public:
+	// constructor
+	JobSystem();
+	// destructor
+	~JobSystem();
+
+	// job run over a range of indices, from first up to last, as
+	// the function called with the context it was passed in with
+	struct RANGE_JOB
+	{
+		void (*pRun)(void* pContext, size_t first, size_t last);
+		void* pContext;
+	};
+
+	// run the passed in job over the indices from 0 up to count,
+	// in chunks of the passed in size, returning once every chunk
+	// has been run - the job is anything called with the first
+	// and last index, and is not copied
+	template<typename FUNCTION>
+	void ParallelFor(size_t count, size_t chunkSize, const FUNCTION& job)
+	{
+		RANGE_JOB rangeJob;
+		rangeJob.pRun = &RunFunction<FUNCTION>;
+		rangeJob.pContext = (void*)&job;
+		RunParallel(count, chunkSize, rangeJob);
+	}
+	// number of threads running the chunks, with the calling one
+	int GetThreadCount() const { return((int)m_queues.size()); }
+
+private:
+	// chunk of a parallel loop
+	struct JOB
+	{
+		const RANGE_JOB* pJob;
+		size_t first;
+		size_t last;
+		// chunks of the loop that are not finished yet
+		std::atomic<size_t>* pRemaining;
+	};
+
+	// queue of the chunks handed to one thread, taken from the
+	// back by its own thread and from the head by the others -
+	// the storage is kept for the next loop once it is empty
+	struct JOB_QUEUE
+	{
+		std::mutex mutex;
+		std::vector<JOB> jobs;
+		size_t head;
+	};
+
+	// worker threads, each with the queue of the same index,
+	// followed by the queue of the calling thread
+	std::vector<std::thread> m_workers;
+	std::vector<std::unique_ptr<JOB_QUEUE>> m_queues;
+	// chunks waiting in any queue, which the idle workers sleep on
+	std::atomic<size_t> m_queuedJobs;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_jobsQueued;
+	bool m_bStopping;
+
+	// call a job of the passed in type from its context
+	template<typename FUNCTION>
+	static void RunFunction(void* pContext, size_t first, size_t last)
+	{
+		(*(const FUNCTION*)pContext)(first, last);
+	}
+	// cut the range into chunks, queue them and run them until
+	// all of them are finished
+	void RunParallel(size_t count, size_t chunkSize, const RANGE_JOB& job);
+	// take the next chunk of a thread, from its own queue or
+	// stolen from another one
+	bool TakeJob(int queueIndex, JOB& job);
+	// run a chunk and count it as finished
+	void RunJob(const JOB& job);
+	// run chunks until the job system is destroyed
+	void WorkerLoop(int queueIndex);
+};
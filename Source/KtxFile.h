@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////
+// ktxfile.h
+// ============
+// layout of the KTX texture files written by the texture cooker and read by
+// the texture loader
+//
+//	Cooked textures hold a block-compressed mip chain, with the rows
+//	stored bottom first like the images that stb_image flips on load,
+//	so cooked and raw textures map the same way.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+
+// extension of the cooked texture files
+#define KTX_FILE_EXTENSION ".ktx"
+
+// block-compressed formats written by the texture cooker
+#define KTX_FORMAT_BC1_RGB 0x83F0
+#define KTX_FORMAT_BC3_RGBA 0x83F3
+#define KTX_BASE_FORMAT_RGB 0x1907
+#define KTX_BASE_FORMAT_RGBA 0x1908
+
+// value of the endianness field in files written on little-endian machines
+#define KTX_ENDIANNESS 0x04030201
+
+/***********************************************************
+ *  KTX_HEADER
+ *
+ *  The header at the start of every KTX file.  It is followed
+ *  by the key and value data, then by every mip level as its
+ *  size in bytes and its data.
+ ***********************************************************/
+struct KTX_HEADER
+{
+	unsigned char identifier[12];
+	uint32_t endianness;
+	uint32_t glType;
+	uint32_t glTypeSize;
+	uint32_t glFormat;
+	uint32_t glInternalFormat;
+	uint32_t glBaseInternalFormat;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t numberOfArrayElements;
+	uint32_t numberOfFaces;
+	uint32_t numberOfMipmapLevels;
+	uint32_t bytesOfKeyValueData;
+};
+
+static_assert(sizeof(KTX_HEADER) == 64, "KTX header layout mismatch");
+
+// the identifier at the start of every KTX file
+static const unsigned char KTX_IDENTIFIER[12] =
+{
+	0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+/***********************************************************
+ *  GetKtxBlockSize()
+ *
+ *  This function is used for getting the bytes per 4x4 block
+ *  of a compressed format, or 0 for formats that the texture
+ *  cooker does not write.
+ ***********************************************************/
+inline uint32_t GetKtxBlockSize(uint32_t glInternalFormat)
+{
+	if (KTX_FORMAT_BC1_RGB == glInternalFormat)
+	{
+		return(8);
+	}
+	if (KTX_FORMAT_BC3_RGBA == glInternalFormat)
+	{
+		return(16);
+	}
+	return(0);
+}
+
+/***********************************************************
+ *  IsKtxHeaderValid()
+ *
+ *  This function is used for checking that a file holds a
+ *  single compressed 2D texture that the loader can upload.
+ ***********************************************************/
+inline bool IsKtxHeaderValid(const unsigned char* pData, size_t size)
+{
+	if ((NULL == pData) || (size < sizeof(KTX_HEADER)))
+	{
+		return(false);
+	}
+
+	KTX_HEADER header;
+	memcpy(&header, pData, sizeof(header));
+
+	return((0 == memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER))) &&
+		(KTX_ENDIANNESS == header.endianness) &&
+		(0 == header.glType) &&
+		(GetKtxBlockSize(header.glInternalFormat) > 0) &&
+		(header.pixelWidth > 0) && (header.pixelHeight > 0) &&
+		(0 == header.pixelDepth) &&
+		(0 == header.numberOfArrayElements) &&
+		(1 == header.numberOfFaces) &&
+		(header.numberOfMipmapLevels > 0) &&
+		(sizeof(KTX_HEADER) + header.bytesOfKeyValueData <= size));
+}
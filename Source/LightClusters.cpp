@@ -0,0 +1,555 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ============
+// bin the point lights of the scene into view space clusters every frame,
+// so each fragment only lights itself with the lights near it
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+#include "BufferUpload.h"
+#include "FrameProfiler.h"
+#include "ShaderCompiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	const int g_TotalClusters = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+	// every cluster holds its light count followed by its list
+	const int g_ClusterStride = MAX_CLUSTER_LIGHTS + 1;
+
+	// storage buffer bindings of the compute shader
+	const GLuint g_LightBinding = 0;
+	const GLuint g_ClusterBinding = 1;
+
+	const char* g_ViewName = "view";
+	const char* g_ProjectionName = "projection";
+	const char* g_ViewportName = "viewport";
+	const char* g_LightCountName = "lightCount";
+
+	// attenuated light below this fraction of a color channel
+	// is not shown, which is where the range of a light ends
+	const float g_LightCutoff = 5.0f / 256.0f;
+
+	static_assert(sizeof(LightClusters::POINT_LIGHT) == 64, "PointLight layout mismatch");
+
+	/***********************************************************
+	 *  GetDepthSlice()
+	 *
+	 *  This function is used for getting the depth slice of a
+	 *  view space depth, the same way as the fragment shader.
+	 ***********************************************************/
+	int GetDepthSlice(float depth, float nearPlane, float farPlane)
+	{
+		if (depth <= nearPlane)
+		{
+			return(0);
+		}
+		int slice = (int)floor(log(depth / nearPlane) / log(farPlane / nearPlane) * CLUSTER_GRID_Z);
+		return((slice < CLUSTER_GRID_Z) ? slice : (CLUSTER_GRID_Z - 1));
+	}
+}
+
+/***********************************************************
+ *  LightClusters()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+LightClusters::LightClusters()
+{
+	m_bLightsChanged = true;
+	m_lightBuffer = 0;
+	m_lightTexture = 0;
+	m_pStreamBuffer = NULL;
+	m_bTextureRange = false;
+	m_lightSource = 0;
+	m_lightOffset = 0;
+	m_lightSize = 0;
+	m_clusterBuffer = 0;
+	m_clusterTexture = 0;
+	m_computeProgram = 0;
+	m_boundsProjection = glm::mat4(0.0f);
+	m_boundsViewport = glm::vec4(0.0f);
+}
+
+/***********************************************************
+ *  ~LightClusters()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+LightClusters::~LightClusters()
+{
+	if (0 != m_lightTexture)
+	{
+		glDeleteTextures(1, &m_lightTexture);
+		m_lightTexture = 0;
+	}
+	if (0 != m_clusterTexture)
+	{
+		glDeleteTextures(1, &m_clusterTexture);
+		m_clusterTexture = 0;
+	}
+	if (0 != m_lightBuffer)
+	{
+		glDeleteBuffers(1, &m_lightBuffer);
+		m_lightBuffer = 0;
+	}
+	if (0 != m_clusterBuffer)
+	{
+		glDeleteBuffers(1, &m_clusterBuffer);
+		m_clusterBuffer = 0;
+	}
+	if (0 != m_computeProgram)
+	{
+		glDeleteProgram(m_computeProgram);
+		m_computeProgram = 0;
+	}
+}
+
+/***********************************************************
+ *  CreateResources()
+ *
+ *  This method is used for creating the light and cluster
+ *  buffers with their buffer textures, and the compute
+ *  program when the driver has compute shaders and storage
+ *  buffers.
+ ***********************************************************/
+void LightClusters::CreateResources(const char* computeShaderFile)
+{
+	glGenBuffers(1, &m_lightBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, MAX_POINT_LIGHTS * sizeof(POINT_LIGHT), NULL, GL_DYNAMIC_DRAW);
+	m_lightSource = m_lightBuffer;
+	m_lightOffset = 0;
+	m_lightSize = MAX_POINT_LIGHTS * sizeof(POINT_LIGHT);
+	m_bTextureRange = (GLEW_VERSION_4_3 || GLEW_ARB_texture_buffer_range);
+
+	// every cluster starts without lights
+	m_clusterLights.assign(g_TotalClusters * g_ClusterStride, 0);
+	glGenBuffers(1, &m_clusterBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_clusterBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_clusterLights.size() * sizeof(int), m_clusterLights.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glGenTextures(1, &m_lightTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_lightBuffer);
+
+	glGenTextures(1, &m_clusterTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, m_clusterTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, m_clusterBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	if (GLEW_VERSION_4_3 ||
+		(GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object))
+	{
+		if (CreateComputeProgram(computeShaderFile) == false)
+		{
+			std::cout << "Building the light clusters on the CPU" << std::endl;
+		}
+	}
+}
+
+/***********************************************************
+ *  CreateComputeProgram()
+ *
+ *  This method is used for compiling and linking the compute
+ *  shader that bins the lights into the clusters.
+ ***********************************************************/
+bool LightClusters::CreateComputeProgram(const char* computeShaderFile)
+{
+	GLuint program = ShaderCompiler::CreateComputeProgram(computeShaderFile);
+	if (0 == program)
+	{
+		return(false);
+	}
+
+	m_computeProgram = program;
+	m_computeUniforms.ResolveUniforms(program);
+	m_viewUniform = m_computeUniforms.GetUniform<glm::mat4>(g_ViewName);
+	m_projectionUniform = m_computeUniforms.GetUniform<glm::mat4>(g_ProjectionName);
+	m_viewportUniform = m_computeUniforms.GetUniform<glm::vec4>(g_ViewportName);
+	m_lightCountUniform = m_computeUniforms.GetUniform<int>(g_LightCountName);
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetAttenuation()
+ *
+ *  This method is used for setting the attenuation terms of
+ *  a point light and its range, where the attenuation of its
+ *  brightest channel falls below the cutoff.  That is where
+ *  constant + linear * d + quadratic * d^2 reaches the
+ *  intensity over the cutoff.
+ ***********************************************************/
+void LightClusters::SetAttenuation(
+	POINT_LIGHT& light,
+	float constant,
+	float linear,
+	float quadratic,
+	float intensity)
+{
+	light.constant = constant;
+	light.linear = linear;
+	light.quadratic = quadratic;
+
+	float reach = intensity / g_LightCutoff - constant;
+	if (reach <= 0.0f)
+	{
+		light.range = 0.0f;
+	}
+	else if (quadratic > 0.0f)
+	{
+		light.range = (-linear + sqrt(linear * linear + 4.0f * quadratic * reach)) / (2.0f * quadratic);
+	}
+	else if (linear > 0.0f)
+	{
+		light.range = reach / linear;
+	}
+	else
+	{
+		// a light that never fades reaches every part
+		light.range = FLT_MAX;
+	}
+}
+
+/***********************************************************
+ *  UploadLights()
+ *
+ *  This method is used for writing the point lights into the
+ *  light buffer after they change.
+ ***********************************************************/
+void LightClusters::UploadLights()
+{
+	if (m_pointLights.size() > MAX_POINT_LIGHTS)
+	{
+		std::cout << "Only " << MAX_POINT_LIGHTS << " of " << m_pointLights.size() << " point lights fit in the light buffer" << std::endl;
+		m_pointLights.resize(MAX_POINT_LIGHTS);
+	}
+
+	// every light can reach every depth slice, so sorting them
+	// into the slices does not allocate for any view
+	for (int z = 0; z < CLUSTER_GRID_Z; z++)
+	{
+		m_sliceLights[z].reserve(m_pointLights.size());
+	}
+	m_viewLights.reserve(m_pointLights.size());
+
+	if (!m_pointLights.empty())
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, m_lightBuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, m_pointLights.size() * sizeof(POINT_LIGHT), m_pointLights.data());
+		FrameProfiler::CountUniformUpload(m_pointLights.size() * sizeof(POINT_LIGHT));
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+	m_bLightsChanged = false;
+	m_changedLights.clear();
+}
+
+/***********************************************************
+ *  SetPointLightColors()
+ *
+ *  This method is used for changing the colors of a point
+ *  light without uploading the whole light buffer again.
+ *  The range and position are not changed, so the cluster
+ *  lists are not affected.
+ ***********************************************************/
+void LightClusters::SetPointLightColors(
+	int index,
+	const glm::vec3& ambient,
+	const glm::vec3& diffuse,
+	const glm::vec3& specular)
+{
+	if ((index < 0) || (index >= (int)m_pointLights.size()))
+	{
+		return;
+	}
+
+	m_pointLights[index].ambient = ambient;
+	m_pointLights[index].diffuse = diffuse;
+	m_pointLights[index].specular = specular;
+	m_changedLights.push_back(index);
+}
+
+/***********************************************************
+ *  UploadChangedLights()
+ *
+ *  This method is used for writing the changed point lights
+ *  into the light buffer, with one write for every run of
+ *  neighboring lights.
+ ***********************************************************/
+void LightClusters::UploadChangedLights()
+{
+	int nLights = std::min((int)m_pointLights.size(), (int)MAX_POINT_LIGHTS);
+	BufferUpload::WriteChangedElements(GL_TEXTURE_BUFFER, m_lightBuffer,
+		m_pointLights.data(), sizeof(POINT_LIGHT), nLights, m_changedLights);
+
+	m_changedLights.clear();
+}
+
+/***********************************************************
+ *  StreamLights()
+ *
+ *  This method is used for writing all the point lights of
+ *  the frame into a range of the stream buffer, which the
+ *  buffer texture and the compute program then read.  The
+ *  range is only kept for the frames in flight, so the
+ *  lights are written every frame, whether they changed or
+ *  not.  Returns false when the lights went nowhere, in
+ *  which case the light buffer is used again and written
+ *  whole.
+ ***********************************************************/
+bool LightClusters::StreamLights()
+{
+	StreamBuffer::STREAM_RANGE range;
+	if ((NULL != m_pStreamBuffer) && m_bTextureRange &&
+		!m_pointLights.empty() && (m_pointLights.size() <= MAX_POINT_LIGHTS) &&
+		m_pStreamBuffer->Allocate(m_pointLights.size() * sizeof(POINT_LIGHT), range))
+	{
+		memcpy(range.pData, m_pointLights.data(), range.size);
+		SetLightRange(m_pStreamBuffer->GetBuffer(), range.offset, range.size);
+		return(true);
+	}
+
+	// the light buffer missed the writes while the lights were
+	// streamed
+	if (m_lightSource != m_lightBuffer)
+	{
+		SetLightRange(m_lightBuffer, 0, MAX_POINT_LIGHTS * sizeof(POINT_LIGHT));
+		m_bLightsChanged = true;
+	}
+	return(false);
+}
+
+/***********************************************************
+ *  SetLightRange()
+ *
+ *  This method is used for pointing the buffer texture of
+ *  the point lights at a range of a buffer, on the texture
+ *  unit it stays bound to.
+ ***********************************************************/
+void LightClusters::SetLightRange(GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	glActiveTexture(GL_TEXTURE0 + UNIT_POINT_LIGHTS);
+	glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+	if (buffer == m_lightBuffer)
+	{
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+	}
+	else
+	{
+		glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer, offset, size);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	m_lightSource = buffer;
+	m_lightOffset = offset;
+	m_lightSize = size;
+}
+
+/***********************************************************
+ *  BuildClusters()
+ *
+ *  This method is used for building the light list of every
+ *  cluster for the camera of the frame, before the scene is
+ *  drawn.
+ ***********************************************************/
+void LightClusters::BuildClusters(const UniformBuffers::FRAME_DATA& frameData)
+{
+	if (0 == m_clusterBuffer)
+	{
+		return;
+	}
+
+	if (StreamLights())
+	{
+		m_bLightsChanged = false;
+		m_changedLights.clear();
+	}
+	else if (m_bLightsChanged)
+	{
+		UploadLights();
+	}
+	else if (m_changedLights.empty() == false)
+	{
+		UploadChangedLights();
+	}
+
+	if (0 == m_computeProgram)
+	{
+		BuildClustersOnCPU(frameData);
+		return;
+	}
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glUseProgram(m_computeProgram);
+
+	m_computeUniforms.SetValue(m_viewUniform, frameData.view);
+	m_computeUniforms.SetValue(m_projectionUniform, frameData.projection);
+	m_computeUniforms.SetValue(m_viewportUniform, frameData.viewport);
+	m_computeUniforms.SetValue(m_lightCountUniform, (int)m_pointLights.size());
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, g_LightBinding, m_lightSource, m_lightOffset, m_lightSize);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_ClusterBinding, m_clusterBuffer);
+
+	// one invocation per cluster, one work group per depth slice
+	glDispatchCompute(1, 1, CLUSTER_GRID_Z);
+
+	// the lists are read through the buffer texture
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glUseProgram(previousProgram);
+}
+
+/***********************************************************
+ *  BindBuffers()
+ *
+ *  This method is used for binding the buffer textures to the
+ *  texture units the fragment shader reads them from.
+ ***********************************************************/
+void LightClusters::BindBuffers() const
+{
+	glActiveTexture(GL_TEXTURE0 + UNIT_POINT_LIGHTS);
+	glBindTexture(GL_TEXTURE_BUFFER, m_lightTexture);
+	glActiveTexture(GL_TEXTURE0 + UNIT_CLUSTER_LIGHTS);
+	glBindTexture(GL_TEXTURE_BUFFER, m_clusterTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  ComputeClusterBounds()
+ *
+ *  This method is used for computing the view space bounding
+ *  box of every cluster from the corners of its screen tile
+ *  at the depths of its slice.  Unprojecting the corners
+ *  works for both the perspective and orthographic views.
+ ***********************************************************/
+void LightClusters::ComputeClusterBounds(const glm::mat4& projection, const glm::vec4& viewport)
+{
+	const float nearPlane = viewport.z;
+	const float farPlane = viewport.w;
+	const glm::mat4 inverseProjection = glm::inverse(projection);
+
+	m_clusterBounds.resize(g_TotalClusters);
+	for (int z = 0; z < CLUSTER_GRID_Z; z++)
+	{
+		// normalized device depth of the slice boundaries
+		float sliceDepths[2];
+		float ndcDepths[2];
+		for (int i = 0; i < 2; i++)
+		{
+			sliceDepths[i] = nearPlane * pow(farPlane / nearPlane, (float)(z + i) / CLUSTER_GRID_Z);
+			glm::vec4 clip = projection * glm::vec4(0.0f, 0.0f, -sliceDepths[i], 1.0f);
+			ndcDepths[i] = clip.z / clip.w;
+		}
+
+		for (int y = 0; y < CLUSTER_GRID_Y; y++)
+		{
+			for (int x = 0; x < CLUSTER_GRID_X; x++)
+			{
+				CLUSTER_BOUNDS& bounds = m_clusterBounds[x + y * CLUSTER_GRID_X + z * CLUSTER_GRID_X * CLUSTER_GRID_Y];
+				bounds.boundsMin = glm::vec3(FLT_MAX);
+				bounds.boundsMax = glm::vec3(-FLT_MAX);
+
+				for (int corner = 0; corner < 8; corner++)
+				{
+					glm::vec4 ndc(
+						-1.0f + 2.0f * (float)(x + (corner & 1)) / CLUSTER_GRID_X,
+						-1.0f + 2.0f * (float)(y + ((corner >> 1) & 1)) / CLUSTER_GRID_Y,
+						ndcDepths[corner >> 2],
+						1.0f);
+					glm::vec4 view = inverseProjection * ndc;
+					glm::vec3 point = glm::vec3(view) / view.w;
+					bounds.boundsMin = glm::min(bounds.boundsMin, point);
+					bounds.boundsMax = glm::max(bounds.boundsMax, point);
+				}
+			}
+		}
+	}
+
+	m_boundsProjection = projection;
+	m_boundsViewport = viewport;
+}
+
+/***********************************************************
+ *  BuildClustersOnCPU()
+ *
+ *  This method is used for building the cluster lists on the
+ *  CPU when compute shaders are not available.  The lights
+ *  are first sorted into the depth slices they reach, so
+ *  each cluster only tests the lights of its slice.
+ ***********************************************************/
+void LightClusters::BuildClustersOnCPU(const UniformBuffers::FRAME_DATA& frameData)
+{
+	const float nearPlane = frameData.viewport.z;
+	const float farPlane = frameData.viewport.w;
+	if ((nearPlane <= 0.0f) || (farPlane <= nearPlane))
+	{
+		return;
+	}
+
+	if ((0 != memcmp(&m_boundsProjection, &frameData.projection, sizeof(glm::mat4))) ||
+		(m_boundsViewport != frameData.viewport))
+	{
+		ComputeClusterBounds(frameData.projection, frameData.viewport);
+	}
+
+	for (int z = 0; z < CLUSTER_GRID_Z; z++)
+	{
+		m_sliceLights[z].clear();
+	}
+
+	m_viewLights.resize(m_pointLights.size());
+	for (size_t i = 0; i < m_pointLights.size(); i++)
+	{
+		const POINT_LIGHT& light = m_pointLights[i];
+		glm::vec4 viewPosition = frameData.view * glm::vec4(light.position, 1.0f);
+		m_viewLights[i] = glm::vec4(glm::vec3(viewPosition), light.range);
+
+		float depth = -viewPosition.z;
+		if ((depth + light.range < nearPlane) || (depth - light.range > farPlane))
+		{
+			continue;
+		}
+		int firstSlice = GetDepthSlice(depth - light.range, nearPlane, farPlane);
+		int lastSlice = GetDepthSlice(depth + light.range, nearPlane, farPlane);
+		for (int z = firstSlice; z <= lastSlice; z++)
+		{
+			m_sliceLights[z].push_back((int)i);
+		}
+	}
+
+	for (int cluster = 0; cluster < g_TotalClusters; cluster++)
+	{
+		const CLUSTER_BOUNDS& bounds = m_clusterBounds[cluster];
+		const std::vector<int>& sliceLights = m_sliceLights[cluster / (CLUSTER_GRID_X * CLUSTER_GRID_Y)];
+		int* pList = &m_clusterLights[cluster * g_ClusterStride];
+		int count = 0;
+
+		for (size_t i = 0; (i < sliceLights.size()) && (count < MAX_CLUSTER_LIGHTS); i++)
+		{
+			// distance from the light to the closest point of the box
+			const glm::vec4& light = m_viewLights[sliceLights[i]];
+			glm::vec3 closest = glm::clamp(glm::vec3(light), bounds.boundsMin, bounds.boundsMax);
+			glm::vec3 offset = closest - glm::vec3(light);
+			if (glm::dot(offset, offset) <= light.w * light.w)
+			{
+				pList[1 + count] = sliceLights[i];
+				count++;
+			}
+		}
+		pList[0] = count;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_clusterBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, m_clusterLights.size() * sizeof(int), m_clusterLights.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	FrameProfiler::CountUniformUpload(m_clusterLights.size() * sizeof(int));
+}
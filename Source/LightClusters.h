@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ============
+// bin the point lights of the scene into view space clusters every frame,
+// so each fragment only lights itself with the lights near it
+//
+//	The view frustum is split into a grid of tiles on the screen and
+//	exponential slices in depth.  Every cluster lists up to
+//	MAX_CLUSTER_LIGHTS of the lights whose range reaches it.  The lists
+//	are built by a compute shader when the driver has compute shaders and
+//	storage buffers, and on the CPU otherwise.  The fragment shader reads
+//	the lights and the lists through buffer textures in both cases.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "UniformBuffers.h"
+#include "ShaderUniforms.h"
+#include "StreamBuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// size of the cluster grid, which must match the shaders
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+// number of lights that fit in the list of one cluster
+#define MAX_CLUSTER_LIGHTS 32
+// number of point lights that fit in the light buffer
+#define MAX_POINT_LIGHTS 1024
+
+/***********************************************************
+ *  LightClusters
+ *
+ *  This class contains the code for holding the point lights
+ *  of the scene in a buffer and building the per-cluster
+ *  light lists that the fragment shader loops over.
+ ***********************************************************/
+class LightClusters
+{
+public:
+	// constructor
+	LightClusters();
+	// destructor
+	~LightClusters();
+
+	// texture units of the buffer textures read by the fragment
+	// shader, above the units of the texture arrays
+	enum BUFFER_UNIT
+	{
+		UNIT_POINT_LIGHTS = 8,
+		UNIT_CLUSTER_LIGHTS = 9
+	};
+
+	// layout of a point light in the light buffer, four texels
+	// of the buffer texture and std430 for the compute shader -
+	// the light fades with the constant, linear and quadratic
+	// attenuation terms and reaches nothing past its range
+	struct POINT_LIGHT
+	{
+		glm::vec3 position;
+		float range;
+		glm::vec3 ambient;
+		float constant;
+		glm::vec3 diffuse;
+		float linear;
+		glm::vec3 specular;
+		float quadratic;
+	};
+
+	// set the attenuation terms of a point light and its range,
+	// the distance where a light of the passed in intensity is
+	// attenuated below what a color channel can show
+	static void SetAttenuation(
+		POINT_LIGHT& light,
+		float constant,
+		float linear,
+		float quadratic,
+		float intensity);
+
+	// create the buffers, and the compute program when compute
+	// shaders are available
+	void CreateResources(const char* computeShaderFile);
+	// write the point lights of every frame into ranges of the
+	// passed in stream buffer, when it has room
+	void SetStreamBuffer(StreamBuffer* pStreamBuffer) { m_pStreamBuffer = pStreamBuffer; }
+
+	// point lights of the scene - they are uploaded at the next
+	// build after they change
+	std::vector<POINT_LIGHT>& GetPointLights() { m_bLightsChanged = true; return m_pointLights; }
+	// change the colors of one point light - only the changed
+	// lights are uploaded at the next build
+	void SetPointLightColors(
+		int index,
+		const glm::vec3& ambient,
+		const glm::vec3& diffuse,
+		const glm::vec3& specular);
+
+	// build the light lists of the clusters for the camera of
+	// the passed in frame values
+	void BuildClusters(const UniformBuffers::FRAME_DATA& frameData);
+	// bind the buffer textures to their texture units
+	void BindBuffers() const;
+
+private:
+	// bounding box of a cluster in view space
+	struct CLUSTER_BOUNDS
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	std::vector<POINT_LIGHT> m_pointLights;
+	bool m_bLightsChanged;
+	// indices of the lights changed on their own since the
+	// last upload
+	std::vector<int> m_changedLights;
+
+	// buffer holding the point lights
+	GLuint m_lightBuffer;
+	GLuint m_lightTexture;
+	// stream buffer the point lights are written into, and
+	// whether the buffer texture can show a range of it
+	StreamBuffer* m_pStreamBuffer;
+	bool m_bTextureRange;
+	// range the lights of the frame were read from, either the
+	// light buffer or the stream buffer
+	GLuint m_lightSource;
+	GLintptr m_lightOffset;
+	GLsizeiptr m_lightSize;
+	// buffer holding the light count and list of every cluster
+	GLuint m_clusterBuffer;
+	GLuint m_clusterTexture;
+
+	// compute program binning the lights, 0 when the lists are
+	// built on the CPU
+	GLuint m_computeProgram;
+	ShaderUniforms m_computeUniforms;
+	ShaderUniforms::UNIFORM<glm::mat4> m_viewUniform;
+	ShaderUniforms::UNIFORM<glm::mat4> m_projectionUniform;
+	ShaderUniforms::UNIFORM<glm::vec4> m_viewportUniform;
+	ShaderUniforms::UNIFORM<int> m_lightCountUniform;
+
+	// cluster bounds and lists for building on the CPU - the
+	// bounds are only computed again when the projection changes
+	std::vector<CLUSTER_BOUNDS> m_clusterBounds;
+	glm::mat4 m_boundsProjection;
+	glm::vec4 m_boundsViewport;
+	std::vector<int> m_clusterLights;
+	// view space lights, and the lights reaching each depth slice
+	std::vector<glm::vec4> m_viewLights;
+	std::vector<int> m_sliceLights[CLUSTER_GRID_Z];
+
+	// compile and link the compute program
+	bool CreateComputeProgram(const char* computeShaderFile);
+	// write the point lights into the light buffer
+	void UploadLights();
+	// write only the changed point lights into the light buffer
+	void UploadChangedLights();
+	// write the point lights into a range of the stream buffer
+	// and point the buffer texture at it
+	bool StreamLights();
+	// point the buffer texture at a range of a buffer
+	void SetLightRange(GLuint buffer, GLintptr offset, GLsizeiptr size);
+	// compute the view space bounds of every cluster
+	void ComputeClusterBounds(const glm::mat4& projection, const glm::vec4& viewport);
+	// build the cluster lists on the CPU
+	void BuildClustersOnCPU(const UniformBuffers::FRAME_DATA& frameData);
+};
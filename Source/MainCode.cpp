@@ -9,6 +9,10 @@
 
 #include <iostream>         // error handling and output
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
+#include <cstdio>           // snprintf
+#include <algorithm>
+#include <string>
 
 #include <GL/glew.h>        // GLEW library
 #include "GLFW/glfw3.h"     // GLFW library
@@ -22,6 +26,16 @@
 #include "ViewManager.h"
 #include "ShapeMeshes.h"
 #include "ShaderManager.h"
+#include "ShaderUniforms.h"
+#include "ShaderVariants.h"
+#include "UniformBuffers.h"
+#include "FrameProfiler.h"
+#include "AllocationCounter.h"
+#include "BenchmarkRunner.h"
+#include "DynamicResolution.h"
+#include "FramePipeline.h"
+
+#include <chrono>
 
 // Namespace for declaring global variables
 namespace
@@ -36,14 +50,32 @@ namespace
 	SceneManager* g_SceneManager = nullptr;
 	// shader manager object for dynamic interaction with the shader code
 	ShaderManager* g_ShaderManager = nullptr;
+	// shader manager object of the depth pre-pass shaders
+	ShaderManager* g_DepthShaderManager = nullptr;
+	// specialized programs of the scene shaders
+	ShaderVariants* g_ShaderVariants = nullptr;
+	// cached uniform locations of the loaded shader program
+	ShaderUniforms* g_ShaderUniforms = nullptr;
+	// uniform buffers for the camera and lighting values
+	UniformBuffers* g_UniformBuffers = nullptr;
 	// view manager object for managing the 3D view setup and projection to 2D
 	ViewManager* g_ViewManager = nullptr;
+	// frame profiler timing the passes of every frame
+	FrameProfiler* g_Profiler = nullptr;
+	// scaled render target of the display window
+	DynamicResolution* g_DynamicResolution = nullptr;
+	// simulation thread updating the camera and the animations
+	FramePipeline* g_FramePipeline = nullptr;
+
+	// seconds between updates of the timings in the window title
+	const double g_TitleInterval = 0.5;
 }
 
 // Function declarations - all functions that are called manually
 // need to be pre-declared at the beginning of the source code.
 bool InitializeGLFW();
 bool InitializeGLEW();
+void RunBenchmark(BenchmarkRunner* pBenchmark, int viewScope, int swapScope);
 
 
 /***********************************************************
@@ -66,8 +98,23 @@ int main(int argc, char* argv[])
 	g_ViewManager = new ViewManager(
 		g_ShaderManager);
 
-	// try to create the main display window
-	g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
+	// a benchmark run draws into an offscreen framebuffer of a
+	// hidden window, every other run opens the display window
+	BenchmarkRunner::BENCHMARK_SETTINGS benchmarkSettings;
+	bool bBenchmark = BenchmarkRunner::ParseArguments(argc, argv, benchmarkSettings);
+	if (bBenchmark)
+	{
+		g_Window = g_ViewManager->CreateOffscreenWindow(
+			WINDOW_TITLE, benchmarkSettings.width, benchmarkSettings.height);
+	}
+	else
+	{
+		g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
+	}
+	if (NULL == g_Window)
+	{
+		return(EXIT_FAILURE);
+	}
 
 	// if GLEW fails initialization, then terminate the application
 	if (InitializeGLEW() == false)
@@ -77,29 +124,167 @@ int main(int argc, char* argv[])
 
 	// load the shader code from the external GLSL files
 	g_ShaderManager->LoadShaders(
-		"shaders/vertexShader.glsl",
+		"shaders/instancedVertexShader.glsl",
 		"shaders/fragmentShader.glsl");
+
+	// load the depth-only shaders for the depth pre-pass
+	g_DepthShaderManager = new ShaderManager();
+	g_DepthShaderManager->LoadShaders(
+		"shaders/depthVertexShader.glsl",
+		"shaders/depthFragmentShader.glsl");
+
 	g_ShaderManager->use();
 
+	// resolve the uniform locations of the loaded shaders once,
+	// so values are not looked up by name every frame
+	g_ShaderUniforms = new ShaderUniforms();
+	g_ShaderUniforms->ResolveUniforms(g_ShaderManager->m_programID);
+
+	// create the uniform buffers that the shader programs share
+	// for the camera and lighting values
+	g_UniformBuffers = new UniformBuffers();
+	g_UniformBuffers->CreateBuffers();
+	g_UniformBuffers->BindProgramBlocks(g_ShaderManager->m_programID);
+	g_UniformBuffers->BindProgramBlocks(g_DepthShaderManager->m_programID);
+	g_ViewManager->SetUniformBuffers(g_UniformBuffers);
+
 	// try to create a new scene manager object and prepare the 3D scene
-	g_SceneManager = new SceneManager(g_ShaderManager);
+	g_SceneManager = new SceneManager(g_ShaderManager, g_ShaderUniforms, g_UniformBuffers);
+	g_SceneManager->SetDepthShader(g_DepthShaderManager);
+
+	// the parts are drawn with shader variants built from the same
+	// sources, cached as program binaries next to the shaders
+	g_ShaderVariants = new ShaderVariants();
+	if (g_ShaderVariants->LoadSources(
+		"shaders/instancedVertexShader.glsl",
+		"shaders/fragmentShader.glsl",
+		"shaders"))
+	{
+		g_SceneManager->SetShaderVariants(g_ShaderVariants);
+	}
+	g_SceneManager->SetSceneReplicas(benchmarkSettings.replicas);
+	// load another scene description when one is passed with --scene
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--scene") == 0)
+		{
+			g_SceneManager->SetSceneFile(argv[i + 1]);
+		}
+	}
 	g_SceneManager->PrepareScene();
 
-	std::cout << "\n*** HOW TO LOOK AROUND: ***\n";
-	std::cout << "ESC - exit program\n";
-	std::cout << "Mouse - look around\t" << "Scroll Wheel - zoom in/out\n";
-	std::cout << "W - zoom in\t" << "S - zoom out\n";
-	std::cout << "A - pan left\t" << "D - pan right\n";
-	std::cout << "Q - pan up\t" << "E - pan down\n";
-	std::cout << "1 - front view (ortho)\n";
-	std::cout << "2 - side view (ortho)\n";
-	std::cout << "3 - top view (ortho)\n";
-	std::cout << "4 - perspective view\n";
+	// time the passes of every frame, writing them into a CSV
+	// file when one is passed with --profile-csv
+	g_Profiler = new FrameProfiler();
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--profile-csv") == 0)
+		{
+			g_Profiler->OpenCSV(argv[i + 1]);
+		}
+	}
+	int viewScope = g_Profiler->AddScope("view", true);
+	g_SceneManager->SetProfiler(g_Profiler);
+	int swapScope = g_Profiler->AddScope("swap", false);
+	double lastTitleTime = glfwGetTime();
+	char titleText[640];
+
+	// the allocations of the render thread are counted from
+	// here on, for the profiler to show
+	AllocationCounter::CountThread();
+
+	// the display window draws the view at a resolution that
+	// follows the frame time, aiming for the time passed with
+	// --target-ms, and upscales it to the window
+	int upscaleScope = -1;
+	long long lastScaledFrame = -1;
+	if (bBenchmark == false)
+	{
+		g_DynamicResolution = new DynamicResolution();
+		if (g_DynamicResolution->CreateResources(
+			"shaders/upscaleVertexShader.glsl",
+			"shaders/upscaleFragmentShader.glsl"))
+		{
+			for (int i = 1; i < argc - 1; i++)
+			{
+				if (strcmp(argv[i], "--target-ms") == 0)
+				{
+					g_DynamicResolution->SetTargetFrameTime(atof(argv[i + 1]));
+				}
+			}
+			upscaleScope = g_Profiler->AddScope("upscale", true);
+		}
+		else
+		{
+			delete g_DynamicResolution;
+			g_DynamicResolution = NULL;
+		}
+	}
+
+	if (bBenchmark)
+	{
+		// the results hold the replicas that were drawn
+		benchmarkSettings.replicas = g_SceneManager->GetSceneReplicas();
+		BenchmarkRunner* pBenchmark = new BenchmarkRunner(benchmarkSettings);
+		if (pBenchmark->CreateTarget())
+		{
+			RunBenchmark(pBenchmark, viewScope, swapScope);
+		}
+		// the interactive loop is skipped once the benchmark ran
+		delete pBenchmark;
+		glfwSetWindowShouldClose(g_Window, true);
+	}
+	else
+	{
+		std::cout << "\n*** HOW TO LOOK AROUND: ***\n";
+		std::cout << "ESC - exit program\n";
+		std::cout << "Mouse - look around\t" << "Scroll Wheel - zoom in/out\n";
+		std::cout << "W - zoom in\t" << "S - zoom out\n";
+		std::cout << "A - pan left\t" << "D - pan right\n";
+		std::cout << "Q - pan up\t" << "E - pan down\n";
+		std::cout << "1 - front view (ortho)\n";
+		std::cout << "2 - side view (ortho)\n";
+		std::cout << "3 - top view (ortho)\n";
+		std::cout << "4 - perspective view\n";
+		std::cout << "Z - toggle depth pre-pass\n";
+		std::cout << "R - toggle deferred rendering\n";
+		std::cout << "P - toggle profiler overlay\n";
+		std::cout << "V - toggle dynamic resolution\n";
+		std::cout << "O - toggle occlusion culling\n";
+
+		// the camera and the animations are updated at a fixed rate
+		// on the simulation thread from here on
+		g_FramePipeline = new FramePipeline(g_ViewManager, g_SceneManager->GetSceneAnimator());
+		g_SceneManager->SetSimulatedAnimation(true);
+		g_FramePipeline->Start();
+	}
 
 	// loop will keep running until the application is closed 
 	// or until an error has occurred
 	while (!glfwWindowShouldClose(g_Window))
 	{
+		// a minimized window has nothing to draw, so wait until it
+		// is restored
+		if (g_ViewManager->IsMinimized())
+		{
+			glfwWaitEvents();
+			continue;
+		}
+
+		g_Profiler->BeginFrame();
+
+		// draw the view into the scaled target, at the size the
+		// frame timings allow for
+		if (NULL != g_DynamicResolution)
+		{
+			g_DynamicResolution->SetEnabled(g_ViewManager->IsDynamicResolutionEnabled());
+			g_DynamicResolution->SetOutputSize(g_ViewManager->GetViewWidth(), g_ViewManager->GetViewHeight());
+			g_DynamicResolution->BindTarget();
+			g_ViewManager->SetRenderSize(
+				g_DynamicResolution->GetRenderWidth(),
+				g_DynamicResolution->GetRenderHeight());
+		}
+
 		// Enable z-depth
 		glEnable(GL_DEPTH_TEST);
 
@@ -107,31 +292,125 @@ int main(int argc, char* argv[])
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// convert from 3D object space to 2D view
-		g_ViewManager->PrepareSceneView();
+		// convert from 3D object space to 2D view, with the camera
+		// and the animated values of the newest simulation step
+		g_Profiler->BeginScope(viewScope);
+		if (g_FramePipeline->AcquireSnapshot())
+		{
+			g_SceneManager->SetAnimationChanges(&g_FramePipeline->GetSnapshot().changes);
+		}
+		g_ViewManager->ApplyViewState(g_FramePipeline->GetSnapshot().view);
+		g_Profiler->EndScope(viewScope);
+
+		// pass the camera view to the scene for ordering its parts
+		g_SceneManager->SetSceneView(
+			g_ViewManager->GetViewMatrix(),
+			g_ViewManager->GetProjectionMatrix(),
+			g_ViewManager->GetViewPosition());
 
 		// refresh the 3D scene
+		g_SceneManager->SetDepthPrePass(g_ViewManager->IsDepthPrePassEnabled());
+		g_SceneManager->SetRenderPath(g_ViewManager->IsDeferredEnabled() ?
+			SceneManager::RENDER_DEFERRED : SceneManager::RENDER_FORWARD);
+		g_SceneManager->SetOcclusionCulling(g_ViewManager->IsOcclusionCullingEnabled());
 		g_SceneManager->RenderScene();
 
+		// upscale the view to the window
+		if (NULL != g_DynamicResolution)
+		{
+			g_Profiler->BeginScope(upscaleScope);
+			g_DynamicResolution->DrawUpscale();
+			g_Profiler->EndScope(upscaleScope);
+		}
+
+		// draw the timings of the passes over the view
+		if (g_ViewManager->IsProfilerOverlayEnabled())
+		{
+			g_Profiler->DrawOverlay(g_ViewManager->GetViewWidth(), g_ViewManager->GetViewHeight());
+		}
+
+		// wait out the rest of the target frame time, so the frames
+		// stay evenly spaced
+		if (NULL != g_DynamicResolution)
+		{
+			g_DynamicResolution->PaceFrame();
+		}
 
 		// Flips the the back buffer with the front buffer every frame.
+		g_Profiler->BeginScope(swapScope);
 		glfwSwapBuffers(g_Window);
+		g_Profiler->EndScope(swapScope);
+		g_Profiler->EndFrame();
+
+		// move the scale once the GPU timings of another frame
+		// have been read back
+		if ((NULL != g_DynamicResolution) && (g_Profiler->GetLastFrameNumber() != lastScaledFrame))
+		{
+			lastScaledFrame = g_Profiler->GetLastFrameNumber();
+			g_DynamicResolution->UpdateScale(g_Profiler->GetLastFrameGPU());
+		}
+
+		// show the averaged timings in the window title
+		if (glfwGetTime() - lastTitleTime > g_TitleInterval)
+		{
+			snprintf(titleText, sizeof(titleText), "%s - %s", WINDOW_TITLE, g_Profiler->GetSummary());
+			glfwSetWindowTitle(g_Window, titleText);
+			lastTitleTime = glfwGetTime();
+		}
 
 		// query the latest GLFW events
 		glfwPollEvents();
 	}
 
+	// stop the simulation thread before the objects it updates
+	// are cleared
+	if (NULL != g_FramePipeline)
+	{
+		delete g_FramePipeline;
+		g_FramePipeline = NULL;
+	}
+
 	// clear the allocated manager objects from memory
+	if (NULL != g_DynamicResolution)
+	{
+		delete g_DynamicResolution;
+		g_DynamicResolution = NULL;
+	}
+	if (NULL != g_Profiler)
+	{
+		delete g_Profiler;
+		g_Profiler = NULL;
+	}
 	if (NULL != g_SceneManager)
 	{
 		delete g_SceneManager;
 		g_SceneManager = NULL;
 	}
+	if (NULL != g_ShaderVariants)
+	{
+		delete g_ShaderVariants;
+		g_ShaderVariants = NULL;
+	}
 	if (NULL != g_ViewManager)
 	{
 		delete g_ViewManager;
 		g_ViewManager = NULL;
 	}
+	if (NULL != g_UniformBuffers)
+	{
+		delete g_UniformBuffers;
+		g_UniformBuffers = NULL;
+	}
+	if (NULL != g_ShaderUniforms)
+	{
+		delete g_ShaderUniforms;
+		g_ShaderUniforms = NULL;
+	}
+	if (NULL != g_DepthShaderManager)
+	{
+		delete g_DepthShaderManager;
+		g_DepthShaderManager = NULL;
+	}
 	if (NULL != g_ShaderManager)
 	{
 		delete g_ShaderManager;
@@ -194,4 +473,82 @@ bool InitializeGLEW()
 	std::cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << "\n" << std::endl;
 
 	return(true);
-}
\ No newline at end of file
+}
+
+/***********************************************************
+ *	RunBenchmark()
+ *
+ *  This function is used to draw the warm-up and measured
+ *  frames of a benchmark run into the offscreen framebuffer,
+ *  with the camera on its scripted path, and to write the
+ *  results and the capture of the last frame once it is
+ *  read back.
+ ***********************************************************/
+void RunBenchmark(BenchmarkRunner* pBenchmark, int viewScope, int swapScope)
+{
+	const BenchmarkRunner::BENCHMARK_SETTINGS& settings = pBenchmark->GetSettings();
+	int totalFrames = settings.warmupFrames + settings.frames;
+
+	for (int frame = 0; frame < totalFrames; frame++)
+	{
+		// the warm-up frames stream in the textures and fill the
+		// caches, and are left out of the results
+		if (frame == settings.warmupFrames)
+		{
+			g_Profiler->Flush();
+			g_Profiler->ResetTotals();
+			// the measured frames are steady and allocate nothing
+			g_Profiler->SetAllocationCheck(true);
+		}
+
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		g_Profiler->BeginFrame();
+
+		pBenchmark->BindTarget();
+		glEnable(GL_DEPTH_TEST);
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// the warm-up frames sweep the whole path, so every view
+		// the measured frames draw was already drawn once
+		int pathFrame = frame - settings.warmupFrames;
+		if (pathFrame < 0)
+		{
+			pathFrame = frame * settings.frames / std::max(1, settings.warmupFrames);
+		}
+		g_Profiler->BeginScope(viewScope);
+		pBenchmark->PlaceCamera(g_ViewManager, pathFrame);
+		g_ViewManager->PrepareSceneView();
+		g_Profiler->EndScope(viewScope);
+
+		g_SceneManager->SetSceneView(
+			g_ViewManager->GetViewMatrix(),
+			g_ViewManager->GetProjectionMatrix(),
+			g_ViewManager->GetViewPosition());
+		g_SceneManager->SetDepthPrePass(g_ViewManager->IsDepthPrePassEnabled());
+		g_SceneManager->SetRenderPath(settings.bDeferred ?
+			SceneManager::RENDER_DEFERRED : SceneManager::RENDER_FORWARD);
+		g_SceneManager->SetOcclusionCulling(settings.bOcclusionCulling);
+		g_SceneManager->RenderScene();
+
+		// swapping the hidden window with vsync off keeps the CPU
+		// from running frames ahead of the GPU
+		g_Profiler->BeginScope(swapScope);
+		glfwSwapBuffers(g_Window);
+		g_Profiler->EndScope(swapScope);
+		g_Profiler->EndFrame();
+
+		if (frame >= settings.warmupFrames)
+		{
+			pBenchmark->RecordFrameTime(std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - frameStart).count());
+		}
+
+		glfwPollEvents();
+	}
+
+	pBenchmark->WriteCapture();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	g_Profiler->Flush();
+	pBenchmark->WriteResults(g_Profiler);
+}
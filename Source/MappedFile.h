@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.h
+// ============
+// map a file read-only into memory, so cooked data is used in place
+// without being read into a separate buffer
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+/***********************************************************
+ *  MappedFile
+ *
+ *  This class contains the code for mapping a whole file
+ *  into memory with the file mapping calls of the platform.
+ ***********************************************************/
+class MappedFile
+{
+public:
+	// constructor
+	MappedFile();
+	// destructor
+	~MappedFile();
+
+	// map the passed in file - returns false when the file
+	// cannot be opened or is empty
+	bool Open(const char* filename);
+	// unmap the file
+	void Close();
+
+	// contents of the mapped file
+	const unsigned char* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const unsigned char* m_pData;
+	size_t m_size;
+	// handles of the file and its mapping on Windows
+	void* m_fileHandle;
+	void* m_mappingHandle;
+
+	// a mapped file is not copied
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
@@ -0,0 +1,1227 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlibrary.cpp
+// ============
+// generate the basic 3D shape meshes into shared buffers and draw them with
+// hardware instancing and multi-draw-indirect
+//
+//	The meshes follow the same unit sizes and vertex layout as ShapeMeshes,
+//	so parts keep their transformations when drawn from this library.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshLibrary.h"
+#include "FrameProfiler.h"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// declaration of global variables and defines
+namespace
+{
+	// tessellation of the curved meshes at every level of detail -
+	// the sphere stacks stay even so the half sphere is a range
+	const int g_CylinderSlices[MESH_LOD_COUNT] = { 36, 16, 8 };
+	const int g_SphereStacks[MESH_LOD_COUNT] = { 18, 10, 6 };
+	const int g_SphereSectors[MESH_LOD_COUNT] = { 36, 16, 8 };
+	const int g_TorusMainSegments[MESH_LOD_COUNT] = { 36, 18, 10 };
+	const int g_TorusTubeSegments[MESH_LOD_COUNT] = { 18, 8, 6 };
+	const float g_TorusMainRadius = 1.0f;
+	const float g_TorusTubeRadius = 0.1f;
+
+	// vertex attribute locations used by the shaders
+	const GLuint g_PositionAttribute = 0;
+	const GLuint g_NormalAttribute = 1;
+	const GLuint g_TextureAttribute = 2;
+	const GLuint g_ModelAttribute = 3;		// uses locations 3 to 6
+	const GLuint g_ColorAttribute = 7;
+	const GLuint g_MaterialAttribute = 8;	// material index and texture slot
+	const GLuint g_UVscaleAttribute = 9;
+
+	typedef MeshLibrary::MESH_VERTEX MESH_VERTEX;
+
+	// library shared by the scenes, and the number of scenes
+	// holding it
+	MeshLibrary* g_pSharedLibrary = NULL;
+	int g_nLibraryReferences = 0;
+
+	/***********************************************************
+	 *  AddVertex()
+	 *
+	 *  Append one vertex and return its index.
+	 ***********************************************************/
+	GLuint AddVertex(
+		std::vector<MESH_VERTEX>& vertices,
+		glm::vec3 position,
+		glm::vec3 normal,
+		glm::vec2 textureCoordinate)
+	{
+		MESH_VERTEX vertex;
+		vertex.position = position;
+		vertex.normal = normal;
+		vertex.textureCoordinate = textureCoordinate;
+		vertices.push_back(vertex);
+
+		return((GLuint)vertices.size() - 1);
+	}
+
+	/***********************************************************
+	 *  AddTriangle()
+	 *
+	 *  Append a flat shaded triangle given counter-clockwise
+	 *  when seen from outside the mesh.
+	 ***********************************************************/
+	void AddTriangle(
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<GLuint>& indices,
+		glm::vec3 p0, glm::vec2 uv0,
+		glm::vec3 p1, glm::vec2 uv1,
+		glm::vec3 p2, glm::vec2 uv2)
+	{
+		glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+
+		indices.push_back(AddVertex(vertices, p0, normal, uv0));
+		indices.push_back(AddVertex(vertices, p1, normal, uv1));
+		indices.push_back(AddVertex(vertices, p2, normal, uv2));
+	}
+
+	/***********************************************************
+	 *  AddQuad()
+	 *
+	 *  Append a flat shaded quad given counter-clockwise
+	 *  when seen from outside the mesh, with the texture
+	 *  mapped over the whole face.
+	 ***********************************************************/
+	void AddQuad(
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<GLuint>& indices,
+		glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
+	{
+		glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+
+		GLuint i0 = AddVertex(vertices, p0, normal, glm::vec2(0.0f, 0.0f));
+		GLuint i1 = AddVertex(vertices, p1, normal, glm::vec2(1.0f, 0.0f));
+		GLuint i2 = AddVertex(vertices, p2, normal, glm::vec2(1.0f, 1.0f));
+		GLuint i3 = AddVertex(vertices, p3, normal, glm::vec2(0.0f, 1.0f));
+
+		indices.push_back(i0);
+		indices.push_back(i1);
+		indices.push_back(i2);
+		indices.push_back(i0);
+		indices.push_back(i2);
+		indices.push_back(i3);
+	}
+
+	/***********************************************************
+	 *  AddCap()
+	 *
+	 *  Append a flat disc of the passed in radius at the
+	 *  passed in height, facing up or down.
+	 ***********************************************************/
+	void AddCap(
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<GLuint>& indices,
+		float radius,
+		float height,
+		int slices,
+		bool bFacingUp)
+	{
+		glm::vec3 normal = glm::vec3(0.0f, bFacingUp ? 1.0f : -1.0f, 0.0f);
+		GLuint center = AddVertex(vertices, glm::vec3(0.0f, height, 0.0f), normal, glm::vec2(0.5f, 0.5f));
+		GLuint first = (GLuint)vertices.size();
+
+		for (int i = 0; i <= slices; i++)
+		{
+			float angle = glm::two_pi<float>() * (float)i / (float)slices;
+			float x = cos(angle);
+			float z = sin(angle);
+
+			AddVertex(
+				vertices,
+				glm::vec3(x * radius, height, z * radius),
+				normal,
+				glm::vec2(0.5f + 0.5f * x, 0.5f + 0.5f * z));
+		}
+
+		for (int i = 0; i < slices; i++)
+		{
+			indices.push_back(center);
+			if (bFacingUp)
+			{
+				indices.push_back(first + i + 1);
+				indices.push_back(first + i);
+			}
+			else
+			{
+				indices.push_back(first + i);
+				indices.push_back(first + i + 1);
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  BuildCylinder()
+	 *
+	 *  Generate a cylinder from height 0 to 1 with the passed
+	 *  in bottom and top radii and number of slices.  A top
+	 *  radius of 0 makes a cone.
+	 ***********************************************************/
+	void BuildCylinder(
+		float bottomRadius,
+		float topRadius,
+		int slices,
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<GLuint>& indices)
+	{
+		// sides
+		for (int i = 0; i <= slices; i++)
+		{
+			float u = (float)i / (float)slices;
+			float angle = glm::two_pi<float>() * u;
+			float x = cos(angle);
+			float z = sin(angle);
+			glm::vec3 normal = glm::normalize(glm::vec3(x, bottomRadius - topRadius, z));
+
+			AddVertex(vertices, glm::vec3(x * bottomRadius, 0.0f, z * bottomRadius), normal, glm::vec2(u, 0.0f));
+			AddVertex(vertices, glm::vec3(x * topRadius, 1.0f, z * topRadius), normal, glm::vec2(u, 1.0f));
+		}
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint bottom0 = i * 2;
+			GLuint top0 = bottom0 + 1;
+			GLuint bottom1 = bottom0 + 2;
+			GLuint top1 = bottom0 + 3;
+
+			indices.push_back(bottom0);
+			indices.push_back(top0);
+			indices.push_back(bottom1);
+			indices.push_back(bottom1);
+			indices.push_back(top0);
+			indices.push_back(top1);
+		}
+
+		// bottom and top
+		AddCap(vertices, indices, bottomRadius, 0.0f, slices, false);
+		if (topRadius > 0.0f)
+		{
+			AddCap(vertices, indices, topRadius, 1.0f, slices, true);
+		}
+	}
+
+	/***********************************************************
+	 *  BuildSphere()
+	 *
+	 *  Generate a sphere of radius 1 with the passed in number
+	 *  of stacks and sectors.  The stacks are generated from
+	 *  the top down, so the upper half sphere is the leading
+	 *  half of the indices.
+	 ***********************************************************/
+	void BuildSphere(
+		int stacks,
+		int sectors,
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<GLuint>& indices)
+	{
+		for (int stack = 0; stack <= stacks; stack++)
+		{
+			float v = (float)stack / (float)stacks;
+			float phi = glm::pi<float>() * v;
+
+			for (int sector = 0; sector <= sectors; sector++)
+			{
+				float u = (float)sector / (float)sectors;
+				float theta = glm::two_pi<float>() * u;
+				glm::vec3 position = glm::vec3(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));
+
+				AddVertex(vertices, position, position, glm::vec2(u, 1.0f - v));
+			}
+		}
+
+		for (int stack = 0; stack < stacks; stack++)
+		{
+			for (int sector = 0; sector < sectors; sector++)
+			{
+				GLuint upper = stack * (sectors + 1) + sector;
+				GLuint lower = upper + sectors + 1;
+
+				indices.push_back(upper);
+				indices.push_back(upper + 1);
+				indices.push_back(lower);
+				indices.push_back(upper + 1);
+				indices.push_back(lower + 1);
+				indices.push_back(lower);
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  BuildTorus()
+	 *
+	 *  Generate a torus around the Z axis with the passed in
+	 *  number of segments around the main ring and the tube.
+	 ***********************************************************/
+	void BuildTorus(
+		int mainSegments,
+		int tubeSegments,
+		std::vector<MESH_VERTEX>& vertices,
+		std::vector<GLuint>& indices)
+	{
+		for (int i = 0; i <= mainSegments; i++)
+		{
+			float u = (float)i / (float)mainSegments;
+			float mainAngle = glm::two_pi<float>() * u;
+
+			for (int j = 0; j <= tubeSegments; j++)
+			{
+				float v = (float)j / (float)tubeSegments;
+				float tubeAngle = glm::two_pi<float>() * v;
+				glm::vec3 normal = glm::vec3(
+					cos(tubeAngle) * cos(mainAngle),
+					cos(tubeAngle) * sin(mainAngle),
+					sin(tubeAngle));
+				glm::vec3 center = glm::vec3(cos(mainAngle), sin(mainAngle), 0.0f) * g_TorusMainRadius;
+
+				AddVertex(vertices, center + normal * g_TorusTubeRadius, normal, glm::vec2(u, v));
+			}
+		}
+
+		for (int i = 0; i < mainSegments; i++)
+		{
+			for (int j = 0; j < tubeSegments; j++)
+			{
+				GLuint current = i * (tubeSegments + 1) + j;
+				GLuint next = current + tubeSegments + 1;
+
+				indices.push_back(current);
+				indices.push_back(next);
+				indices.push_back(current + 1);
+				indices.push_back(current + 1);
+				indices.push_back(next);
+				indices.push_back(next + 1);
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  Acquire()
+ *
+ *  This method is used for getting the mesh library shared
+ *  by every scene, so the scenes and viewports draw from the
+ *  same buffers and a mesh is only generated once.  Every
+ *  call must be paired with a call to Release().
+ ***********************************************************/
+MeshLibrary* MeshLibrary::Acquire()
+{
+	if (NULL == g_pSharedLibrary)
+	{
+		g_pSharedLibrary = new MeshLibrary();
+	}
+	g_nLibraryReferences++;
+
+	return(g_pSharedLibrary);
+}
+
+/***********************************************************
+ *  Release()
+ *
+ *  This method is used for giving back the shared mesh
+ *  library.  The library and its buffers are freed when the
+ *  last scene holding it gives it back, which must happen
+ *  while the context is still current.
+ ***********************************************************/
+void MeshLibrary::Release(MeshLibrary* pLibrary)
+{
+	if ((NULL == pLibrary) || (pLibrary != g_pSharedLibrary))
+	{
+		return;
+	}
+
+	g_nLibraryReferences--;
+	if (g_nLibraryReferences <= 0)
+	{
+		delete g_pSharedLibrary;
+		g_pSharedLibrary = NULL;
+		g_nLibraryReferences = 0;
+	}
+}
+
+/***********************************************************
+ *  MeshLibrary()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MeshLibrary::MeshLibrary()
+{
+	for (int i = 0; i < MESH_COUNT; i++)
+	{
+		for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+		{
+			m_meshRanges[i][lod].firstIndex = 0;
+			m_meshRanges[i][lod].nIndices = 0;
+			m_meshRanges[i][lod].baseVertex = 0;
+			m_meshRanges[i][lod].boundsMin = glm::vec3(0.0f);
+			m_meshRanges[i][lod].boundsMax = glm::vec3(0.0f);
+		}
+		m_lodCounts[i] = 1;
+	}
+
+	m_vao = 0;
+	m_vertexBuffer = 0;
+	m_indexBuffer = 0;
+	m_bMeshesChanged = false;
+	m_instanceBuffer = 0;
+	m_instanceCapacity = 0;
+	m_commandBuffer = 0;
+	m_commandCapacity = 0;
+	m_instanceSource = 0;
+	m_instanceOffset = 0;
+	m_commandSource = 0;
+	m_commandOffset = 0;
+	m_bBaseInstance = false;
+	m_bMultiDrawIndirect = false;
+}
+
+/***********************************************************
+ *  ~MeshLibrary()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MeshLibrary::~MeshLibrary()
+{
+	if (0 != m_vao)
+	{
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(1, &m_vertexBuffer);
+		glDeleteBuffers(1, &m_indexBuffer);
+		glDeleteBuffers(1, &m_instanceBuffer);
+		glDeleteBuffers(1, &m_commandBuffer);
+		m_vao = 0;
+		m_vertexBuffer = 0;
+		m_indexBuffer = 0;
+		m_instanceBuffer = 0;
+		m_commandBuffer = 0;
+	}
+}
+
+/***********************************************************
+ *  CreateBuffers()
+ *
+ *  This method is used for creating the vertex array and
+ *  the buffers that all the meshes share.  The instance
+ *  buffer is attached to the same vertex array, so any mesh
+ *  can be drawn many times with one draw command.
+ ***********************************************************/
+void MeshLibrary::CreateBuffers()
+{
+	// the features are checked here, once a context is current
+	m_bBaseInstance = (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+	m_bMultiDrawIndirect = m_bBaseInstance &&
+		(GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect);
+
+	glGenVertexArrays(1, &m_vao);
+	glGenBuffers(1, &m_vertexBuffer);
+	glGenBuffers(1, &m_indexBuffer);
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_commandBuffer);
+	m_instanceSource = m_instanceBuffer;
+	m_commandSource = m_commandBuffer;
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+	// per-vertex attributes
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	glEnableVertexAttribArray(g_PositionAttribute);
+	glVertexAttribPointer(g_PositionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(MESH_VERTEX),
+		(void*)offsetof(MESH_VERTEX, position));
+	glEnableVertexAttribArray(g_NormalAttribute);
+	glVertexAttribPointer(g_NormalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(MESH_VERTEX),
+		(void*)offsetof(MESH_VERTEX, normal));
+	glEnableVertexAttribArray(g_TextureAttribute);
+	glVertexAttribPointer(g_TextureAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(MESH_VERTEX),
+		(void*)offsetof(MESH_VERTEX, textureCoordinate));
+
+	// per-instance attributes
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(g_ModelAttribute + i);
+		glVertexAttribDivisor(g_ModelAttribute + i, 1);
+	}
+	glEnableVertexAttribArray(g_ColorAttribute);
+	glVertexAttribDivisor(g_ColorAttribute, 1);
+	glEnableVertexAttribArray(g_MaterialAttribute);
+	glVertexAttribDivisor(g_MaterialAttribute, 1);
+	glEnableVertexAttribArray(g_UVscaleAttribute);
+	glVertexAttribDivisor(g_UVscaleAttribute, 1);
+	SetInstanceAttributes(0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  UploadMeshes()
+ *
+ *  This method is used for writing the generated data of
+ *  all the meshes into the shared vertex and index buffers.
+ ***********************************************************/
+void MeshLibrary::UploadMeshes()
+{
+	if (0 == m_vao)
+	{
+		CreateBuffers();
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(MESH_VERTEX), m_vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// the index buffer binding is part of the vertex array
+	glBindVertexArray(m_vao);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLuint), m_indices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+
+	m_bMeshesChanged = false;
+}
+
+/***********************************************************
+ *  AddMesh()
+ *
+ *  This method is used for appending generated mesh data to
+ *  the data shared by all the meshes.  The mesh indices stay
+ *  relative to the first vertex of the mesh.
+ ***********************************************************/
+MeshLibrary::MESH_RANGE MeshLibrary::AddMesh(
+	const std::vector<MESH_VERTEX>& vertices,
+	const std::vector<GLuint>& indices)
+{
+	MESH_RANGE meshRange;
+	meshRange.firstIndex = (GLuint)m_indices.size();
+	meshRange.nIndices = (GLuint)indices.size();
+	meshRange.baseVertex = (GLint)m_vertices.size();
+
+	m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+	m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+	m_bMeshesChanged = true;
+
+	return(meshRange);
+}
+
+/***********************************************************
+ *  SetInstanceAttributes()
+ *
+ *  This method is used for pointing the instance attributes
+ *  of the bound vertex array at the passed in instance.
+ ***********************************************************/
+void MeshLibrary::SetInstanceAttributes(int firstInstance)
+{
+	const GLsizei stride = sizeof(INSTANCE_DATA);
+	const char* base = (const char*)NULL + m_instanceOffset + firstInstance * stride;
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceSource);
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(g_ModelAttribute + i, 4, GL_FLOAT, GL_FALSE, stride,
+			base + offsetof(INSTANCE_DATA, model) + i * sizeof(glm::vec4));
+	}
+	glVertexAttribPointer(g_ColorAttribute, 4, GL_FLOAT, GL_FALSE, stride,
+		base + offsetof(INSTANCE_DATA, color));
+	// the material index and texture slot are read together
+	glVertexAttribIPointer(g_MaterialAttribute, 2, GL_INT, stride,
+		base + offsetof(INSTANCE_DATA, materialIndex));
+	glVertexAttribPointer(g_UVscaleAttribute, 2, GL_FLOAT, GL_FALSE, stride,
+		base + offsetof(INSTANCE_DATA, UVscale));
+}
+
+/***********************************************************
+ *  SetMeshRange()
+ *
+ *  This method is used for setting the drawn range of a
+ *  mesh type at a level of detail to the leading indices of
+ *  an added mesh, and finding the bounding box of the range.
+ *  The full detail fills every level, so the meshes that are
+ *  generated once draw the same at any level.
+ ***********************************************************/
+void MeshLibrary::SetMeshRange(MESH_TYPE type, int lod, const MESH_RANGE& meshRange, GLuint nIndices)
+{
+	MESH_RANGE& range = m_meshRanges[type][lod];
+	range = meshRange;
+	range.nIndices = nIndices;
+
+	// bound only the vertices that the range draws, so the half
+	// sphere gets a box around the upper half
+	range.boundsMin = glm::vec3(FLT_MAX);
+	range.boundsMax = glm::vec3(-FLT_MAX);
+	for (GLuint i = range.firstIndex; i < range.firstIndex + nIndices; i++)
+	{
+		const glm::vec3& position = m_vertices[range.baseVertex + m_indices[i]].position;
+		range.boundsMin = glm::min(range.boundsMin, position);
+		range.boundsMax = glm::max(range.boundsMax, position);
+	}
+
+	if (0 == lod)
+	{
+		for (int i = 1; i < MESH_LOD_COUNT; i++)
+		{
+			m_meshRanges[type][i] = range;
+		}
+		m_lodCounts[type] = 1;
+	}
+	else
+	{
+		m_lodCounts[type] = std::max(m_lodCounts[type], lod + 1);
+	}
+}
+
+/***********************************************************
+ *  LoadMesh()
+ *
+ *  This method is used for generating the mesh of the passed
+ *  in type on its first use.  The box and half sphere
+ *  variants are ranges of other meshes, so those meshes are
+ *  generated for them.
+ ***********************************************************/
+void MeshLibrary::LoadMesh(MESH_TYPE mesh)
+{
+	switch (mesh)
+	{
+	case MESH_BOX:
+	case MESH_BOX_OPEN_TOP:
+	case MESH_BOX_SIDES:
+		LoadBoxMesh();
+		break;
+	case MESH_PLANE:
+		LoadPlaneMesh();
+		break;
+	case MESH_CYLINDER:
+		LoadCylinderMesh();
+		break;
+	case MESH_TAPERED_CYLINDER:
+		LoadTaperedCylinderMesh();
+		break;
+	case MESH_CONE:
+		LoadConeMesh();
+		break;
+	case MESH_SPHERE:
+	case MESH_HALF_SPHERE:
+		LoadSphereMesh();
+		break;
+	case MESH_TORUS:
+		LoadTorusMesh();
+		break;
+	case MESH_PYRAMID4:
+		LoadPyramid4Mesh();
+		break;
+	case MESH_PRISM:
+		LoadPrismMesh();
+		break;
+	default:
+		break;
+	}
+}
+
+/***********************************************************
+ *  LoadBoxMesh()
+ *
+ *  This method is used for generating a unit box centered
+ *  on the origin.  The faces are ordered so the box without
+ *  its top, and the box with only its four sides, are the
+ *  leading ranges of the indices.
+ ***********************************************************/
+void MeshLibrary::LoadBoxMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_BOX))
+	{
+		return;
+	}
+
+	std::vector<MESH_VERTEX> vertices;
+	std::vector<GLuint> indices;
+
+	// front
+	AddQuad(vertices, indices,
+		glm::vec3(-0.5f, -0.5f, 0.5f), glm::vec3(0.5f, -0.5f, 0.5f),
+		glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(-0.5f, 0.5f, 0.5f));
+	// back
+	AddQuad(vertices, indices,
+		glm::vec3(0.5f, -0.5f, -0.5f), glm::vec3(-0.5f, -0.5f, -0.5f),
+		glm::vec3(-0.5f, 0.5f, -0.5f), glm::vec3(0.5f, 0.5f, -0.5f));
+	// left
+	AddQuad(vertices, indices,
+		glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(-0.5f, -0.5f, 0.5f),
+		glm::vec3(-0.5f, 0.5f, 0.5f), glm::vec3(-0.5f, 0.5f, -0.5f));
+	// right
+	AddQuad(vertices, indices,
+		glm::vec3(0.5f, -0.5f, 0.5f), glm::vec3(0.5f, -0.5f, -0.5f),
+		glm::vec3(0.5f, 0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f));
+	// bottom
+	AddQuad(vertices, indices,
+		glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, -0.5f, -0.5f),
+		glm::vec3(0.5f, -0.5f, 0.5f), glm::vec3(-0.5f, -0.5f, 0.5f));
+	// top
+	AddQuad(vertices, indices,
+		glm::vec3(-0.5f, 0.5f, 0.5f), glm::vec3(0.5f, 0.5f, 0.5f),
+		glm::vec3(0.5f, 0.5f, -0.5f), glm::vec3(-0.5f, 0.5f, -0.5f));
+
+	MESH_RANGE meshRange = AddMesh(vertices, indices);
+
+	// every face is two triangles
+	SetMeshRange(MESH_BOX, 0, meshRange, 36);
+	SetMeshRange(MESH_BOX_OPEN_TOP, 0, meshRange, 30);
+	SetMeshRange(MESH_BOX_SIDES, 0, meshRange, 24);
+}
+
+/***********************************************************
+ *  LoadPlaneMesh()
+ *
+ *  This method is used for generating a 2x2 plane on the
+ *  XZ axes facing up.
+ ***********************************************************/
+void MeshLibrary::LoadPlaneMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_PLANE))
+	{
+		return;
+	}
+
+	std::vector<MESH_VERTEX> vertices;
+	std::vector<GLuint> indices;
+
+	AddQuad(vertices, indices,
+		glm::vec3(-1.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 1.0f),
+		glm::vec3(1.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, -1.0f));
+
+	MESH_RANGE meshRange = AddMesh(vertices, indices);
+	SetMeshRange(MESH_PLANE, 0, meshRange, meshRange.nIndices);
+}
+
+/***********************************************************
+ *  LoadCylinderMesh()
+ *
+ *  This method is used for generating a cylinder of radius
+ *  1 from height 0 to 1, at every level of detail.
+ ***********************************************************/
+void MeshLibrary::LoadCylinderMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_CYLINDER))
+	{
+		return;
+	}
+
+	for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+	{
+		std::vector<MESH_VERTEX> vertices;
+		std::vector<GLuint> indices;
+
+		BuildCylinder(1.0f, 1.0f, g_CylinderSlices[lod], vertices, indices);
+
+		MESH_RANGE meshRange = AddMesh(vertices, indices);
+		SetMeshRange(MESH_CYLINDER, lod, meshRange, meshRange.nIndices);
+	}
+}
+
+/***********************************************************
+ *  LoadTaperedCylinderMesh()
+ *
+ *  This method is used for generating a cylinder of bottom
+ *  radius 1 and top radius 0.5 from height 0 to 1, at
+ *  every level of detail.
+ ***********************************************************/
+void MeshLibrary::LoadTaperedCylinderMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_TAPERED_CYLINDER))
+	{
+		return;
+	}
+
+	for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+	{
+		std::vector<MESH_VERTEX> vertices;
+		std::vector<GLuint> indices;
+
+		BuildCylinder(1.0f, 0.5f, g_CylinderSlices[lod], vertices, indices);
+
+		MESH_RANGE meshRange = AddMesh(vertices, indices);
+		SetMeshRange(MESH_TAPERED_CYLINDER, lod, meshRange, meshRange.nIndices);
+	}
+}
+
+/***********************************************************
+ *  LoadConeMesh()
+ *
+ *  This method is used for generating a cone of radius 1
+ *  with its point at height 1, at every level of detail.
+ ***********************************************************/
+void MeshLibrary::LoadConeMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_CONE))
+	{
+		return;
+	}
+
+	for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+	{
+		std::vector<MESH_VERTEX> vertices;
+		std::vector<GLuint> indices;
+
+		BuildCylinder(1.0f, 0.0f, g_CylinderSlices[lod], vertices, indices);
+
+		MESH_RANGE meshRange = AddMesh(vertices, indices);
+		SetMeshRange(MESH_CONE, lod, meshRange, meshRange.nIndices);
+	}
+}
+
+/***********************************************************
+ *  LoadSphereMesh()
+ *
+ *  This method is used for generating a sphere of radius 1
+ *  centered on the origin at every level of detail, with
+ *  the upper half sphere drawn from the same indices.
+ ***********************************************************/
+void MeshLibrary::LoadSphereMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_SPHERE))
+	{
+		return;
+	}
+
+	for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+	{
+		std::vector<MESH_VERTEX> vertices;
+		std::vector<GLuint> indices;
+
+		BuildSphere(g_SphereStacks[lod], g_SphereSectors[lod], vertices, indices);
+
+		MESH_RANGE meshRange = AddMesh(vertices, indices);
+		SetMeshRange(MESH_SPHERE, lod, meshRange, meshRange.nIndices);
+		SetMeshRange(MESH_HALF_SPHERE, lod, meshRange, meshRange.nIndices / 2);
+	}
+}
+
+/***********************************************************
+ *  LoadTorusMesh()
+ *
+ *  This method is used for generating a torus of radius 1
+ *  around the Z axis, at every level of detail.
+ ***********************************************************/
+void MeshLibrary::LoadTorusMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_TORUS))
+	{
+		return;
+	}
+
+	for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+	{
+		std::vector<MESH_VERTEX> vertices;
+		std::vector<GLuint> indices;
+
+		BuildTorus(g_TorusMainSegments[lod], g_TorusTubeSegments[lod], vertices, indices);
+
+		MESH_RANGE meshRange = AddMesh(vertices, indices);
+		SetMeshRange(MESH_TORUS, lod, meshRange, meshRange.nIndices);
+	}
+}
+
+/***********************************************************
+ *  LoadPyramid4Mesh()
+ *
+ *  This method is used for generating a unit four sided
+ *  pyramid centered on the origin.
+ ***********************************************************/
+void MeshLibrary::LoadPyramid4Mesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_PYRAMID4))
+	{
+		return;
+	}
+
+	std::vector<MESH_VERTEX> vertices;
+	std::vector<GLuint> indices;
+
+	glm::vec3 top = glm::vec3(0.0f, 0.5f, 0.0f);
+	glm::vec3 frontLeft = glm::vec3(-0.5f, -0.5f, 0.5f);
+	glm::vec3 frontRight = glm::vec3(0.5f, -0.5f, 0.5f);
+	glm::vec3 backRight = glm::vec3(0.5f, -0.5f, -0.5f);
+	glm::vec3 backLeft = glm::vec3(-0.5f, -0.5f, -0.5f);
+	glm::vec2 uvLeft = glm::vec2(0.0f, 0.0f);
+	glm::vec2 uvRight = glm::vec2(1.0f, 0.0f);
+	glm::vec2 uvTop = glm::vec2(0.5f, 1.0f);
+
+	AddTriangle(vertices, indices, frontLeft, uvLeft, frontRight, uvRight, top, uvTop);
+	AddTriangle(vertices, indices, frontRight, uvLeft, backRight, uvRight, top, uvTop);
+	AddTriangle(vertices, indices, backRight, uvLeft, backLeft, uvRight, top, uvTop);
+	AddTriangle(vertices, indices, backLeft, uvLeft, frontLeft, uvRight, top, uvTop);
+	AddQuad(vertices, indices, backLeft, backRight, frontRight, frontLeft);
+
+	MESH_RANGE meshRange = AddMesh(vertices, indices);
+	SetMeshRange(MESH_PYRAMID4, 0, meshRange, meshRange.nIndices);
+}
+
+/***********************************************************
+ *  LoadPrismMesh()
+ *
+ *  This method is used for generating a unit triangular
+ *  prism centered on the origin, extruded along the Z axis.
+ ***********************************************************/
+void MeshLibrary::LoadPrismMesh()
+{
+	// the mesh is shared by every part drawn with it
+	if (IsMeshLoaded(MESH_PRISM))
+	{
+		return;
+	}
+
+	std::vector<MESH_VERTEX> vertices;
+	std::vector<GLuint> indices;
+
+	glm::vec3 frontLeft = glm::vec3(-0.5f, -0.5f, 0.5f);
+	glm::vec3 frontRight = glm::vec3(0.5f, -0.5f, 0.5f);
+	glm::vec3 frontTop = glm::vec3(0.0f, 0.5f, 0.5f);
+	glm::vec3 backLeft = glm::vec3(-0.5f, -0.5f, -0.5f);
+	glm::vec3 backRight = glm::vec3(0.5f, -0.5f, -0.5f);
+	glm::vec3 backTop = glm::vec3(0.0f, 0.5f, -0.5f);
+
+	AddTriangle(vertices, indices,
+		frontLeft, glm::vec2(0.0f, 0.0f), frontRight, glm::vec2(1.0f, 0.0f), frontTop, glm::vec2(0.5f, 1.0f));
+	AddTriangle(vertices, indices,
+		backRight, glm::vec2(0.0f, 0.0f), backLeft, glm::vec2(1.0f, 0.0f), backTop, glm::vec2(0.5f, 1.0f));
+	AddQuad(vertices, indices, backLeft, backRight, frontRight, frontLeft);
+	AddQuad(vertices, indices, frontRight, backRight, backTop, frontTop);
+	AddQuad(vertices, indices, backLeft, frontLeft, frontTop, backTop);
+
+	MESH_RANGE meshRange = AddMesh(vertices, indices);
+	SetMeshRange(MESH_PRISM, 0, meshRange, meshRange.nIndices);
+}
+
+/***********************************************************
+ *  PrepareDraw()
+ *
+ *  This method is used for writing any newly generated mesh
+ *  data and binding the shared vertex array before drawing.
+ ***********************************************************/
+bool MeshLibrary::PrepareDraw()
+{
+	if (m_bMeshesChanged)
+	{
+		UploadMeshes();
+	}
+	if (0 == m_vao)
+	{
+		return(false);
+	}
+
+	glBindVertexArray(m_vao);
+	return(true);
+}
+
+/***********************************************************
+ *  UpdateInstanceData()
+ *
+ *  This method is used for copying the per-instance values
+ *  of the next draws into a range of the stream buffer of
+ *  the drawing scene, or into the instance buffer when the
+ *  stream buffer has no room.  The instance attributes are pointed at wherever
+ *  the values went.  The instance buffer only grows, so a
+ *  steady scene does not reallocate it.
+ ***********************************************************/
+void MeshLibrary::UpdateInstanceData(const INSTANCE_DATA* pInstances, int count, StreamBuffer* pStreamBuffer)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	if (0 == m_vao)
+	{
+		CreateBuffers();
+	}
+
+	StreamBuffer::STREAM_RANGE range;
+	if ((NULL != pStreamBuffer) && pStreamBuffer->Allocate(count * sizeof(INSTANCE_DATA), range))
+	{
+		memcpy(range.pData, pInstances, count * sizeof(INSTANCE_DATA));
+		m_instanceSource = pStreamBuffer->GetBuffer();
+		m_instanceOffset = range.offset;
+	}
+	else
+	{
+		WriteInstanceBuffer(pInstances, count);
+		m_instanceSource = m_instanceBuffer;
+		m_instanceOffset = 0;
+	}
+
+	glBindVertexArray(m_vao);
+	SetInstanceAttributes(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  WriteInstanceBuffer()
+ *
+ *  This method is used for copying the per-instance values
+ *  into the own instance buffer, growing it when they do
+ *  not fit.
+ ***********************************************************/
+void MeshLibrary::WriteInstanceBuffer(const INSTANCE_DATA* pInstances, int count)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+	if (count > m_instanceCapacity)
+	{
+		m_instanceCapacity = count;
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(INSTANCE_DATA), pInstances, GL_DYNAMIC_DRAW);
+	}
+	else
+	{
+		// orphan the previous contents so the driver does not
+		// wait for draws still reading them
+		glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity * sizeof(INSTANCE_DATA), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(INSTANCE_DATA), pInstances);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  GetDrawCommand()
+ *
+ *  This method is used for getting the indirect draw command
+ *  for a range of the instance buffer with a mesh at a level
+ *  of detail.  Levels past the generated ones draw the
+ *  coarsest level.
+ ***********************************************************/
+MeshLibrary::DRAW_COMMAND MeshLibrary::GetDrawCommand(MESH_TYPE mesh, int lod, int count, int firstInstance) const
+{
+	lod = std::min(std::max(lod, 0), m_lodCounts[mesh] - 1);
+	const MESH_RANGE& range = m_meshRanges[mesh][lod];
+
+	DRAW_COMMAND command;
+	command.count = range.nIndices;
+	// meshes that were never loaded draw nothing
+	command.instanceCount = (range.nIndices > 0) ? (GLuint)count : 0;
+	command.firstIndex = range.firstIndex;
+	command.baseVertex = range.baseVertex;
+	command.baseInstance = (GLuint)firstInstance;
+
+	return(command);
+}
+
+/***********************************************************
+ *  UpdateDrawCommands()
+ *
+ *  This method is used for copying the draw commands of the
+ *  next draws into a range of the stream buffer of the
+ *  drawing scene, or into the command buffer when the stream buffer has no room.
+ ***********************************************************/
+void MeshLibrary::UpdateDrawCommands(const DRAW_COMMAND* pCommands, int count, StreamBuffer* pStreamBuffer)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	if (0 == m_vao)
+	{
+		CreateBuffers();
+	}
+
+	// the commands are drawn one at a time from memory without
+	// multi-draw-indirect, and are counted by the profiler
+	m_commands.assign(pCommands, pCommands + count);
+	if (m_bMultiDrawIndirect == false)
+	{
+		return;
+	}
+
+	StreamBuffer::STREAM_RANGE range;
+	if ((NULL != pStreamBuffer) && pStreamBuffer->Allocate(count * sizeof(DRAW_COMMAND), range))
+	{
+		memcpy(range.pData, pCommands, count * sizeof(DRAW_COMMAND));
+		m_commandSource = pStreamBuffer->GetBuffer();
+		m_commandOffset = range.offset;
+		return;
+	}
+	m_commandSource = m_commandBuffer;
+	m_commandOffset = 0;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	if (count > m_commandCapacity)
+	{
+		m_commandCapacity = count;
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, count * sizeof(DRAW_COMMAND), pCommands, GL_DYNAMIC_DRAW);
+	}
+	else
+	{
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commandCapacity * sizeof(DRAW_COMMAND), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, count * sizeof(DRAW_COMMAND), pCommands);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+/***********************************************************
+ *  GetDrawSources()
+ *
+ *  This method is used for getting the buffers and offsets
+ *  the instances and the commands of the frame were written
+ *  to, either the own buffers or ranges of the stream
+ *  buffer.
+ ***********************************************************/
+void MeshLibrary::GetDrawSources(GLuint& instanceBuffer, GLintptr& instanceOffset,
+	GLuint& commandBuffer, GLintptr& commandOffset) const
+{
+	instanceBuffer = m_instanceSource;
+	instanceOffset = m_instanceOffset;
+	commandBuffer = m_commandSource;
+	commandOffset = m_commandOffset;
+}
+
+/***********************************************************
+ *  SetDrawSources()
+ *
+ *  This method is used for drawing from instances and
+ *  commands that were written into other buffers on the GPU,
+ *  laid out the same as the ones of the last update.  The
+ *  commands count the same on the CPU, since their instance
+ *  counts are never read back.
+ ***********************************************************/
+void MeshLibrary::SetDrawSources(GLuint instanceBuffer, GLintptr instanceOffset,
+	GLuint commandBuffer, GLintptr commandOffset)
+{
+	if (0 == m_vao)
+	{
+		return;
+	}
+
+	m_instanceSource = instanceBuffer;
+	m_instanceOffset = instanceOffset;
+	m_commandSource = commandBuffer;
+	m_commandOffset = commandOffset;
+
+	glBindVertexArray(m_vao);
+	SetInstanceAttributes(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  DrawCommands()
+ *
+ *  This method is used for submitting a range of the draw
+ *  commands.  With multi-draw-indirect the whole range is a
+ *  single call that reads the commands from the GPU buffer,
+ *  otherwise every command is drawn on its own.
+ ***********************************************************/
+void MeshLibrary::DrawCommands(int firstCommand, int count)
+{
+	if ((count <= 0) || (PrepareDraw() == false))
+	{
+		return;
+	}
+
+	if (m_bMultiDrawIndirect)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandSource);
+		glMultiDrawElementsIndirect(
+			GL_TRIANGLES,
+			GL_UNSIGNED_INT,
+			(const char*)NULL + m_commandOffset + firstCommand * sizeof(DRAW_COMMAND),
+			count,
+			0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		long long triangles = 0;
+		for (int i = firstCommand; (i < firstCommand + count) && (i < (int)m_commands.size()); i++)
+		{
+			triangles += (long long)(m_commands[i].count / 3) * m_commands[i].instanceCount;
+		}
+		FrameProfiler::CountDrawCall(triangles);
+		return;
+	}
+
+	for (int i = firstCommand; (i < firstCommand + count) && (i < (int)m_commands.size()); i++)
+	{
+		const DRAW_COMMAND& command = m_commands[i];
+		const void* indexOffset = (const char*)NULL + command.firstIndex * sizeof(GLuint);
+
+		if (m_bBaseInstance)
+		{
+			glDrawElementsInstancedBaseVertexBaseInstance(
+				GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indexOffset,
+				command.instanceCount, command.baseVertex, command.baseInstance);
+		}
+		else
+		{
+			// without base instances the attributes themselves are
+			// offset to the first instance
+			SetInstanceAttributes(command.baseInstance);
+			glDrawElementsInstancedBaseVertex(
+				GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indexOffset,
+				command.instanceCount, command.baseVertex);
+		}
+		FrameProfiler::CountDrawCall((long long)(command.count / 3) * command.instanceCount);
+	}
+}
+
+/***********************************************************
+ *  DrawMeshInstanced()
+ *
+ *  This method is used for drawing a range of the instance
+ *  buffer with the passed in mesh in one draw command.
+ ***********************************************************/
+void MeshLibrary::DrawMeshInstanced(MESH_TYPE mesh, int count, int firstInstance)
+{
+	const MESH_RANGE& range = m_meshRanges[mesh][0];
+
+	// do nothing for meshes that were never loaded
+	if ((0 == range.nIndices) || (count <= 0) || (PrepareDraw() == false))
+	{
+		return;
+	}
+
+	const void* indexOffset = (const char*)NULL + range.firstIndex * sizeof(GLuint);
+	if (m_bBaseInstance)
+	{
+		glDrawElementsInstancedBaseVertexBaseInstance(
+			GL_TRIANGLES, range.nIndices, GL_UNSIGNED_INT, indexOffset,
+			count, range.baseVertex, firstInstance);
+	}
+	else
+	{
+		SetInstanceAttributes(firstInstance);
+		glDrawElementsInstancedBaseVertex(
+			GL_TRIANGLES, range.nIndices, GL_UNSIGNED_INT, indexOffset,
+			count, range.baseVertex);
+	}
+	FrameProfiler::CountDrawCall((long long)(range.nIndices / 3) * count);
+}
+
+/***********************************************************
+ *  GetMeshBounds()
+ *
+ *  This method is used for getting the bounding box of a
+ *  loaded mesh in its object space, at the full detail that
+ *  holds the coarser levels.  Meshes that were never loaded
+ *  get an empty box at the origin.
+ ***********************************************************/
+void MeshLibrary::GetMeshBounds(MESH_TYPE mesh, glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+	const MESH_RANGE& range = m_meshRanges[mesh][0];
+
+	if (0 == range.nIndices)
+	{
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+		return;
+	}
+
+	boundsMin = range.boundsMin;
+	boundsMax = range.boundsMax;
+}
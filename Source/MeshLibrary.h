@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlibrary.h
+// ============
+// generate the basic 3D shape meshes into shared buffers and draw them with
+// hardware instancing and multi-draw-indirect
+//
+//	The meshes follow the same unit sizes and vertex layout as ShapeMeshes,
+//	so parts keep their transformations when drawn from this library.  One
+//	library is shared by every scene through Acquire() and Release(), and a
+//	mesh is only generated the first time a part uses it.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "StreamBuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// levels of detail the curved meshes are generated at, from the
+// full tessellation down
+#define MESH_LOD_COUNT 3
+
+/***********************************************************
+ *  MeshLibrary
+ *
+ *  This class contains the code for generating the basic
+ *  3D shape meshes into one shared vertex and index buffer,
+ *  and drawing many parts with instanced and indirect draw
+ *  commands.
+ ***********************************************************/
+class MeshLibrary
+{
+public:
+	// get the library shared by every scene, created by the first
+	// scene that asks for it
+	static MeshLibrary* Acquire();
+	// give back the shared library - it is freed with its buffers
+	// once the last scene gives it back
+	static void Release(MeshLibrary* pLibrary);
+
+	// meshes that can be drawn - the box and half sphere
+	// variants are ranges of the box and sphere meshes
+	enum MESH_TYPE
+	{
+		MESH_BOX,
+		MESH_BOX_OPEN_TOP,
+		MESH_BOX_SIDES,
+		MESH_PLANE,
+		MESH_CYLINDER,
+		MESH_TAPERED_CYLINDER,
+		MESH_CONE,
+		MESH_SPHERE,
+		MESH_HALF_SPHERE,
+		MESH_TORUS,
+		MESH_PYRAMID4,
+		MESH_PRISM,
+		MESH_COUNT
+	};
+
+	// vertex layout shared with ShapeMeshes
+	struct MESH_VERTEX
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 textureCoordinate;
+	};
+
+	// per-instance values read by the instanced vertex shader
+	struct INSTANCE_DATA
+	{
+		glm::mat4 model;
+		glm::vec4 color;
+		int materialIndex;
+		// -1 when the part is drawn with the solid color
+		int textureSlot;
+		glm::vec2 UVscale;
+	};
+
+	// layout of an indexed indirect draw command
+	struct DRAW_COMMAND
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// generate the mesh a part is drawn with, along with the
+	// meshes sharing its data - a mesh that is already loaded
+	// is not generated again
+	void LoadMesh(MESH_TYPE mesh);
+	// generate the meshes into the shared buffers, the curved
+	// ones at every level of detail - a mesh that is already
+	// loaded is not generated again
+	void LoadBoxMesh();
+	void LoadPlaneMesh();
+	void LoadCylinderMesh();
+	void LoadTaperedCylinderMesh();
+	void LoadConeMesh();
+	void LoadSphereMesh();
+	void LoadTorusMesh();
+	void LoadPyramid4Mesh();
+	void LoadPrismMesh();
+
+	// copy the per-instance values for the next draws into a
+	// range of the passed in stream buffer of the drawing scene,
+	// or into the instance buffer when it has no room - the
+	// library is shared, so the stream buffer is never kept
+	void UpdateInstanceData(const INSTANCE_DATA* pInstances, int count, StreamBuffer* pStreamBuffer);
+
+	// get the command that draws the instances
+	// [firstInstance, firstInstance + count) with the passed in mesh
+	// at the passed in level of detail
+	DRAW_COMMAND GetDrawCommand(MESH_TYPE mesh, int lod, int count, int firstInstance) const;
+	// make room for the passed in number of draw commands, so
+	// copying them does not allocate while rendering
+	void ReserveDrawCommands(int count) { m_commands.reserve(count); }
+	// copy the draw commands for the next draws into a range of
+	// the passed in stream buffer, or into the command buffer
+	void UpdateDrawCommands(const DRAW_COMMAND* pCommands, int count, StreamBuffer* pStreamBuffer);
+	// submit the commands [firstCommand, firstCommand + count) of
+	// the command buffer, with one call when multi-draw-indirect
+	// is available
+	void DrawCommands(int firstCommand, int count);
+	// whether the commands are drawn with multi-draw-indirect,
+	// so they can be written on the GPU
+	bool IsMultiDrawIndirect() const { return(m_bMultiDrawIndirect); }
+	// buffers and offsets the instances and the commands of the
+	// next draws are read from
+	void GetDrawSources(GLuint& instanceBuffer, GLintptr& instanceOffset,
+		GLuint& commandBuffer, GLintptr& commandOffset) const;
+	// read the instances and the commands of the next draws from
+	// the passed in buffers, until they are updated again
+	void SetDrawSources(GLuint instanceBuffer, GLintptr instanceOffset,
+		GLuint commandBuffer, GLintptr commandOffset);
+
+	// draw the instances [firstInstance, firstInstance + count)
+	// of the instance buffer with the passed in mesh
+	void DrawMeshInstanced(MESH_TYPE mesh, int count, int firstInstance = 0);
+
+	// get the bounding box of a loaded mesh in its object space
+	void GetMeshBounds(MESH_TYPE mesh, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+	// number of levels of detail of a loaded mesh - the meshes
+	// without curves have a single level
+	int GetLodCount(MESH_TYPE mesh) const { return m_lodCounts[mesh]; }
+
+private:
+	// constructor, only called through Acquire()
+	MeshLibrary();
+	// destructor, only called through Release()
+	~MeshLibrary();
+
+	// range of the shared buffers that is drawn for a mesh type
+	struct MESH_RANGE
+	{
+		GLuint firstIndex;
+		GLuint nIndices;
+		GLint baseVertex;
+		// bounding box of the drawn vertices
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	// generated vertex and index data of all the meshes
+	std::vector<MESH_VERTEX> m_vertices;
+	std::vector<GLuint> m_indices;
+	// drawn range of every mesh type at every level of detail
+	MESH_RANGE m_meshRanges[MESH_COUNT][MESH_LOD_COUNT];
+	// number of generated levels of detail of every mesh type
+	int m_lodCounts[MESH_COUNT];
+
+	// vertex array and buffers shared by all the meshes
+	GLuint m_vao;
+	GLuint m_vertexBuffer;
+	GLuint m_indexBuffer;
+	// whether meshes were generated since the buffers were written
+	bool m_bMeshesChanged;
+
+	// buffer holding the per-instance values
+	GLuint m_instanceBuffer;
+	// number of instances the buffer has room for
+	int m_instanceCapacity;
+	// buffer holding the indirect draw commands
+	GLuint m_commandBuffer;
+	// number of commands the buffer has room for
+	int m_commandCapacity;
+	// copy of the commands for drawing them one at a time
+	std::vector<DRAW_COMMAND> m_commands;
+	// buffers and offsets the instances and the commands of the
+	// frame were written to, either the own buffers or ranges of
+	// the stream buffer
+	GLuint m_instanceSource;
+	GLintptr m_instanceOffset;
+	GLuint m_commandSource;
+	GLintptr m_commandOffset;
+
+	// whether instances can be offset in the draw command
+	bool m_bBaseInstance;
+	// whether the commands can be drawn with one call
+	bool m_bMultiDrawIndirect;
+
+	// create the shared vertex array and buffers
+	void CreateBuffers();
+	// write the generated mesh data into the shared buffers
+	void UploadMeshes();
+	// append generated mesh data to the shared mesh data
+	MESH_RANGE AddMesh(
+		const std::vector<MESH_VERTEX>& vertices,
+		const std::vector<GLuint>& indices);
+	// set the drawn range of a mesh type at a level of detail to
+	// the leading indices of an added mesh
+	void SetMeshRange(MESH_TYPE type, int lod, const MESH_RANGE& meshRange, GLuint nIndices);
+	// whether a mesh type was already generated
+	bool IsMeshLoaded(MESH_TYPE type) const { return(m_meshRanges[type][0].nIndices > 0); }
+	// set the instance attribute pointers of the vertex array
+	void SetInstanceAttributes(int firstInstance);
+	// copy the per-instance values into the own instance buffer
+	void WriteInstanceBuffer(const INSTANCE_DATA* pInstances, int count);
+	// prepare the vertex array for drawing
+	bool PrepareDraw();
+};
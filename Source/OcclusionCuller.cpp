@@ -0,0 +1,480 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionculler.cpp
+// ============
+// drop the instances hidden behind the opaque depth of the last frame on the
+// GPU, writing the draw commands that are left straight into the buffer the
+// multi-draw-indirect calls read
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OcclusionCuller.h"
+#include "FrameProfiler.h"
+#include "ShaderCompiler.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// storage buffer bindings of the cull program
+	const GLuint g_BoundsBinding = 0;
+	const GLuint g_InstanceBinding = 1;
+	const GLuint g_CommandBinding = 2;
+	const GLuint g_CulledInstanceBinding = 3;
+	// image units of the pyramid program
+	const GLuint g_SourceLevelUnit = 0;
+	const GLuint g_TargetLevelUnit = 1;
+
+	// work group sizes, which must match the shaders
+	const int g_PyramidGroupSize = 8;
+	const int g_CullGroupSize = 64;
+
+	// room left when the buffers grow, so a frame that draws a
+	// few more parts does not grow them again
+	const float g_GrowthFactor = 1.5f;
+
+	const char* g_DepthMapName = "depthMap";
+	const char* g_CopyDepthName = "copyDepth";
+	const char* g_DepthPyramidName = "depthPyramid";
+	const char* g_PyramidLevelsName = "pyramidLevels";
+	const char* g_PyramidViewProjectionName = "pyramidViewProjection";
+	const char* g_InstanceCountName = "instanceCount";
+	const char* g_CommandCountName = "commandCount";
+	const char* g_ResetCommandsName = "resetCommands";
+
+	static_assert(sizeof(OcclusionCuller::INSTANCE_BOUNDS) == 32, "InstanceBounds layout mismatch");
+	static_assert(sizeof(MeshLibrary::INSTANCE_DATA) == 96, "InstanceData layout mismatch");
+	static_assert(sizeof(MeshLibrary::DRAW_COMMAND) == 20, "DrawCommand layout mismatch");
+}
+
+/***********************************************************
+ *  OcclusionCuller()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+OcclusionCuller::OcclusionCuller()
+{
+	m_bEnabled = true;
+	m_bPyramidValid = false;
+	m_pyramidViewProjection = glm::mat4(1.0f);
+	m_depthTexture = 0;
+	m_depthFramebuffer = 0;
+	m_pyramidTexture = 0;
+	m_pyramidWidth = 0;
+	m_pyramidHeight = 0;
+	m_pyramidLevels = 0;
+	m_commandBuffer = 0;
+	m_instanceBuffer = 0;
+	m_commandCapacity = 0;
+	m_instanceCapacity = 0;
+	m_boundsBuffer = 0;
+	m_boundsCapacity = 0;
+	m_pStreamBuffer = NULL;
+	m_pyramidProgram = 0;
+	m_cullProgram = 0;
+}
+
+/***********************************************************
+ *  ~OcclusionCuller()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+OcclusionCuller::~OcclusionCuller()
+{
+	if (0 != m_depthFramebuffer)
+	{
+		glDeleteFramebuffers(1, &m_depthFramebuffer);
+		m_depthFramebuffer = 0;
+	}
+	if (0 != m_depthTexture)
+	{
+		glDeleteTextures(1, &m_depthTexture);
+		m_depthTexture = 0;
+	}
+	if (0 != m_pyramidTexture)
+	{
+		glDeleteTextures(1, &m_pyramidTexture);
+		m_pyramidTexture = 0;
+	}
+	if (0 != m_commandBuffer)
+	{
+		glDeleteBuffers(1, &m_commandBuffer);
+		m_commandBuffer = 0;
+	}
+	if (0 != m_instanceBuffer)
+	{
+		glDeleteBuffers(1, &m_instanceBuffer);
+		m_instanceBuffer = 0;
+	}
+	if (0 != m_boundsBuffer)
+	{
+		glDeleteBuffers(1, &m_boundsBuffer);
+		m_boundsBuffer = 0;
+	}
+	if (0 != m_pyramidProgram)
+	{
+		glDeleteProgram(m_pyramidProgram);
+		m_pyramidProgram = 0;
+	}
+	if (0 != m_cullProgram)
+	{
+		glDeleteProgram(m_cullProgram);
+		m_cullProgram = 0;
+	}
+}
+
+/***********************************************************
+ *  CreateResources()
+ *
+ *  This method is used for building the pyramid and cull
+ *  programs, and the buffers the culled frames are drawn
+ *  from, when the driver has compute shaders, storage
+ *  buffers and multi-draw-indirect.
+ ***********************************************************/
+bool OcclusionCuller::CreateResources(const char* pyramidShaderFile, const char* cullShaderFile)
+{
+	if ((GLEW_VERSION_4_3 ||
+		(GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+			GLEW_ARB_shader_image_load_store && GLEW_ARB_texture_storage &&
+			GLEW_ARB_multi_draw_indirect)) == false)
+	{
+		return(false);
+	}
+
+	m_pyramidProgram = ShaderCompiler::CreateComputeProgram(pyramidShaderFile);
+	m_cullProgram = ShaderCompiler::CreateComputeProgram(cullShaderFile);
+	if (IsAvailable() == false)
+	{
+		std::cout << "Drawing without occlusion culling" << std::endl;
+		return(false);
+	}
+
+	m_pyramidUniforms.ResolveUniforms(m_pyramidProgram);
+	m_copyDepthUniform = m_pyramidUniforms.GetUniform<bool>(g_CopyDepthName);
+	m_cullUniforms.ResolveUniforms(m_cullProgram);
+	m_pyramidLevelsUniform = m_cullUniforms.GetUniform<int>(g_PyramidLevelsName);
+	m_pyramidViewProjectionUniform = m_cullUniforms.GetUniform<glm::mat4>(g_PyramidViewProjectionName);
+	m_instanceCountUniform = m_cullUniforms.GetUniform<int>(g_InstanceCountName);
+	m_commandCountUniform = m_cullUniforms.GetUniform<int>(g_CommandCountName);
+	m_resetCommandsUniform = m_cullUniforms.GetUniform<bool>(g_ResetCommandsName);
+
+	// both programs read their depth from the same unit, which
+	// only has to be set once
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glUseProgram(m_pyramidProgram);
+	m_pyramidUniforms.SetValue(m_pyramidUniforms.GetUniform<int>(g_DepthMapName), (int)UNIT_DEPTH_PYRAMID);
+	glUseProgram(m_cullProgram);
+	m_cullUniforms.SetValue(m_cullUniforms.GetUniform<int>(g_DepthPyramidName), (int)UNIT_DEPTH_PYRAMID);
+	glUseProgram(previousProgram);
+
+	glGenBuffers(1, &m_commandBuffer);
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_boundsBuffer);
+	glGenFramebuffers(1, &m_depthFramebuffer);
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetEnabled()
+ *
+ *  This method is used for turning culling on or off.  The
+ *  pyramid is not built while culling is off, so it is
+ *  dropped, and the first frame after turning it back on
+ *  draws everything.
+ ***********************************************************/
+void OcclusionCuller::SetEnabled(bool bEnabled)
+{
+	if (bEnabled != m_bEnabled)
+	{
+		m_bEnabled = bEnabled;
+		m_bPyramidValid = false;
+	}
+}
+
+/***********************************************************
+ *  CullCommands()
+ *
+ *  This method is used for culling the instances of the
+ *  first commands of the frame on the GPU.  The commands and
+ *  the instances after them are copied as they are, the
+ *  instance counts of the culled commands are cleared, and
+ *  every instance that is not hidden is counted into its
+ *  command and copied to the next free place of the command.
+ *  The meshes then draw the frame from the copies.
+ ***********************************************************/
+bool OcclusionCuller::CullCommands(
+	MeshLibrary* pMeshes,
+	const INSTANCE_BOUNDS* pBounds,
+	int nCulledInstances,
+	int nCulledCommands,
+	int nInstances,
+	int nCommands)
+{
+	if ((m_bEnabled == false) || (m_bPyramidValid == false) || (IsAvailable() == false) ||
+		(pMeshes->IsMultiDrawIndirect() == false) ||
+		(nCulledInstances <= 0) || (nCulledCommands <= 0))
+	{
+		return(false);
+	}
+
+	GLuint instanceSource = 0;
+	GLintptr instanceOffset = 0;
+	GLuint commandSource = 0;
+	GLintptr commandOffset = 0;
+	pMeshes->GetDrawSources(instanceSource, instanceOffset, commandSource, commandOffset);
+	if ((0 == instanceSource) || (0 == commandSource))
+	{
+		return(false);
+	}
+
+	ReserveBuffers(nInstances, nCommands);
+
+	// the commands are copied whole and the instances after the
+	// culled ones as they are, so the later commands draw the
+	// same from the copies
+	const GLsizeiptr instanceSize = sizeof(MeshLibrary::INSTANCE_DATA);
+	glBindBuffer(GL_COPY_READ_BUFFER, commandSource);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+		commandOffset, 0, nCommands * sizeof(MeshLibrary::DRAW_COMMAND));
+	if (nInstances > nCulledInstances)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, instanceSource);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_instanceBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			instanceOffset + nCulledInstances * instanceSize,
+			nCulledInstances * instanceSize,
+			(nInstances - nCulledInstances) * instanceSize);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glUseProgram(m_cullProgram);
+
+	BindBounds(pBounds, nCulledInstances);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, g_InstanceBinding, instanceSource,
+		instanceOffset, nCulledInstances * instanceSize);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, g_CommandBinding, m_commandBuffer,
+		0, nCommands * sizeof(MeshLibrary::DRAW_COMMAND));
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, g_CulledInstanceBinding, m_instanceBuffer,
+		0, nInstances * instanceSize);
+	glActiveTexture(GL_TEXTURE0 + UNIT_DEPTH_PYRAMID);
+	glBindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	m_cullUniforms.SetValue(m_pyramidLevelsUniform, m_pyramidLevels);
+	m_cullUniforms.SetValue(m_pyramidViewProjectionUniform, m_pyramidViewProjection);
+	m_cullUniforms.SetValue(m_instanceCountUniform, nCulledInstances);
+	m_cullUniforms.SetValue(m_commandCountUniform, nCulledCommands);
+
+	// the counts are cleared before any instance is counted
+	m_cullUniforms.SetValue(m_resetCommandsUniform, true);
+	glDispatchCompute((nCulledCommands + g_CullGroupSize - 1) / g_CullGroupSize, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	m_cullUniforms.SetValue(m_resetCommandsUniform, false);
+	glDispatchCompute((nCulledInstances + g_CullGroupSize - 1) / g_CullGroupSize, 1, 1);
+
+	// the commands are read by the indirect draws and the
+	// instances as vertex attributes
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+	glUseProgram(previousProgram);
+	FrameProfiler::CountStateChange();
+
+	pMeshes->SetDrawSources(m_instanceBuffer, 0, m_commandBuffer, 0);
+	return(true);
+}
+
+/***********************************************************
+ *  BuildDepthPyramid()
+ *
+ *  This method is used for copying the depth of the current
+ *  framebuffer within its viewport, and reducing it level by
+ *  level into the pyramid the next frame is culled against.
+ *  The framebuffer depth is copied with a blit, so it has to
+ *  have the 24 bit depth and 8 bit stencil of the copy.
+ ***********************************************************/
+void OcclusionCuller::BuildDepthPyramid(const glm::mat4& viewProjection)
+{
+	if ((m_bEnabled == false) || (IsAvailable() == false))
+	{
+		return;
+	}
+
+	GLint viewport[4];
+	GLint framebuffer = 0;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	if ((viewport[2] <= 0) || (viewport[3] <= 0))
+	{
+		return;
+	}
+	if ((viewport[2] != m_pyramidWidth) || (viewport[3] != m_pyramidHeight))
+	{
+		ResizePyramid(viewport[2], viewport[3]);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+	glBlitFramebuffer(
+		viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+		0, 0, m_pyramidWidth, m_pyramidHeight,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	GLint previousProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glUseProgram(m_pyramidProgram);
+	glActiveTexture(GL_TEXTURE0 + UNIT_DEPTH_PYRAMID);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// the first level is the depth itself, and every level
+	// after it is reduced from the one before
+	int width = m_pyramidWidth;
+	int height = m_pyramidHeight;
+	for (int level = 0; level < m_pyramidLevels; level++)
+	{
+		if (level > 0)
+		{
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+
+		m_pyramidUniforms.SetValue(m_copyDepthUniform, 0 == level);
+		glBindImageTexture(g_SourceLevelUnit, m_pyramidTexture, std::max(level - 1, 0),
+			GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(g_TargetLevelUnit, m_pyramidTexture, level,
+			GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute(
+			(width + g_PyramidGroupSize - 1) / g_PyramidGroupSize,
+			(height + g_PyramidGroupSize - 1) / g_PyramidGroupSize,
+			1);
+	}
+
+	// the next frame fetches the levels as a texture
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	glUseProgram(previousProgram);
+	FrameProfiler::CountStateChange();
+
+	m_pyramidViewProjection = viewProjection;
+	m_bPyramidValid = true;
+}
+
+/***********************************************************
+ *  ResizePyramid()
+ *
+ *  This method is used for creating the depth copy and the
+ *  pyramid at the size of a viewport, with all the levels
+ *  down to a single texel.  The boxes are tested in the
+ *  coordinates of the whole view, so the pyramid built next
+ *  is culled against the same way at any size.
+ ***********************************************************/
+void OcclusionCuller::ResizePyramid(int width, int height)
+{
+	if (0 != m_depthTexture)
+	{
+		glDeleteTextures(1, &m_depthTexture);
+	}
+	if (0 != m_pyramidTexture)
+	{
+		glDeleteTextures(1, &m_pyramidTexture);
+	}
+
+	m_pyramidWidth = width;
+	m_pyramidHeight = height;
+	m_pyramidLevels = 1;
+	while ((std::max(width, height) >> m_pyramidLevels) > 0)
+	{
+		m_pyramidLevels++;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_DEPTH_PYRAMID);
+	glGenTextures(1, &m_depthTexture);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &m_pyramidTexture);
+	glBindTexture(GL_TEXTURE_2D, m_pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_pyramidLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "The depth copy of the occlusion culling is not complete" << std::endl;
+	}
+}
+
+/***********************************************************
+ *  ReserveBuffers()
+ *
+ *  This method is used for growing the copies of the
+ *  commands and the instances to hold the frame.  They are
+ *  only written and read on the GPU.
+ ***********************************************************/
+void OcclusionCuller::ReserveBuffers(int nInstances, int nCommands)
+{
+	if (nCommands > m_commandCapacity)
+	{
+		m_commandCapacity = (int)(nCommands * g_GrowthFactor);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, m_commandCapacity * sizeof(MeshLibrary::DRAW_COMMAND), NULL, GL_DYNAMIC_COPY);
+	}
+	if (nInstances > m_instanceCapacity)
+	{
+		m_instanceCapacity = (int)(nInstances * g_GrowthFactor);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_instanceBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, m_instanceCapacity * sizeof(MeshLibrary::INSTANCE_DATA), NULL, GL_DYNAMIC_COPY);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+/***********************************************************
+ *  BindBounds()
+ *
+ *  This method is used for writing the boxes of the culled
+ *  instances into a range of the stream buffer, or into the
+ *  bounds buffer when it has no room, and binding them for
+ *  the cull program.
+ ***********************************************************/
+void OcclusionCuller::BindBounds(const INSTANCE_BOUNDS* pBounds, int count)
+{
+	const GLsizeiptr size = count * sizeof(INSTANCE_BOUNDS);
+	StreamBuffer::STREAM_RANGE range;
+	if ((NULL != m_pStreamBuffer) && m_pStreamBuffer->Allocate(size, range))
+	{
+		memcpy(range.pData, pBounds, size);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, g_BoundsBinding, m_pStreamBuffer->GetBuffer(), range.offset, size);
+		return;
+	}
+
+	// the buffer is orphaned first, so the boxes of a frame the
+	// GPU still reads are not waited on
+	if (count > m_boundsCapacity)
+	{
+		m_boundsCapacity = (int)(count * g_GrowthFactor);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_boundsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_boundsCapacity * sizeof(INSTANCE_BOUNDS), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, pBounds);
+	FrameProfiler::CountUniformUpload(size);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, g_BoundsBinding, m_boundsBuffer, 0, size);
+}
@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionculler.h
+// ============
+// drop the instances hidden behind the opaque depth of the last frame on the
+// GPU, writing the draw commands that are left straight into the buffer the
+// multi-draw-indirect calls read
+//
+//	Once the opaque parts of a frame are drawn, their depth is copied out of
+//	the framebuffer and reduced into a pyramid of mip levels, where every
+//	texel holds the farthest depth of the texels under it.  The next frame
+//	projects the box of every opaque instance with the camera the pyramid
+//	was built from, and a compute shader compares its nearest depth with
+//	the four texels of the level where the box covers at most two texels
+//	across.  The instances that are not hidden are packed at the front of
+//	their command and counted into its instance count, in a copy of the
+//	commands and the instances the meshes then draw from.  The CPU never
+//	reads the counts back, so a part that comes into view is drawn one frame
+//	late, and the triangles the profiler counts are the ones before culling.
+//	Culling needs compute shaders, storage buffers and multi-draw-indirect,
+//	and is skipped when any of them is missing.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MeshLibrary.h"
+#include "ShaderUniforms.h"
+#include "StreamBuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  OcclusionCuller
+ *
+ *  This class contains the code for building the depth
+ *  pyramid of a frame and culling the commands of the next
+ *  frame against it.
+ ***********************************************************/
+class OcclusionCuller
+{
+public:
+	// constructor
+	OcclusionCuller();
+	// destructor
+	~OcclusionCuller();
+
+	// texture unit the compute programs read the depth from,
+	// above the units of the scene shaders
+	enum TEXTURE_UNIT
+	{
+		UNIT_DEPTH_PYRAMID = 16
+	};
+
+	// layout of the box of an instance in the bounds buffer,
+	// std430 for the compute shader
+	struct INSTANCE_BOUNDS
+	{
+		glm::vec3 center;
+		// command of the frame that draws the instance
+		GLuint command;
+		glm::vec3 extent;
+		GLuint padding;
+	};
+
+	// create the compute programs when the driver has compute
+	// shaders - returns false when culling is not available
+	bool CreateResources(const char* pyramidShaderFile, const char* cullShaderFile);
+	// write the boxes of every frame into ranges of the passed
+	// in stream buffer, when it has room
+	void SetStreamBuffer(StreamBuffer* pStreamBuffer) { m_pStreamBuffer = pStreamBuffer; }
+	// whether the programs could be built
+	bool IsAvailable() const { return((0 != m_pyramidProgram) && (0 != m_cullProgram)); }
+	// turn culling on or off - the pyramid is built again
+	// before anything is culled once it is turned back on
+	void SetEnabled(bool bEnabled);
+
+	// cull the instances of the leading commands of the frame
+	// against the pyramid of the last frame, and have the meshes
+	// draw from the culled commands and instances - the later
+	// commands are drawn as they are.  Returns false when
+	// nothing was culled.
+	bool CullCommands(
+		MeshLibrary* pMeshes,
+		const INSTANCE_BOUNDS* pBounds,
+		int nCulledInstances,
+		int nCulledCommands,
+		int nInstances,
+		int nCommands);
+	// build the pyramid from the depth of the current
+	// framebuffer within its viewport, drawn with the passed in
+	// view projection
+	void BuildDepthPyramid(const glm::mat4& viewProjection);
+
+private:
+	// whether culling is turned on, and whether the pyramid
+	// holds the depth of an earlier frame to cull against
+	bool m_bEnabled;
+	bool m_bPyramidValid;
+	glm::mat4 m_pyramidViewProjection;
+
+	// copy of the framebuffer depth, the framebuffer it is
+	// copied into, and the pyramid with its size
+	GLuint m_depthTexture;
+	GLuint m_depthFramebuffer;
+	GLuint m_pyramidTexture;
+	int m_pyramidWidth;
+	int m_pyramidHeight;
+	int m_pyramidLevels;
+
+	// copies of the commands and the instances the culled
+	// frame is drawn from, and the room they have
+	GLuint m_commandBuffer;
+	GLuint m_instanceBuffer;
+	int m_commandCapacity;
+	int m_instanceCapacity;
+	// boxes of the instances without the stream buffer
+	GLuint m_boundsBuffer;
+	int m_boundsCapacity;
+	StreamBuffer* m_pStreamBuffer;
+
+	// program reducing the depth into the pyramid levels
+	GLuint m_pyramidProgram;
+	ShaderUniforms m_pyramidUniforms;
+	ShaderUniforms::UNIFORM<bool> m_copyDepthUniform;
+	// program testing the instances against the pyramid
+	GLuint m_cullProgram;
+	ShaderUniforms m_cullUniforms;
+	ShaderUniforms::UNIFORM<int> m_pyramidLevelsUniform;
+	ShaderUniforms::UNIFORM<glm::mat4> m_pyramidViewProjectionUniform;
+	ShaderUniforms::UNIFORM<int> m_instanceCountUniform;
+	ShaderUniforms::UNIFORM<int> m_commandCountUniform;
+	ShaderUniforms::UNIFORM<bool> m_resetCommandsUniform;
+
+	// size the depth copy and the pyramid for a viewport
+	void ResizePyramid(int width, int height);
+	// make room for the commands and instances of a frame
+	void ReserveBuffers(int nInstances, int nCommands);
+	// write the boxes of the frame where the cull program
+	// reads them, and bind them
+	void BindBounds(const INSTANCE_BOUNDS* pBounds, int count);
+};
@@ -0,0 +1,251 @@
+///////////////////////////////////////////////////////////////////////////////
+// sceneanimator.cpp
+// ============
+// evaluate the animated light, material and part values of the scene every
+// frame, keeping only the values that changed
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneAnimator.h"
+
+#include <cmath>
+
+// declaration of global variables and defines
+namespace
+{
+	// smallest change that is written, below one step of an
+	// 8-bit color channel
+	const float g_ChangeThreshold = 1.0f / 512.0f;
+	// random variation of the flame color channels
+	const float g_FlameJitter = 0.03f;
+
+	/***********************************************************
+	 *  HasChanged()
+	 *
+	 *  This function is used for checking whether any channel
+	 *  of a color moved past the change threshold.
+	 ***********************************************************/
+	bool HasChanged(const glm::vec4& first, const glm::vec4& second)
+	{
+		glm::vec4 difference = glm::abs(first - second);
+		return((difference.x > g_ChangeThreshold) ||
+			(difference.y > g_ChangeThreshold) ||
+			(difference.z > g_ChangeThreshold) ||
+			(difference.w > g_ChangeThreshold));
+	}
+
+	/***********************************************************
+	 *  MergeList()
+	 *
+	 *  This function is used for adding changes to a list of
+	 *  pending ones, replacing a pending change of the same
+	 *  entry so every entry is listed once with its newest
+	 *  value.  The lists hold a few flickering entries, so they
+	 *  are searched in order.
+	 ***********************************************************/
+	template <typename CHANGE, typename KEY>
+	void MergeList(std::vector<CHANGE>& pending, const std::vector<CHANGE>& changes, KEY CHANGE::* key)
+	{
+		for (size_t i = 0; i < changes.size(); i++)
+		{
+			size_t j = 0;
+			while ((j < pending.size()) && (pending[j].*key != changes[i].*key))
+			{
+				j++;
+			}
+			if (j < pending.size())
+			{
+				pending[j] = changes[i];
+			}
+			else
+			{
+				pending.push_back(changes[i]);
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  SceneAnimator()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneAnimator::SceneAnimator() :
+	m_jitter(-g_FlameJitter, g_FlameJitter)
+{
+}
+
+/***********************************************************
+ *  AddLightFlicker()
+ *
+ *  This method is used for registering a point light whose
+ *  colors flicker like a candle flame.
+ ***********************************************************/
+void SceneAnimator::AddLightFlicker(int lightIndex, float phase)
+{
+	LIGHT_FLICKER flicker;
+	flicker.lightIndex = lightIndex;
+	flicker.phase = phase;
+	flicker.color = glm::vec3(0.0f);
+	// nothing has been written yet
+	flicker.writtenColor = glm::vec3(-1.0f);
+	m_lightFlickers.push_back(flicker);
+}
+
+/***********************************************************
+ *  AddEmissiveFlicker()
+ *
+ *  This method is used for registering a material whose glow
+ *  pulses around its emissive color.
+ ***********************************************************/
+void SceneAnimator::AddEmissiveFlicker(int materialIndex, const glm::vec3& emissiveColor, float phase)
+{
+	if (materialIndex < 0)
+	{
+		return;
+	}
+
+	EMISSIVE_FLICKER flicker;
+	flicker.materialIndex = materialIndex;
+	flicker.phase = phase;
+	flicker.emissiveColor = emissiveColor;
+	flicker.writtenColor = glm::vec3(-1.0f);
+	m_emissiveFlickers.push_back(flicker);
+}
+
+/***********************************************************
+ *  AddPartFlicker()
+ *
+ *  This method is used for registering a part whose color
+ *  follows a flickering point light, with a transparency
+ *  that flickers on its own.
+ ***********************************************************/
+void SceneAnimator::AddPartFlicker(int itemIndex, int lightIndex, float phase)
+{
+	PART_FLICKER flicker;
+	flicker.itemIndex = itemIndex;
+	flicker.lightFlicker = -1;
+	flicker.phase = phase;
+	flicker.writtenColor = glm::vec4(-1.0f);
+
+	for (size_t i = 0; i < m_lightFlickers.size(); i++)
+	{
+		if (m_lightFlickers[i].lightIndex == lightIndex)
+		{
+			flicker.lightFlicker = (int)i;
+			break;
+		}
+	}
+
+	// the part needs a flickering light to follow
+	if (flicker.lightFlicker >= 0)
+	{
+		m_partFlickers.push_back(flicker);
+	}
+}
+
+/***********************************************************
+ *  ClearPartFlickers()
+ *
+ *  This method is used for removing the part flickers, whose
+ *  item indices are no longer valid once the draw list is
+ *  built again.
+ ***********************************************************/
+void SceneAnimator::ClearPartFlickers()
+{
+	m_partFlickers.clear();
+}
+
+/***********************************************************
+ *  EvaluateFlameColor()
+ *
+ *  This method is used for getting the color of a flame at
+ *  the passed in time - a red flame with a pulsing green
+ *  channel and a little random variation.
+ ***********************************************************/
+glm::vec3 SceneAnimator::EvaluateFlameColor(float time, float phase)
+{
+	// flickering green channel
+	float flickerFactor = sin(time * 3.0f + phase) * 0.3f + 0.5f;
+
+	float red = 1.0f + m_jitter(m_generator);
+	float green = 0.2f + flickerFactor * 0.2f + m_jitter(m_generator);
+	float blue = 0.1f + m_jitter(m_generator) * 0.1f; // small, subtle blue tint
+
+	return(glm::clamp(glm::vec3(red, green, blue), glm::vec3(0.0f), glm::vec3(1.0f)));
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for evaluating every registered
+ *  property for the passed in time.  Only the values that
+ *  moved past the change threshold since they were last
+ *  written are listed as changes.
+ ***********************************************************/
+void SceneAnimator::Update(float time)
+{
+	m_changes.lights.clear();
+	m_changes.materials.clear();
+	m_changes.parts.clear();
+
+	for (size_t i = 0; i < m_lightFlickers.size(); i++)
+	{
+		LIGHT_FLICKER& flicker = m_lightFlickers[i];
+		flicker.color = EvaluateFlameColor(time, flicker.phase);
+		if (HasChanged(glm::vec4(flicker.color, 0.0f), glm::vec4(flicker.writtenColor, 0.0f)))
+		{
+			LIGHT_CHANGE change;
+			change.lightIndex = flicker.lightIndex;
+			change.ambient = flicker.color * 0.1f;
+			change.diffuse = flicker.color;
+			change.specular = flicker.color * 0.8f;
+			m_changes.lights.push_back(change);
+			flicker.writtenColor = flicker.color;
+		}
+	}
+
+	for (size_t i = 0; i < m_emissiveFlickers.size(); i++)
+	{
+		EMISSIVE_FLICKER& flicker = m_emissiveFlickers[i];
+		float flickerIntensity = (sin(time * 10.0f + flicker.phase) * 0.2f) + 0.8f;
+		glm::vec3 emissiveColor = flicker.emissiveColor * flickerIntensity;
+		if (HasChanged(glm::vec4(emissiveColor, 0.0f), glm::vec4(flicker.writtenColor, 0.0f)))
+		{
+			MATERIAL_CHANGE change;
+			change.materialIndex = flicker.materialIndex;
+			change.emissiveColor = emissiveColor;
+			m_changes.materials.push_back(change);
+			flicker.writtenColor = emissiveColor;
+		}
+	}
+
+	for (size_t i = 0; i < m_partFlickers.size(); i++)
+	{
+		PART_FLICKER& flicker = m_partFlickers[i];
+		// flickering transparency
+		float alpha = glm::clamp(sin(time * 2.5f + flicker.phase) * 0.2f + 0.6f, 0.5f, 0.8f);
+		glm::vec4 partColor(m_lightFlickers[flicker.lightFlicker].color, alpha);
+		if (HasChanged(partColor, flicker.writtenColor))
+		{
+			PART_CHANGE change;
+			change.itemIndex = flicker.itemIndex;
+			change.color = partColor;
+			m_changes.parts.push_back(change);
+			flicker.writtenColor = partColor;
+		}
+	}
+}
+
+/***********************************************************
+ *  MergeChanges()
+ *
+ *  This method is used for adding the changes of an update
+ *  to changes that were not applied yet, so values skipped
+ *  over by a slower reader are still written once.
+ ***********************************************************/
+void SceneAnimator::MergeChanges(ANIMATION_CHANGES& pending, const ANIMATION_CHANGES& changes)
+{
+	MergeList(pending.lights, changes.lights, &LIGHT_CHANGE::lightIndex);
+	MergeList(pending.materials, changes.materials, &MATERIAL_CHANGE::materialIndex);
+	MergeList(pending.parts, changes.parts, &PART_CHANGE::itemIndex);
+}
@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// sceneanimator.h
+// ============
+// evaluate the animated light, material and part values of the scene every
+// frame, keeping only the values that changed
+//
+//	Animated properties are registered once while the scene is prepared.
+//	Every frame they are evaluated for the current time, and the ones that
+//	changed by more than a color step are listed, so only those light and
+//	material entries are written into their buffers.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <random>
+#include <vector>
+
+/***********************************************************
+ *  SceneAnimator
+ *
+ *  This class contains the code for holding the animated
+ *  properties of the scene and evaluating them into the
+ *  lists of changed values every frame.
+ ***********************************************************/
+class SceneAnimator
+{
+public:
+	// constructor
+	SceneAnimator();
+
+	// new colors of a flickering point light
+	struct LIGHT_CHANGE
+	{
+		int lightIndex;
+		glm::vec3 ambient;
+		glm::vec3 diffuse;
+		glm::vec3 specular;
+	};
+
+	// new glow of a flickering material
+	struct MATERIAL_CHANGE
+	{
+		int materialIndex;
+		glm::vec3 emissiveColor;
+	};
+
+	// new color of a flickering part of the draw list
+	struct PART_CHANGE
+	{
+		int itemIndex;
+		glm::vec4 color;
+	};
+
+	// values that changed in an update
+	struct ANIMATION_CHANGES
+	{
+		std::vector<LIGHT_CHANGE> lights;
+		std::vector<MATERIAL_CHANGE> materials;
+		std::vector<PART_CHANGE> parts;
+	};
+
+	// register a point light whose color flickers like a flame,
+	// with a phase so neighboring flames differ
+	void AddLightFlicker(int lightIndex, float phase);
+	// register a material whose glow flickers around the passed
+	// in emissive color
+	void AddEmissiveFlicker(int materialIndex, const glm::vec3& emissiveColor, float phase);
+	// register a part whose color follows a flickering point
+	// light and whose transparency flickers
+	void AddPartFlicker(int itemIndex, int lightIndex, float phase);
+	// remove the part flickers when the draw list is rebuilt
+	void ClearPartFlickers();
+
+	// flame color of a flickering light at the passed in time
+	glm::vec3 EvaluateFlameColor(float time, float phase);
+
+	// evaluate every animated property for the passed in time,
+	// listing the values that changed
+	void Update(float time);
+
+	// values that changed in the last update
+	const ANIMATION_CHANGES& GetChanges() const { return m_changes; }
+	// add the passed in changes to ones that were not applied yet,
+	// replacing the older values of the same entries
+	static void MergeChanges(ANIMATION_CHANGES& pending, const ANIMATION_CHANGES& changes);
+
+private:
+	// a flickering point light and its last written color
+	struct LIGHT_FLICKER
+	{
+		int lightIndex;
+		float phase;
+		glm::vec3 color;
+		glm::vec3 writtenColor;
+	};
+
+	// a flickering material and its last written glow
+	struct EMISSIVE_FLICKER
+	{
+		int materialIndex;
+		float phase;
+		glm::vec3 emissiveColor;
+		glm::vec3 writtenColor;
+	};
+
+	// a flickering part, following the light flicker of the
+	// passed in slot, and its last written color
+	struct PART_FLICKER
+	{
+		int itemIndex;
+		int lightFlicker;
+		float phase;
+		glm::vec4 writtenColor;
+	};
+
+	std::vector<LIGHT_FLICKER> m_lightFlickers;
+	std::vector<EMISSIVE_FLICKER> m_emissiveFlickers;
+	std::vector<PART_FLICKER> m_partFlickers;
+
+	// values that changed in the last update
+	ANIMATION_CHANGES m_changes;
+
+	// random variation of the flame colors
+	std::default_random_engine m_generator;
+	std::uniform_real_distribution<float> m_jitter;
+};
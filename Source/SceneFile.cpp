@@ -0,0 +1,526 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.cpp
+// ============
+// read the parts of a scene from a text description or from its cooked
+// binary form, which is mapped and used in place
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneFile.h"
+#include "MeshLibrary.h"
+#include "TransformBatch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// declaration of global variables and defines
+namespace
+{
+	// names of the meshes in the text form, in the order of
+	// the mesh types
+	const char* g_MeshNames[] = {
+		"box",
+		"box_open_top",
+		"box_sides",
+		"plane",
+		"cylinder",
+		"tapered_cylinder",
+		"cone",
+		"sphere",
+		"half_sphere",
+		"torus",
+		"pyramid4",
+		"prism" };
+	static_assert(sizeof(g_MeshNames) / sizeof(g_MeshNames[0]) == MeshLibrary::MESH_COUNT,
+		"every mesh type needs a name in the scene files");
+
+	// tag of no texture or material in the text form
+	const char* g_NoneTag = "-";
+	// values on a part line after the mesh, texture and material
+	const int g_PartValues = 3 + 3 + 3 + 4 + 2;
+
+	static_assert(sizeof(SceneFile::SCENE_HEADER) == 32, "SceneHeader layout mismatch");
+	static_assert(sizeof(SceneFile::SCENE_TEXTURE) == 128, "SceneTexture layout mismatch");
+	static_assert(sizeof(SceneFile::SCENE_MATERIAL) == 32, "SceneMaterial layout mismatch");
+	static_assert(sizeof(SceneFile::SCENE_PART) == 112, "ScenePart layout mismatch");
+
+	/***********************************************************
+	 *  NextToken()
+	 *
+	 *  This function is used for cutting the next word out of a
+	 *  line in place, returning NULL at the end of the line or
+	 *  at a comment.
+	 ***********************************************************/
+	char* NextToken(char*& pCursor)
+	{
+		while ((' ' == *pCursor) || ('\t' == *pCursor) || ('\r' == *pCursor))
+		{
+			pCursor++;
+		}
+		if (('\0' == *pCursor) || ('#' == *pCursor))
+		{
+			return(NULL);
+		}
+
+		char* pToken = pCursor;
+		while (('\0' != *pCursor) && (' ' != *pCursor) && ('\t' != *pCursor) && ('\r' != *pCursor))
+		{
+			pCursor++;
+		}
+		if ('\0' != *pCursor)
+		{
+			*pCursor = '\0';
+			pCursor++;
+		}
+		return(pToken);
+	}
+
+	/***********************************************************
+	 *  CopyTag()
+	 *
+	 *  This function is used for copying a tag or file name into
+	 *  a fixed size field, returning false when it is too long.
+	 ***********************************************************/
+	bool CopyTag(char* pField, size_t fieldSize, const char* pTag)
+	{
+		size_t length = strlen(pTag);
+		memset(pField, 0, fieldSize);
+		if (length >= fieldSize)
+		{
+			return(false);
+		}
+		memcpy(pField, pTag, length);
+		return(true);
+	}
+
+	/***********************************************************
+	 *  FindMeshType()
+	 *
+	 *  This function is used for getting the mesh type of a mesh
+	 *  name, or -1 for an unknown name.
+	 ***********************************************************/
+	int FindMeshType(const char* pName)
+	{
+		for (int i = 0; i < MeshLibrary::MESH_COUNT; i++)
+		{
+			if (strcmp(g_MeshNames[i], pName) == 0)
+			{
+				return(i);
+			}
+		}
+		return(-1);
+	}
+}
+
+/***********************************************************
+ *  SceneFile()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneFile::SceneFile()
+{
+	m_pTextures = NULL;
+	m_nTextures = 0;
+	m_pMaterials = NULL;
+	m_nMaterials = 0;
+	m_pParts = NULL;
+	m_nParts = 0;
+	m_sourceSize = 0;
+	m_sourceTime = 0;
+}
+
+/***********************************************************
+ *  GetCookedFilename()
+ *
+ *  This method is used for getting the name of the cooked
+ *  file that sits next to a text scene file.
+ ***********************************************************/
+std::string SceneFile::GetCookedFilename(const char* filename)
+{
+	std::string cookedName = filename;
+	size_t extension = cookedName.find_last_of("./\\");
+	if ((std::string::npos != extension) && ('.' == cookedName[extension]))
+	{
+		cookedName.erase(extension);
+	}
+	cookedName += SCENE_COOKED_EXTENSION;
+
+	return(cookedName);
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method is used for opening a scene, mapping its
+ *  cooked file when there is a usable one and parsing the
+ *  text description otherwise.  A cooked file that was not
+ *  cooked from the text file as it is now is stale, and the
+ *  text is parsed instead.
+ ***********************************************************/
+bool SceneFile::Open(const char* filename)
+{
+	std::string cookedName = GetCookedFilename(filename);
+	if ((cookedName != filename) && LoadCooked(cookedName.c_str()))
+	{
+		if (IsCookedCurrent(filename))
+		{
+			return(true);
+		}
+		std::cout << "Cooked scene file is older than its scene, cook it again:" << cookedName << std::endl;
+	}
+
+	return(LoadText(filename));
+}
+
+/***********************************************************
+ *  GetFileStamp()
+ *
+ *  This method is used for getting the size and the
+ *  modification time of a file, which tell a cooked scene
+ *  whether its text file changed since it was cooked.
+ ***********************************************************/
+bool SceneFile::GetFileStamp(const char* filename, uint32_t& size, uint64_t& time)
+{
+	struct stat fileInfo;
+	if (0 != stat(filename, &fileInfo))
+	{
+		return(false);
+	}
+
+	size = (uint32_t)fileInfo.st_size;
+	time = (uint64_t)fileInfo.st_mtime;
+	return(true);
+}
+
+/***********************************************************
+ *  IsCookedCurrent()
+ *
+ *  This method is used for checking the opened cooked file
+ *  against the size and modification time of the text file
+ *  it was cooked from.  A cooked file without its text file
+ *  next to it is used as it is.
+ ***********************************************************/
+bool SceneFile::IsCookedCurrent(const char* filename) const
+{
+	uint32_t size = 0;
+	uint64_t time = 0;
+	if (GetFileStamp(filename, size, time) == false)
+	{
+		return(true);
+	}
+
+	return((m_sourceSize == size) && (m_sourceTime == time));
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method is used for releasing the mapping or the
+ *  parsed tables of the opened scene.
+ ***********************************************************/
+void SceneFile::Close()
+{
+	m_cookedFile.Close();
+	m_textTextures.clear();
+	m_textMaterials.clear();
+	m_textParts.clear();
+
+	m_pTextures = NULL;
+	m_nTextures = 0;
+	m_pMaterials = NULL;
+	m_nMaterials = 0;
+	m_pParts = NULL;
+	m_nParts = 0;
+	m_sourceSize = 0;
+	m_sourceTime = 0;
+}
+
+/***********************************************************
+ *  LoadCooked()
+ *
+ *  This method is used for mapping a cooked scene file and
+ *  pointing the tables into the mapping, after checking that
+ *  the header matches the size of the file.
+ ***********************************************************/
+bool SceneFile::LoadCooked(const char* filename)
+{
+	Close();
+	if (m_cookedFile.Open(filename) == false)
+	{
+		return(false);
+	}
+
+	const unsigned char* pData = m_cookedFile.GetData();
+	size_t size = m_cookedFile.GetSize();
+	if (size < sizeof(SCENE_HEADER))
+	{
+		std::cout << "Cooked scene file is too short:" << filename << std::endl;
+		Close();
+		return(false);
+	}
+
+	const SCENE_HEADER* pHeader = (const SCENE_HEADER*)pData;
+	uint64_t expectedSize = sizeof(SCENE_HEADER) +
+		(uint64_t)pHeader->nTextures * sizeof(SCENE_TEXTURE) +
+		(uint64_t)pHeader->nMaterials * sizeof(SCENE_MATERIAL) +
+		(uint64_t)pHeader->nParts * sizeof(SCENE_PART);
+	if ((SCENE_FILE_MAGIC != pHeader->magic) ||
+		(SCENE_FILE_VERSION != pHeader->version) ||
+		(expectedSize != size))
+	{
+		std::cout << "Cooked scene file does not match this version:" << filename << std::endl;
+		Close();
+		return(false);
+	}
+
+	size_t offset = sizeof(SCENE_HEADER);
+	m_pTextures = (const SCENE_TEXTURE*)(pData + offset);
+	m_nTextures = (int)pHeader->nTextures;
+	offset += m_nTextures * sizeof(SCENE_TEXTURE);
+	m_pMaterials = (const SCENE_MATERIAL*)(pData + offset);
+	m_nMaterials = (int)pHeader->nMaterials;
+	offset += m_nMaterials * sizeof(SCENE_MATERIAL);
+	m_pParts = (const SCENE_PART*)(pData + offset);
+	m_nParts = (int)pHeader->nParts;
+	m_sourceSize = pHeader->sourceSize;
+	m_sourceTime = ((uint64_t)pHeader->sourceTimeHigh << 32) | pHeader->sourceTimeLow;
+
+	return(true);
+}
+
+/***********************************************************
+ *  LoadText()
+ *
+ *  This method is used for parsing a text scene description.
+ *  The file is read whole and every line is cut into words
+ *  in place, and the model matrices of all the parts are
+ *  built together once every line is read, so the parts are
+ *  used like the cooked ones.  A line that cannot be read is
+ *  reported and skipped.
+ ***********************************************************/
+bool SceneFile::LoadText(const char* filename)
+{
+	Close();
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open scene file:" << filename << std::endl;
+		return(false);
+	}
+	// the cooked file written from the parsed scene remembers
+	// which version of the text it came from
+	GetFileStamp(filename, m_sourceSize, m_sourceTime);
+
+	std::vector<char> text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	text.push_back('\0');
+	// one part for every line at most
+	m_textParts.reserve(std::count(text.begin(), text.end(), '\n') + 1);
+	TransformBatch transforms;
+
+	int lineNumber = 0;
+	char* pLine = text.data();
+	while (NULL != pLine)
+	{
+		lineNumber++;
+		char* pNextLine = strchr(pLine, '\n');
+		if (NULL != pNextLine)
+		{
+			*pNextLine = '\0';
+			pNextLine++;
+		}
+
+		char* pCursor = pLine;
+		char* pKeyword = NextToken(pCursor);
+		pLine = pNextLine;
+		if (NULL == pKeyword)
+		{
+			continue;
+		}
+
+		if (strcmp(pKeyword, "texture") == 0)
+		{
+			char* pTag = NextToken(pCursor);
+			char* pFilename = NextToken(pCursor);
+			SCENE_TEXTURE texture;
+			if ((NULL == pTag) || (NULL == pFilename) ||
+				!CopyTag(texture.tag, sizeof(texture.tag), pTag) ||
+				!CopyTag(texture.filename, sizeof(texture.filename), pFilename))
+			{
+				std::cout << filename << "(" << lineNumber << "): bad texture line" << std::endl;
+				continue;
+			}
+			m_textTextures.push_back(texture);
+		}
+		else if (strcmp(pKeyword, "part") == 0)
+		{
+			char* pMesh = NextToken(pCursor);
+			char* pTexture = NextToken(pCursor);
+			char* pMaterial = NextToken(pCursor);
+			float values[g_PartValues];
+			int nValues = 0;
+			char* pValue = NULL;
+			while ((nValues < g_PartValues) && (NULL != (pValue = NextToken(pCursor))))
+			{
+				char* pEnd = NULL;
+				values[nValues] = strtof(pValue, &pEnd);
+				if ('\0' != *pEnd)
+				{
+					break;
+				}
+				nValues++;
+			}
+
+			int mesh = (NULL != pMesh) ? FindMeshType(pMesh) : -1;
+			if ((NULL == pMaterial) || (mesh < 0) || (nValues != g_PartValues))
+			{
+				std::cout << filename << "(" << lineNumber << "): bad part line" << std::endl;
+				continue;
+			}
+
+			SCENE_PART part;
+			memset((void*)&part, 0, sizeof(part));
+			part.mesh = mesh;
+			part.texture = -1;
+			if (strcmp(pTexture, g_NoneTag) != 0)
+			{
+				for (size_t i = 0; i < m_textTextures.size(); i++)
+				{
+					if (strcmp(m_textTextures[i].tag, pTexture) == 0)
+					{
+						part.texture = (int32_t)i;
+						break;
+					}
+				}
+				if (part.texture < 0)
+				{
+					std::cout << filename << "(" << lineNumber << "): unknown texture " << pTexture << std::endl;
+				}
+			}
+			part.material = (strcmp(pMaterial, g_NoneTag) != 0) ? AddMaterialTag(pMaterial) : -1;
+
+			memcpy(part.color, &values[9], sizeof(part.color));
+			memcpy(part.UVscale, &values[13], sizeof(part.UVscale));
+
+			char* pFlag = NULL;
+			while (NULL != (pFlag = NextToken(pCursor)))
+			{
+				if (strcmp(pFlag, "flicker") == 0)
+				{
+					part.flags |= PART_FLICKER;
+				}
+				else
+				{
+					std::cout << filename << "(" << lineNumber << "): unknown part flag " << pFlag << std::endl;
+				}
+			}
+			// the model matrix is built below with the others,
+			// from the scale, rotation and position
+			transforms.AddTransform(&values[0], &values[3], &values[6]);
+			m_textParts.push_back(part);
+		}
+		else
+		{
+			std::cout << filename << "(" << lineNumber << "): unknown entry " << pKeyword << std::endl;
+		}
+	}
+
+	std::vector<float> matrices(transforms.GetCount() * 16);
+	transforms.Compose(matrices.data());
+	for (size_t i = 0; i < m_textParts.size(); i++)
+	{
+		memcpy(m_textParts[i].model, &matrices[i * 16], sizeof(m_textParts[i].model));
+	}
+
+	UseTextTables();
+	return(true);
+}
+
+/***********************************************************
+ *  WriteCooked()
+ *
+ *  This method is used for writing the opened scene into a
+ *  cooked file, which is loaded by mapping it.  The size and
+ *  modification time of the text file go into the header.
+ ***********************************************************/
+bool SceneFile::WriteCooked(const char* filename) const
+{
+	FILE* pFile = fopen(filename, "wb");
+	if (NULL == pFile)
+	{
+		std::cout << "Could not write cooked scene file:" << filename << std::endl;
+		return(false);
+	}
+
+	SCENE_HEADER header;
+	memset((void*)&header, 0, sizeof(header));
+	header.magic = SCENE_FILE_MAGIC;
+	header.version = SCENE_FILE_VERSION;
+	header.nTextures = (uint32_t)m_nTextures;
+	header.nMaterials = (uint32_t)m_nMaterials;
+	header.nParts = (uint32_t)m_nParts;
+	header.sourceSize = m_sourceSize;
+	header.sourceTimeLow = (uint32_t)m_sourceTime;
+	header.sourceTimeHigh = (uint32_t)(m_sourceTime >> 32);
+
+	bool bWritten =
+		(fwrite(&header, sizeof(header), 1, pFile) == 1) &&
+		(fwrite(m_pTextures, sizeof(SCENE_TEXTURE), m_nTextures, pFile) == (size_t)m_nTextures) &&
+		(fwrite(m_pMaterials, sizeof(SCENE_MATERIAL), m_nMaterials, pFile) == (size_t)m_nMaterials) &&
+		(fwrite(m_pParts, sizeof(SCENE_PART), m_nParts, pFile) == (size_t)m_nParts);
+	fclose(pFile);
+
+	if (bWritten == false)
+	{
+		std::cout << "Could not write cooked scene file:" << filename << std::endl;
+	}
+	return(bWritten);
+}
+
+/***********************************************************
+ *  AddMaterialTag()
+ *
+ *  This method is used for getting the index of a material
+ *  tag in the material table, adding the tag when it is new.
+ ***********************************************************/
+int SceneFile::AddMaterialTag(const std::string& tag)
+{
+	for (size_t i = 0; i < m_textMaterials.size(); i++)
+	{
+		if (tag == m_textMaterials[i].tag)
+		{
+			return((int)i);
+		}
+	}
+
+	SCENE_MATERIAL material;
+	if (CopyTag(material.tag, sizeof(material.tag), tag.c_str()) == false)
+	{
+		std::cout << "Material tag is too long:" << tag << std::endl;
+		return(-1);
+	}
+	m_textMaterials.push_back(material);
+
+	return((int)m_textMaterials.size() - 1);
+}
+
+/***********************************************************
+ *  UseTextTables()
+ *
+ *  This method is used for pointing the tables of the scene
+ *  at the tables parsed from the text file.
+ ***********************************************************/
+void SceneFile::UseTextTables()
+{
+	m_pTextures = m_textTextures.data();
+	m_nTextures = (int)m_textTextures.size();
+	m_pMaterials = m_textMaterials.data();
+	m_nMaterials = (int)m_textMaterials.size();
+	m_pParts = m_textParts.data();
+	m_nParts = (int)m_textParts.size();
+}
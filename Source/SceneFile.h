@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.h
+// ============
+// read the parts of a scene from a text description or from its cooked
+// binary form, which is mapped and used in place
+//
+//	The text form is written by hand, one line per entry:
+//
+//		texture <tag> <image file>
+//		part <mesh> <texture tag|-> <material tag|-> <sx sy sz> <rx ry rz>
+//		     <px py pz> <r g b a> <u v> [flicker]
+//
+//	with the rotation in degrees around X, Y and Z, and '#' starting a
+//	comment.  The cooked form holds the same tables with the model matrix
+//	of every part already built, so loading it is a single mapping.  The
+//	scene loader prefers the cooked file next to the text file as long as
+//	the size and modification time of the text file are the ones it was
+//	cooked from, and parses the text again otherwise.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// extension of the cooked scene files
+#define SCENE_COOKED_EXTENSION ".bin"
+// identifier and version at the start of every cooked scene file
+#define SCENE_FILE_MAGIC 0x454E4353
+#define SCENE_FILE_VERSION 2
+// longest tag and image file name, with the terminating zero
+#define SCENE_TAG_LENGTH 32
+#define SCENE_PATH_LENGTH 96
+
+/***********************************************************
+ *  SceneFile
+ *
+ *  This class contains the code for parsing the text scene
+ *  description, mapping the cooked scene file and writing
+ *  the cooked file from a parsed description.
+ ***********************************************************/
+class SceneFile
+{
+public:
+	// constructor
+	SceneFile();
+
+	// header at the start of a cooked file, followed by the
+	// texture, material and part tables
+	struct SCENE_HEADER
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t nTextures;
+		uint32_t nMaterials;
+		uint32_t nParts;
+		// size and modification time of the text file the scene
+		// was cooked from
+		uint32_t sourceSize;
+		uint32_t sourceTimeLow;
+		uint32_t sourceTimeHigh;
+	};
+
+	// texture image of the scene and the tag the parts use
+	struct SCENE_TEXTURE
+	{
+		char tag[SCENE_TAG_LENGTH];
+		char filename[SCENE_PATH_LENGTH];
+	};
+
+	// material tag used by the parts, defined by the scene code
+	struct SCENE_MATERIAL
+	{
+		char tag[SCENE_TAG_LENGTH];
+	};
+
+	// flags of a scene part
+	enum PART_FLAGS
+	{
+		// the part follows the flickering flame light
+		PART_FLICKER = 1
+	};
+
+	// a part of the scene, with the texture and material as
+	// indices into the tables of the file, -1 for none
+	struct SCENE_PART
+	{
+		int32_t mesh;
+		int32_t texture;
+		int32_t material;
+		uint32_t flags;
+		float model[16];
+		float color[4];
+		float UVscale[2];
+		float padding[2];
+	};
+
+	// open a scene - the cooked file next to the passed in text
+	// file is mapped when it was cooked from the text file as it
+	// is now, the text is parsed otherwise
+	bool Open(const char* filename);
+	// parse a text scene description
+	bool LoadText(const char* filename);
+	// map a cooked scene file
+	bool LoadCooked(const char* filename);
+	// write the opened scene as a cooked file
+	bool WriteCooked(const char* filename) const;
+	// release the parts of the scene
+	void Close();
+
+	// name of the cooked file of a text scene file
+	static std::string GetCookedFilename(const char* filename);
+
+	// tables of the opened scene
+	int GetTextureCount() const { return m_nTextures; }
+	const SCENE_TEXTURE* GetTextures() const { return m_pTextures; }
+	int GetMaterialCount() const { return m_nMaterials; }
+	const SCENE_MATERIAL* GetMaterials() const { return m_pMaterials; }
+	int GetPartCount() const { return m_nParts; }
+	const SCENE_PART* GetParts() const { return m_pParts; }
+
+private:
+	// mapping of a cooked file
+	MappedFile m_cookedFile;
+	// tables parsed from a text file
+	std::vector<SCENE_TEXTURE> m_textTextures;
+	std::vector<SCENE_MATERIAL> m_textMaterials;
+	std::vector<SCENE_PART> m_textParts;
+
+	// tables of the opened scene, in the mapping or the vectors
+	const SCENE_TEXTURE* m_pTextures;
+	int m_nTextures;
+	const SCENE_MATERIAL* m_pMaterials;
+	int m_nMaterials;
+	const SCENE_PART* m_pParts;
+	int m_nParts;
+	// size and modification time of the text file the scene was
+	// parsed or cooked from
+	uint32_t m_sourceSize;
+	uint64_t m_sourceTime;
+
+	// get the size and modification time of a file - returns
+	// false when it cannot be read
+	static bool GetFileStamp(const char* filename, uint32_t& size, uint64_t& time);
+	// whether the opened cooked file was cooked from the passed
+	// in text file as it is now
+	bool IsCookedCurrent(const char* filename) const;
+
+	// index of a material tag, added to the table when new
+	int AddMaterialTag(const std::string& tag);
+	// point the tables at the parsed vectors
+	void UseTextTables();
+};
@@ -16,19 +16,92 @@
 #endif
 
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <GLFW/glfw3.h>
-#include <random>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
 
 // declaration of global variables and defines
 namespace
 {
-	const char* g_ModelName = "model";
-	const char* g_ColorValueName = "objectColor";
-	const char* g_TextureValueName = "objectTexture";
-	const char* g_UseTextureName = "bUseTexture";
+	const char* g_TextureArraysName = "textureArrays";
+	const char* g_PointLightDataName = "pointLightData";
+	const char* g_ClusterLightDataName = "clusterLightData";
+	const char* g_LightClusterShaderFile = "shaders/lightClusterComputeShader.glsl";
+	const char* g_DepthPyramidShaderFile = "shaders/depthPyramidComputeShader.glsl";
+	const char* g_OcclusionCullShaderFile = "shaders/occlusionCullComputeShader.glsl";
+	const char* g_CascadeShadowMapName = "cascadeShadowMap";
+	const char* g_PointShadowMapName = "pointShadowMap";
+	const char* g_GBufferAlbedoMapName = "gbufferAlbedoMap";
+	const char* g_GBufferNormalMapName = "gbufferNormalMap";
+	const char* g_GBufferDepthMapName = "gbufferDepthMap";
+	const char* g_ShadowVertexShaderFile = "shaders/shadowVertexShader.glsl";
+	const char* g_ShadowFragmentShaderFile = "shaders/shadowFragmentShader.glsl";
 	const char* g_UseLightingName = "bUseLighting";
 	glm::vec3 flameColor;
 
+	// layout of the 64-bit render queue sort keys, from the
+	// highest bit down:
+	//	63		pass, set for transparent parts so all the opaque
+	//			parts are drawn first
+	//	62		textured, so the parts drawn with one shader
+	//			variant are together
+	//	57-61	mesh
+	//	55-56	level of detail, so parts with the same mesh and
+	//			level share a draw command
+	//	46-54	texture slot plus one, so parts with the same
+	//			texture are drawn one after another
+	//	39-45	material index plus one, so the material values
+	//			change the least between batches
+	//	0-19	draw list index, so the queue can be walked
+	//			without a second lookup
+	// Transparent keys only set the pass and the draw list index
+	// of these, and hold their inverted view depth in bits 20-51
+	// instead, so they are drawn from back to front.
+	const int g_SortPassShift = 63;
+	const int g_SortVariantShift = 62;
+	const int g_SortMeshShift = 57;
+	const int g_SortLodShift = 55;
+	const int g_SortTextureShift = 46;
+	const int g_SortMaterialShift = 39;
+	const int g_SortDepthShift = 20;
+	const uint64_t g_SortIndexMask = (1 << g_SortDepthShift) - 1;
+
+	// constant, linear and quadratic attenuation terms of the
+	// scene point lights, which fade them out over about a
+	// table length, so far away lights are left out of the
+	// clusters
+	const float g_PointLightConstant = 1.0f;
+	const float g_PointLightLinear = 0.22f;
+	const float g_PointLightQuadratic = 0.2f;
+
+	// height of a part on the screen, as a fraction of the view
+	// height, below which the next coarser level of detail is
+	// drawn
+	const float g_LodScreenSizes[MESH_LOD_COUNT - 1] = { 0.2f, 0.06f };
+	// fraction of a screen size a part has to move past before
+	// its level of detail changes, so parts do not pop back and
+	// forth at a boundary
+	const float g_LodHysteresis = 0.15f;
+
+	// time in seconds spent uploading loaded textures per frame
+	const double g_TextureUploadBudget = 0.002;
+
+	// scene description loaded unless another one is set
+	const char* g_SceneFile = "scenes/scene.txt";
+
+	// distance between the copies of a stress scene, over the
+	// size of the objects
+	const float g_ReplicaSpacing = 1.1f;
+
+	// parts in every chunk of the per-frame loops run on the job
+	// system, enough to outweigh handing a chunk to a thread
+	const size_t g_JobChunkSize = 1024;
 }
 
 /***********************************************************
@@ -36,19 +109,69 @@ namespace
  *
  *  The constructor for the class
  ***********************************************************/
-SceneManager::SceneManager(ShaderManager *pShaderManager)
+SceneManager::SceneManager(
+	ShaderManager *pShaderManager,
+	ShaderUniforms *pShaderUniforms,
+	UniformBuffers *pUniformBuffers)
 {
 	m_pShaderManager = pShaderManager;
-	// create the shape meshes object
-	m_basicMeshes = new ShapeMeshes();
+	m_pShaderUniforms = pShaderUniforms;
+	m_pUniformBuffers = pUniformBuffers;
+	// share the shape meshes with the other scenes
+	m_basicMeshes = MeshLibrary::Acquire();
+	// create the texture loader and its worker threads
+	m_pTextureLoader = new TextureLoader();
+
+	// create the owner of the scene textures
+	m_pTextureResidency = new TextureResidency(pUniformBuffers);
+	// create the point light clusters
+	m_pLightClusters = new LightClusters();
+	// create the shadow maps of the moonlight and the flame
+	m_pShadowMaps = new ShadowMaps(pUniformBuffers);
+	// create the animated values of the scene
+	m_pSceneAnimator = new SceneAnimator();
+	// create the worker threads of the per-frame loops
+	m_pJobSystem = new JobSystem();
+	// create the scratch memory of every frame
+	m_pFrameArena = new FrameArena();
+	m_pChunkKeys = NULL;
+	m_pChunkKeyCounts = NULL;
+	// create the buffer the values of every frame are streamed
+	// through, which is mapped once the scene is prepared
+	m_pStreamBuffer = new StreamBuffer();
+	m_bSimulatedAnimation = false;
+	m_pAnimationChanges = NULL;
+	// create the G-buffer of the deferred path
+	m_pDeferredRenderer = new DeferredRenderer();
+	// create the culling of the parts hidden behind others
+	m_pOcclusionCuller = new OcclusionCuller();
+	m_renderPath = RENDER_FORWARD;
+	m_bDeferredAvailable = false;
+	m_pDepthShaderManager = NULL;
+	m_bDepthPrePass = true;
+	m_pShaderVariants = NULL;
+	m_bUseLighting = false;
+	m_lightingVariant = 0;
+	m_pProfiler = NULL;
+	for (int i = 0; i < PROFILE_SCOPE_COUNT; i++)
+	{
+		m_profileScopes[i] = -1;
+	}
+	m_sceneReplicas = 1;
+
+	m_sceneFilename = g_SceneFile;
+	m_flameItem = -1;
+	m_flameLight = -1;
+
+	m_viewMatrix = glm::mat4(1.0f);
+	m_projectionMatrix = glm::mat4(1.0f);
+	m_viewPosition = glm::vec3(0.0f);
 
-	// initialize the texture collection
-	for (int i = 0; i < 16; i++)
+	// nothing is culled until the first view is set
+	for (int i = 0; i < 6; i++)
 	{
-		m_textureIDs[i].tag = "/0";
-		m_textureIDs[i].ID = -1;
+		m_frustumPlanes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 	}
-	m_loadedTextures = 0;
 }
 
 /***********************************************************
@@ -58,106 +181,116 @@ SceneManager::SceneManager(ShaderManager *pShaderManager)
  ***********************************************************/
 SceneManager::~SceneManager()
 {
+	// the uniform buffers and the shared meshes are handed the
+	// stream buffer on every call, so nothing outliving the
+	// scene points at it
+	if (NULL != m_pStreamBuffer)
+	{
+		delete m_pStreamBuffer;
+		m_pStreamBuffer = NULL;
+	}
+
 	// free the allocated objects
 	m_pShaderManager = NULL;
+	m_pShaderUniforms = NULL;
+	m_pUniformBuffers = NULL;
+	m_pDepthShaderManager = NULL;
+	m_pShaderVariants = NULL;
+	m_pProfiler = NULL;
 	if (NULL != m_basicMeshes)
 	{
-		delete m_basicMeshes;
+		MeshLibrary::Release(m_basicMeshes);
 		m_basicMeshes = NULL;
 	}
+	if (NULL != m_pTextureLoader)
+	{
+		delete m_pTextureLoader;
+		m_pTextureLoader = NULL;
+	}
 
 	// free the allocated OpenGL textures
 	DestroyGLTextures();
+	if (NULL != m_pTextureResidency)
+	{
+		delete m_pTextureResidency;
+		m_pTextureResidency = NULL;
+	}
+	if (NULL != m_pLightClusters)
+	{
+		delete m_pLightClusters;
+		m_pLightClusters = NULL;
+	}
+	if (NULL != m_pShadowMaps)
+	{
+		delete m_pShadowMaps;
+		m_pShadowMaps = NULL;
+	}
+	if (NULL != m_pSceneAnimator)
+	{
+		delete m_pSceneAnimator;
+		m_pSceneAnimator = NULL;
+	}
+	if (NULL != m_pJobSystem)
+	{
+		delete m_pJobSystem;
+		m_pJobSystem = NULL;
+	}
+	if (NULL != m_pFrameArena)
+	{
+		delete m_pFrameArena;
+		m_pFrameArena = NULL;
+	}
+	if (NULL != m_pOcclusionCuller)
+	{
+		delete m_pOcclusionCuller;
+		m_pOcclusionCuller = NULL;
+	}
+	if (NULL != m_pDeferredRenderer)
+	{
+		delete m_pDeferredRenderer;
+		m_pDeferredRenderer = NULL;
+	}
 }
 
 /***********************************************************
  *  CreateGLTexture()
  *
- *  This method is used for loading textures from image files,
- *  configuring the texture mapping parameters in OpenGL, 
- *  generating the mipmaps, and loading the read texture into
- *  the next available texture slot in memory.
+ *  This method is used for requesting a texture from an
+ *  image file and registering it in the next available
+ *  texture slot.  The texture shows a placeholder image
+ *  until the texture loader has decoded and uploaded the
+ *  image file, without its texture object changing.
  ***********************************************************/
 bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
 {
-	int width = 0;
-	int height = 0;
-	int colorChannels = 0;
-	GLuint textureID = 0;
-
-	// indicate to always flip images vertically when loaded
-	stbi_set_flip_vertically_on_load(true);
-
-	// try to parse the image data from the specified image file
-	unsigned char* image = stbi_load(
-		filename, 
-		&width, 
-		&height, 
-		&colorChannels, 
-		0);
-
-	// if the image was successfully read from the image file
-	if (image)
-	{
-		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// if the loaded image is in RGB format
-		if (colorChannels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		// if the loaded image is in RGBA format - it supports transparency
-		else if (colorChannels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
-		{
-			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
-			return false;
-		}
-
-		// generate the texture mipmaps for mapping textures to lower resolutions
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// free the image data from local memory
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-		// register the loaded texture and associate it with the special tag string
-		m_textureIDs[m_loadedTextures].ID = textureID;
-		m_textureIDs[m_loadedTextures].tag = tag;
-		m_loadedTextures++;
-
-		return true;
+	if (m_pTextureResidency->GetTextureCount() >= TOTAL_TEXTURES)
+	{
+		std::cout << "No texture slot left for image:" << filename << std::endl;
+		return false;
 	}
 
-	std::cout << "Could not load image:" << filename << std::endl;
+	GLuint textureID = m_pTextureLoader->RequestTexture(filename);
+
+	// register the requested texture and associate it with the special tag string
+	TEXTURE_INFO texture;
+	texture.ID = textureID;
+	texture.tag = tag;
+	m_textureIDs.push_back(texture);
+	m_textureSlots[tag] = m_pTextureResidency->AddTexture(textureID);
 
-	// Error loading the image
-	return false;
+	return true;
 }
 
 /***********************************************************
  *  BindGLTextures()
  *
- *  This method is used for binding the loaded textures to
- *  OpenGL texture memory slots.  There are up to 16 slots.
+ *  This method is used for binding the texture arrays to
+ *  their texture units.  Textures are not bound per draw,
+ *  the shader finds them by their slot in the texture block.
  ***********************************************************/
 void SceneManager::BindGLTextures()
 {
-	for (int i = 0; i < m_loadedTextures; i++)
-	{
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
-	}
+	m_pTextureResidency->BindTextures();
 }
 
 /***********************************************************
@@ -168,10 +301,12 @@ void SceneManager::BindGLTextures()
  ***********************************************************/
 void SceneManager::DestroyGLTextures()
 {
-	for (int i = 0; i < m_loadedTextures; i++)
+	if (NULL != m_pTextureResidency)
 	{
-		glGenTextures(1, &m_textureIDs[i].ID);
+		m_pTextureResidency->DestroyTextures();
 	}
+	m_textureIDs.clear();
+	m_textureSlots.clear();
 }
 
 /***********************************************************
@@ -180,24 +315,15 @@ void SceneManager::DestroyGLTextures()
  *  This method is used for getting an ID for the previously
  *  loaded texture bitmap associated with the passed in tag.
  ***********************************************************/
-int SceneManager::FindTextureID(std::string tag)
+int SceneManager::FindTextureID(const std::string& tag) const
 {
-	int textureID = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
+	int textureSlot = FindTextureSlot(tag);
+	if (textureSlot < 0)
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureID = m_textureIDs[index].ID;
-			bFound = true;
-		}
-		else
-			index++;
+		return(-1);
 	}
-	
-	return(textureID);
+
+	return(m_pTextureResidency->GetTextureID(textureSlot));
 }
 
 /***********************************************************
@@ -206,24 +332,15 @@ int SceneManager::FindTextureID(std::string tag)
  *  This method is used for getting a slot index for the previously
  *  loaded texture bitmap associated with the passed in tag.
  ***********************************************************/
-int SceneManager::FindTextureSlot(std::string tag)
+int SceneManager::FindTextureSlot(const std::string& tag) const
 {
-	int textureSlot = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
+	std::unordered_map<std::string, int>::const_iterator found = m_textureSlots.find(tag);
+	if (found == m_textureSlots.end())
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureSlot = index;
-			bFound = true;
-		}
-		else
-			index++;
+		return(-1);
 	}
 
-	return(textureSlot);
+	return(found->second);
 }
 
 /***********************************************************
@@ -232,210 +349,745 @@ int SceneManager::FindTextureSlot(std::string tag)
  *  This method is used for getting a material from the previously
  *  defined materials list that is associated with the passed in tag.
  ***********************************************************/
-bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL &material)
+bool SceneManager::FindMaterial(const std::string& tag, OBJECT_MATERIAL &material) const
 {
-	if (m_objectMaterials.size() == 0)
+	int index = FindMaterialIndex(tag);
+	if (index < 0)
 	{
 		return(false);
 	}
 
-	int index = 0;
-	bool bFound = false;
-	while ((index < m_objectMaterials.size()) && (bFound == false))
+	material = m_objectMaterials[index];
+
+	return(true);
+}
+
+/***********************************************************
+ *  FindMaterialIndex()
+ *
+ *  This method is used for getting the index of the previously
+ *  defined material associated with the passed in tag.
+ ***********************************************************/
+int SceneManager::FindMaterialIndex(const std::string& tag) const
+{
+	std::unordered_map<std::string, int>::const_iterator found = m_materialIndices.find(tag);
+	if (found == m_materialIndices.end())
 	{
-		if (m_objectMaterials[index].tag.compare(tag) == 0)
-		{
-			bFound = true;
-			material.diffuseColor = m_objectMaterials[index].diffuseColor;
-			material.specularColor = m_objectMaterials[index].specularColor;
-			material.shininess = m_objectMaterials[index].shininess;
-		}
-		else
+		return(-1);
+	}
+
+	return(found->second);
+}
+
+/***********************************************************
+ *  ResolveShaderUniforms()
+ *
+ *  This method is used for getting the handles of the values
+ *  that are passed into the shader for every batch of parts,
+ *  so the uniforms are not looked up by name while rendering.
+ ***********************************************************/
+void SceneManager::ResolveShaderUniforms()
+{
+	// the shader declares the array samplers when it was not
+	// compiled for bindless textures
+	if (SetShaderSamplers(*m_pShaderUniforms))
+	{
+		m_pTextureResidency->SetMode(TextureResidency::RESIDENCY_ARRAYS);
+	}
+	else if (GLEW_ARB_bindless_texture && GLEW_NV_gpu_shader5)
+	{
+		m_pTextureResidency->SetMode(TextureResidency::RESIDENCY_BINDLESS);
+	}
+	else
+	{
+		std::cout << "The shader can not sample the scene textures" << std::endl;
+	}
+}
+
+/***********************************************************
+ *  SetShaderSamplers()
+ *
+ *  This method is used for pointing the samplers of the
+ *  program in use at the texture units their textures stay
+ *  bound to.  It returns whether the program samples the
+ *  scene textures from the texture arrays.
+ ***********************************************************/
+bool SceneManager::SetShaderSamplers(const ShaderUniforms& uniforms) const
+{
+	ShaderUniforms::UNIFORM<int> firstArray =
+		uniforms.GetUniform<int>(std::string(g_TextureArraysName) + "[0]");
+	if (firstArray.location >= 0)
+	{
+		for (int i = 0; i < TOTAL_TEXTURE_ARRAYS; i++)
 		{
-			index++;
+			ShaderUniforms::UNIFORM<int> textureArray = uniforms.GetUniform<int>(
+				std::string(g_TextureArraysName) + "[" + std::to_string(i) + "]");
+			uniforms.SetValue(textureArray, i);
 		}
 	}
 
-	return(true);
+	// the point lights and the cluster lists are read through
+	// buffer textures
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_PointLightDataName), (int)LightClusters::UNIT_POINT_LIGHTS);
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_ClusterLightDataName), (int)LightClusters::UNIT_CLUSTER_LIGHTS);
+
+	// the shadow maps stay bound to the units above them
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_CascadeShadowMapName), (int)ShadowMaps::UNIT_CASCADE_SHADOWS);
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_PointShadowMapName), (int)ShadowMaps::UNIT_POINT_SHADOW);
+
+	// the deferred lighting pass reads the G-buffer
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_GBufferAlbedoMapName), (int)DeferredRenderer::UNIT_GBUFFER_ALBEDO);
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_GBufferNormalMapName), (int)DeferredRenderer::UNIT_GBUFFER_NORMAL);
+	uniforms.SetValue(
+		uniforms.GetUniform<int>(g_GBufferDepthMapName), (int)DeferredRenderer::UNIT_GBUFFER_DEPTH);
+
+	return(firstArray.location >= 0);
 }
 
 /***********************************************************
- *  SetTransformations()
+ *  GetItemVariant()
  *
- *  This method is used for setting the transform buffer
- *  using the passed in transformation values.
+ *  This method is used for getting the variant features of
+ *  the program that draws a part - the lighting of the frame
+ *  and whether the part is textured.
  ***********************************************************/
-void SceneManager::SetTransformations(
-	glm::vec3 scaleXYZ,
-	float XrotationDegrees,
-	float YrotationDegrees,
-	float ZrotationDegrees,
-	glm::vec3 positionXYZ)
+unsigned int SceneManager::GetItemVariant(const DRAW_ITEM& item) const
 {
-	// variables for this method
-	glm::mat4 modelView;
-	glm::mat4 scale;
-	glm::mat4 rotationX;
-	glm::mat4 rotationY;
-	glm::mat4 rotationZ;
-	glm::mat4 translation;
+	unsigned int flags = m_lightingVariant;
+	if (item.textureSlot >= 0)
+	{
+		flags |= ShaderVariants::VARIANT_TEXTURED;
+	}
+	return(flags);
+}
 
-	// set the scale value in the transform buffer
-	scale = glm::scale(scaleXYZ);
-	// set the rotation values in the transform buffer
-	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
-	// set the translation value in the transform buffer
-	translation = glm::translate(positionXYZ);
+/***********************************************************
+ *  GetGBufferVariant()
+ *
+ *  This method is used for getting the variant features of
+ *  the program that writes a part into the G-buffer, which
+ *  only depend on whether the part is textured, since the
+ *  lights are added by the lighting pass.
+ ***********************************************************/
+unsigned int SceneManager::GetGBufferVariant(const DRAW_ITEM& item) const
+{
+	unsigned int flags = ShaderVariants::VARIANT_GBUFFER;
+	if (item.textureSlot >= 0)
+	{
+		flags |= ShaderVariants::VARIANT_TEXTURED;
+	}
+	return(flags);
+}
 
-	modelView = translation * rotationZ * rotationY * rotationX * scale;
+/***********************************************************
+ *  BuildVariantProgram()
+ *
+ *  This method is used for building the program of a shader
+ *  variant.  A variant that is not built yet is built and
+ *  set up with the buffer bindings and samplers of the
+ *  scene.  The shader without variants is used when there
+ *  are no variants or one can not be built.  Only the
+ *  preparation of the variants builds them, never a frame.
+ ***********************************************************/
+GLuint SceneManager::BuildVariantProgram(unsigned int flags)
+{
+	if (NULL == m_pShaderVariants)
+	{
+		return(m_pShaderManager->m_programID);
+	}
 
-	if (NULL != m_pShaderManager)
+	GLuint program = m_pShaderVariants->FindProgram(flags);
+	if (0 != program)
 	{
-		m_pShaderManager->setMat4Value(g_ModelName, modelView);
+		return(program);
 	}
+
+	program = m_pShaderVariants->BuildProgram(flags);
+	if (0 == program)
+	{
+		return(m_pShaderManager->m_programID);
+	}
+
+	glUseProgram(program);
+	m_pUniformBuffers->BindProgramBlocks(program);
+	ShaderUniforms uniforms;
+	uniforms.ResolveUniforms(program);
+	SetShaderSamplers(uniforms);
+	m_pShaderManager->use();
+
+	return(program);
 }
 
 /***********************************************************
- *  SetShaderColor()
+ *  FindVariantProgram()
  *
- *  This method is used for setting the passed in color
- *  into the shader for the next draw command
+ *  This method is used for getting the program a frame draws
+ *  a shader variant with, which the preparation of the
+ *  variants built.  The shader without variants is used
+ *  when there are no variants or the variant did not build.
  ***********************************************************/
-void SceneManager::SetShaderColor(
-	float redColorValue,
-	float greenColorValue,
-	float blueColorValue,
-	float alphaValue)
+GLuint SceneManager::FindVariantProgram(unsigned int flags) const
 {
-	// variables for this method
-	glm::vec4 currentColor;
+	GLuint program = (NULL != m_pShaderVariants) ? m_pShaderVariants->FindProgram(flags) : 0;
+	return((0 != program) ? program : m_pShaderManager->m_programID);
+}
 
-	currentColor.r = redColorValue;
-	currentColor.g = greenColorValue;
-	currentColor.b = blueColorValue;
-	currentColor.a = alphaValue;
+/***********************************************************
+ *  UpdateLightingVariant()
+ *
+ *  This method is used for finding the variant features of
+ *  the lighting from the lights that are active, so the
+ *  variants leave out the code of the lights that are off.
+ ***********************************************************/
+void SceneManager::UpdateLightingVariant()
+{
+	m_lightingVariant = 0;
+	if (m_bUseLighting == false)
+	{
+		return;
+	}
 
-	if (NULL != m_pShaderManager)
+	// the lights are only read, so the light block is not
+	// uploaded again for it
+	const UniformBuffers& uniformBuffers = *m_pUniformBuffers;
+	const UniformBuffers::LIGHT_DATA& lights = uniformBuffers.GetLightData();
+	m_lightingVariant |= ShaderVariants::VARIANT_LIT;
+	if (0 != lights.directionalLight.bActive)
 	{
-		m_pShaderManager->setIntValue(g_UseTextureName, false);
-		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
+		m_lightingVariant |= ShaderVariants::VARIANT_DIRECTIONAL_LIGHT;
+	}
+	if (m_pLightClusters->GetPointLights().empty() == false)
+	{
+		m_lightingVariant |= ShaderVariants::VARIANT_POINT_LIGHTS;
+	}
+	if (0 != lights.spotLight.bActive)
+	{
+		m_lightingVariant |= ShaderVariants::VARIANT_SPOT_LIGHT;
 	}
 }
 
 /***********************************************************
- *  SetShaderTexture()
+ *  PrepareShaderVariants()
  *
- *  This method is used for setting the texture data
- *  associated with the passed in ID into the shader.
+ *  This method is used for building the shader variants the
+ *  parts of the draw list are drawn with, so no program is
+ *  built while rendering.  The variants saved by an earlier
+ *  launch are loaded without compiling.
  ***********************************************************/
-void SceneManager::SetShaderTexture(
-	std::string textureTag)
+void SceneManager::PrepareShaderVariants()
 {
-	if (NULL != m_pShaderManager)
+	if (NULL == m_pShaderVariants)
+	{
+		return;
+	}
+
+	std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+	bool bUsed[ShaderVariants::VARIANT_COUNT] = { false };
+	for (size_t i = 0; i < m_drawList.size(); i++)
 	{
-		m_pShaderManager->setIntValue(g_UseTextureName, true);
+		unsigned int flags = GetItemVariant(m_drawList[i]);
+		if (bUsed[flags] == false)
+		{
+			BuildVariantProgram(flags);
+			bUsed[flags] = true;
+		}
+	}
 
-		int textureID = -1;
-		textureID = FindTextureSlot(textureTag);
-		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
+	// the deferred path draws the opaque parts with the G-buffer
+	// variants and lights them with one more program, and is
+	// only offered when all of them build
+	if (m_pDeferredRenderer->IsAvailable())
+	{
+		m_bDeferredAvailable = true;
+		for (size_t i = 0; i < m_drawList.size(); i++)
+		{
+			unsigned int flags = GetGBufferVariant(m_drawList[i]);
+			if ((m_drawList[i].bTransparent == false) && (bUsed[flags] == false))
+			{
+				BuildVariantProgram(flags);
+				m_bDeferredAvailable = m_bDeferredAvailable && (0 != m_pShaderVariants->FindProgram(flags));
+				bUsed[flags] = true;
+			}
+		}
+		unsigned int lightingFlags = m_lightingVariant | ShaderVariants::VARIANT_DEFERRED_LIGHTING;
+		BuildVariantProgram(lightingFlags);
+		m_bDeferredAvailable = m_bDeferredAvailable && (0 != m_pShaderVariants->FindProgram(lightingFlags));
+		if (m_bDeferredAvailable == false)
+		{
+			std::cout << "The deferred programs could not be built, the scene is drawn forward only" << std::endl;
+		}
 	}
+
+	std::cout << "Prepared shader variants (" << m_pShaderVariants->GetCachedCount() << " cached, "
+		<< m_pShaderVariants->GetCompiledCount() << " compiled) in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count()
+		<< " ms" << std::endl;
 }
 
 /***********************************************************
- *  SetTextureUVScale()
+ *  UploadObjectMaterials()
  *
- *  This method is used for setting the texture UV scale
- *  values into the shader.
+ *  This method is used for writing the defined materials
+ *  into the material buffer, in the same order as the
+ *  material indices of the parts in the draw list.
  ***********************************************************/
-void SceneManager::SetTextureUVScale(float u, float v)
+void SceneManager::UploadObjectMaterials()
 {
-	if (NULL != m_pShaderManager)
+	m_materials.resize(m_objectMaterials.size());
+
+	for (size_t i = 0; i < m_objectMaterials.size(); i++)
 	{
-		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
+		m_materials[i].diffuseColor = m_objectMaterials[i].diffuseColor;
+		m_materials[i].specularColor = m_objectMaterials[i].specularColor;
+		m_materials[i].emissiveColor = m_objectMaterials[i].emissiveColor;
+		m_materials[i].shininess = m_objectMaterials[i].shininess;
+		m_materials[i].padding0 = 0.0f;
+		m_materials[i].padding1 = 0.0f;
 	}
+
+	m_pUniformBuffers->UploadMaterials(m_materials.data(), (int)m_materials.size());
+}
+
+/***********************************************************
+ *  AddDrawItem()
+ *
+ *  This method is used for adding a part of the scene file
+ *  to the draw list.  The texture and material of the part
+ *  are indices into the tables of the file, which are
+ *  turned into texture slots and material indices through
+ *  the passed in lookups.  The mesh must already be loaded
+ *  for the bounds of the part to be found.
+ ***********************************************************/
+void SceneManager::AddDrawItem(
+	const SceneFile::SCENE_PART& part,
+	const std::vector<int>& textureSlots,
+	const std::vector<int>& materialIndices)
+{
+	DRAW_ITEM item;
+	item.mesh = (MeshLibrary::MESH_TYPE)part.mesh;
+	memcpy(glm::value_ptr(item.model), part.model, sizeof(part.model));
+	item.color = glm::vec4(part.color[0], part.color[1], part.color[2], part.color[3]);
+	item.UVscale = glm::vec2(part.UVscale[0], part.UVscale[1]);
+	item.textureSlot = ((part.texture >= 0) && (part.texture < (int)textureSlots.size())) ?
+		textureSlots[part.texture] : -1;
+	item.materialIndex = ((part.material >= 0) && (part.material < (int)materialIndices.size())) ?
+		materialIndices[part.material] : -1;
+
+	// move the bounding box of the mesh into world space - the
+	// box of the transformed box corners is found from the center
+	// and the absolute values of the transform
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	m_basicMeshes->GetMeshBounds(item.mesh, boundsMin, boundsMax);
+
+	const glm::mat4& model = item.model;
+	glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+	glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	glm::vec3 worldExtent = glm::abs(glm::vec3(model[0])) * extent.x +
+		glm::abs(glm::vec3(model[1])) * extent.y +
+		glm::abs(glm::vec3(model[2])) * extent.z;
+	item.boundsMin = center - worldExtent;
+	item.boundsMax = center + worldExtent;
+	item.lod = 0;
+
+	// solid colored parts that are not fully opaque need blending
+	item.bTransparent = (item.textureSlot < 0) && (item.color.a < 1.0f);
+
+	m_drawList.push_back(item);
 }
 
 /***********************************************************
- *  SetShaderMaterial()
+ *  CanBatchItems()
  *
- *  This method is used for passing the material values
- *  into the shader.
+ *  This method is used for checking whether two parts share
+ *  the mesh and its level of detail, and every shader value
+ *  that is not per instance, so they can be drawn with one
+ *  instanced draw command.
  ***********************************************************/
-void SceneManager::SetShaderMaterial(
-	std::string materialTag)
+bool SceneManager::CanBatchItems(const DRAW_ITEM& first, const DRAW_ITEM& second) const
 {
-	if (m_objectMaterials.size() > 0)
+	return((first.mesh == second.mesh) && (first.lod == second.lod) &&
+		CanGroupItems(first, second));
+}
+
+/***********************************************************
+ *  CanGroupItems()
+ *
+ *  This method is used for checking whether two parts share
+ *  the shader values that are not per instance and the
+ *  shader variant, so their draw commands can be submitted
+ *  with one indirect call.
+ ***********************************************************/
+bool SceneManager::CanGroupItems(const DRAW_ITEM& first, const DRAW_ITEM& second) const
+{
+	return((first.bTransparent == second.bTransparent) &&
+		((first.textureSlot >= 0) == (second.textureSlot >= 0)));
+}
+
+/***********************************************************
+ *  BuildRenderQueue()
+ *
+ *  This method is used for building a sort key for every
+ *  visible part in the draw list and sorting them.  Opaque parts are
+ *  grouped by texture, mesh and material so the fewest
+ *  shader values change between draws, and transparent parts
+ *  are drawn after them from back to front.  The parts are
+ *  culled and keyed in chunks on the job system, every chunk
+ *  sorting its own keys, and the sorted chunks are merged.
+ *  The keys of the chunks are written to the frame arena.
+ ***********************************************************/
+void SceneManager::BuildRenderQueue()
+{
+	size_t nItems = m_drawList.size();
+	size_t nChunks = (nItems + g_JobChunkSize - 1) / g_JobChunkSize;
+	// the keys hold the draw list index in their lowest bits
+	assert(nItems <= g_SortIndexMask + 1);
+	m_pChunkKeys = m_pFrameArena->AllocateArray<uint64_t>(nItems);
+	m_pChunkKeyCounts = m_pFrameArena->AllocateArray<size_t>(nChunks);
+	// a loop run as one job on the calling thread keys all the
+	// parts into the first chunk
+	memset(m_pChunkKeyCounts, 0, nChunks * sizeof(size_t));
+
+	m_pJobSystem->ParallelFor(nItems, g_JobChunkSize,
+		[this](size_t first, size_t last) { BuildChunkKeys(first, last); });
+
+	// the sorted chunks are laid side by side as the runs that
+	// are merged
+	m_renderQueue.clear();
+	m_sortRuns.clear();
+	for (size_t i = 0; i < nChunks; i++)
 	{
-		OBJECT_MATERIAL material;
-		bool bReturn = false;
+		m_sortRuns.push_back(m_renderQueue.size());
+		const uint64_t* pKeys = m_pChunkKeys + i * g_JobChunkSize;
+		m_renderQueue.insert(m_renderQueue.end(), pKeys, pKeys + m_pChunkKeyCounts[i]);
+	}
+	m_sortRuns.push_back(m_renderQueue.size());
+	MergeSortRuns();
+}
 
-		bReturn = FindMaterial(materialTag, material);
-		if (bReturn == true)
+/***********************************************************
+ *  BuildChunkKeys()
+ *
+ *  This method is used for culling the parts of one chunk of
+ *  the draw list, choosing their levels of detail and
+ *  building their sort keys into the keys of the chunk,
+ *  which are sorted.  It reads the culling arrays of the
+ *  parts, and only writes the parts and keys of its own
+ *  chunk, so the chunks can be built at the same time.
+ ***********************************************************/
+void SceneManager::BuildChunkKeys(size_t first, size_t last)
+{
+	uint64_t* pKeys = m_pChunkKeys + first;
+	size_t nKeys = 0;
+
+	for (size_t i = first; i < last; i++)
+	{
+		// parts outside the view are not drawn
+		if (IsItemVisible(i) == false)
 		{
-			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
-			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
-			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
+			continue;
 		}
+
+		// the parts of the chunk are written by this chunk only
+		int lod = SelectItemLod(i);
+		m_itemLods[i] = lod;
+		m_drawList[i].lod = lod;
+
+		uint64_t key = m_itemSortKeys[i];
+		if (0 == (key >> g_SortPassShift))
+		{
+			key |= (uint64_t)lod << g_SortLodShift;
+		}
+		else
+		{
+			// distance of the part in front of the camera - farther
+			// parts get smaller keys so they are drawn first
+			glm::vec4 viewPosition = m_viewMatrix * glm::vec4(m_itemPositions[i], 1.0f);
+			float depth = std::max(-viewPosition.z, 0.0f);
+			uint32_t depthBits = 0;
+			memcpy(&depthBits, &depth, sizeof(depthBits));
+
+			key |= (uint64_t)(0xFFFFFFFFu - depthBits) << g_SortDepthShift;
+		}
+
+		key |= (uint64_t)i & g_SortIndexMask;
+		pKeys[nKeys] = key;
+		nKeys++;
 	}
+
+	std::sort(pKeys, pKeys + nKeys);
+	m_pChunkKeyCounts[first / g_JobChunkSize] = nKeys;
 }
 
-/**************************************************************/
-/*** The code in the methods BELOW is for preparing and     ***/
-/*** rendering the 3D replicated scenes.                    ***/
-/**************************************************************/
+/***********************************************************
+ *  MergeSortRuns()
+ *
+ *  This method is used for merging the sorted runs of the
+ *  render queue into one sorted queue.  Neighboring runs are
+ *  merged in pairs, with the pairs of every round merged at
+ *  the same time, until a single run is left.  The rounds
+ *  merge back and forth between the queue and a copy of it
+ *  in the frame arena.
+ ***********************************************************/
+void SceneManager::MergeSortRuns()
+{
+	if (m_sortRuns.size() <= 2)
+	{
+		return;
+	}
+
+	uint64_t* pSource = m_renderQueue.data();
+	uint64_t* pTarget = m_pFrameArena->AllocateArray<uint64_t>(m_renderQueue.size());
+	while (m_sortRuns.size() > 2)
+	{
+		size_t nRuns = m_sortRuns.size() - 1;
+		size_t nPairs = (nRuns + 1) / 2;
+		m_pJobSystem->ParallelFor(nPairs, 1, [this, pSource, pTarget](size_t first, size_t last)
+		{
+			size_t lastRun = m_sortRuns.size() - 1;
+			for (size_t pair = first; pair < last; pair++)
+			{
+				size_t begin = m_sortRuns[pair * 2];
+				size_t middle = m_sortRuns[std::min(pair * 2 + 1, lastRun)];
+				size_t end = m_sortRuns[std::min(pair * 2 + 2, lastRun)];
+				std::merge(
+					pSource + begin, pSource + middle,
+					pSource + middle, pSource + end,
+					pTarget + begin);
+			}
+		});
+
+		// every merged pair is one run of the next round
+		for (size_t pair = 0; pair < nPairs; pair++)
+		{
+			m_sortRuns[pair] = m_sortRuns[pair * 2];
+		}
+		m_sortRuns[nPairs] = m_sortRuns[nRuns];
+		m_sortRuns.resize(nPairs + 1);
+		std::swap(pSource, pTarget);
+	}
+
+	if (pSource != m_renderQueue.data())
+	{
+		memcpy(m_renderQueue.data(), pSource, m_renderQueue.size() * sizeof(uint64_t));
+	}
+}
 
 /***********************************************************
- *  LoadSceneTextures()
+ *  IsItemVisible()
  *
- *  This method is used for preparing the 3D scene by loading
- *  the shapes, textures in memory to support the 3D scene
- *  rendering
+ *  This method is used for testing the bounding box of a
+ *  part against the view frustum.  The box reaches furthest
+ *  along the normal of a plane by its extent projected onto
+ *  the normal, so a part is only culled when it is fully
+ *  outside a plane.
+ ***********************************************************/
+bool SceneManager::IsItemVisible(size_t index) const
+{
+	const glm::vec3& center = m_itemBoundsCenters[index];
+	const glm::vec3& extent = m_itemBoundsExtents[index];
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4& plane = m_frustumPlanes[i];
+		glm::vec3 normal(plane);
+		if (glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + plane.w < 0.0f)
+		{
+			return(false);
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  SelectItemLod()
+ *
+ *  This method is used for choosing the level of detail of
+ *  a part from the height of its bounding sphere on the
+ *  screen.  The part only moves to a finer level once it
+ *  grows past the boundary by the hysteresis band, and to a
+ *  coarser level once it shrinks past it, so a part that
+ *  sits at a boundary keeps its level.
  ***********************************************************/
-void SceneManager::LoadSceneTextures()
+int SceneManager::SelectItemLod(size_t index) const
 {
-	bool bReturn = false;
+	int nLods = m_itemLodCounts[index];
+	if (nLods <= 1)
+	{
+		return(0);
+	}
+
+	const glm::vec3& center = m_itemBoundsCenters[index];
+	float radius = glm::length(m_itemBoundsExtents[index]);
 
-	bReturn = CreateGLTexture(
-		"textures/knit.jpg",
-		"fabric");
+	// the projection scales a height to the -1 to 1 view, and a
+	// perspective one divides it by the depth as well
+	float screenSize = radius * m_projectionMatrix[1][1];
+	if (0.0f != m_projectionMatrix[2][3])
+	{
+		float depth = -(m_viewMatrix * glm::vec4(center, 1.0f)).z;
+		if (depth <= radius)
+		{
+			// the camera is inside or right at the part
+			return(0);
+		}
+		screenSize /= depth;
+	}
 
-	bReturn = CreateGLTexture(
-		"textures/glass.jpg",
-		"glass");
+	int lod = std::min(m_itemLods[index], nLods - 1);
+	while ((lod > 0) && (screenSize > g_LodScreenSizes[lod - 1] * (1.0f + g_LodHysteresis)))
+	{
+		lod--;
+	}
+	while ((lod < nLods - 1) && (screenSize < g_LodScreenSizes[lod] * (1.0f - g_LodHysteresis)))
+	{
+		lod++;
+	}
+	return(lod);
+}
+
+/***********************************************************
+ *  BuildCullingArrays()
+ *
+ *  This method is used for copying the values the per-frame
+ *  loops read out of the draw list into arrays of their own
+ *  - the position, the bounding box as center and extent,
+ *  the number of detail levels and the sort key bits that
+ *  stay the same - so every chunk reads them in order
+ *  without loading the rest of the parts.  The arrays every
+ *  frame fills are reserved for the whole draw list.
+ ***********************************************************/
+void SceneManager::BuildCullingArrays()
+{
+	size_t nItems = m_drawList.size();
+	m_itemPositions.resize(nItems);
+	m_itemBoundsCenters.resize(nItems);
+	m_itemBoundsExtents.resize(nItems);
+	m_itemLodCounts.resize(nItems);
+	m_itemLods.resize(nItems);
+	m_itemSortKeys.resize(nItems);
+
+	for (size_t i = 0; i < nItems; i++)
+	{
+		const DRAW_ITEM& item = m_drawList[i];
+		m_itemPositions[i] = glm::vec3(item.model[3]);
+		m_itemBoundsCenters[i] = (item.boundsMin + item.boundsMax) * 0.5f;
+		m_itemBoundsExtents[i] = (item.boundsMax - item.boundsMin) * 0.5f;
+		m_itemLodCounts[i] = m_basicMeshes->GetLodCount(item.mesh);
+		m_itemLods[i] = item.lod;
+
+		uint64_t key = 0;
+		if (item.bTransparent == false)
+		{
+			key |= (uint64_t)((item.textureSlot >= 0) ? 1 : 0) << g_SortVariantShift;
+			key |= (uint64_t)(item.textureSlot + 1) << g_SortTextureShift;
+			key |= (uint64_t)item.mesh << g_SortMeshShift;
+			key |= (uint64_t)(item.materialIndex + 1) << g_SortMaterialShift;
+		}
+		else
+		{
+			key |= (uint64_t)1 << g_SortPassShift;
+		}
+		m_itemSortKeys[i] = key;
+	}
 
-	bReturn = CreateGLTexture(
-		"textures/rubber.jpg",
-		"rubber");
+	// the frame holds at most every part in its queue, and once
+	// more as a shadow caster, so no camera position grows the
+	// per-frame arrays past what is reserved here
+	size_t nChunks = (nItems + g_JobChunkSize - 1) / g_JobChunkSize;
+	m_renderQueue.reserve(nItems);
+	m_sortRuns.reserve(nChunks + 1);
+	m_instances.reserve(nItems * 2);
+	m_instanceBounds.reserve(nItems);
+	m_drawCommands.reserve(nItems * 2);
+	m_drawGroups.reserve(nItems);
+	m_basicMeshes->ReserveDrawCommands((int)nItems * 2);
+}
 
-	bReturn = CreateGLTexture(
-		"textures/candle.jpg",
-		"candle");
+/***********************************************************
+ *  UpdateAnimatedParts()
+ *
+ *  This method is used for evaluating the animated values
+ *  of the scene before the draw list is drawn.  When the
+ *  simulation thread evaluates them, only the changes of its
+ *  latest snapshot are applied, if there is a new one.
+ ***********************************************************/
+void SceneManager::UpdateAnimatedParts()
+{
+	if (m_bSimulatedAnimation == false)
+	{
+		m_pSceneAnimator->Update(static_cast<float>(glfwGetTime()));
+		ApplyAnimationChanges(m_pSceneAnimator->GetChanges());
+	}
+	else if (NULL != m_pAnimationChanges)
+	{
+		ApplyAnimationChanges(*m_pAnimationChanges);
+		m_pAnimationChanges = NULL;
+	}
+}
 
-	bReturn = CreateGLTexture(
-		"textures/stainless.jpg",
-		"stainless");
+/***********************************************************
+ *  ApplyAnimationChanges()
+ *
+ *  This method is used for writing evaluated animation
+ *  changes into the scene.  Only the lights and materials
+ *  that changed are written into their buffers.
+ ***********************************************************/
+void SceneManager::ApplyAnimationChanges(const SceneAnimator::ANIMATION_CHANGES& changes)
+{
+	for (size_t i = 0; i < changes.lights.size(); i++)
+	{
+		const SceneAnimator::LIGHT_CHANGE& change = changes.lights[i];
+		m_pLightClusters->SetPointLightColors(
+			change.lightIndex, change.ambient, change.diffuse, change.specular);
+	}
 
-	bReturn = CreateGLTexture(
-		"textures/metal.jpg",
-		"metal");
+	m_changedMaterials.clear();
+	for (size_t i = 0; i < changes.materials.size(); i++)
+	{
+		const SceneAnimator::MATERIAL_CHANGE& change = changes.materials[i];
+		if (change.materialIndex < (int)m_materials.size())
+		{
+			m_materials[change.materialIndex].emissiveColor = change.emissiveColor;
+			m_changedMaterials.push_back(change.materialIndex);
+		}
+	}
+	m_pUniformBuffers->UpdateMaterials(m_materials.data(), m_changedMaterials);
 
-	bReturn = CreateGLTexture(
-		"textures/pages.jpg",
-		"pages");
+	// the parts are copied into the instance buffer every frame
+	for (size_t i = 0; i < changes.parts.size(); i++)
+	{
+		m_drawList[changes.parts[i].itemIndex].color = changes.parts[i].color;
+	}
+}
 
-	bReturn = CreateGLTexture(
-		"textures/leather.png",
-		"leather");
+/**************************************************************/
+/*** The code in the methods BELOW is for preparing and     ***/
+/*** rendering the 3D replicated scenes.                    ***/
+/**************************************************************/
 
-	bReturn = CreateGLTexture(
-		"textures/wood.jpg",
-		"wood");
+/***********************************************************
+ *  LoadSceneTextures()
+ *
+ *  This method is used for requesting every texture image
+ *  listed in the scene file under its tag.
+ ***********************************************************/
+void SceneManager::LoadSceneTextures(const SceneFile& scene)
+{
+	const SceneFile::SCENE_TEXTURE* pTextures = scene.GetTextures();
+	for (int i = 0; i < scene.GetTextureCount(); i++)
+	{
+		CreateGLTexture(pTextures[i].filename, pTextures[i].tag);
+	}
 
-	// after the texture image data is loaded into memory, the
-	// loaded textures need to be bound to texture slots - there
-	// are a total of 16 available slots for scene textures
+	// the texture arrays are bound to their texture units as
+	// the loaded textures are packed into them
 	BindGLTextures();
 }
 
@@ -450,6 +1102,7 @@ void SceneManager::DefineObjectMaterials()
 	OBJECT_MATERIAL backdropMaterial;
 	backdropMaterial.diffuseColor = glm::vec3(0.258824f, 0.258824f, 0.435294f);
 	backdropMaterial.specularColor = glm::vec3(0.0f, 0.0f, 0.0f);
+	backdropMaterial.emissiveColor = glm::vec3(0.0f, 0.0f, 0.0f);
 	backdropMaterial.shininess = 0.3;
 	backdropMaterial.tag = "backdrop";
 
@@ -458,6 +1111,7 @@ void SceneManager::DefineObjectMaterials()
 	OBJECT_MATERIAL glassMaterial;
 	glassMaterial.diffuseColor = glm::vec4(0.3f, 0.3f, 0.3f, 0.5f);
 	glassMaterial.specularColor = glm::vec3(0.7f, 0.6f, 0.9f);
+	glassMaterial.emissiveColor = glm::vec3(0.0f, 0.0f, 0.0f);
 	glassMaterial.shininess = 95.0;
 	glassMaterial.tag = "glass";
 
@@ -466,6 +1120,7 @@ void SceneManager::DefineObjectMaterials()
 	OBJECT_MATERIAL metalMaterial;
 	metalMaterial.diffuseColor = glm::vec3(0.4f, 0.4f, 0.4f);
 	metalMaterial.specularColor = glm::vec3(0.7f, 0.7f, 0.6f);
+	metalMaterial.emissiveColor = glm::vec3(0.0f, 0.0f, 0.0f);
 	metalMaterial.shininess = 52.0;
 	metalMaterial.tag = "metal";
 
@@ -474,6 +1129,7 @@ void SceneManager::DefineObjectMaterials()
 	OBJECT_MATERIAL woodMaterial;
 	woodMaterial.diffuseColor = glm::vec3(0.2f, 0.2f, 0.3f);
 	woodMaterial.specularColor = glm::vec3(0.0f, 0.0f, 0.0f);
+	woodMaterial.emissiveColor = glm::vec3(0.0f, 0.0f, 0.0f);
 	woodMaterial.shininess = 0.1;
 	woodMaterial.tag = "wood";
 
@@ -485,26 +1141,35 @@ void SceneManager::DefineObjectMaterials()
 	flameMaterial.shininess = 32.0f; // High shininess for glowing effect
 	flameMaterial.emissiveColor = glm::vec3(1.0f, 0.4f, 0.0f);  // Bright orange glow
 	flameMaterial.tag = "flame";
-	// Simulate flame flickering by changing the emissive color
-	float flickerIntensity = (sin(glfwGetTime() * 10.0f) * 0.2f) + 0.8f; // Flickering effect
-	flameMaterial.emissiveColor *= flickerIntensity; // Apply flicker intensity
 
 	m_objectMaterials.push_back(flameMaterial);
 
 	OBJECT_MATERIAL liquidMaterial;
 	liquidMaterial.diffuseColor = glm::vec4(0.396f, 0.694f, 0.996f, 0.9f);
 	liquidMaterial.specularColor = glm::vec3(0.3f, 0.5f, 0.7f);
+	liquidMaterial.emissiveColor = glm::vec3(0.0f, 0.0f, 0.0f);
 	liquidMaterial.shininess = 50.0f;
 	liquidMaterial.tag = "liquid";
 
 	m_objectMaterials.push_back(liquidMaterial);
+
+	// index the materials by tag for describing the scene parts
+	m_materialIndices.clear();
+	for (int i = 0; i < (int)m_objectMaterials.size(); i++)
+	{
+		m_materialIndices[m_objectMaterials[i].tag] = i;
+	}
+
+	// the glow of the flame pulses every frame
+	m_pSceneAnimator->AddEmissiveFlicker(FindMaterialIndex("flame"), flameMaterial.emissiveColor, 0.0f);
 }
 
 /***********************************************************
  *  SetupSceneLights()
  *
  *  This method is called to add and configure the light 
- *  sources for the 3D scene.  There are up to 4 light sources.
+ *  sources for the 3D scene.  Any number of point lights
+ *  can be added.
  ***********************************************************/
 void SceneManager::SetupSceneLights()
 {
@@ -512,67 +1177,77 @@ void SceneManager::SetupSceneLights()
 	// the 3D scene with custom lighting - to use the default rendered 
 	// lighting then comment out the following line
 	m_pShaderManager->setBoolValue(g_UseLightingName, true);
+	m_bUseLighting = true;
 
-	// Directional light 1 for moonlight
-	m_pShaderManager->setVec3Value("directionalLight.direction", -0.05f, -0.3f, -0.1f);
-	m_pShaderManager->setVec3Value("directionalLight.ambient", 0.08f, 0.08f, 0.1f); // Subtle moonlit shadow
-	m_pShaderManager->setVec3Value("directionalLight.diffuse", 0.3f, 0.3f, 0.5f); // Soft moonlight glow
-	m_pShaderManager->setVec3Value("directionalLight.specular", 0.6f, 0.6f, 0.7f); // Silvery highlights
-	m_pShaderManager->setBoolValue("directionalLight.bActive", true);
-
-	// Point light 1 - flickering flame light placed on top of flame mesh
-	float flameTime = static_cast<float>(glfwGetTime()); // Get the current time
-
-	// Flickering green channel
-	float flickerFactor = sin(flameTime * 3.0f) * 0.3f + 0.5f;
-
-	// Random variation
-	static std::default_random_engine generator;
-	static std::uniform_real_distribution<float> distribution(-0.03f, 0.03f);
+	// the light sources are written into the shared lighting
+	// block, which is uploaded once for every shader program
+	UniformBuffers::LIGHT_DATA& lights = m_pUniformBuffers->GetLightData();
 
-	float red = 1.0f + distribution(generator);
-	float green = 0.2f + flickerFactor * 0.2f + distribution(generator);
-	float blue = 0.1f + distribution(generator) * 0.1f; // Small, subtle blue tint
-
-	// Clamp values
-	red = glm::clamp(red, 0.0f, 1.0f);
-	green = glm::clamp(green, 0.0f, 1.0f);
-	blue = glm::clamp(blue, 0.0f, 1.0f);
-
-	// Update flameColor
-	flameColor = glm::vec3(red, green, blue);
+	// Directional light 1 for moonlight
+	lights.directionalLight.direction = glm::vec3(-0.05f, -0.3f, -0.1f);
+	lights.directionalLight.ambient = glm::vec3(0.08f, 0.08f, 0.1f); // Subtle moonlit shadow
+	lights.directionalLight.diffuse = glm::vec3(0.3f, 0.3f, 0.5f); // Soft moonlight glow
+	lights.directionalLight.specular = glm::vec3(0.6f, 0.6f, 0.7f); // Silvery highlights
+	lights.directionalLight.bActive = true;
+	m_pShadowMaps->SetDirectionalLight(lights.directionalLight.direction);
+
+	// Point light 1 - flickering flame light placed on top of flame mesh,
+	// starting from the flame color at the current time - the scene
+	// animator keeps it flickering every frame
+	flameColor = m_pSceneAnimator->EvaluateFlameColor(static_cast<float>(glfwGetTime()), 0.0f);
+
+	// the point lights are binned into the light clusters, so
+	// any number of them can be added - the range of each one
+	// is where its attenuated light fades out, from the
+	// intensity of its brightest channel
+	std::vector<LightClusters::POINT_LIGHT>& pointLights = m_pLightClusters->GetPointLights();
+	pointLights.clear();
+	LightClusters::POINT_LIGHT pointLight;
+	memset((void*)&pointLight, 0, sizeof(pointLight));
 
 	// Update point light 1
-	m_pShaderManager->setVec3Value("pointLights[3].position", -5.0f, 8.8f, 0.9f);
-	m_pShaderManager->setVec3Value("pointLights[3].ambient", flameColor * 0.1f);
-	m_pShaderManager->setVec3Value("pointLights[3].diffuse", flameColor);
-	m_pShaderManager->setVec3Value("pointLights[3].specular", flameColor * 0.8f);
-	m_pShaderManager->setBoolValue("pointLights[3].bActive", true);
+	pointLight.position = glm::vec3(-5.0f, 8.8f, 0.9f);
+	pointLight.ambient = flameColor * 0.1f;
+	pointLight.diffuse = flameColor;
+	pointLight.specular = flameColor * 0.8f;
+	// the flicker keeps every channel of the flame at most one,
+	// so the range covers its brightest color
+	LightClusters::SetAttenuation(pointLight,
+		g_PointLightConstant, g_PointLightLinear, g_PointLightQuadratic, 1.0f);
+	pointLights.push_back(pointLight);
+	m_flameLight = (int)pointLights.size() - 1;
+	m_pSceneAnimator->AddLightFlicker(m_flameLight, 0.0f);
+	// the flame light is the one point light casting a shadow
+	m_pShadowMaps->SetPointLight(m_flameLight, pointLight.position, pointLight.range);
 
 	// Point light 2 - cool bluish-purple magical light
-	m_pShaderManager->setVec3Value("pointLights[1].position", -4.0f, 8.0f, 0.0f);
-	m_pShaderManager->setVec3Value("pointLights[1].ambient", 0.05f, 0.04f, 0.03f);
-	m_pShaderManager->setVec3Value("pointLights[1].diffuse", 0.4f, 0.3f, 0.2f);
-	m_pShaderManager->setVec3Value("pointLights[1].specular", 0.5f, 0.4f, 0.3f);
-	m_pShaderManager->setBoolValue("pointLights[1].bActive", true);
+	pointLight.position = glm::vec3(-4.0f, 8.0f, 0.0f);
+	pointLight.ambient = glm::vec3(0.05f, 0.04f, 0.03f);
+	pointLight.diffuse = glm::vec3(0.4f, 0.3f, 0.2f);
+	pointLight.specular = glm::vec3(0.5f, 0.4f, 0.3f);
+	LightClusters::SetAttenuation(pointLight,
+		g_PointLightConstant, g_PointLightLinear, g_PointLightQuadratic, 0.5f);
+	pointLights.push_back(pointLight);
 
 	// Point light 3 - soft pinkish-purple magical light
-	m_pShaderManager->setVec3Value("pointLights[2].position", 3.8f, 5.5f, 4.0f);
-	m_pShaderManager->setVec3Value("pointLights[2].ambient", 0.08f, 0.06f, 0.1f);
-	m_pShaderManager->setVec3Value("pointLights[2].diffuse", 0.2f, 0.2f, 0.5f);
-	m_pShaderManager->setVec3Value("pointLights[2].specular", 0.3f, 0.3f, 0.6f);
-	m_pShaderManager->setBoolValue("pointLights[2].bActive", true);
+	pointLight.position = glm::vec3(3.8f, 5.5f, 4.0f);
+	pointLight.ambient = glm::vec3(0.08f, 0.06f, 0.1f);
+	pointLight.diffuse = glm::vec3(0.2f, 0.2f, 0.5f);
+	pointLight.specular = glm::vec3(0.3f, 0.3f, 0.6f);
+	LightClusters::SetAttenuation(pointLight,
+		g_PointLightConstant, g_PointLightLinear, g_PointLightQuadratic, 0.6f);
+	pointLights.push_back(pointLight);
 	
 	// Spotlight for focus (moonbeam with a magical touch)
-	m_pShaderManager->setVec3Value("spotLight.ambient", 0.1f, 0.1f, 0.15f);
-	m_pShaderManager->setVec3Value("spotLight.diffuse", 0.6f, 0.6f, 0.9f);
-	m_pShaderManager->setVec3Value("spotLight.specular", 0.9f, 0.9f, 1.2f);
-	m_pShaderManager->setFloatValue("spotLight.constant", 1.0f);
-	m_pShaderManager->setFloatValue("spotLight.linear", 0.09f);
-	m_pShaderManager->setFloatValue("spotLight.quadratic", 0.032f);
-	m_pShaderManager->setFloatValue("spotLight.cutOff", glm::cos(glm::radians(35.0f)));
-	m_pShaderManager->setFloatValue("spotLight.outerCutOff", glm::cos(glm::radians(45.0f)));
-	m_pShaderManager->setBoolValue("spotLight.bActive", true);
+	lights.spotLight.ambient = glm::vec3(0.1f, 0.1f, 0.15f);
+	lights.spotLight.diffuse = glm::vec3(0.6f, 0.6f, 0.9f);
+	lights.spotLight.specular = glm::vec3(0.9f, 0.9f, 1.2f);
+	lights.spotLight.constant = 1.0f;
+	lights.spotLight.linear = 0.09f;
+	lights.spotLight.quadratic = 0.032f;
+	lights.spotLight.cutOff = glm::cos(glm::radians(35.0f));
+	lights.spotLight.outerCutOff = glm::cos(glm::radians(45.0f));
+	lights.spotLight.bActive = true;
 }
 
 /***********************************************************
@@ -584,1106 +1259,713 @@ void SceneManager::SetupSceneLights()
  ***********************************************************/
 void SceneManager::PrepareScene()
 {
+	// get the handles of the shader values set while rendering
+	ResolveShaderUniforms();
+
+	// the instances, draw commands, frame values and point lights
+	// of every frame are streamed through the mapped buffer, when
+	// the driver has buffer storage
+	if (m_pStreamBuffer->CreateBuffer())
+	{
+		m_pLightClusters->SetStreamBuffer(m_pStreamBuffer);
+		m_pOcclusionCuller->SetStreamBuffer(m_pStreamBuffer);
+	}
+
+	// create the light and cluster buffers, which stay bound
+	// to their texture units
+	m_pLightClusters->CreateResources(g_LightClusterShaderFile);
+	m_pLightClusters->BindBuffers();
+	// create the shadow maps, which are drawn once the draw
+	// list is built
+	m_pShadowMaps->CreateResources(g_ShadowVertexShaderFile, g_ShadowFragmentShaderFile);
+	m_pShadowMaps->BindTextures();
+	// create the G-buffer of the deferred path, which is sized
+	// to the view on the first frame drawn with it
+	if (m_pDeferredRenderer->CreateResources())
+	{
+		m_pDeferredRenderer->BindTextures();
+	}
+	// create the programs culling the parts hidden behind the
+	// opaque depth of the last frame, when the driver can run
+	// them
+	m_pOcclusionCuller->CreateResources(g_DepthPyramidShaderFile, g_OcclusionCullShaderFile);
+
+	// open the scene description, mapping its cooked form when
+	// there is one
+	SceneFile scene;
+	std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+	if (scene.Open(m_sceneFilename.c_str()) == false)
+	{
+		std::cout << "The scene is empty without its scene file:" << m_sceneFilename << std::endl;
+	}
+
 	// load the texture image files for the textures applied
 	// to objects in the 3D scene
-	LoadSceneTextures();
+	LoadSceneTextures(scene);
 	// define the materials that will be used for the objects
 	// in the 3D scene
 	DefineObjectMaterials();
+	UploadObjectMaterials();
 	// add and defile the light sources for the 3D scene
 	SetupSceneLights();
 
-	// only one instance of a particular mesh needs to be
-	// loaded in memory no matter how many times it is drawn
-	// in the rendered 3D scene
-
-	m_basicMeshes->LoadBoxMesh();
-	m_basicMeshes->LoadPlaneMesh();
-	m_basicMeshes->LoadCylinderMesh();
-	m_basicMeshes->LoadConeMesh();
-	m_basicMeshes->LoadPrismMesh();
-	m_basicMeshes->LoadPyramid4Mesh();
-	m_basicMeshes->LoadSphereMesh();
-	m_basicMeshes->LoadTaperedCylinderMesh();
-	m_basicMeshes->LoadTorusMesh();
-	m_basicMeshes->LoadSphereMesh(); // not used yet
-	m_basicMeshes->LoadConeMesh();
+	// build the retained draw list for all the parts of the
+	// 3D scene - nothing in the scene moves, so the parts
+	// only need to be described once.  Only one instance of a
+	// particular mesh is loaded in memory, the first time a
+	// part is drawn with it
+	BuildDrawList(scene);
+	std::cout << "Loaded " << scene.GetPartCount() << " scene parts in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count()
+		<< " ms" << std::endl;
 }
 
 /***********************************************************
- *  RenderScene()
+ *  BuildDrawList()
  *
- *  This method is used for rendering the 3D scene by 
- *  transforming and drawing the basic 3D shapes
+ *  This method is used for adding every part of the scene
+ *  file to the draw list.  The tags of the file tables are
+ *  looked up once, and the draw list is sized for all the
+ *  parts up front, so no part allocates.  The mesh of every
+ *  part is generated on its first use, so only the meshes
+ *  the scene draws take up memory.  A part flagged to
+ *  flicker follows the flame light.  Parts past the ones
+ *  the sort keys can index are left out.
  ***********************************************************/
-void SceneManager::RenderScene()
+void SceneManager::BuildDrawList(const SceneFile& scene)
 {
-	RenderTable();
-	RenderBackdrop();
-	RenderPotionBottle();
-	RenderCandle();
-	RenderBottomBook();
-	RenderTopBook();
-	RenderCauldron();
+	m_drawList.clear();
+	m_flameItem = -1;
+	m_pSceneAnimator->ClearPartFlickers();
+
+	std::vector<int> textureSlots(scene.GetTextureCount());
+	for (int i = 0; i < scene.GetTextureCount(); i++)
+	{
+		textureSlots[i] = FindTextureSlot(scene.GetTextures()[i].tag);
+	}
+	std::vector<int> materialIndices(scene.GetMaterialCount());
+	for (int i = 0; i < scene.GetMaterialCount(); i++)
+	{
+		materialIndices[i] = FindMaterialIndex(scene.GetMaterials()[i].tag);
+		if (materialIndices[i] < 0)
+		{
+			std::cout << "Scene material is not defined:" << scene.GetMaterials()[i].tag << std::endl;
+		}
+	}
+
+	// the parts are limited to the ones the sort keys of the
+	// render queue can index
+	const SceneFile::SCENE_PART* pParts = scene.GetParts();
+	const size_t maxItems = (size_t)g_SortIndexMask + 1;
+	m_drawList.reserve(std::min((size_t)scene.GetPartCount(), maxItems));
+	for (int i = 0; i < scene.GetPartCount(); i++)
+	{
+		if ((pParts[i].mesh < 0) || (pParts[i].mesh >= MeshLibrary::MESH_COUNT))
+		{
+			continue;
+		}
+		if (m_drawList.size() >= maxItems)
+		{
+			std::cout << "Only " << maxItems << " of " << scene.GetPartCount() <<
+				" scene parts fit in the render queue" << std::endl;
+			break;
+		}
+		m_basicMeshes->LoadMesh((MeshLibrary::MESH_TYPE)pParts[i].mesh);
+		AddDrawItem(pParts[i], textureSlots, materialIndices);
+
+		if (0 != (pParts[i].flags & SceneFile::PART_FLICKER))
+		{
+			m_flameItem = (int)m_drawList.size() - 1;
+			m_pSceneAnimator->AddPartFlicker(m_flameItem, m_flameLight, 0.0f);
+		}
+	}
+
+	ReplicateDrawList();
+	BuildCullingArrays();
+	CollectShadowCasters();
+	UpdateLightingVariant();
+	PrepareShaderVariants();
 }
 
 /***********************************************************
- *  RenderTable()
+ *  ReplicateDrawList()
  *
- *  This method is called to render the shapes for the table
- *  object.
+ *  This method is used for adding copies of every part of
+ *  the draw list on a grid behind and beside the objects,
+ *  so the benchmark can measure how the frame grows with
+ *  the scene.  The copies of the flame do not flicker.  The
+ *  copies are limited to the parts the sort keys of the
+ *  render queue can index.
  ***********************************************************/
-void SceneManager::RenderTable()
+void SceneManager::ReplicateDrawList()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/***********************/
-	/*** FABRIC ON TABLE ***/
-	/***********************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(20.0f, .2f, 15.0f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.0f, -0.2f, -0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(1, 1, 1, 1);
-	SetShaderTexture("fabric");
-	SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("wood");
-
-	// draw the mesh with transformation values - this plane is used for the base
-	m_basicMeshes->DrawBoxMesh();
-
-	/********************/
-	/*** ACTUAL TABLE ***/
-	/********************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(50.0f, 1.5f, 15.0f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.0f, -1.2f, -0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.39f, 0.24f, 0.12f, 1.0f); // Very dark brown
-	SetShaderTexture("wood");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("wood");
-
-	// draw the mesh with transformation values - this plane is used for the base
-	m_basicMeshes->DrawBoxMesh();
+	if ((m_sceneReplicas <= 1) || m_drawList.empty())
+	{
+		return;
+	}
+
+	int maxReplicas = std::max(1, (int)((g_SortIndexMask + 1) / m_drawList.size()));
+	if (m_sceneReplicas > maxReplicas)
+	{
+		std::cout << "Only " << maxReplicas << " of " << m_sceneReplicas <<
+			" scene replicas fit in the render queue" << std::endl;
+		m_sceneReplicas = maxReplicas;
+	}
+
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	for (size_t i = 0; i < m_drawList.size(); i++)
+	{
+		boundsMin = glm::min(boundsMin, m_drawList[i].boundsMin);
+		boundsMax = glm::max(boundsMax, m_drawList[i].boundsMax);
+	}
+	glm::vec3 spacing = (boundsMax - boundsMin) * g_ReplicaSpacing;
+
+	// the copies fill a square grid, with the objects in a corner
+	int columns = (int)std::ceil(std::sqrt((float)m_sceneReplicas));
+	size_t nItems = m_drawList.size();
+	m_drawList.reserve(nItems * m_sceneReplicas);
+	for (int replica = 1; replica < m_sceneReplicas; replica++)
+	{
+		glm::vec3 offset(
+			(replica % columns) * spacing.x,
+			0.0f,
+			-(float)(replica / columns) * spacing.z);
+		glm::mat4 translation = glm::translate(offset);
+
+		for (size_t i = 0; i < nItems; i++)
+		{
+			DRAW_ITEM item = m_drawList[i];
+			item.model = translation * item.model;
+			item.boundsMin += offset;
+			item.boundsMax += offset;
+			m_drawList.push_back(item);
+		}
+	}
 }
 
 /***********************************************************
- *  RenderBackdrop()
+ *  CollectShadowCasters()
  *
- *  This method is called to render the shapes for the scene
- *  backdrop object.
+ *  This method is used for listing the parts of the draw
+ *  list that cast shadows, ordered by mesh so they are drawn
+ *  with few draw commands.  Transparent parts and the
+ *  flickering flame, which holds the flame light, cast no
+ *  shadow.
  ***********************************************************/
-void SceneManager::RenderBackdrop()
+void SceneManager::CollectShadowCasters()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh ***/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(20.0f, 1.0f, 20.0f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.0f, 15.0f, -9.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderTexture("fabric");
-	SetTextureUVScale(10.0, 10.0);
-	SetShaderMaterial("backdrop");
-
-	// draw the mesh with transformation values - this plane is used for the backdrop
-	m_basicMeshes->DrawPlaneMesh();
+	m_shadowCasters.clear();
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+
+	for (size_t i = 0; i < m_drawList.size(); i++)
+	{
+		const DRAW_ITEM& item = m_drawList[i];
+		if (item.bTransparent || ((int)i == m_flameItem))
+		{
+			continue;
+		}
+		m_shadowCasters.push_back((int)i);
+		boundsMin = glm::min(boundsMin, item.boundsMin);
+		boundsMax = glm::max(boundsMax, item.boundsMax);
+	}
+
+	std::stable_sort(m_shadowCasters.begin(), m_shadowCasters.end(),
+		[this](int first, int second) { return(m_drawList[first].mesh < m_drawList[second].mesh); });
+
+	if (m_shadowCasters.empty() == false)
+	{
+		m_pShadowMaps->SetCasterBounds(boundsMin, boundsMax);
+	}
 }
 
 /***********************************************************
- *  RenderPotionBottle()
+ *  AppendShadowCasters()
  *
- *  This method is called to render the shapes for the potion
- *  bottle object.
+ *  This method is used for adding the instances and draw
+ *  commands of the shadow casters after the ones of the
+ *  frame, so the shadow maps are drawn from the same
+ *  buffers.  The casters are drawn at the full detail, since
+ *  the cached maps outlive the camera the levels of detail
+ *  were chosen for.  It returns the first command of the
+ *  casters.
  ***********************************************************/
-void SceneManager::RenderPotionBottle()
+int SceneManager::AppendShadowCasters()
 {
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-	float scaleFactor = 0.9f;
-
-	/************************************************/
-	/*** LIQUID IN BOTTLE - box						***/
-	/************************************************/
-
-	float liquidScaleFactor = 0.8f;
-
-	// color for the liquid
-	glm::vec4 liquidColor = glm::vec4(0.396f, 0.694f, 0.996f, 0.7f);
-
-	// Liquid for the bottom section - Box shape
-	scaleXYZ = glm::vec3(2.0f, 2.8f, 2.0f) * liquidScaleFactor;
-	positionXYZ = glm::vec3(4.0f, 5.5f * liquidScaleFactor, -1.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		0.0f, 15.0f, 0.0f, // Same rotation as the bottle
-		positionXYZ);
-
-	SetShaderColor(liquidColor.r, liquidColor.g, liquidColor.b, liquidColor.a);
-	SetShaderMaterial("liquid");
-
-	m_basicMeshes->DrawBoxMesh();
-
-	/************************************************/
-	/*** BOTTOM OF POTION BOTTLE - Box shape	  ***/
-	/************************************************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(2.0f, 3.5f, 2.0f) * scaleFactor;
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 15.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 4.75f * scaleFactor, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.196, 0.294, 0.796, 0.65);
-	//SetShaderTexture("glass");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("glass");
-
-	// draw a box mesh minus the top
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::front);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::back);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::left);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::right);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::bottom);
-
-	/************************************************/
-	/*** MIDDLE OF POTION - Pyramid shape		  ***/
-	/************************************************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(2.0f, 1.5f, 2.0f) * scaleFactor;
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 15.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 7.25f * scaleFactor, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.196, 0.294, 0.796, 0.65);
-	//SetShaderTexture("glass");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("glass");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPyramid4Mesh();
-
-	/************************************************/
-	/*** NECK OF BOTTLE - Cylinder shape		  ***/
-	/************************************************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.35f, 2.2f, 0.35f) * scaleFactor;
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 15.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 7.0f * scaleFactor, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.196, 0.294, 0.796, 0.65);
-	//SetShaderTexture("glass");
-	//SetTextureUVScale(2.0, 1.0);
-	SetShaderMaterial("glass");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawCylinderMesh();
-
-	/************************************************/
-	/*** LIP OF BOTTLE - Torus shape			  ***/
-	/************************************************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.42f, 0.42f, 0.65f) * scaleFactor;
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 9.2f * scaleFactor, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.196, 0.294, 0.796, 0.65);
-	//SetShaderTexture("glass");
-	//SetTextureUVScale(0.5, 1.0);
-	SetShaderMaterial("glass");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTorusMesh();
-
-	/************************************************/
-	/*** BOTTLE CLOSURE - Tapered Cylinder shape  ***/
-	/************************************************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.45f, 0.69f, 0.45f) * scaleFactor;
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 180.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 9.92f * scaleFactor, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	// SetShaderColor(0.196, 0.294, 0.796, 0.8);
-	SetShaderTexture("rubber");
-	SetTextureUVScale(2.0, 2.0);
-	SetShaderMaterial("wood");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-	// disable transparency
-	glDisable(GL_BLEND);
+	int firstCommand = (int)m_drawCommands.size();
+
+	size_t first = 0;
+	while (first < m_shadowCasters.size())
+	{
+		MeshLibrary::MESH_TYPE mesh = m_drawList[m_shadowCasters[first]].mesh;
+		int firstInstance = (int)m_instances.size();
+
+		size_t last = first;
+		while ((last < m_shadowCasters.size()) && (m_drawList[m_shadowCasters[last]].mesh == mesh))
+		{
+			MeshLibrary::INSTANCE_DATA instance;
+			memset((void*)&instance, 0, sizeof(instance));
+			instance.model = m_drawList[m_shadowCasters[last]].model;
+			m_instances.push_back(instance);
+			last++;
+		}
+
+		m_drawCommands.push_back(
+			m_basicMeshes->GetDrawCommand(mesh, 0, (int)(last - first), firstInstance));
+		first = last;
+	}
+
+	return(firstCommand);
 }
 
 /***********************************************************
- *  RenderCandle()
+ *  SetSceneView()
  *
- *  This method is called to render the shapes for the wine
- *  bottle object.
+ *  This method is used for setting the camera view of the
+ *  current frame, which culls the parts outside the view and
+ *  orders the transparent parts.
  ***********************************************************/
-void SceneManager::RenderCandle()
+void SceneManager::SetSceneView(
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	const glm::vec3& viewPosition)
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-	
-	/*** Set needed transformations before drawing the basic mesh ***/
-	
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Torus shape touching the floor			      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.5f, 1.7f, 1.5f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 0.25f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.2, 0.2, 0.2, 1.0);
-	SetShaderTexture("metal");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("metal");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTorusMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Tapered cylinder for Bell shape bottom	      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.5f, 2.2f, 1.5f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 0.3f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.2, 0.2, 0.2, 1.0);
-	SetShaderTexture("metal");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("metal");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Middle cylinder							      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.5f, 0.5f, 0.5f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 2.5f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.2, 0.2, 0.2, 1.0);
-	SetShaderTexture("metal");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("metal");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawCylinderMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Middle tapered upside down cylinder		      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.58f, 1.4f, 0.58f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 90.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 3.0f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.2, 0.2, 0.2, 1.0);
-	SetShaderTexture("metal");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("metal");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Top tapered upside down cylinder		      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.62f, 1.9f, 0.62f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 180.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 5.8f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.2, 0.2, 0.2, 1.0);
-	SetShaderTexture("metal");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("metal");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Torus shape for the lip of the candleholder     ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.7f, 0.7f, 0.45f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 5.85f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.2, 0.2, 0.2, 1.0);
-	SetShaderTexture("metal");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("metal");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTorusMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Cylinder for actual candle				      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.35f, 2.4f, 0.35f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 5.8f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(1.0, 1.0, 1.0, 1.0);
-	SetShaderTexture("candle");
-	SetTextureUVScale(2.0, 1.0);
-	SetShaderMaterial("wood");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawCylinderMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Cone shape for wick						      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.04f, 0.6f, 0.04f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 8.0f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.1, 0.1, 0.1, 1.0);
-	SetShaderTexture("rubber");
-	//SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("wood");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawConeMesh();
-
-	/****************************************************************/
-	/*** Set needed transformations  and draw the basic mesh of   ***/
-	/*** CANDLE - Flame on  wick							      ***/
-	/****************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.2f, 0.8f, 0.2f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-5.0f, 8.0f, 0.9f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	// flickering transparency
-	float alpha = sin(static_cast<float>(glfwGetTime()) * 2.5f) * 0.2f + 0.6f;
-	alpha = glm::clamp(alpha, 0.5f, 0.8f);
-
-	// set color of flame with same color from the light source + the flickering transparency
-	SetShaderColor(flameColor.r, flameColor.g, flameColor.b, alpha); // Set object color with transparency
-
-	SetShaderMaterial("flame");  // Set the flame material properties (defined earlier)
-
-	// Enable blending for transparency (flames are semi-transparent)
+	m_viewMatrix = view;
+	m_projectionMatrix = projection;
+	m_viewPosition = viewPosition;
+
+	// pull the frustum planes out of the rows of the combined
+	// matrix, which works for perspective and orthographic
+	// projections alike
+	glm::mat4 viewProjection = projection * view;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	m_frustumPlanes[0] = rows[3] + rows[0];		// left
+	m_frustumPlanes[1] = rows[3] - rows[0];		// right
+	m_frustumPlanes[2] = rows[3] + rows[1];		// bottom
+	m_frustumPlanes[3] = rows[3] - rows[1];		// top
+	m_frustumPlanes[4] = rows[3] + rows[2];		// near
+	m_frustumPlanes[5] = rows[3] - rows[2];		// far
+}
+
+/***********************************************************
+ *  RenderScene()
+ *
+ *  This method is used for rendering the 3D scene by 
+ *  walking the sorted render queue built from the draw list
+ ***********************************************************/
+void SceneManager::RenderScene()
+{
+	bool bBlending = true;
+
+	// the scratch memory of the last frame is free again
+	m_pFrameArena->Reset();
+	m_pChunkKeys = NULL;
+	m_pChunkKeyCounts = NULL;
+	// the values of the frame go into the next region of the
+	// stream buffer, once the GPU is done with it
+	m_pStreamBuffer->BeginFrame();
+
+	// replace placeholder images with the textures decoded since
+	// the last frame
+	m_pTextureLoader->ProcessUploads(g_TextureUploadBudget);
+	m_uploadedTextures.clear();
+	m_pTextureLoader->TakeUploadedTextures(m_uploadedTextures);
+	m_pTextureResidency->MakeResident(m_uploadedTextures);
+
+	BeginProfileScope(PROFILE_UPDATE);
+	UpdateAnimatedParts();
+	// the variants of other lights are built when the lights
+	// change, before the frame draws with them
+	unsigned int lightingVariant = m_lightingVariant;
+	UpdateLightingVariant();
+	if (lightingVariant != m_lightingVariant)
+	{
+		PrepareShaderVariants();
+	}
+	BuildRenderQueue();
+
+	// move the shadow cascades along with the camera, before
+	// the shadow values are written with the others
+	m_pShadowMaps->UpdateCascades(m_pUniformBuffers->GetFrameData());
+
+	// write the camera and lighting values of the frame into
+	// the shared uniform buffers
+	m_pUniformBuffers->UploadBuffers(m_pStreamBuffer);
+	// list the point lights reaching every cluster of the view
+	m_pLightClusters->BuildClusters(m_pUniformBuffers->GetFrameData());
+
+	// copy the per-instance values in queue order so every
+	// batch is a contiguous range of the instance buffer, along
+	// with the boxes the occlusion culling tests
+	m_instances.resize(m_renderQueue.size());
+	m_instanceBounds.resize(m_renderQueue.size());
+	m_pJobSystem->ParallelFor(m_renderQueue.size(), g_JobChunkSize, [this](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			size_t index = m_renderQueue[i] & g_SortIndexMask;
+			const DRAW_ITEM& item = m_drawList[index];
+			m_instances[i].model = item.model;
+			m_instances[i].color = item.color;
+			m_instances[i].materialIndex = item.materialIndex;
+			m_instances[i].textureSlot = item.textureSlot;
+			m_instances[i].UVscale = item.UVscale;
+			m_instanceBounds[i].center = m_itemBoundsCenters[index];
+			m_instanceBounds[i].extent = m_itemBoundsExtents[index];
+		}
+	});
+
+	// the deferred path needs the lighting program of the lights
+	// of the frame, and the frame is drawn forward without it
+	bool bDeferred = IsDeferredPath();
+	GLuint lightingProgram = 0;
+	if (bDeferred)
+	{
+		unsigned int lightingFlags = m_lightingVariant | ShaderVariants::VARIANT_DEFERRED_LIGHTING;
+		lightingProgram = m_pShaderVariants->FindProgram(lightingFlags);
+		bDeferred = (0 != lightingProgram);
+	}
+
+	// build one draw command for every batch of parts with the
+	// same mesh, and one group of commands for every run of
+	// batches with the same shader values.  The opaque batches
+	// come first, and only they are culled against the depth
+	m_drawCommands.clear();
+	m_drawGroups.clear();
+	int nCulledInstances = -1;
+	int nCulledCommands = -1;
+	size_t first = 0;
+	while (first < m_renderQueue.size())
+	{
+		const DRAW_ITEM& item = m_drawList[m_renderQueue[first] & g_SortIndexMask];
+		if (item.bTransparent && (nCulledCommands < 0))
+		{
+			nCulledInstances = (int)first;
+			nCulledCommands = (int)m_drawCommands.size();
+		}
+
+		// extend the batch over the following parts that can be
+		// drawn with the same shader values
+		size_t last = first + 1;
+		while ((last < m_renderQueue.size()) &&
+			CanBatchItems(item, m_drawList[m_renderQueue[last] & g_SortIndexMask]))
+		{
+			last++;
+		}
+
+		if (m_drawGroups.empty() || !CanGroupItems(*m_drawGroups.back().pItem, item))
+		{
+			DRAW_GROUP group;
+			group.pItem = &item;
+			group.program = FindVariantProgram(GetItemVariant(item));
+			// the deferred path is only offered when every G-buffer
+			// variant of the draw list was built
+			group.gbufferProgram = (bDeferred && (item.bTransparent == false)) ?
+				m_pShaderVariants->FindProgram(GetGBufferVariant(item)) : 0;
+			group.firstCommand = (int)m_drawCommands.size();
+			group.nCommands = 0;
+			m_drawGroups.push_back(group);
+		}
+		for (size_t i = first; i < last; i++)
+		{
+			m_instanceBounds[i].command = (GLuint)m_drawCommands.size();
+		}
+		m_drawCommands.push_back(
+			m_basicMeshes->GetDrawCommand(item.mesh, item.lod, (int)(last - first), (int)first));
+		m_drawGroups.back().nCommands++;
+
+		first = last;
+	}
+	if (nCulledCommands < 0)
+	{
+		nCulledInstances = (int)m_renderQueue.size();
+		nCulledCommands = (int)m_drawCommands.size();
+	}
+
+	// the shadow casters are only added on the frames that draw
+	// a shadow map, the maps are kept from earlier frames otherwise
+	int shadowFirstCommand = (int)m_drawCommands.size();
+	bool bDrawShadows = m_pShadowMaps->IsDirty();
+	if (bDrawShadows)
+	{
+		shadowFirstCommand = AppendShadowCasters();
+	}
+	m_basicMeshes->UpdateInstanceData(m_instances.data(), (int)m_instances.size(), m_pStreamBuffer);
+	m_basicMeshes->UpdateDrawCommands(m_drawCommands.data(), (int)m_drawCommands.size(), m_pStreamBuffer);
+	EndProfileScope(PROFILE_UPDATE);
+
+	// drop the opaque instances hidden behind the depth of the
+	// last frame, leaving the commands for the GPU to draw
+	BeginProfileScope(PROFILE_OCCLUSION_CULL);
+	m_pOcclusionCuller->CullCommands(m_basicMeshes, m_instanceBounds.data(),
+		nCulledInstances, nCulledCommands,
+		(int)m_instances.size(), (int)m_drawCommands.size());
+	EndProfileScope(PROFILE_OCCLUSION_CULL);
+
+	if (bDrawShadows)
+	{
+		BeginProfileScope(PROFILE_SHADOWS);
+		m_pShadowMaps->RenderShadows(m_basicMeshes, shadowFirstCommand,
+			(int)m_drawCommands.size() - shadowFirstCommand);
+		m_pShaderManager->use();
+		FrameProfiler::CountStateChange();
+		EndProfileScope(PROFILE_SHADOWS);
+	}
+
+	// lay down the depth of the opaque parts first, so the lit
+	// pass only shades the fragments that end up visible - the
+	// deferred path shades every pixel once without it
+	bool bDepthEqual = m_bDepthPrePass && (NULL != m_pDepthShaderManager) && (bDeferred == false);
+	if (bDepthEqual)
+	{
+		BeginProfileScope(PROFILE_DEPTH_PREPASS);
+		DrawDepthPrePass();
+		EndProfileScope(PROFILE_DEPTH_PREPASS);
+	}
+
+	// the deferred path draws and lights the opaque groups, and
+	// leaves the transparent ones to the forward pass
+	size_t firstGroup = 0;
+	bool bDepthPyramid = false;
+	if (bDeferred)
+	{
+		firstGroup = DrawDeferredOpaque(lightingProgram);
+		BuildDepthPyramid();
+		bDepthPyramid = true;
+	}
+
+	// blending is enabled when the display window is created
 	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	FrameProfiler::CountStateChange();
+
+	// the opaque groups come first, followed by the transparent
+	// ones, and each run is timed as its own pass
+	PROFILE_SCOPE passScope = bDeferred ? PROFILE_TRANSPARENT : PROFILE_OPAQUE;
+	BeginProfileScope(passScope);
 
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawConeMesh();
-	glDisable(GL_BLEND); // Disable blending after drawing the flame
+	GLuint currentProgram = 0;
+	for (size_t i = firstGroup; i < m_drawGroups.size(); i++)
+	{
+		const DRAW_GROUP& group = m_drawGroups[i];
+
+		// every group is drawn with the variant of its bucket
+		if (group.program != currentProgram)
+		{
+			glUseProgram(group.program);
+			currentProgram = group.program;
+			FrameProfiler::CountStateChange();
+		}
+
+		// only transparent parts are drawn with blending
+		if (group.pItem->bTransparent != bBlending)
+		{
+			if (group.pItem->bTransparent)
+				glEnable(GL_BLEND);
+			else
+				glDisable(GL_BLEND);
+			bBlending = group.pItem->bTransparent;
+			FrameProfiler::CountStateChange();
+		}
+
+		// the depth of the next frame is culled against is the
+		// opaque depth, taken before any transparent part
+		if (group.pItem->bTransparent && (bDepthPyramid == false))
+		{
+			EndProfileScope(passScope);
+			BuildDepthPyramid();
+			bDepthPyramid = true;
+			passScope = PROFILE_TRANSPARENT;
+			BeginProfileScope(passScope);
+		}
+
+		// the transparent parts are not in the pre-pass depth, and
+		// are tested and written as usual
+		if (bDepthEqual && group.pItem->bTransparent)
+		{
+			glDepthFunc(GL_LESS);
+			glDepthMask(GL_TRUE);
+			bDepthEqual = false;
+			FrameProfiler::CountStateChange();
+		}
+
+		m_basicMeshes->DrawCommands(group.firstCommand, group.nCommands);
+	}
+	EndProfileScope(passScope);
+	if (bDepthPyramid == false)
+	{
+		BuildDepthPyramid();
+	}
+
+	if (bDepthEqual)
+	{
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+		FrameProfiler::CountStateChange();
+	}
+
+	// every draw reading the region is submitted
+	m_pStreamBuffer->EndFrame();
 }
 
 /***********************************************************
- *  RenderBottomBook()
+ *  SetProfiler()
  *
- *  This method is called to render the shapes for the book
- *  object on the bottom of pile.
+ *  This method is used for registering the passes of the
+ *  frame with the passed in profiler, which then times them
+ *  every frame.
  ***********************************************************/
-void SceneManager::RenderBottomBook()
+void SceneManager::SetProfiler(FrameProfiler* pProfiler)
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** BOTTOM BOOK - Box shape, pages					***/
-	/******************************************************************/
-
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(4.0f, 1.4f, 4.5f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 30.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 0.75f, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.659, 0.576, 0.439, 1.0);
-	SetShaderTexture("pages");
-	SetTextureUVScale(2.0, 0.5);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values, only sides visible
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::front);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::back);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::left);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::right);
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** BOTTOM BOOK - Box shape, bottom cover						***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(4.2f, 0.2f, 4.7f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 30.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 0.1f, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.36, 0.25, 0.20, 1.0);
-	SetShaderTexture("leather");
-	SetTextureUVScale(0.5, 6.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** BOTTOM BOOK - Box shape, top cover							***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(4.2f, 0.2f, 4.7f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 30.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 1.5f, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.36, 0.25, 0.20, 1.0);
-	SetShaderTexture("leather");
-	SetTextureUVScale(0.5, 6.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** BOTTOM BOOK - Box shape, binding							***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.6f, 0.2f, 4.7f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 30.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 90.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(5.8f, 0.8f, -2.05f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.36, 0.25, 0.20, 1.0);
-	SetShaderTexture("leather");
-	SetTextureUVScale(0.5, 6.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
+	m_pProfiler = pProfiler;
+	if (NULL == m_pProfiler)
+	{
+		return;
+	}
+
+	m_profileScopes[PROFILE_UPDATE] = m_pProfiler->AddScope("update", true);
+	m_profileScopes[PROFILE_OCCLUSION_CULL] = m_pProfiler->AddScope("cull", true);
+	m_profileScopes[PROFILE_SHADOWS] = m_pProfiler->AddScope("shadows", true);
+	m_profileScopes[PROFILE_DEPTH_PREPASS] = m_pProfiler->AddScope("prepass", true);
+	m_profileScopes[PROFILE_GBUFFER] = m_pProfiler->AddScope("gbuffer", true);
+	m_profileScopes[PROFILE_LIGHTING] = m_pProfiler->AddScope("lighting", true);
+	m_profileScopes[PROFILE_OPAQUE] = m_pProfiler->AddScope("opaque", true);
+	m_profileScopes[PROFILE_TRANSPARENT] = m_pProfiler->AddScope("transparent", true);
+	m_profileScopes[PROFILE_DEPTH_PYRAMID] = m_pProfiler->AddScope("pyramid", true);
 }
 
 /***********************************************************
- *  RenderTopBook()
+ *  BeginProfileScope()
  *
- *  This method is called to render the shapes for the book
- *  on the top of book pile.
+ *  This method is used for starting the timing of a pass
+ *  when a profiler is set.
  ***********************************************************/
-void SceneManager::RenderTopBook()
+void SceneManager::BeginProfileScope(PROFILE_SCOPE scope)
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-	/******************************************************************/
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** TOP BOOK - Box shape, pages								***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(4.0f, 1.5f, 4.5f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 60.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 2.35f, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	// SetShaderColor(0.659, 0.576, 0.439, 1.0);
-	SetShaderTexture("pages");
-	SetTextureUVScale(1.0, 1.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::front);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::back);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::left);
-	m_basicMeshes->DrawBoxMeshSide(ShapeMeshes::BoxSide::right);
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** TOP BOOK - Box shape, bottom cover							***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(4.2f, 0.2f, 4.7f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 60.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 1.7f, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.36, 0.25, 0.20, 1.0);
-	SetShaderTexture("leather");
-	// SetTextureUVScale(3.0, 3.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** TOP BOOK - Box shape, top cover							***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(4.2f, 0.2f, 4.7f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 60.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(4.0f, 3.1f, -1.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.36, 0.25, 0.20, 1.0);
-	SetShaderTexture("leather");
-	// SetTextureUVScale(3.0, 3.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** TOP BOOK - Box shape, binding								***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.6f, 0.2f, 4.7f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 60.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 90.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(5.0f, 2.4f, -2.735f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(0.36, 0.25, 0.20, 1.0);
-	SetShaderTexture("leather");
-	SetTextureUVScale(0.5, 6.0);
-	SetShaderMaterial("wood");
-
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-	/******************************************************************/
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->BeginScope(m_profileScopes[scope]);
+	}
 }
 
 /***********************************************************
- *  RenderCauldron()
+ *  EndProfileScope()
  *
- *  This method is called to render the shapes for the book
- *  on the top of book pile.
+ *  This method is used for finishing the timing of a pass
+ *  when a profiler is set.
  ***********************************************************/
-void SceneManager::RenderCauldron()
+void SceneManager::EndProfileScope(PROFILE_SCOPE scope)
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/****************************************************************/
-	/*** Set transformations and draw the main body of the cauldron ***/
-	/****************************************************************/
-	// Set the XYZ scale for the cauldron body (half sphere for cauldron shape)
-	scaleXYZ = glm::vec3(3.2f, 4.2f, 3.2f);
-
-	// Set the XYZ position for the cauldron body
-	positionXYZ = glm::vec3(-1.5f, 4.6f, -2.5f);
-
-	// Apply transformations and properties for the cauldron body
-	SetTransformations(
-		scaleXYZ,
-		180.0f,
-		0.0f,
-		0.0f,
-		positionXYZ);
-
-	SetShaderColor(0.1f, 0.1f, 0.1f, 1.0f);
-	SetShaderTexture("metal");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("metal");
-
-	// Draw the main body as a half sphere
-	m_basicMeshes->DrawHalfSphereMesh();
-
-	/****************************************************************/
-	/*** Set transformations and draw the rim of the cauldron      ***/
-	/****************************************************************/
-	// Set the XYZ scale for the rim (torus)
-	scaleXYZ = glm::vec3(3.0f, 3.0f, 0.6f);
-
-	// Set the XYZ position for the rim
-	positionXYZ = glm::vec3(-1.5f, 4.5f, -2.5f); 
-
-	// Apply transformations for the rim
-	SetTransformations(
-		scaleXYZ,
-		90.0f,  // Rotate 90 degrees around the X-axis to lay the torus parallel to the half-sphere
-		0.0f,
-		0.0f,
-		positionXYZ);
-
-	SetShaderColor(0.1f, 0.1f, 0.1f, 1.0f);
-	SetShaderTexture("metal");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("metal");
-
-	// Draw the rim as a torus mesh (correct orientation)
-	m_basicMeshes->DrawTorusMesh();
-
-	/****************************************************************/
-	/*** Set transformations and draw the legs of the cauldron     ***/
-	/****************************************************************/
-	// Define the scale for each leg
-	glm::vec3 legScale = glm::vec3(0.6f, 1.9f, 0.3f);
-
-	// Define the positions for three evenly spaced legs under the cauldron
-	glm::vec3 legPositions[] = {
-		glm::vec3(-2.8f, 2.0f, -3.0f),
-		glm::vec3(-0.2f, 2.0f, -3.0f),
-		glm::vec3(-1.25f, 2.0f, -1.0f)
-	};
-
-	for (const auto& legPos : legPositions) {
-		// Set transformations for each leg
-		SetTransformations(
-			legScale,
-			0.0f,
-			0.0f,
-			180.0f,
-			legPos);
-
-		SetShaderColor(0.1f, 0.1f, 0.1f, 1.0f);
-		SetShaderTexture("metal");
-		SetTextureUVScale(1.0f, 1.0f);
-		SetShaderMaterial("metal");
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->EndScope(m_profileScopes[scope]);
+	}
+}
 
-		// Draw each leg as a cylinder mesh
-		m_basicMeshes->DrawTaperedCylinderMesh();
+/***********************************************************
+ *  DrawDepthPrePass()
+ *
+ *  This method is used for drawing the depth of the opaque
+ *  parts with the depth-only shaders, leaving the depth test
+ *  set to GL_EQUAL so the lit pass shades every pixel once.
+ ***********************************************************/
+void SceneManager::DrawDepthPrePass()
+{
+	m_pDepthShaderManager->use();
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	FrameProfiler::CountStateChange();
+	FrameProfiler::CountStateChange();
+
+	// the opaque groups come first in the render queue
+	for (size_t i = 0; i < m_drawGroups.size(); i++)
+	{
+		const DRAW_GROUP& group = m_drawGroups[i];
+		if (group.pItem->bTransparent)
+		{
+			break;
+		}
+		m_basicMeshes->DrawCommands(group.firstCommand, group.nCommands);
 	}
 
-	/********************************************************************/
-	/*** Set transformations and draw the liquid inside the cauldron  ***/
-	/********************************************************************/
-	// Enable blending for transparency (liquid is semi-transparent)
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	m_pShaderManager->use();
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+	FrameProfiler::CountStateChange();
+	FrameProfiler::CountStateChange();
+}
 
-	// Set the scale for the liquid inside the cauldron (slightly smaller than the body)
-	scaleXYZ = glm::vec3(2.8f, 1.5f, 2.8f);
+/***********************************************************
+ *  BuildDepthPyramid()
+ *
+ *  This method is used for building the depth pyramid the
+ *  next frame is culled against from the opaque depth of
+ *  the framebuffer, with the camera of this frame.
+ ***********************************************************/
+void SceneManager::BuildDepthPyramid()
+{
+	BeginProfileScope(PROFILE_DEPTH_PYRAMID);
+	m_pOcclusionCuller->BuildDepthPyramid(m_projectionMatrix * m_viewMatrix);
+	EndProfileScope(PROFILE_DEPTH_PYRAMID);
+}
 
-	// Set the position for the liquid inside (slightly below the rim)
-	positionXYZ = glm::vec3(-1.5f, 2.75f, -2.5f);
+/***********************************************************
+ *  IsDeferredPath()
+ *
+ *  This method is used for finding whether the opaque parts
+ *  of the frame are drawn with the deferred path, which needs
+ *  the G-buffer and its shader variants.
+ ***********************************************************/
+bool SceneManager::IsDeferredPath() const
+{
+	return((RENDER_DEFERRED == m_renderPath) &&
+		(NULL != m_pShaderVariants) &&
+		m_bDeferredAvailable &&
+		m_pDeferredRenderer->IsAvailable());
+}
 
-	// Apply transformations for the liquid
-	SetTransformations(
-		scaleXYZ,
-		0.0f,   // No rotation for the liquid
-		0.0f,
-		0.0f,
-		positionXYZ);
+/***********************************************************
+ *  DrawDeferredOpaque()
+ *
+ *  This method is used for drawing the opaque groups at the
+ *  front of the render queue into the G-buffer, and lighting
+ *  the G-buffer into the framebuffer of the frame with the
+ *  passed in program.  It returns the index of the first
+ *  transparent group, which the forward pass draws over the
+ *  lit view.
+ ***********************************************************/
+size_t SceneManager::DrawDeferredOpaque(GLuint lightingProgram)
+{
+	BeginProfileScope(PROFILE_GBUFFER);
+	m_pDeferredRenderer->BeginGeometryPass();
 
-	SetShaderColor(0.3f, 0.8f, 1.0f, 0.65f);
-	SetShaderMaterial("liquid");
+	GLuint currentProgram = 0;
+	size_t i = 0;
+	while ((i < m_drawGroups.size()) && (m_drawGroups[i].pItem->bTransparent == false))
+	{
+		const DRAW_GROUP& group = m_drawGroups[i];
+		if (group.gbufferProgram != currentProgram)
+		{
+			glUseProgram(group.gbufferProgram);
+			currentProgram = group.gbufferProgram;
+			FrameProfiler::CountStateChange();
+		}
+		m_basicMeshes->DrawCommands(group.firstCommand, group.nCommands);
+		i++;
+	}
 
-	// Draw the liquid as a cylinder mesh (inside the cauldron)
-	m_basicMeshes->DrawCylinderMesh();
-	glDisable(GL_BLEND); // Disable blending after drawing the liquid
-}
+	m_pDeferredRenderer->EndGeometryPass();
+	EndProfileScope(PROFILE_GBUFFER);
 
+	BeginProfileScope(PROFILE_LIGHTING);
+	m_pDeferredRenderer->DrawLighting(lightingProgram);
+	EndProfileScope(PROFILE_LIGHTING);
 
+	return(i);
+}
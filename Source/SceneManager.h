@@ -10,9 +10,27 @@
 #pragma once
 
 #include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "ShaderVariants.h"
+#include "MeshLibrary.h"
+#include "TextureLoader.h"
+#include "TextureResidency.h"
+#include "LightClusters.h"
+#include "ShadowMaps.h"
+#include "DeferredRenderer.h"
+#include "OcclusionCuller.h"
+#include "SceneAnimator.h"
+#include "SceneFile.h"
+#include "ShaderUniforms.h"
+#include "FrameProfiler.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "StreamBuffer.h"
+#include "UniformBuffers.h"
 
+#include <stdint.h>
+#include <algorithm>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 /***********************************************************
@@ -25,10 +43,22 @@ class SceneManager
 {
 public:
 	// constructor
-	SceneManager(ShaderManager *pShaderManager);
+	SceneManager(
+		ShaderManager *pShaderManager,
+		ShaderUniforms *pShaderUniforms,
+		UniformBuffers *pUniformBuffers);
 	// destructor
 	~SceneManager();
 
+	// ways of drawing the opaque parts of the scene
+	enum RENDER_PATH
+	{
+		// lit as they are drawn, with the clustered lights
+		RENDER_FORWARD = 0,
+		// drawn into the G-buffer and lit once per pixel
+		RENDER_DEFERRED
+	};
+
 	// properties for loaded texture access
 	struct TEXTURE_INFO
 	{
@@ -46,78 +76,305 @@ public:
 		std::string tag;
 	};
 
+	// properties for a part of the 3D scene in the draw list
+	struct DRAW_ITEM
+	{
+		MeshLibrary::MESH_TYPE mesh;
+		glm::mat4 model;
+		glm::vec4 color;
+		glm::vec2 UVscale;
+		// -1 when the part is drawn with the solid color
+		int textureSlot;
+		// -1 when the part has no material
+		int materialIndex;
+		bool bTransparent;
+		// world space bounding box for culling the part
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		// level of detail of the mesh, kept between frames so it
+		// only changes past the hysteresis band
+		int lod;
+	};
+
 private:
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
-	// pointer to basic shapes object
-	ShapeMeshes *m_basicMeshes;
-	// total number of loaded textures
-	int m_loadedTextures;
+	// pointer to the cached uniform locations of the shader
+	ShaderUniforms* m_pShaderUniforms;
+	// pointer to the uniform buffers shared by the shaders
+	UniformBuffers* m_pUniformBuffers;
+	// pointer to the shape meshes shared by the scenes
+	MeshLibrary *m_basicMeshes;
+	// pointer to the texture loader decoding the image files
+	TextureLoader* m_pTextureLoader;
+	// pointer to the point light clusters
+	LightClusters* m_pLightClusters;
+	// pointer to the owner of the scene textures
+	TextureResidency* m_pTextureResidency;
+	// pointer to the shadow maps of the scene lights
+	ShadowMaps* m_pShadowMaps;
+	// pointer to the animated light, material and part values
+	SceneAnimator* m_pSceneAnimator;
+	// whether the animated values are evaluated by the simulation
+	// thread, and the changes of its snapshot not applied yet
+	bool m_bSimulatedAnimation;
+	const SceneAnimator::ANIMATION_CHANGES* m_pAnimationChanges;
+	// pointer to the worker threads of the per-frame loops
+	JobSystem* m_pJobSystem;
+	// pointer to the scratch memory of the current frame
+	FrameArena* m_pFrameArena;
+	// pointer to the mapped buffer the values of every frame
+	// are streamed through
+	StreamBuffer* m_pStreamBuffer;
+	// pointer to the G-buffer of the deferred path
+	DeferredRenderer* m_pDeferredRenderer;
+	// pointer to the culling of the parts hidden behind the
+	// opaque depth of the last frame
+	OcclusionCuller* m_pOcclusionCuller;
+	// how the opaque parts are drawn
+	RENDER_PATH m_renderPath;
+	// whether the deferred programs could be built
+	bool m_bDeferredAvailable;
+	// pointer to the depth-only shaders of the depth pre-pass
+	ShaderManager* m_pDepthShaderManager;
+	// whether the opaque depth is drawn before the lit pass
+	bool m_bDepthPrePass;
+	// pointer to the specialized programs of the scene shaders,
+	// if any
+	ShaderVariants* m_pShaderVariants;
+	// whether the scene is drawn with the custom lighting
+	bool m_bUseLighting;
+	// variant features of the lighting in the current frame
+	unsigned int m_lightingVariant;
+	// pointer to the frame profiler timing the passes, if any
+	FrameProfiler* m_pProfiler;
+	// passes of the frame that are timed by the profiler
+	enum PROFILE_SCOPE
+	{
+		PROFILE_UPDATE = 0,
+		PROFILE_OCCLUSION_CULL,
+		PROFILE_SHADOWS,
+		PROFILE_DEPTH_PREPASS,
+		PROFILE_GBUFFER,
+		PROFILE_LIGHTING,
+		PROFILE_OPAQUE,
+		PROFILE_TRANSPARENT,
+		PROFILE_DEPTH_PYRAMID,
+		PROFILE_SCOPE_COUNT
+	};
+	// profiler handles of the timed passes
+	int m_profileScopes[PROFILE_SCOPE_COUNT];
+	// number of copies of the objects in the draw list
+	int m_sceneReplicas;
+	// scene description the draw list is built from
+	std::string m_sceneFilename;
 	// loaded textures info
-	TEXTURE_INFO m_textureIDs[16];
+	std::vector<TEXTURE_INFO> m_textureIDs;
+	// textures uploaded during the current frame
+	std::vector<GLuint> m_uploadedTextures;
+	// texture slot of every loaded texture by tag
+	std::unordered_map<std::string, int> m_textureSlots;
 	// defined object materials
 	std::vector<OBJECT_MATERIAL> m_objectMaterials;
+	// index of every defined material by tag
+	std::unordered_map<std::string, int> m_materialIndices;
+	// defined materials in the layout of the material buffer,
+	// kept for writing the animated ones
+	std::vector<UniformBuffers::MATERIAL> m_materials;
+	// indices of the materials changed in the current frame
+	std::vector<int> m_changedMaterials;
+	// retained parts of the 3D scene, built once in PrepareScene()
+	std::vector<DRAW_ITEM> m_drawList;
+	// index of the candle flame part, which flickers every frame
+	int m_flameItem;
+	// index of the flame point light, which flickers with it
+	int m_flameLight;
+	// draw list parts casting shadows, ordered by mesh
+	std::vector<int> m_shadowCasters;
+	// values of the draw list parts read by the per-frame loops,
+	// in arrays of their own in draw list order - the position,
+	// the bounding box as center and extent, the number of detail
+	// levels and the current one, and the sort key bits that do
+	// not change between frames
+	std::vector<glm::vec3> m_itemPositions;
+	std::vector<glm::vec3> m_itemBoundsCenters;
+	std::vector<glm::vec3> m_itemBoundsExtents;
+	std::vector<int> m_itemLodCounts;
+	std::vector<int> m_itemLods;
+	std::vector<uint64_t> m_itemSortKeys;
+	// sort keys of the draw list parts, rebuilt every frame
+	std::vector<uint64_t> m_renderQueue;
+	// sort keys of every chunk of the draw list, at the index of
+	// the first part of the chunk, and the number of keys of
+	// every chunk, handed out by the frame arena
+	uint64_t* m_pChunkKeys;
+	size_t* m_pChunkKeyCounts;
+	// sorted runs of the render queue the chunks form
+	std::vector<size_t> m_sortRuns;
+	// per-instance values of the parts in render queue order,
+	// rebuilt every frame
+	std::vector<MeshLibrary::INSTANCE_DATA> m_instances;
+	// boxes of the instances and the commands drawing them, in
+	// the same order, for the occlusion culling
+	std::vector<OcclusionCuller::INSTANCE_BOUNDS> m_instanceBounds;
+	// indirect draw commands of the batches of parts, rebuilt
+	// every frame
+	std::vector<MeshLibrary::DRAW_COMMAND> m_drawCommands;
+	// run of draw commands drawn with the same shader values
+	// and shader program, with the program filling the G-buffer
+	// for the opaque runs of the deferred path
+	struct DRAW_GROUP
+	{
+		const DRAW_ITEM* pItem;
+		GLuint program;
+		GLuint gbufferProgram;
+		int firstCommand;
+		int nCommands;
+	};
+	std::vector<DRAW_GROUP> m_drawGroups;
+	// camera view of the current frame
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	glm::vec3 m_viewPosition;
+	// planes of the view frustum of the current frame, with the
+	// normals pointing inwards
+	glm::vec4 m_frustumPlanes[6];
 
-	// load texture images and convert to OpenGL texture data
+	// request a texture image to be loaded into the next texture slot
 	bool CreateGLTexture(const char* filename, std::string tag);
 	// bind loaded OpenGL textures to slots in memory
 	void BindGLTextures();
 	// free the loaded OpenGL textures
 	void DestroyGLTextures();
 	// find a loaded texture by tag
-	int FindTextureID(std::string tag);
-	int FindTextureSlot(std::string tag);
+	int FindTextureID(const std::string& tag) const;
+	int FindTextureSlot(const std::string& tag) const;
 	// find a defined material by tag
-	bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
-
-	// set the transformation values 
-	// into the transform buffer
-	void SetTransformations(
-		glm::vec3 scaleXYZ,
-		float XrotationDegrees,
-		float YrotationDegrees,
-		float ZrotationDegrees,
-		glm::vec3 positionXYZ);
-
-	// set the color values into the shader
-	void SetShaderColor(
-		float redColorValue,
-		float greenColorValue,
-		float blueColorValue,
-		float alphaValue);
-
-	// set the texture data into the shader
-	void SetShaderTexture(
-		std::string textureTag);
-
-	// set the UV scale for the texture mapping
-	void SetTextureUVScale(
-		float u, float v);
-
-	// set the object material into the shader
-	void SetShaderMaterial(
-		std::string materialTag);
+	bool FindMaterial(const std::string& tag, OBJECT_MATERIAL& material) const;
+	int FindMaterialIndex(const std::string& tag) const;
+	// resolve the handles of the values passed into the shader
+	void ResolveShaderUniforms();
+	// point the samplers of the program in use at their units -
+	// returns whether the program samples the texture arrays
+	bool SetShaderSamplers(const ShaderUniforms& uniforms) const;
+	// variant features of the program drawing a cached part
+	unsigned int GetItemVariant(const DRAW_ITEM& item) const;
+	// variant features of the program writing a cached part into
+	// the G-buffer
+	unsigned int GetGBufferVariant(const DRAW_ITEM& item) const;
+	// build the program of a shader variant and set it up for
+	// the scene
+	GLuint BuildVariantProgram(unsigned int flags);
+	// get the built program of a shader variant, or the shader
+	// without variants when it is not built
+	GLuint FindVariantProgram(unsigned int flags) const;
+	// build the shader variants the draw list uses
+	void PrepareShaderVariants();
+	// find the variant features of the lighting of the frame
+	void UpdateLightingVariant();
+	// write the defined materials into the material buffer
+	void UploadObjectMaterials();
+
+	// add a part of the scene file to the draw list, with the
+	// texture slots and material indices of the file tables
+	void AddDrawItem(
+		const SceneFile::SCENE_PART& part,
+		const std::vector<int>& textureSlots,
+		const std::vector<int>& materialIndices);
+
+	// build the sorted render queue from the draw list
+	void BuildRenderQueue();
+	// whether two cached parts can be drawn in the same batch
+	bool CanBatchItems(const DRAW_ITEM& first, const DRAW_ITEM& second) const;
+	// whether two cached parts can be drawn in the same group
+	bool CanGroupItems(const DRAW_ITEM& first, const DRAW_ITEM& second) const;
+	// cull and key the parts of one chunk of the draw list
+	void BuildChunkKeys(size_t first, size_t last);
+	// merge the sorted runs of the render queue
+	void MergeSortRuns();
+	// whether any of a cached part is inside the view frustum
+	bool IsItemVisible(size_t index) const;
+	// choose the level of detail of a cached part from its size
+	// on the screen
+	int SelectItemLod(size_t index) const;
+	// copy the values read by the per-frame loops out of the
+	// draw list
+	void BuildCullingArrays();
+	// update the cached parts that change over time
+	void UpdateAnimatedParts();
+	// write evaluated animation changes into the scene
+	void ApplyAnimationChanges(const SceneAnimator::ANIMATION_CHANGES& changes);
+	// draw the depth of the opaque parts before the lit pass
+	void DrawDepthPrePass();
+	// build the depth pyramid of the occlusion culling from the
+	// opaque depth of the frame
+	void BuildDepthPyramid();
+	// whether the opaque parts of the frame are drawn deferred
+	bool IsDeferredPath() const;
+	// draw the opaque parts into the G-buffer and light them with
+	// the passed in program - returns the first draw group left
+	// to the forward pass
+	size_t DrawDeferredOpaque(GLuint lightingProgram);
+	// start and finish timing a pass when profiling
+	void BeginProfileScope(PROFILE_SCOPE scope);
+	void EndProfileScope(PROFILE_SCOPE scope);
+	// add the copies of the objects for a stress scene
+	void ReplicateDrawList();
+	// list the draw list parts that cast shadows
+	void CollectShadowCasters();
+	// add the shadow casters to the instances and draw commands
+	int AppendShadowCasters();
 
 public:
 
 	// prepare the 3D scene for rendering
 	void PrepareScene();
+	// set the camera view used for ordering the 3D scene
+	void SetSceneView(
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		const glm::vec3& viewPosition);
 	// render the objects in the 3D scene
 	void RenderScene();
+	// set the depth-only shaders used by the depth pre-pass
+	void SetDepthShader(ShaderManager* pDepthShaderManager) { m_pDepthShaderManager = pDepthShaderManager; }
+	// turn the depth pre-pass on or off
+	void SetDepthPrePass(bool bEnabled) { m_bDepthPrePass = bEnabled; }
+	// choose how the opaque parts are drawn - the deferred path
+	// falls back to the forward one when it is not available
+	void SetRenderPath(RENDER_PATH renderPath) { m_renderPath = renderPath; }
+	// turn the culling of the hidden opaque parts on or off
+	void SetOcclusionCulling(bool bEnabled) { m_pOcclusionCuller->SetEnabled(bEnabled); }
+	// set the specialized programs the parts are drawn with
+	void SetShaderVariants(ShaderVariants* pShaderVariants) { m_pShaderVariants = pShaderVariants; }
+	// time the passes of the frame with the passed in profiler
+	void SetProfiler(FrameProfiler* pProfiler);
+	// the animated values that the simulation thread evaluates,
+	// once the scene is prepared
+	SceneAnimator* GetSceneAnimator() const { return m_pSceneAnimator; }
+	// have the animated values come from the simulation instead
+	// of being evaluated every frame
+	void SetSimulatedAnimation(bool bSimulated) { m_bSimulatedAnimation = bSimulated; }
+	// set the changes of a new simulation snapshot, applied by the
+	// next frame - they have to stay valid until it is drawn
+	void SetAnimationChanges(const SceneAnimator::ANIMATION_CHANGES* pChanges) { m_pAnimationChanges = pChanges; }
+	// draw the objects the passed in number of times side by
+	// side, set before the scene is prepared
+	void SetSceneReplicas(int nReplicas) { m_sceneReplicas = std::max(1, nReplicas); }
+	// number of times the objects are drawn, once the scene is
+	// prepared and the replicas are limited to what fits
+	int GetSceneReplicas() const { return m_sceneReplicas; }
+
+	// set the scene description loaded by PrepareScene
+	void SetSceneFile(const std::string& filename) { m_sceneFilename = filename; }
 
-	// load all of the needed textures before rendering
-	void LoadSceneTextures();
+	// load all of the textures of the scene before rendering
+	void LoadSceneTextures(const SceneFile& scene);
 	// define all the object materials before rendering
 	void DefineObjectMaterials();
 	// add and define the light sources before rendering
 	void SetupSceneLights();
 
-	// methods for rendering the various objects in the 3D scene
-	void RenderTable();
-	void RenderBackdrop();
-	void RenderPotionBottle();
-	void RenderCandle();
-	void RenderBottomBook();
-	void RenderTopBook();
-	void RenderCauldron();
+	// build the draw list for all the parts of the scene
+	void BuildDrawList(const SceneFile& scene);
 };
\ No newline at end of file
@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercompiler.cpp
+// ============
+// read shader files, compile their stages and link them into programs for
+// the renderers that build their own programs
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderCompiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// declaration of global variables and defines
+namespace
+{
+	// size of the info log written for a failed stage or link
+	const int g_InfoLogSize = 1024;
+}
+
+/***********************************************************
+ *  ReadShaderFile()
+ *
+ *  This method is used for reading a whole shader file into
+ *  the passed in text.
+ ***********************************************************/
+bool ShaderCompiler::ReadShaderFile(const char* filename, std::string& text)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open shader:" << filename << std::endl;
+		return(false);
+	}
+	std::stringstream source;
+	source << file.rdbuf();
+	text = source.str();
+	return(true);
+}
+
+/***********************************************************
+ *  CompileShaderStage()
+ *
+ *  This method is used for compiling a shader stage from
+ *  its source, returning 0 when it can not be compiled.
+ ***********************************************************/
+GLuint ShaderCompiler::CompileShaderStage(GLenum type, const std::string& sourceText, const char* filename)
+{
+	const char* pSource = sourceText.c_str();
+	GLint bSuccess = GL_FALSE;
+	char infoLog[g_InfoLogSize];
+
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &pSource, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &bSuccess);
+	if (GL_FALSE == bSuccess)
+	{
+		glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+		std::cout << "Could not compile shader:" << filename << std::endl << infoLog << std::endl;
+		glDeleteShader(shader);
+		return(0);
+	}
+
+	return(shader);
+}
+
+/***********************************************************
+ *  CompileShaderFile()
+ *
+ *  This method is used for reading a shader stage from a
+ *  file and compiling it, returning 0 when it fails.
+ ***********************************************************/
+GLuint ShaderCompiler::CompileShaderFile(GLenum type, const char* filename)
+{
+	std::string sourceText;
+	if (ReadShaderFile(filename, sourceText) == false)
+	{
+		return(0);
+	}
+
+	return(CompileShaderStage(type, sourceText, filename));
+}
+
+/***********************************************************
+ *  LinkProgram()
+ *
+ *  This method is used for linking compiled stages into a
+ *  program.  The stages are deleted in every case, so the
+ *  result of every compile can be passed straight in.
+ ***********************************************************/
+GLuint ShaderCompiler::LinkProgram(const GLuint* pShaders, int count, const char* name, bool bRetrievable)
+{
+	bool bComplete = true;
+	for (int i = 0; i < count; i++)
+	{
+		bComplete = bComplete && (0 != pShaders[i]);
+	}
+	if (bComplete == false)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			glDeleteShader(pShaders[i]);
+		}
+		return(0);
+	}
+
+	GLint bSuccess = GL_FALSE;
+	char infoLog[g_InfoLogSize];
+
+	GLuint program = glCreateProgram();
+	// the binary can only be read back when asked for before linking
+	if (bRetrievable)
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	for (int i = 0; i < count; i++)
+	{
+		glAttachShader(program, pShaders[i]);
+	}
+	glLinkProgram(program);
+	for (int i = 0; i < count; i++)
+	{
+		glDeleteShader(pShaders[i]);
+	}
+	glGetProgramiv(program, GL_LINK_STATUS, &bSuccess);
+	if (GL_FALSE == bSuccess)
+	{
+		glGetProgramInfoLog(program, sizeof(infoLog), NULL, infoLog);
+		std::cout << "Could not link shader program:" << name << std::endl << infoLog << std::endl;
+		glDeleteProgram(program);
+		return(0);
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  CreateProgram()
+ *
+ *  This method is used for building a program from a vertex
+ *  and a fragment shader file, returning 0 when it fails.
+ ***********************************************************/
+GLuint ShaderCompiler::CreateProgram(const char* vertexShaderFile, const char* fragmentShaderFile)
+{
+	GLuint shaders[2] = {
+		CompileShaderFile(GL_VERTEX_SHADER, vertexShaderFile),
+		CompileShaderFile(GL_FRAGMENT_SHADER, fragmentShaderFile) };
+
+	return(LinkProgram(shaders, 2, vertexShaderFile));
+}
+
+/***********************************************************
+ *  CreateComputeProgram()
+ *
+ *  This method is used for building a program from a
+ *  compute shader file, returning 0 when it fails.
+ ***********************************************************/
+GLuint ShaderCompiler::CreateComputeProgram(const char* computeShaderFile)
+{
+	GLuint shader = CompileShaderFile(GL_COMPUTE_SHADER, computeShaderFile);
+
+	return(LinkProgram(&shader, 1, computeShaderFile));
+}
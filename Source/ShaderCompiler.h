@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercompiler.h
+// ============
+// read shader files, compile their stages and link them into programs for
+// the renderers that build their own programs
+//
+//	The shadow maps, the light clusters, the shader variants, the dynamic
+//	resolution upscale and the occlusion culling all build programs of
+//	their own next to the ones of the shader manager.  They load, compile
+//	and link them here, so the error handling and the messages are the
+//	same for all of them.  Every step writes the info log of a failure to
+//	the console and returns 0, and the shaders of a program are deleted
+//	once it is linked, whether the link worked or not.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+
+/***********************************************************
+ *  ShaderCompiler
+ *
+ *  This class contains the code for loading, compiling and
+ *  linking shader programs.
+ ***********************************************************/
+class ShaderCompiler
+{
+public:
+	// read a whole shader file - returns false when it can not
+	// be opened
+	static bool ReadShaderFile(const char* filename, std::string& text);
+	// compile a shader stage from its source, naming the passed
+	// in file in the errors - returns 0 when it fails
+	static GLuint CompileShaderStage(GLenum type, const std::string& sourceText, const char* filename);
+	// read and compile a shader stage from a file - returns 0
+	// when it fails
+	static GLuint CompileShaderFile(GLenum type, const char* filename);
+	// link the passed in stages into a program and delete them,
+	// asking for a program binary that can be read back when
+	// passed in - returns 0 when a stage is missing or the link
+	// fails
+	static GLuint LinkProgram(const GLuint* pShaders, int count, const char* name, bool bRetrievable = false);
+	// read, compile and link a vertex and a fragment shader
+	static GLuint CreateProgram(const char* vertexShaderFile, const char* fragmentShaderFile);
+	// read, compile and link a compute shader
+	static GLuint CreateComputeProgram(const char* computeShaderFile);
+};
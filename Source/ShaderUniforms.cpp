@@ -0,0 +1,142 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.cpp
+// ============
+// resolve the uniform locations of a linked shader program once and pass
+// values into the shader through typed handles
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderUniforms.h"
+#include "FrameProfiler.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+/***********************************************************
+ *  ShaderUniforms()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderUniforms::ShaderUniforms()
+{
+	m_programID = 0;
+}
+
+/***********************************************************
+ *  ResolveUniforms()
+ *
+ *  This method is used for reading the locations of all the
+ *  active uniforms of the linked shader program into the
+ *  cache.  Every element of a uniform array is added under
+ *  its own indexed name.
+ ***********************************************************/
+void ShaderUniforms::ResolveUniforms(GLuint programID)
+{
+	GLint nUniforms = 0;
+	GLint maxNameLength = 0;
+
+	m_programID = programID;
+	m_locations.clear();
+
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &nUniforms);
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<GLchar> nameBuffer(maxNameLength + 1);
+	for (GLint i = 0; i < nUniforms; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		GLsizei nameLength = 0;
+
+		glGetActiveUniform(programID, (GLuint)i, (GLsizei)nameBuffer.size(),
+			&nameLength, &size, &type, nameBuffer.data());
+		std::string name(nameBuffer.data(), nameLength);
+
+		// uniforms in blocks have no location
+		GLint location = glGetUniformLocation(programID, name.c_str());
+		if (location < 0)
+		{
+			continue;
+		}
+		m_locations[name] = location;
+
+		// arrays of basic types are reported once as "name[0]"
+		std::string::size_type bracket = name.rfind("[0]");
+		if ((bracket != std::string::npos) && (bracket + 3 == name.size()))
+		{
+			std::string baseName = name.substr(0, bracket);
+			m_locations[baseName] = location;
+
+			for (GLint element = 1; element < size; element++)
+			{
+				std::string elementName = baseName + "[" + std::to_string(element) + "]";
+				m_locations[elementName] = glGetUniformLocation(programID, elementName.c_str());
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  FindLocation()
+ *
+ *  This method is used for finding the cached location of
+ *  the uniform with the passed in name.  Uniforms that the
+ *  shader compiler removed are not active and get -1.
+ ***********************************************************/
+GLint ShaderUniforms::FindLocation(const std::string& name) const
+{
+	std::unordered_map<std::string, GLint>::const_iterator found = m_locations.find(name);
+	if (found == m_locations.end())
+	{
+		return(-1);
+	}
+
+	return(found->second);
+}
+
+/***********************************************************
+ *  SetValue()
+ *
+ *  These methods are used for passing values into the
+ *  shader program through the cached uniform locations.
+ ***********************************************************/
+void ShaderUniforms::SetValue(const UNIFORM<bool>& uniform, bool value) const
+{
+	glUniform1i(uniform.location, (int)value);
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
+
+void ShaderUniforms::SetValue(const UNIFORM<int>& uniform, int value) const
+{
+	glUniform1i(uniform.location, value);
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
+
+void ShaderUniforms::SetValue(const UNIFORM<float>& uniform, float value) const
+{
+	glUniform1f(uniform.location, value);
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
+
+void ShaderUniforms::SetValue(const UNIFORM<glm::vec2>& uniform, const glm::vec2& value) const
+{
+	glUniform2fv(uniform.location, 1, glm::value_ptr(value));
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
+
+void ShaderUniforms::SetValue(const UNIFORM<glm::vec3>& uniform, const glm::vec3& value) const
+{
+	glUniform3fv(uniform.location, 1, glm::value_ptr(value));
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
+
+void ShaderUniforms::SetValue(const UNIFORM<glm::vec4>& uniform, const glm::vec4& value) const
+{
+	glUniform4fv(uniform.location, 1, glm::value_ptr(value));
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
+
+void ShaderUniforms::SetValue(const UNIFORM<glm::mat4>& uniform, const glm::mat4& value) const
+{
+	glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+	FrameProfiler::CountUniformUpload(sizeof(value));
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.h
+// ============
+// resolve the uniform locations of a linked shader program once and pass
+// values into the shader through typed handles
+//
+//	ShaderManager looks up the location of a uniform by name every time a
+//	value is set.  The handles from this cache are resolved once after the
+//	shaders are loaded, so setting a value is a single glUniform call.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+
+/***********************************************************
+ *  ShaderUniforms
+ *
+ *  This class contains the code for caching the uniform
+ *  locations of the active shader program and setting
+ *  uniform values through the cached locations.
+ ***********************************************************/
+class ShaderUniforms
+{
+public:
+	// constructor
+	ShaderUniforms();
+
+	// handle to a resolved uniform of the passed in value type,
+	// a location of -1 is silently ignored by OpenGL
+	template <typename T>
+	struct UNIFORM
+	{
+		GLint location;
+		UNIFORM() : location(-1) {}
+		bool IsValid() const { return(location >= 0); }
+	};
+
+	// read the locations of all the active uniforms of the
+	// linked shader program
+	void ResolveUniforms(GLuint programID);
+
+	// get the handle for the uniform with the passed in name
+	// - names of array elements include the index, such as
+	// "pointLights[3].diffuse"
+	template <typename T>
+	UNIFORM<T> GetUniform(const std::string& name) const
+	{
+		UNIFORM<T> uniform;
+		uniform.location = FindLocation(name);
+		return(uniform);
+	}
+
+	// pass values into the shader program that is in use
+	void SetValue(const UNIFORM<bool>& uniform, bool value) const;
+	void SetValue(const UNIFORM<int>& uniform, int value) const;
+	void SetValue(const UNIFORM<float>& uniform, float value) const;
+	void SetValue(const UNIFORM<glm::vec2>& uniform, const glm::vec2& value) const;
+	void SetValue(const UNIFORM<glm::vec3>& uniform, const glm::vec3& value) const;
+	void SetValue(const UNIFORM<glm::vec4>& uniform, const glm::vec4& value) const;
+	void SetValue(const UNIFORM<glm::mat4>& uniform, const glm::mat4& value) const;
+
+	// shader program the locations were read from
+	GLuint GetProgramID() const { return(m_programID); }
+
+private:
+	// shader program the locations were read from
+	GLuint m_programID;
+	// location of every active uniform by name
+	std::unordered_map<std::string, GLint> m_locations;
+
+	// find the location of a uniform by name
+	GLint FindLocation(const std::string& name) const;
+};
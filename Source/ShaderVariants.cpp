@@ -0,0 +1,382 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadervariants.cpp
+// ============
+// build specialized programs of the scene shaders from #defines, and keep
+// the linked programs in an on-disk binary cache
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderVariants.h"
+#include "ShaderCompiler.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// declaration of global variables and defines
+namespace
+{
+	// names of the variant features in the shaders, in the order
+	// of the variant flag bits
+	const char* g_VariantDefineNames[] = {
+		"USE_LIGHTING",
+		"USE_TEXTURE",
+		"USE_DIRECTIONAL_LIGHT",
+		"USE_POINT_LIGHTS",
+		"USE_SPOT_LIGHT" };
+	const int g_VariantDefineCount = sizeof(g_VariantDefineNames) / sizeof(g_VariantDefineNames[0]);
+	// names of the passes a variant is built for, in the order of
+	// the flag bits after the features - they are only defined for
+	// the passes that are set, since they choose the inputs and
+	// outputs of the shaders with #ifdef
+	const char* g_VariantPassNames[] = {
+		"GBUFFER_OUTPUT",
+		"DEFERRED_LIGHTING" };
+	const int g_VariantPassCount = sizeof(g_VariantPassNames) / sizeof(g_VariantPassNames[0]);
+
+	// prefix of the cached program binary files
+	const char* g_CacheFilePrefix = "program_";
+	const char* g_CacheFileExtension = ".bin";
+
+	/***********************************************************
+	 *  HashText()
+	 *
+	 *  This function is used for folding text into a 64-bit
+	 *  FNV-1a hash, continuing from the passed in hash.
+	 ***********************************************************/
+	uint64_t HashText(uint64_t hash, const std::string& text)
+	{
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			hash ^= (unsigned char)text[i];
+			hash *= 0x100000001B3ull;
+		}
+		return(hash);
+	}
+
+	/***********************************************************
+	 *  InsertDefines()
+	 *
+	 *  This function is used for putting the #define lines of
+	 *  a variant right after the #version line of a shader,
+	 *  followed by a #line so the compiler errors keep the
+	 *  line numbers of the file.
+	 ***********************************************************/
+	std::string InsertDefines(const std::string& source, const std::string& defines)
+	{
+		std::string::size_type version = source.find("#version");
+		std::string::size_type lineEnd = (version == std::string::npos) ?
+			std::string::npos : source.find('\n', version);
+		if (lineEnd == std::string::npos)
+		{
+			return(defines + source);
+		}
+
+		int versionLine = 1;
+		for (std::string::size_type i = 0; i < lineEnd; i++)
+		{
+			if (source[i] == '\n')
+			{
+				versionLine++;
+			}
+		}
+
+		return(source.substr(0, lineEnd + 1) + defines +
+			"#line " + std::to_string(versionLine + 1) + "\n" +
+			source.substr(lineEnd + 1));
+	}
+
+}
+
+/***********************************************************
+ *  ShaderVariants()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderVariants::ShaderVariants()
+{
+	m_sourceHash = 0;
+	m_bProgramBinaries = false;
+	for (int i = 0; i < VARIANT_COUNT; i++)
+	{
+		m_programs[i] = 0;
+		m_bFailed[i] = false;
+	}
+	m_nCached = 0;
+	m_nCompiled = 0;
+}
+
+/***********************************************************
+ *  ~ShaderVariants()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShaderVariants::~ShaderVariants()
+{
+	for (int i = 0; i < VARIANT_COUNT; i++)
+	{
+		if (0 != m_programs[i])
+		{
+			glDeleteProgram(m_programs[i]);
+			m_programs[i] = 0;
+		}
+	}
+}
+
+/***********************************************************
+ *  LoadSources()
+ *
+ *  This method is used for reading the sources the variants
+ *  are built from.  The sources are hashed together with the
+ *  driver strings, so the cached binaries of another shader
+ *  or driver version are never loaded.
+ ***********************************************************/
+bool ShaderVariants::LoadSources(
+	const char* vertexShaderFile,
+	const char* fragmentShaderFile,
+	const char* cacheDirectory)
+{
+	if ((ShaderCompiler::ReadShaderFile(vertexShaderFile, m_vertexSource) == false) ||
+		(ShaderCompiler::ReadShaderFile(fragmentShaderFile, m_fragmentSource) == false))
+	{
+		return(false);
+	}
+	m_vertexShaderFile = vertexShaderFile;
+	m_fragmentShaderFile = fragmentShaderFile;
+	m_cacheDirectory = cacheDirectory;
+
+	// the binaries are only saved when the driver has a format
+	// to save them in
+	GLint nFormats = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+	}
+	m_bProgramBinaries = (nFormats > 0);
+
+	const GLubyte* pVendor = glGetString(GL_VENDOR);
+	const GLubyte* pRenderer = glGetString(GL_RENDERER);
+	const GLubyte* pVersion = glGetString(GL_VERSION);
+
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = HashText(hash, m_vertexSource);
+	hash = HashText(hash, m_fragmentSource);
+	hash = HashText(hash, (NULL != pVendor) ? (const char*)pVendor : "");
+	hash = HashText(hash, (NULL != pRenderer) ? (const char*)pRenderer : "");
+	hash = HashText(hash, (NULL != pVersion) ? (const char*)pVersion : "");
+	m_sourceHash = hash;
+
+	return(true);
+}
+
+/***********************************************************
+ *  FindProgram()
+ *
+ *  This method is used for getting the program of a variant
+ *  that is already built, 0 when it is not.
+ ***********************************************************/
+GLuint ShaderVariants::FindProgram(unsigned int flags) const
+{
+	if (flags >= VARIANT_COUNT)
+	{
+		return(0);
+	}
+	return(m_programs[flags]);
+}
+
+/***********************************************************
+ *  BuildProgram()
+ *
+ *  This method is used for building the program of a
+ *  variant, loading it from the cache when it was saved by
+ *  an earlier launch and compiling and saving it otherwise.
+ *  A variant that fails to compile is remembered, so its
+ *  errors are not compiled and printed again.
+ ***********************************************************/
+GLuint ShaderVariants::BuildProgram(unsigned int flags)
+{
+	if ((flags >= VARIANT_COUNT) || m_fragmentSource.empty() || m_bFailed[flags])
+	{
+		return(0);
+	}
+	if (0 != m_programs[flags])
+	{
+		return(m_programs[flags]);
+	}
+
+	GLuint program = LoadCachedProgram(flags);
+	if (0 != program)
+	{
+		m_nCached++;
+	}
+	else
+	{
+		program = CompileProgram(flags);
+		if (0 == program)
+		{
+			m_bFailed[flags] = true;
+			return(0);
+		}
+		SaveCachedProgram(flags, program);
+		m_nCompiled++;
+	}
+
+	m_programs[flags] = program;
+	return(program);
+}
+
+/***********************************************************
+ *  GetVariantDefines()
+ *
+ *  This method is used for getting the #define lines that
+ *  turn the features of a variant on and off, and that
+ *  choose its pass.
+ ***********************************************************/
+std::string ShaderVariants::GetVariantDefines(unsigned int flags)
+{
+	std::string defines = "#define SHADER_VARIANT\n";
+	for (int i = 0; i < g_VariantDefineCount; i++)
+	{
+		defines += std::string("#define ") + g_VariantDefineNames[i] +
+			((0 != (flags & (1u << i))) ? " true\n" : " false\n");
+	}
+	for (int i = 0; i < g_VariantPassCount; i++)
+	{
+		if (0 != (flags & (1u << (g_VariantDefineCount + i))))
+		{
+			defines += std::string("#define ") + g_VariantPassNames[i] + "\n";
+		}
+	}
+	return(defines);
+}
+
+/***********************************************************
+ *  GetCacheFilename()
+ *
+ *  This method is used for getting the name of the cached
+ *  binary of a variant, from the hash of the sources, the
+ *  driver and the variant defines.
+ ***********************************************************/
+std::string ShaderVariants::GetCacheFilename(unsigned int flags) const
+{
+	uint64_t hash = HashText(m_sourceHash, GetVariantDefines(flags));
+
+	char hashText[17];
+	snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)hash);
+
+	std::string filename = m_cacheDirectory;
+	if (!filename.empty() && (filename.back() != '/') && (filename.back() != '\\'))
+	{
+		filename += '/';
+	}
+	return(filename + g_CacheFilePrefix + hashText + g_CacheFileExtension);
+}
+
+/***********************************************************
+ *  LoadCachedProgram()
+ *
+ *  This method is used for creating the program of a variant
+ *  from its cached binary.  A binary the driver no longer
+ *  accepts is dropped, and the variant is compiled again.
+ ***********************************************************/
+GLuint ShaderVariants::LoadCachedProgram(unsigned int flags) const
+{
+	if (m_bProgramBinaries == false)
+	{
+		return(0);
+	}
+
+	std::ifstream file(GetCacheFilename(flags).c_str(), std::ios::binary);
+	if (!file.is_open())
+	{
+		return(0);
+	}
+
+	PROGRAM_CACHE_HEADER header;
+	if (!file.read((char*)&header, sizeof(header)) ||
+		(header.magic != PROGRAM_CACHE_MAGIC) ||
+		(header.length == 0))
+	{
+		return(0);
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), header.length))
+	{
+		return(0);
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, (GLenum)header.format, binary.data(), (GLsizei)header.length);
+
+	GLint bSuccess = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &bSuccess);
+	if (GL_FALSE == bSuccess)
+	{
+		glDeleteProgram(program);
+		return(0);
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  SaveCachedProgram()
+ *
+ *  This method is used for writing the binary of a linked
+ *  variant into the cache.  A binary that can not be written
+ *  only costs a compile on the next launch.
+ ***********************************************************/
+void ShaderVariants::SaveCachedProgram(unsigned int flags, GLuint program) const
+{
+	if (m_bProgramBinaries == false)
+	{
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+	std::string filename = GetCacheFilename(flags);
+	std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write cached shader program:" << filename << std::endl;
+		return;
+	}
+
+	PROGRAM_CACHE_HEADER header;
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.format = (uint32_t)format;
+	header.length = (uint32_t)length;
+	header.reserved = 0;
+	file.write((const char*)&header, sizeof(header));
+	file.write(binary.data(), length);
+}
+
+/***********************************************************
+ *  CompileProgram()
+ *
+ *  This method is used for compiling and linking a variant
+ *  from the sources with its #define lines inserted.
+ ***********************************************************/
+GLuint ShaderVariants::CompileProgram(unsigned int flags) const
+{
+	std::string defines = GetVariantDefines(flags);
+	GLuint shaders[2] = {
+		ShaderCompiler::CompileShaderStage(GL_VERTEX_SHADER,
+			InsertDefines(m_vertexSource, defines), m_vertexShaderFile.c_str()),
+		ShaderCompiler::CompileShaderStage(GL_FRAGMENT_SHADER,
+			InsertDefines(m_fragmentSource, defines), m_fragmentShaderFile.c_str()) };
+
+	// the binary of the variant is cached once it is linked
+	std::string name = "variant " + std::to_string(flags);
+	return(ShaderCompiler::LinkProgram(shaders, 2, name.c_str(), m_bProgramBinaries));
+}
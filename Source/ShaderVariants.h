@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadervariants.h
+// ============
+// build specialized programs of the scene shaders from #defines, and keep
+// the linked programs in an on-disk binary cache
+//
+//	The scene shaders decide at run time whether a part is lit and textured
+//	and which lights are active.  Every variant is the same source with the
+//	features of one draw bucket defined as constants after the #version
+//	line, so the compiler drops the branches and the code of the features
+//	the bucket does not use.  A linked variant is saved with
+//	glGetProgramBinary under a name hashed from the sources, the defines and
+//	the driver, so the next launch loads it without compiling, and a changed
+//	shader or driver simply misses the cache.  The pass flags build the
+//	G-buffer and deferred lighting programs of the deferred path from the
+//	same sources.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+#include <string>
+
+// identifier at the start of every cached program binary
+#define PROGRAM_CACHE_MAGIC 0x4D475250
+
+/***********************************************************
+ *  ShaderVariants
+ *
+ *  This class contains the code for building the shader
+ *  program of every combination of the variant features,
+ *  loading them from and saving them to the program cache.
+ ***********************************************************/
+class ShaderVariants
+{
+public:
+	// constructor
+	ShaderVariants();
+	// destructor
+	~ShaderVariants();
+
+	// features a variant is specialized for, combined as bits
+	enum VARIANT_FLAGS
+	{
+		VARIANT_LIT = 1,
+		VARIANT_TEXTURED = 2,
+		VARIANT_DIRECTIONAL_LIGHT = 4,
+		VARIANT_POINT_LIGHTS = 8,
+		VARIANT_SPOT_LIGHT = 16,
+		// the opaque parts write their surface into the G-buffer
+		VARIANT_GBUFFER = 32,
+		// the G-buffer is lit over the whole view
+		VARIANT_DEFERRED_LIGHTING = 64,
+		VARIANT_COUNT = 128
+	};
+
+	// read the shader sources the variants are built from, with
+	// the cached binaries kept in the passed in directory
+	bool LoadSources(
+		const char* vertexShaderFile,
+		const char* fragmentShaderFile,
+		const char* cacheDirectory);
+
+	// get an already built variant, 0 when it is not built
+	GLuint FindProgram(unsigned int flags) const;
+	// build a variant from the cache or from the sources - returns
+	// 0 when it can not be built, and right away for a variant
+	// that already failed to build
+	GLuint BuildProgram(unsigned int flags);
+
+	// number of variants loaded from the cache and compiled
+	int GetCachedCount() const { return m_nCached; }
+	int GetCompiledCount() const { return m_nCompiled; }
+
+private:
+	// header of a cached program binary file
+	struct PROGRAM_CACHE_HEADER
+	{
+		uint32_t magic;
+		uint32_t format;
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	// sources the variants are built from
+	std::string m_vertexSource;
+	std::string m_fragmentSource;
+	std::string m_vertexShaderFile;
+	std::string m_fragmentShaderFile;
+	// directory of the cached binaries
+	std::string m_cacheDirectory;
+	// hash of the sources and the driver
+	uint64_t m_sourceHash;
+	// whether the driver can save and load program binaries
+	bool m_bProgramBinaries;
+
+	// built program of every variant, 0 until it is built
+	GLuint m_programs[VARIANT_COUNT];
+	// whether a variant failed to build, so it is not tried again
+	bool m_bFailed[VARIANT_COUNT];
+	int m_nCached;
+	int m_nCompiled;
+
+	// the #define lines of a variant
+	static std::string GetVariantDefines(unsigned int flags);
+	// name of the cached binary of a variant
+	std::string GetCacheFilename(unsigned int flags) const;
+	// load a variant from its cached binary
+	GLuint LoadCachedProgram(unsigned int flags) const;
+	// save the binary of a linked variant
+	void SaveCachedProgram(unsigned int flags, GLuint program) const;
+	// compile and link a variant from the sources
+	GLuint CompileProgram(unsigned int flags) const;
+};
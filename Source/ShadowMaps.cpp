@@ -0,0 +1,566 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.cpp
+// ============
+// render and cache the shadow maps of the moonlight and the candle flame
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShadowMaps.h"
+#include "FrameProfiler.h"
+#include "ShaderCompiler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// size in texels of every cascade and of every cube face
+	const int g_CascadeMapSize = 2048;
+	const int g_PointMapSize = 1024;
+
+	// view depth covered by the cascades - the scene is small,
+	// so the far plane of the camera is not needed
+	const float g_ShadowDistance = 40.0f;
+	// blend between logarithmic and even cascade splits
+	const float g_SplitBlend = 0.75f;
+	// part of a cascade the camera can move before the cascade
+	// is moved and drawn again
+	const float g_CascadeSnap = 0.25f;
+	// extra light view depth around the shadow casters
+	const float g_CasterMargin = 1.0f;
+	// near plane of the cube faces of the point light
+	const float g_PointNearPlane = 0.05f;
+
+	// slope scaled depth bias of the shadow casters
+	const float g_PolygonOffsetFactor = 2.0f;
+	const float g_PolygonOffsetUnits = 4.0f;
+
+	const char* g_ShadowMatrixName = "shadowMatrix";
+	const char* g_ShadowLightName = "shadowLight";
+
+	// direction and up vector of every cube face, in the order
+	// of the cube map face targets
+	const glm::vec3 g_CubeFaceDirections[6] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+	const glm::vec3 g_CubeFaceUps[6] = {
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+
+	/***********************************************************
+	 *  SetDepthCompare()
+	 *
+	 *  This function is used for setting up the bound depth
+	 *  texture for hardware filtered depth comparisons.
+	 ***********************************************************/
+	void SetDepthCompare(GLenum target)
+	{
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	}
+}
+
+/***********************************************************
+ *  ShadowMaps()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShadowMaps::ShadowMaps(UniformBuffers* pUniformBuffers)
+{
+	m_pUniformBuffers = pUniformBuffers;
+	m_cascadeTexture = 0;
+	m_pointTexture = 0;
+	m_framebuffer = 0;
+	m_program = 0;
+
+	m_lightDirection = glm::vec3(0.0f);
+	m_lightView = glm::mat4(1.0f);
+	// no shadow casters until the draw list is built
+	m_casterMin = glm::vec3(0.0f);
+	m_casterMax = glm::vec3(0.0f);
+	m_casterNear = 0.0f;
+	m_casterFar = 1.0f;
+
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		m_cascadeCenters[i] = glm::vec2(0.0f);
+		m_cascadeSizes[i] = 0.0f;
+		m_cascadeMatrices[i] = glm::mat4(1.0f);
+		m_bCascadeDirty[i] = true;
+	}
+	m_cascadeSplits = glm::vec4(0.0f);
+
+	m_pointLightIndex = -1;
+	m_pointPosition = glm::vec3(0.0f);
+	m_pointRange = 0.0f;
+	m_bPointDirty = true;
+}
+
+/***********************************************************
+ *  ~ShadowMaps()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShadowMaps::~ShadowMaps()
+{
+	if (0 != m_cascadeTexture)
+	{
+		glDeleteTextures(1, &m_cascadeTexture);
+		m_cascadeTexture = 0;
+	}
+	if (0 != m_pointTexture)
+	{
+		glDeleteTextures(1, &m_pointTexture);
+		m_pointTexture = 0;
+	}
+	if (0 != m_framebuffer)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (0 != m_program)
+	{
+		glDeleteProgram(m_program);
+		m_program = 0;
+	}
+}
+
+/***********************************************************
+ *  CreateResources()
+ *
+ *  This method is used for creating the depth textures of
+ *  the cascades and the point light, the framebuffer they
+ *  are drawn through, and the depth program.
+ ***********************************************************/
+bool ShadowMaps::CreateResources(const char* vertexShaderFile, const char* fragmentShaderFile)
+{
+	if (CreateProgram(vertexShaderFile, fragmentShaderFile) == false)
+	{
+		std::cout << "The scene is drawn without shadows" << std::endl;
+		return(false);
+	}
+
+	// the textures are created on their own units, so the
+	// texture arrays on the first units stay bound
+	glActiveTexture(GL_TEXTURE0 + UNIT_CASCADE_SHADOWS);
+	glGenTextures(1, &m_cascadeTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_cascadeTexture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24,
+		g_CascadeMapSize, g_CascadeMapSize, SHADOW_CASCADES, 0,
+		GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	SetDepthCompare(GL_TEXTURE_2D_ARRAY);
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_POINT_SHADOW);
+	glGenTextures(1, &m_pointTexture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_pointTexture);
+	for (int face = 0; face < 6; face++)
+	{
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24,
+			g_PointMapSize, g_PointMapSize, 0,
+			GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	}
+	SetDepthCompare(GL_TEXTURE_CUBE_MAP);
+	glActiveTexture(GL_TEXTURE0);
+
+	// the maps only hold depth, so nothing is drawn into color
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cascadeTexture, 0, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+	if (GL_FRAMEBUFFER_COMPLETE != status)
+	{
+		std::cout << "Could not create the shadow framebuffer" << std::endl;
+		glDeleteProgram(m_program);
+		m_program = 0;
+		return(false);
+	}
+
+	WriteShadowData();
+	return(true);
+}
+
+/***********************************************************
+ *  CreateProgram()
+ *
+ *  This method is used for compiling and linking the program
+ *  that draws the depth of the shadow casters.
+ ***********************************************************/
+bool ShadowMaps::CreateProgram(const char* vertexShaderFile, const char* fragmentShaderFile)
+{
+	GLuint program = ShaderCompiler::CreateProgram(vertexShaderFile, fragmentShaderFile);
+	if (0 == program)
+	{
+		return(false);
+	}
+
+	m_program = program;
+	m_uniforms.ResolveUniforms(program);
+	m_shadowMatrixUniform = m_uniforms.GetUniform<glm::mat4>(g_ShadowMatrixName);
+	m_shadowLightUniform = m_uniforms.GetUniform<glm::vec4>(g_ShadowLightName);
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetDirectionalLight()
+ *
+ *  This method is used for setting the direction of the
+ *  light casting the cascades.  The cascades are only drawn
+ *  again when the direction changes.
+ ***********************************************************/
+void ShadowMaps::SetDirectionalLight(const glm::vec3& direction)
+{
+	if ((direction == m_lightDirection) || (glm::length(direction) <= 0.0f))
+	{
+		return;
+	}
+	m_lightDirection = direction;
+
+	// the light view keeps a fixed origin, so the cascades only
+	// move in it when the camera does
+	glm::vec3 lightDirection = glm::normalize(direction);
+	glm::vec3 up = (std::abs(lightDirection.y) > 0.99f) ?
+		glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	m_lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+	UpdateCasterDepths();
+	InvalidateCascades();
+}
+
+/***********************************************************
+ *  SetPointLight()
+ *
+ *  This method is used for setting the point light casting
+ *  the cube shadow.  Only the cube is drawn again when the
+ *  light moves or its range changes.
+ ***********************************************************/
+void ShadowMaps::SetPointLight(int lightIndex, const glm::vec3& position, float range)
+{
+	if ((lightIndex == m_pointLightIndex) &&
+		(position == m_pointPosition) &&
+		(range == m_pointRange))
+	{
+		return;
+	}
+
+	m_pointLightIndex = lightIndex;
+	m_pointPosition = position;
+	m_pointRange = range;
+	m_bPointDirty = true;
+	WriteShadowData();
+}
+
+/***********************************************************
+ *  SetCasterBounds()
+ *
+ *  This method is used for setting the bounds of all the
+ *  shadow casters, which marks every shadow map to be drawn
+ *  again.
+ ***********************************************************/
+void ShadowMaps::SetCasterBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	m_casterMin = boundsMin;
+	m_casterMax = boundsMax;
+
+	UpdateCasterDepths();
+	InvalidateCascades();
+	m_bPointDirty = true;
+}
+
+/***********************************************************
+ *  UpdateCasterDepths()
+ *
+ *  This method is used for finding the depth range of the
+ *  shadow casters in the light view, which every cascade
+ *  covers so casters outside the view still cast shadows
+ *  into it.
+ ***********************************************************/
+void ShadowMaps::UpdateCasterDepths()
+{
+	float nearDepth = FLT_MAX;
+	float farDepth = -FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner(
+			(i & 1) ? m_casterMax.x : m_casterMin.x,
+			(i & 2) ? m_casterMax.y : m_casterMin.y,
+			(i & 4) ? m_casterMax.z : m_casterMin.z);
+		float depth = -(m_lightView * glm::vec4(corner, 1.0f)).z;
+		nearDepth = std::min(nearDepth, depth);
+		farDepth = std::max(farDepth, depth);
+	}
+
+	m_casterNear = nearDepth - g_CasterMargin;
+	m_casterFar = farDepth + g_CasterMargin;
+}
+
+/***********************************************************
+ *  InvalidateCascades()
+ *
+ *  This method is used for marking every cascade to be
+ *  fitted around the camera and drawn again.
+ ***********************************************************/
+void ShadowMaps::InvalidateCascades()
+{
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		m_cascadeSizes[i] = 0.0f;
+		m_bCascadeDirty[i] = true;
+	}
+}
+
+/***********************************************************
+ *  UpdateCascades()
+ *
+ *  This method is used for fitting every cascade around its
+ *  slice of the view.  A cascade covers the bounding sphere
+ *  of the slice, which keeps its size as the camera turns,
+ *  and its center snaps to steps of whole texels, so it is
+ *  only moved and drawn again after the camera has moved
+ *  far enough.
+ ***********************************************************/
+void ShadowMaps::UpdateCascades(const UniformBuffers::FRAME_DATA& frameData)
+{
+	const float nearPlane = frameData.viewport.z;
+	const float farPlane = frameData.viewport.w;
+	const float shadowFar = std::min(farPlane, g_ShadowDistance);
+	if ((0 == m_program) || (shadowFar <= nearPlane))
+	{
+		return;
+	}
+
+	// corners of the view at the near and far planes
+	glm::mat4 inverseViewProjection = glm::inverse(frameData.projection * frameData.view);
+	glm::vec3 nearCorners[4];
+	glm::vec3 farCorners[4];
+	for (int i = 0; i < 4; i++)
+	{
+		glm::vec4 nearCorner = inverseViewProjection * glm::vec4(
+			(i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, -1.0f, 1.0f);
+		glm::vec4 farCorner = inverseViewProjection * glm::vec4(
+			(i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, 1.0f, 1.0f);
+		nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+		farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+	}
+
+	bool bChanged = false;
+	float splitNear = nearPlane;
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		float fraction = (float)(i + 1) / SHADOW_CASCADES;
+		float logSplit = nearPlane * std::pow(shadowFar / nearPlane, fraction);
+		float evenSplit = nearPlane + (shadowFar - nearPlane) * fraction;
+		float splitFar = g_SplitBlend * logSplit + (1.0f - g_SplitBlend) * evenSplit;
+
+		// corners of the slice along the edges of the view
+		float nearBlend = (splitNear - nearPlane) / (farPlane - nearPlane);
+		float farBlend = (splitFar - nearPlane) / (farPlane - nearPlane);
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int j = 0; j < 4; j++)
+		{
+			corners[j] = glm::mix(nearCorners[j], farCorners[j], nearBlend);
+			corners[j + 4] = glm::mix(nearCorners[j], farCorners[j], farBlend);
+			center += corners[j] + corners[j + 4];
+		}
+		center /= 8.0f;
+
+		float radius = 0.0f;
+		for (int j = 0; j < 8; j++)
+		{
+			radius = std::max(radius, glm::length(corners[j] - center));
+		}
+		// round the radius up so rounding errors do not resize
+		// the cascade while the camera turns
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// the cascade is larger than the sphere by at least one
+		// snap step of whole texels, so the sphere stays inside
+		// it between steps
+		float halfSize = radius * (1.0f + g_CascadeSnap);
+		float texelSize = 2.0f * halfSize / g_CascadeMapSize;
+		float step = std::max(1.0f, std::floor(radius * g_CascadeSnap / texelSize)) * texelSize;
+		glm::vec3 lightCenter = glm::vec3(m_lightView * glm::vec4(center, 1.0f));
+		glm::vec2 snappedCenter(
+			std::floor(lightCenter.x / step + 0.5f) * step,
+			std::floor(lightCenter.y / step + 0.5f) * step);
+
+		if ((snappedCenter != m_cascadeCenters[i]) || (halfSize != m_cascadeSizes[i]))
+		{
+			m_cascadeCenters[i] = snappedCenter;
+			m_cascadeSizes[i] = halfSize;
+			m_cascadeMatrices[i] = glm::ortho(
+				snappedCenter.x - halfSize, snappedCenter.x + halfSize,
+				snappedCenter.y - halfSize, snappedCenter.y + halfSize,
+				m_casterNear, m_casterFar) * m_lightView;
+			m_bCascadeDirty[i] = true;
+			bChanged = true;
+		}
+		if (m_cascadeSplits[i] != splitFar)
+		{
+			m_cascadeSplits[i] = splitFar;
+			bChanged = true;
+		}
+
+		splitNear = splitFar;
+	}
+
+	if (bChanged)
+	{
+		WriteShadowData();
+	}
+}
+
+/***********************************************************
+ *  WriteShadowData()
+ *
+ *  This method is used for writing the cascade matrices and
+ *  splits and the point light of the cube shadow into the
+ *  shadow block.  The matrices also move the positions from
+ *  clip space into texture coordinates.
+ ***********************************************************/
+void ShadowMaps::WriteShadowData()
+{
+	glm::mat4 textureBias(0.5f);
+	textureBias[3] = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+
+	UniformBuffers::SHADOW_DATA& shadows = m_pUniformBuffers->GetShadowData();
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		shadows.cascadeMatrices[i] = textureBias * m_cascadeMatrices[i];
+	}
+	shadows.cascadeSplits = m_cascadeSplits;
+	shadows.cascadeCount = ((0 != m_program) && (m_cascadeSizes[0] > 0.0f)) ? SHADOW_CASCADES : 0;
+	shadows.pointShadowLight = glm::vec4(m_pointPosition, m_pointRange);
+	shadows.pointShadowIndex = ((0 != m_program) && (m_pointRange > 0.0f)) ? m_pointLightIndex : -1;
+}
+
+/***********************************************************
+ *  IsDirty()
+ *
+ *  This method is used for checking whether any shadow map
+ *  is out of date and the shadow casters need to be drawn.
+ ***********************************************************/
+bool ShadowMaps::IsDirty() const
+{
+	if (0 == m_program)
+	{
+		return(false);
+	}
+
+	bool bDirty = m_bPointDirty && (m_pointLightIndex >= 0);
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		bDirty = bDirty || (m_bCascadeDirty[i] && (m_cascadeSizes[i] > 0.0f));
+	}
+	return(bDirty);
+}
+
+/***********************************************************
+ *  RenderShadows()
+ *
+ *  This method is used for drawing the depth of the shadow
+ *  casters into every shadow map that is out of date.  The
+ *  framebuffer and viewport of the frame are put back once
+ *  the maps are drawn.
+ ***********************************************************/
+void ShadowMaps::RenderShadows(MeshLibrary* pMeshes, int firstCommand, int nCommands)
+{
+	if (IsDirty() == false)
+	{
+		return;
+	}
+
+	GLint viewport[4];
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	glUseProgram(m_program);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(g_PolygonOffsetFactor, g_PolygonOffsetUnits);
+	FrameProfiler::CountStateChange();
+	FrameProfiler::CountStateChange();
+
+	// the cascades store the depth of the orthographic view
+	glViewport(0, 0, g_CascadeMapSize, g_CascadeMapSize);
+	m_uniforms.SetValue(m_shadowLightUniform, glm::vec4(0.0f));
+	for (int i = 0; i < SHADOW_CASCADES; i++)
+	{
+		if ((m_bCascadeDirty[i] == false) || (m_cascadeSizes[i] <= 0.0f))
+		{
+			continue;
+		}
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cascadeTexture, 0, i);
+		FrameProfiler::CountStateChange();
+		glClear(GL_DEPTH_BUFFER_BIT);
+		m_uniforms.SetValue(m_shadowMatrixUniform, m_cascadeMatrices[i]);
+		pMeshes->DrawCommands(firstCommand, nCommands);
+		m_bCascadeDirty[i] = false;
+	}
+
+	// the cube stores the distance to the light over its range
+	if (m_bPointDirty && (m_pointLightIndex >= 0))
+	{
+		glViewport(0, 0, g_PointMapSize, g_PointMapSize);
+		m_uniforms.SetValue(m_shadowLightUniform, glm::vec4(m_pointPosition, m_pointRange));
+		glm::mat4 faceProjection = glm::perspective(
+			glm::radians(90.0f), 1.0f, g_PointNearPlane, std::max(m_pointRange, g_PointNearPlane * 2.0f));
+		for (int face = 0; face < 6; face++)
+		{
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+				GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_pointTexture, 0);
+			FrameProfiler::CountStateChange();
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glm::mat4 faceView = glm::lookAt(
+				m_pointPosition, m_pointPosition + g_CubeFaceDirections[face], g_CubeFaceUps[face]);
+			m_uniforms.SetValue(m_shadowMatrixUniform, faceProjection * faceView);
+			pMeshes->DrawCommands(firstCommand, nCommands);
+		}
+		m_bPointDirty = false;
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+/***********************************************************
+ *  BindTextures()
+ *
+ *  This method is used for binding the shadow maps to the
+ *  texture units read by the lit shaders.
+ ***********************************************************/
+void ShadowMaps::BindTextures() const
+{
+	if (0 == m_program)
+	{
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + UNIT_CASCADE_SHADOWS);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_cascadeTexture);
+	glActiveTexture(GL_TEXTURE0 + UNIT_POINT_SHADOW);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, m_pointTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.h
+// ============
+// render and cache the shadow maps of the moonlight and the candle flame
+//
+//	The directional light casts cascaded shadows - the view is split into
+//	SHADOW_CASCADES depth ranges, each with its own layer of a depth array.
+//	The flame light casts its shadow into a depth cube map holding the
+//	distance to the light.  The shadow casters do not move, so a map is
+//	only drawn again when its light, the shadow casters, or for cascades
+//	the snapped area around the camera changes.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MeshLibrary.h"
+#include "ShaderUniforms.h"
+#include "UniformBuffers.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  ShadowMaps
+ *
+ *  This class contains the code for owning the shadow map
+ *  textures, fitting the cascades to the camera, and drawing
+ *  the maps that are out of date.
+ ***********************************************************/
+class ShadowMaps
+{
+public:
+	// constructor
+	ShadowMaps(UniformBuffers* pUniformBuffers);
+	// destructor
+	~ShadowMaps();
+
+	// texture units of the shadow maps, above the units of the
+	// light cluster buffers
+	enum SHADOW_UNIT
+	{
+		UNIT_CASCADE_SHADOWS = 10,
+		UNIT_POINT_SHADOW = 11
+	};
+
+	// create the shadow textures, the framebuffer and the
+	// depth program - returns false when shadows are not drawn
+	bool CreateResources(const char* vertexShaderFile, const char* fragmentShaderFile);
+
+	// set the direction of the light casting the cascades
+	void SetDirectionalLight(const glm::vec3& direction);
+	// set the point light casting the cube shadow, by its index
+	// in the point light buffer
+	void SetPointLight(int lightIndex, const glm::vec3& position, float range);
+	// set the bounds of all the shadow casters, after the draw
+	// list is built
+	void SetCasterBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// fit the cascades around the camera of the passed in frame
+	// values, marking the cascades that moved
+	void UpdateCascades(const UniformBuffers::FRAME_DATA& frameData);
+
+	// whether any shadow map needs to be drawn again
+	bool IsDirty() const;
+	// draw the shadow maps that are out of date with a range of
+	// draw commands holding the shadow casters
+	void RenderShadows(MeshLibrary* pMeshes, int firstCommand, int nCommands);
+	// bind the shadow maps to their texture units
+	void BindTextures() const;
+
+private:
+	// pointer to the uniform buffers holding the shadow block
+	UniformBuffers* m_pUniformBuffers;
+
+	// depth array of the cascades and depth cube of the point
+	// light, drawn through one framebuffer
+	GLuint m_cascadeTexture;
+	GLuint m_pointTexture;
+	GLuint m_framebuffer;
+
+	// program drawing the depth of the shadow casters
+	GLuint m_program;
+	ShaderUniforms m_uniforms;
+	ShaderUniforms::UNIFORM<glm::mat4> m_shadowMatrixUniform;
+	ShaderUniforms::UNIFORM<glm::vec4> m_shadowLightUniform;
+
+	// directional light and the light view looking along it
+	glm::vec3 m_lightDirection;
+	glm::mat4 m_lightView;
+	// light view depth range of the shadow casters
+	glm::vec3 m_casterMin;
+	glm::vec3 m_casterMax;
+	float m_casterNear;
+	float m_casterFar;
+
+	// snapped center and half size of every cascade in the
+	// light view, and the matrix it was drawn with
+	glm::vec2 m_cascadeCenters[SHADOW_CASCADES];
+	float m_cascadeSizes[SHADOW_CASCADES];
+	glm::mat4 m_cascadeMatrices[SHADOW_CASCADES];
+	bool m_bCascadeDirty[SHADOW_CASCADES];
+	// far view depth of every cascade
+	glm::vec4 m_cascadeSplits;
+
+	// point light of the cube shadow
+	int m_pointLightIndex;
+	glm::vec3 m_pointPosition;
+	float m_pointRange;
+	bool m_bPointDirty;
+
+	// compile and link the depth program
+	bool CreateProgram(const char* vertexShaderFile, const char* fragmentShaderFile);
+	// find the light view depth range of the shadow casters
+	void UpdateCasterDepths();
+	// mark every cascade to be fitted and drawn again
+	void InvalidateCascades();
+	// write the shadow values read by the lit shaders
+	void WriteShadowData();
+};
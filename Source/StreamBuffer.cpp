@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.cpp
+// ============
+// stream the values that change every frame to the GPU through one buffer
+// that stays mapped, handing out ranges of it to the renderer
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StreamBuffer.h"
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// bytes of every region before any frame asked for more
+	const GLsizeiptr g_InitialRegionSize = 4 * 1024 * 1024;
+	// room left when the regions grow, so a scene that keeps
+	// growing slowly does not recreate the buffer every frame
+	const float g_GrowthFactor = 1.5f;
+	// smallest alignment of a range, enough for the vectors of
+	// the instance data
+	const GLint g_MinimumAlignment = 16;
+	// nanoseconds of every wait for a fence, waited again until
+	// the fence is signaled
+	const GLuint64 g_FenceWaitTimeout = 1000000;
+}
+
+/***********************************************************
+ *  StreamBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StreamBuffer::StreamBuffer()
+{
+	m_buffer = 0;
+	m_pMapped = NULL;
+	m_regionSize = g_InitialRegionSize;
+	m_alignment = g_MinimumAlignment;
+	for (int i = 0; i < STREAM_FRAME_REGIONS; i++)
+	{
+		m_fences[i] = 0;
+	}
+	m_region = 0;
+	m_used = 0;
+	m_frameDemand = 0;
+	m_largestDemand = 0;
+}
+
+/***********************************************************
+ *  ~StreamBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+StreamBuffer::~StreamBuffer()
+{
+	DestroyBuffer();
+}
+
+/***********************************************************
+ *  CreateBuffer()
+ *
+ *  This method is used for creating the buffer with room for
+ *  all the regions and mapping it for the whole run.  The
+ *  ranges are aligned for any of the uniform, storage and
+ *  texture buffer bindings they are used with.
+ ***********************************************************/
+bool StreamBuffer::CreateBuffer()
+{
+	if ((GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) == false)
+	{
+		return(false);
+	}
+
+	GLint alignment = g_MinimumAlignment;
+	GLint bindingAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &bindingAlignment);
+	alignment = std::max(alignment, bindingAlignment);
+	if (GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object)
+	{
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &bindingAlignment);
+		alignment = std::max(alignment, bindingAlignment);
+	}
+	if (GLEW_VERSION_4_3 || GLEW_ARB_texture_buffer_range)
+	{
+		glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &bindingAlignment);
+		alignment = std::max(alignment, bindingAlignment);
+	}
+	m_alignment = alignment;
+	m_regionSize = (m_regionSize + m_alignment - 1) / m_alignment * m_alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = m_regionSize * STREAM_FRAME_REGIONS;
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+	m_pMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (NULL == m_pMapped)
+	{
+		std::cout << "Could not map the stream buffer of " << size << " bytes" << std::endl;
+		DestroyBuffer();
+		return(false);
+	}
+
+	m_region = 0;
+	m_used = 0;
+	return(true);
+}
+
+/***********************************************************
+ *  DestroyBuffer()
+ *
+ *  This method is used for unmapping and freeing the buffer,
+ *  along with the fences of its regions.
+ ***********************************************************/
+void StreamBuffer::DestroyBuffer()
+{
+	for (int i = 0; i < STREAM_FRAME_REGIONS; i++)
+	{
+		if (m_fences[i])
+		{
+			glDeleteSync(m_fences[i]);
+			m_fences[i] = 0;
+		}
+	}
+
+	if (0 != m_buffer)
+	{
+		if (NULL != m_pMapped)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			m_pMapped = NULL;
+		}
+		glDeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting the region of the next
+ *  frame.  A frame that asked for more than a region holds
+ *  makes all the regions grow first, once the GPU is done
+ *  with every one of them.
+ ***********************************************************/
+void StreamBuffer::BeginFrame()
+{
+	if (IsAvailable() == false)
+	{
+		return;
+	}
+
+	if (m_largestDemand > m_regionSize)
+	{
+		for (int i = 0; i < STREAM_FRAME_REGIONS; i++)
+		{
+			WaitForRegion(i);
+		}
+		DestroyBuffer();
+		m_regionSize = (GLsizeiptr)(m_largestDemand * g_GrowthFactor);
+		if (CreateBuffer() == false)
+		{
+			return;
+		}
+	}
+	else
+	{
+		m_region = (m_region + 1) % STREAM_FRAME_REGIONS;
+		WaitForRegion(m_region);
+	}
+
+	m_used = 0;
+	m_frameDemand = 0;
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for fencing the region of the frame
+ *  after its draws, so it is not written again before the
+ *  GPU has read it.
+ ***********************************************************/
+void StreamBuffer::EndFrame()
+{
+	if ((IsAvailable() == false) || (0 == m_used))
+	{
+		return;
+	}
+
+	m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This method is used for handing out the next aligned
+ *  range of the region of the frame.  A range that does not
+ *  fit is still counted, so the regions grow to hold the
+ *  whole frame from the next one on.
+ ***********************************************************/
+bool StreamBuffer::Allocate(GLsizeiptr size, STREAM_RANGE& range)
+{
+	if ((IsAvailable() == false) || (size <= 0))
+	{
+		return(false);
+	}
+
+	GLsizeiptr first = (m_used + m_alignment - 1) / m_alignment * m_alignment;
+	m_frameDemand += size + m_alignment;
+	m_largestDemand = std::max(m_largestDemand, m_frameDemand);
+	if (first + size > m_regionSize)
+	{
+		return(false);
+	}
+
+	range.offset = m_region * m_regionSize + first;
+	range.pData = m_pMapped + range.offset;
+	range.size = size;
+	m_used = first + size;
+	FrameProfiler::CountStreamUpload(size);
+
+	return(true);
+}
+
+/***********************************************************
+ *  WaitForRegion()
+ *
+ *  This method is used for waiting until the GPU has read
+ *  the last frame that used a region.  A fence that is not
+ *  signaled yet means the CPU ran ahead of the GPU by all
+ *  the regions, which the profiler counts.  The fence is
+ *  waited for in short timeouts, and a wait that fails is
+ *  given up on.
+ ***********************************************************/
+void StreamBuffer::WaitForRegion(int region)
+{
+	if (!m_fences[region])
+	{
+		return;
+	}
+
+	GLenum result = glClientWaitSync(m_fences[region], 0, 0);
+	if (GL_TIMEOUT_EXPIRED == result)
+	{
+		FrameProfiler::CountStreamStall();
+		// the first wait flushes the commands, so the fence is
+		// sure to be signaled at some point
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (GL_TIMEOUT_EXPIRED == result)
+		{
+			result = glClientWaitSync(m_fences[region], flags, g_FenceWaitTimeout);
+			flags = 0;
+		}
+	}
+	if (GL_WAIT_FAILED == result)
+	{
+		std::cout << "Could not wait for the fence of stream buffer region " << region << std::endl;
+	}
+	glDeleteSync(m_fences[region]);
+	m_fences[region] = 0;
+}
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.h
+// ============
+// stream the values that change every frame to the GPU through one buffer
+// that stays mapped, handing out ranges of it to the renderer
+//
+//	The buffer is created with buffer storage and mapped once for writing,
+//	persistent and coherent, so the CPU writes straight into memory the GPU
+//	reads and no driver copy or implicit wait is involved.  It is split
+//	into STREAM_FRAME_REGIONS regions, one for each frame in flight.  Every
+//	frame bumps through the next region, whose fence from its last use is
+//	waited on first, and sets a fence of its own once its draws are
+//	submitted.  A frame that needs more than a region holds is handed out
+//	nothing past the end, so its owners write their own buffers instead,
+//	and the regions grow before the next frame.  Without buffer storage no
+//	buffer is created and nothing is handed out.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// number of frames whose values can be in flight at once
+#define STREAM_FRAME_REGIONS 3
+
+/***********************************************************
+ *  StreamBuffer
+ *
+ *  This class contains the code for the mapped buffer, the
+ *  fences of its regions and handing out ranges of the
+ *  region of the current frame.
+ ***********************************************************/
+class StreamBuffer
+{
+public:
+	// constructor
+	StreamBuffer();
+	// destructor
+	~StreamBuffer();
+
+	// range of the buffer handed out for the current frame
+	struct STREAM_RANGE
+	{
+		// where the values are written
+		void* pData;
+		// where the GPU reads them, from the start of the buffer
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	// create and map the buffer, once a context is current -
+	// returns false when buffer storage is missing
+	bool CreateBuffer();
+	// unmap and free the buffer
+	void DestroyBuffer();
+	// whether ranges can be handed out
+	bool IsAvailable() const { return(NULL != m_pMapped); }
+	// buffer the handed out ranges are in
+	GLuint GetBuffer() const { return(m_buffer); }
+
+	// move on to the region of the next frame, waiting for the
+	// GPU to finish reading it
+	void BeginFrame();
+	// set the fence of the region once the frame is submitted
+	void EndFrame();
+	// hand out the passed in number of bytes of the current
+	// region - returns false when they do not fit
+	bool Allocate(GLsizeiptr size, STREAM_RANGE& range);
+
+private:
+	GLuint m_buffer;
+	unsigned char* m_pMapped;
+	// bytes of every region, a multiple of the alignment
+	GLsizeiptr m_regionSize;
+	// alignment of every range, the largest one the buffer
+	// binding points ask for
+	GLsizeiptr m_alignment;
+	// fence of the last frame that used every region
+	GLsync m_fences[STREAM_FRAME_REGIONS];
+	// region of the current frame and the bytes handed out of it
+	int m_region;
+	GLsizeiptr m_used;
+	// bytes the current frame asked for, and the most any frame
+	// asked for, which the regions grow to
+	GLsizeiptr m_frameDemand;
+	GLsizeiptr m_largestDemand;
+
+	// wait for the fence of a region and free it
+	void WaitForRegion(int region);
+};
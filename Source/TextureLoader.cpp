@@ -0,0 +1,534 @@
+///////////////////////////////////////////////////////////////////////////////
+// textureloader.cpp
+// ============
+// decode texture images on worker threads and upload them to OpenGL a few
+// at a time, so the scene can be drawn before all the images are loaded
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureLoader.h"
+#include "KtxFile.h"
+
+#include "stb_image.h"
+
+#include <GLFW/glfw3.h>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// texture unit used while uploading, so the textures bound
+	// to the scene texture slots are not disturbed
+	const GLenum g_UploadTextureUnit = GL_TEXTURE31;
+
+	// color shown until the image of a texture is uploaded
+	const unsigned char g_PlaceholderColor[4] = { 128, 128, 128, 255 };
+}
+
+/***********************************************************
+ *  TextureLoader()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureLoader::TextureLoader()
+{
+	m_pendingTextures = 0;
+	m_bShutdown = false;
+	m_nextStagingBuffer = 0;
+	m_bPersistentMapping = false;
+	m_bStagingCreated = false;
+	// the cooker writes BC1 and BC3 blocks, which are the S3TC formats
+	m_bCompressedTextures = (GLEW_EXT_texture_compression_s3tc == true);
+
+	for (int i = 0; i < 2; i++)
+	{
+		m_stagingBuffers[i].buffer = 0;
+		m_stagingBuffers[i].size = 0;
+		m_stagingBuffers[i].pMapped = NULL;
+		m_stagingBuffers[i].fence = 0;
+	}
+
+	// indicate to always flip images vertically when loaded - this
+	// is set once here, before any worker reads it
+	stbi_set_flip_vertically_on_load(true);
+
+	// leave a core for the rendering thread
+	unsigned int nWorkers = std::thread::hardware_concurrency();
+	nWorkers = (nWorkers > 2) ? (nWorkers - 1) : 1;
+	for (unsigned int i = 0; i < nWorkers; i++)
+	{
+		m_workers.push_back(std::thread(&TextureLoader::WorkerLoop, this));
+	}
+}
+
+/***********************************************************
+ *  ~TextureLoader()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bShutdown = true;
+	}
+	m_decodeReady.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+
+	// free the images that were decoded but never uploaded
+	for (size_t i = 0; i < m_uploadQueue.size(); i++)
+	{
+		stbi_image_free(m_uploadQueue[i].pImage);
+		delete m_uploadQueue[i].pCookedFile;
+	}
+
+	DestroyStagingBuffer(m_stagingBuffers[0]);
+	DestroyStagingBuffer(m_stagingBuffers[1]);
+}
+
+/***********************************************************
+ *  RequestTexture()
+ *
+ *  This method is used for creating a texture object with
+ *  the placeholder image and queueing the passed in image
+ *  file to be decoded by a worker thread.
+ ***********************************************************/
+GLuint TextureLoader::RequestTexture(const char* filename)
+{
+	GLuint textureID = 0;
+	GLint activeUnit = 0;
+
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+	glActiveTexture(g_UploadTextureUnit);
+
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, g_PlaceholderColor);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(activeUnit);
+
+	TEXTURE_JOB job;
+	job.filename = filename;
+	job.textureID = textureID;
+	job.pImage = NULL;
+	job.width = 0;
+	job.height = 0;
+	job.colorChannels = 0;
+	job.pCookedFile = NULL;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_decodeQueue.push_back(job);
+		m_pendingTextures++;
+	}
+	m_decodeReady.notify_one();
+
+	return(textureID);
+}
+
+/***********************************************************
+ *  IsIdle()
+ *
+ *  This method is used for checking whether every requested
+ *  texture has been uploaded.
+ ***********************************************************/
+bool TextureLoader::IsIdle()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return(0 == m_pendingTextures);
+}
+
+/***********************************************************
+ *  TakeUploadedTextures()
+ *
+ *  This method is used for handing the textures finished on
+ *  the OpenGL thread to the caller, so they can be made
+ *  resident for the shaders.
+ ***********************************************************/
+void TextureLoader::TakeUploadedTextures(std::vector<GLuint>& textureIDs)
+{
+	textureIDs.insert(textureIDs.end(), m_uploadedTextures.begin(), m_uploadedTextures.end());
+	m_uploadedTextures.clear();
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method is run by every worker thread, decoding the
+ *  queued image files until the loader shuts down.  No
+ *  OpenGL calls are made here.
+ ***********************************************************/
+void TextureLoader::WorkerLoop()
+{
+	while (true)
+	{
+		TEXTURE_JOB job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while ((m_bShutdown == false) && m_decodeQueue.empty())
+			{
+				m_decodeReady.wait(lock);
+			}
+			if (m_bShutdown)
+			{
+				return;
+			}
+
+			job = m_decodeQueue.front();
+			m_decodeQueue.pop_front();
+		}
+
+		// the cooked file is used as is, otherwise try to parse the
+		// image data from the specified image file
+		if (OpenCookedFile(job) == false)
+		{
+			job.pImage = stbi_load(
+				job.filename.c_str(),
+				&job.width,
+				&job.height,
+				&job.colorChannels,
+				0);
+		}
+
+		// failed images are also queued, so they are reported on
+		// the rendering thread
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_uploadQueue.push_back(job);
+	}
+}
+
+/***********************************************************
+ *  ProcessUploads()
+ *
+ *  This method is used for uploading the decoded images on
+ *  the OpenGL thread until the passed in time budget is
+ *  spent.  It is called once every frame.
+ ***********************************************************/
+void TextureLoader::ProcessUploads(double budgetSeconds)
+{
+	double startTime = glfwGetTime();
+	bool bFirst = true;
+
+	while (bFirst || (glfwGetTime() - startTime < budgetSeconds))
+	{
+		TEXTURE_JOB job;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_uploadQueue.empty())
+			{
+				return;
+			}
+			job = m_uploadQueue.front();
+			m_uploadQueue.pop_front();
+		}
+
+		if (job.pCookedFile)
+		{
+			UploadCookedTexture(job);
+			delete job.pCookedFile;
+		}
+		else if (job.pImage)
+		{
+			UploadTexture(job);
+			stbi_image_free(job.pImage);
+		}
+		else
+		{
+			std::cout << "Could not load image:" << job.filename << std::endl;
+		}
+
+		m_uploadedTextures.push_back(job.textureID);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pendingTextures--;
+		}
+		bFirst = false;
+	}
+}
+
+/***********************************************************
+ *  UploadTexture()
+ *
+ *  This method is used for copying a decoded image into a
+ *  pixel buffer and replacing the placeholder image of its
+ *  texture with it, generating the mipmaps.
+ ***********************************************************/
+void TextureLoader::UploadTexture(const TEXTURE_JOB& job)
+{
+	GLenum internalFormat = GL_RGBA8;
+	GLenum format = GL_RGBA;
+
+	// if the loaded image is in RGB format
+	if (job.colorChannels == 3)
+	{
+		internalFormat = GL_RGB8;
+		format = GL_RGB;
+	}
+	// if the loaded image is in RGBA format - it supports transparency
+	else if (job.colorChannels != 4)
+	{
+		std::cout << "Not implemented to handle image with " << job.colorChannels << " channels" << std::endl;
+		return;
+	}
+
+	std::cout << "Successfully loaded image:" << job.filename << ", width:" << job.width << ", height:" << job.height << ", channels:" << job.colorChannels << std::endl;
+
+	GLsizeiptr size = (GLsizeiptr)job.width * job.height * job.colorChannels;
+	STAGING_BUFFER& staging = StageData(job.pImage, size);
+
+	GLint activeUnit = 0;
+	GLint unpackAlignment = 4;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+	glActiveTexture(g_UploadTextureUnit);
+	glBindTexture(GL_TEXTURE_2D, job.textureID);
+
+	// rows of RGB images are not padded to four bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, NULL);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+
+	// generate the texture mipmaps for mapping textures to lower resolutions
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(activeUnit);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// the buffer is not written again until the upload is done
+	staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/***********************************************************
+ *  OpenCookedFile()
+ *
+ *  This method is used for mapping the cooked .ktx file that
+ *  sits next to a requested image, on a worker thread.  A
+ *  missing or unusable cooked file leaves the job to decode
+ *  the image instead.
+ ***********************************************************/
+bool TextureLoader::OpenCookedFile(TEXTURE_JOB& job)
+{
+	if (m_bCompressedTextures == false)
+	{
+		return(false);
+	}
+
+	std::string cookedName = job.filename;
+	size_t extension = cookedName.find_last_of("./\\");
+	if ((std::string::npos != extension) && ('.' == cookedName[extension]))
+	{
+		cookedName.erase(extension);
+	}
+	cookedName += KTX_FILE_EXTENSION;
+
+	MappedFile* pFile = new MappedFile();
+	if ((pFile->Open(cookedName.c_str()) == false) ||
+		(IsKtxHeaderValid(pFile->GetData(), pFile->GetSize()) == false))
+	{
+		delete pFile;
+		return(false);
+	}
+
+	job.pCookedFile = pFile;
+	return(true);
+}
+
+/***********************************************************
+ *  UploadCookedTexture()
+ *
+ *  This method is used for copying the compressed mip chain
+ *  of a cooked file into a pixel buffer and uploading every
+ *  level into the texture of the job.  The mip levels are
+ *  generated by the cooker, so none are generated here.
+ ***********************************************************/
+void TextureLoader::UploadCookedTexture(const TEXTURE_JOB& job)
+{
+	const unsigned char* pData = job.pCookedFile->GetData();
+	size_t fileSize = job.pCookedFile->GetSize();
+
+	KTX_HEADER header;
+	memcpy(&header, pData, sizeof(header));
+	const uint32_t blockSize = GetKtxBlockSize(header.glInternalFormat);
+
+	// the levels are staged together with their size fields,
+	// so every level is uploaded from its offset in the file
+	size_t levelsOffset = sizeof(KTX_HEADER) + header.bytesOfKeyValueData;
+	GLsizeiptr levelsSize = (GLsizeiptr)(fileSize - levelsOffset);
+	STAGING_BUFFER& staging = StageData(pData + levelsOffset, levelsSize);
+
+	GLint activeUnit = 0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+	glActiveTexture(g_UploadTextureUnit);
+	glBindTexture(GL_TEXTURE_2D, job.textureID);
+
+	uint32_t width = header.pixelWidth;
+	uint32_t height = header.pixelHeight;
+	size_t offset = 0;
+	uint32_t nLevels = 0;
+	while (nLevels < header.numberOfMipmapLevels)
+	{
+		uint32_t imageSize = 0;
+		if (offset + sizeof(imageSize) > (size_t)levelsSize)
+		{
+			break;
+		}
+		memcpy(&imageSize, pData + levelsOffset + offset, sizeof(imageSize));
+		offset += sizeof(imageSize);
+
+		uint32_t expectedSize = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+		if ((imageSize != expectedSize) || (offset + imageSize > (size_t)levelsSize))
+		{
+			break;
+		}
+
+		glCompressedTexImage2D(GL_TEXTURE_2D, nLevels, header.glInternalFormat,
+			width, height, 0, imageSize, (const void*)offset);
+
+		// the block data keeps the levels 4-byte aligned
+		offset += (imageSize + 3) & ~3u;
+		width = (width > 1) ? (width / 2) : 1;
+		height = (height > 1) ? (height / 2) : 1;
+		nLevels++;
+	}
+
+	if (nLevels > 0)
+	{
+		// only the uploaded levels are sampled
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nLevels - 1);
+		std::cout << "Successfully loaded cooked image:" << job.filename << ", width:" << header.pixelWidth << ", height:" << header.pixelHeight << ", levels:" << nLevels << std::endl;
+	}
+	else
+	{
+		std::cout << "Could not load cooked image:" << job.filename << std::endl;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(activeUnit);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/***********************************************************
+ *  StageData()
+ *
+ *  This method is used for copying data into the next pixel
+ *  buffer, which is left bound for unpacking so the upload
+ *  reads from offsets into it.
+ ***********************************************************/
+TextureLoader::STAGING_BUFFER& TextureLoader::StageData(const void* pData, GLsizeiptr size)
+{
+	STAGING_BUFFER& staging = AcquireStagingBuffer(size);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+	if (staging.pMapped)
+	{
+		memcpy(staging.pMapped, pData, size);
+	}
+	else
+	{
+		// orphan the previous contents and write the data through
+		// a temporary mapping
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, staging.size, NULL, GL_STREAM_DRAW);
+		void* pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (pMapped)
+		{
+			memcpy(pMapped, pData, size);
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	return(staging);
+}
+
+/***********************************************************
+ *  AcquireStagingBuffer()
+ *
+ *  This method is used for getting the next pixel buffer,
+ *  waiting for its previous upload to finish and growing it
+ *  when the passed in size does not fit.  The buffers are
+ *  persistently mapped when buffer storage is available.
+ ***********************************************************/
+TextureLoader::STAGING_BUFFER& TextureLoader::AcquireStagingBuffer(GLsizeiptr size)
+{
+	if (m_bStagingCreated == false)
+	{
+		m_bPersistentMapping = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+		m_bStagingCreated = true;
+	}
+
+	STAGING_BUFFER& staging = m_stagingBuffers[m_nextStagingBuffer];
+	m_nextStagingBuffer = (m_nextStagingBuffer + 1) % 2;
+
+	if (staging.fence)
+	{
+		glClientWaitSync(staging.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(staging.fence);
+		staging.fence = 0;
+	}
+
+	if (staging.size < size)
+	{
+		DestroyStagingBuffer(staging);
+
+		glGenBuffers(1, &staging.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+		if (m_bPersistentMapping)
+		{
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+			staging.pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+		}
+		else
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		staging.size = size;
+	}
+
+	return(staging);
+}
+
+/***********************************************************
+ *  DestroyStagingBuffer()
+ *
+ *  This method is used for freeing a pixel buffer.
+ ***********************************************************/
+void TextureLoader::DestroyStagingBuffer(STAGING_BUFFER& staging)
+{
+	if (staging.fence)
+	{
+		glDeleteSync(staging.fence);
+		staging.fence = 0;
+	}
+	if (0 != staging.buffer)
+	{
+		if (staging.pMapped)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &staging.buffer);
+		staging.buffer = 0;
+	}
+	staging.pMapped = NULL;
+	staging.size = 0;
+}
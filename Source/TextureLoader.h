@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// textureloader.h
+// ============
+// decode texture images on worker threads and upload them to OpenGL a few
+// at a time, so the scene can be drawn before all the images are loaded
+//
+//	Every requested texture gets a placeholder image at once.  The texture
+//	object keeps its name when the decoded image replaces the placeholder,
+//	so texture slots bound to it stay valid.
+//
+//	When a cooked .ktx file sits next to the requested image, its
+//	compressed mip chain is mapped and uploaded as is instead of decoding
+//	the image.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  TextureLoader
+ *
+ *  This class contains the code for the worker threads that
+ *  decode texture images, and for uploading the decoded
+ *  images through pixel buffers on the OpenGL thread.
+ ***********************************************************/
+class TextureLoader
+{
+public:
+	// constructor
+	TextureLoader();
+	// destructor
+	~TextureLoader();
+
+	// create a texture with the placeholder image and queue the
+	// passed in image file for decoding - returns the texture
+	// object, which gets the image once it is uploaded
+	GLuint RequestTexture(const char* filename);
+
+	// upload decoded images until the passed in time budget is
+	// spent - at least one waiting image is uploaded per call
+	void ProcessUploads(double budgetSeconds);
+
+	// whether every requested texture has been uploaded
+	bool IsIdle();
+
+	// move the textures finished since the last call into the
+	// passed in list - textures whose image could not be loaded
+	// are finished with the placeholder image
+	void TakeUploadedTextures(std::vector<GLuint>& textureIDs);
+
+private:
+	// a requested texture image as it moves through the loader
+	struct TEXTURE_JOB
+	{
+		std::string filename;
+		GLuint textureID;
+		unsigned char* pImage;
+		int width;
+		int height;
+		int colorChannels;
+		// mapped cooked file, used instead of the image when found
+		MappedFile* pCookedFile;
+	};
+
+	// pixel buffer that images are copied into for uploading
+	struct STAGING_BUFFER
+	{
+		GLuint buffer;
+		GLsizeiptr size;
+		// mapped memory when the buffer is persistently mapped
+		void* pMapped;
+		// signaled once the last upload from the buffer is done
+		GLsync fence;
+	};
+
+	// worker threads decoding images
+	std::vector<std::thread> m_workers;
+	// images waiting to be decoded
+	std::deque<TEXTURE_JOB> m_decodeQueue;
+	// decoded images waiting to be uploaded
+	std::deque<TEXTURE_JOB> m_uploadQueue;
+	// textures finished on the OpenGL thread since they were
+	// last taken
+	std::vector<GLuint> m_uploadedTextures;
+	// number of requested textures not yet uploaded
+	int m_pendingTextures;
+	// guards the queues and the pending count
+	std::mutex m_mutex;
+	// wakes the workers when images are queued or on shutdown
+	std::condition_variable m_decodeReady;
+	bool m_bShutdown;
+
+	// the pixel buffers are used in turn
+	STAGING_BUFFER m_stagingBuffers[2];
+	int m_nextStagingBuffer;
+	// whether the pixel buffers can be persistently mapped
+	bool m_bPersistentMapping;
+	bool m_bStagingCreated;
+	// whether the cooked compressed formats can be uploaded
+	bool m_bCompressedTextures;
+
+	// decode the queued images until shutdown
+	void WorkerLoop();
+	// map the cooked file of a requested image when there is one
+	bool OpenCookedFile(TEXTURE_JOB& job);
+	// copy a decoded image into a pixel buffer and upload it
+	void UploadTexture(const TEXTURE_JOB& job);
+	// copy the mip chain of a cooked file into a pixel buffer
+	// and upload it
+	void UploadCookedTexture(const TEXTURE_JOB& job);
+	// copy data into a pixel buffer and leave the buffer bound
+	// for unpacking
+	STAGING_BUFFER& StageData(const void* pData, GLsizeiptr size);
+	// get a pixel buffer with room for the passed in size
+	STAGING_BUFFER& AcquireStagingBuffer(GLsizeiptr size);
+	// free a pixel buffer
+	void DestroyStagingBuffer(STAGING_BUFFER& staging);
+};
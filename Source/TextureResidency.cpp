@@ -0,0 +1,463 @@
+///////////////////////////////////////////////////////////////////////////////
+// textureresidency.cpp
+// ============
+// make the scene textures available to the shaders without binding a
+// texture for every draw
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureResidency.h"
+
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	// texture unit used while copying, above the units of the
+	// texture arrays so their bindings are not disturbed
+	const GLenum g_CopyTextureUnit = GL_TEXTURE30;
+
+	/***********************************************************
+	 *  GetPixelFormat()
+	 *
+	 *  This function is used for getting the pixel format that
+	 *  matches an uncompressed internal format.
+	 ***********************************************************/
+	GLenum GetPixelFormat(GLenum internalFormat, int* pChannels)
+	{
+		if ((GL_RGB8 == internalFormat) || (GL_RGB == internalFormat))
+		{
+			*pChannels = 3;
+			return(GL_RGB);
+		}
+		*pChannels = 4;
+		return(GL_RGBA);
+	}
+}
+
+/***********************************************************
+ *  TextureResidency()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureResidency::TextureResidency(UniformBuffers* pUniformBuffers)
+{
+	m_pUniformBuffers = pUniformBuffers;
+	m_mode = RESIDENCY_NONE;
+	m_bCopyImage = false;
+	m_copyBuffer = 0;
+	m_copyBufferSize = 0;
+}
+
+/***********************************************************
+ *  ~TextureResidency()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureResidency::~TextureResidency()
+{
+	DestroyTextures();
+	m_pUniformBuffers = NULL;
+}
+
+/***********************************************************
+ *  SetMode()
+ *
+ *  This method is used for setting how the textures are made
+ *  resident, which must match the texture sampling that the
+ *  shader program was compiled with.  It is set before any
+ *  texture is made resident.
+ ***********************************************************/
+void TextureResidency::SetMode(RESIDENCY_MODE mode)
+{
+	m_mode = mode;
+	m_bCopyImage = (GLEW_VERSION_4_3 || GLEW_ARB_copy_image);
+}
+
+/***********************************************************
+ *  AddTexture()
+ *
+ *  This method is used for taking ownership of a texture and
+ *  giving it the next slot in the texture block.  The slot
+ *  samples the placeholder color until the texture is made
+ *  resident.
+ ***********************************************************/
+int TextureResidency::AddTexture(GLuint textureID)
+{
+	if ((int)m_textures.size() >= TOTAL_TEXTURES)
+	{
+		std::cout << "Only " << TOTAL_TEXTURES << " textures fit in the texture buffer" << std::endl;
+		return(-1);
+	}
+
+	TEXTURE_RECORD record;
+	record.textureID = textureID;
+	record.handle = 0;
+	record.bResident = false;
+	m_textures.push_back(record);
+
+	int slot = (int)m_textures.size() - 1;
+	m_slotsByTexture[textureID] = slot;
+	return(slot);
+}
+
+/***********************************************************
+ *  GetTextureID()
+ *
+ *  This method is used for getting the texture object of a
+ *  slot, which is 0 once it was copied into a texture array.
+ ***********************************************************/
+GLuint TextureResidency::GetTextureID(int slot) const
+{
+	if ((slot < 0) || (slot >= (int)m_textures.size()))
+	{
+		return(0);
+	}
+	return(m_textures[slot].textureID);
+}
+
+/***********************************************************
+ *  MakeResident()
+ *
+ *  This method is used for making the passed in textures
+ *  available to the shaders, now that their images are
+ *  uploaded, and writing their slots in the texture block.
+ ***********************************************************/
+void TextureResidency::MakeResident(const std::vector<GLuint>& textureIDs)
+{
+	std::vector<int> slots;
+	for (size_t i = 0; i < textureIDs.size(); i++)
+	{
+		std::unordered_map<GLuint, int>::const_iterator found = m_slotsByTexture.find(textureIDs[i]);
+		if ((found != m_slotsByTexture.end()) && (m_textures[found->second].bResident == false))
+		{
+			slots.push_back(found->second);
+		}
+	}
+
+	if (slots.empty())
+	{
+		return;
+	}
+
+	if (RESIDENCY_BINDLESS == m_mode)
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			MakeHandleResident(slots[i]);
+		}
+	}
+	else if (RESIDENCY_ARRAYS == m_mode)
+	{
+		PlaceInArrays(slots);
+	}
+}
+
+/***********************************************************
+ *  BindTextures()
+ *
+ *  This method is used for binding the texture arrays to the
+ *  texture units of the array samplers in the shaders.
+ *  Bindless textures need no binding.
+ ***********************************************************/
+void TextureResidency::BindTextures() const
+{
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + (GLenum)i);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, m_arrays[i].texture);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  DestroyTextures()
+ *
+ *  This method is used for freeing every texture and texture
+ *  array, making the bindless handles non-resident first.
+ ***********************************************************/
+void TextureResidency::DestroyTextures()
+{
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (0 != m_textures[i].handle)
+		{
+			glMakeTextureHandleNonResidentARB(m_textures[i].handle);
+		}
+		if (0 != m_textures[i].textureID)
+		{
+			glDeleteTextures(1, &m_textures[i].textureID);
+		}
+	}
+	m_textures.clear();
+	m_slotsByTexture.clear();
+
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		glDeleteTextures(1, &m_arrays[i].texture);
+	}
+	m_arrays.clear();
+
+	if (0 != m_copyBuffer)
+	{
+		glDeleteBuffers(1, &m_copyBuffer);
+		m_copyBuffer = 0;
+		m_copyBufferSize = 0;
+	}
+}
+
+/***********************************************************
+ *  MakeHandleResident()
+ *
+ *  This method is used for creating the bindless handle of a
+ *  loaded texture and writing it into the texture block.  The
+ *  texture can not be changed once it has a handle.
+ ***********************************************************/
+void TextureResidency::MakeHandleResident(int slot)
+{
+	TEXTURE_RECORD& record = m_textures[slot];
+	record.handle = glGetTextureHandleARB(record.textureID);
+	if (0 == record.handle)
+	{
+		return;
+	}
+	glMakeTextureHandleResidentARB(record.handle);
+	record.bResident = true;
+
+	UniformBuffers::TEXTURE_ENTRY& entry = m_pUniformBuffers->GetTextureData().textures[slot];
+	entry.handle[0] = (uint32_t)(record.handle & 0xFFFFFFFF);
+	entry.handle[1] = (uint32_t)(record.handle >> 32);
+}
+
+/***********************************************************
+ *  PlaceInArrays()
+ *
+ *  This method is used for copying loaded textures into the
+ *  texture array of their size and format.  An array that
+ *  gets new layers is created again with room for them, the
+ *  layers it had are copied over, and the copied textures are
+ *  freed, so every texture is only held once.
+ ***********************************************************/
+void TextureResidency::PlaceInArrays(const std::vector<int>& slots)
+{
+	GLint activeUnit = 0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+	glActiveTexture(g_CopyTextureUnit);
+
+	// find the array of every texture by its size and format
+	std::vector<std::vector<int> > newLayers(TOTAL_TEXTURE_ARRAYS);
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		TEXTURE_ARRAY format;
+		GLint value = 0;
+		GLint maxLevel = 0;
+
+		glBindTexture(GL_TEXTURE_2D, m_textures[slots[i]].textureID);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &value);
+		format.width = value;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &value);
+		format.height = value;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &value);
+		format.internalFormat = (GLenum)value;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &value);
+		format.bCompressed = (GL_FALSE != value);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+		// every level down to 1x1 was uploaded or generated,
+		// unless the cooked file stopped earlier
+		GLsizei largest = (format.width > format.height) ? format.width : format.height;
+		format.nLevels = 1;
+		while (((largest >> format.nLevels) > 0) && (format.nLevels <= maxLevel))
+		{
+			format.nLevels++;
+		}
+		if (format.bCompressed)
+		{
+			for (GLint level = 0; level < format.nLevels; level++)
+			{
+				glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &value);
+				format.levelSizes.push_back(value);
+			}
+		}
+
+		size_t index = 0;
+		while ((index < m_arrays.size()) &&
+			((m_arrays[index].width != format.width) ||
+			(m_arrays[index].height != format.height) ||
+			(m_arrays[index].internalFormat != format.internalFormat) ||
+			(m_arrays[index].nLevels != format.nLevels)))
+		{
+			index++;
+		}
+		if (index == m_arrays.size())
+		{
+			if (m_arrays.size() >= TOTAL_TEXTURE_ARRAYS)
+			{
+				std::cout << "No texture array left for a " << format.width << "x" << format.height << " texture" << std::endl;
+				continue;
+			}
+			format.texture = 0;
+			format.nLayers = 0;
+			m_arrays.push_back(format);
+		}
+		newLayers[index].push_back(slots[i]);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	for (size_t index = 0; index < m_arrays.size(); index++)
+	{
+		if (newLayers[index].empty())
+		{
+			continue;
+		}
+
+		TEXTURE_ARRAY& textureArray = m_arrays[index];
+		int nLayers = textureArray.nLayers + (int)newLayers[index].size();
+		int channels = 4;
+		GLenum pixelFormat = GetPixelFormat(textureArray.internalFormat, &channels);
+
+		GLuint texture = 0;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+		// same sampling as the loaded textures
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, textureArray.nLevels - 1);
+
+		for (GLint level = 0; level < textureArray.nLevels; level++)
+		{
+			GLsizei width = (textureArray.width >> level) > 0 ? (textureArray.width >> level) : 1;
+			GLsizei height = (textureArray.height >> level) > 0 ? (textureArray.height >> level) : 1;
+			if (textureArray.bCompressed)
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, textureArray.internalFormat,
+					width, height, nLayers, 0, textureArray.levelSizes[level] * nLayers, NULL);
+			}
+			else
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, textureArray.internalFormat,
+					width, height, nLayers, 0, pixelFormat, GL_UNSIGNED_BYTE, NULL);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		// keep the layers of the previous array
+		if (0 != textureArray.texture)
+		{
+			CopyTextureLayers(textureArray, textureArray.texture, GL_TEXTURE_2D_ARRAY, 0,
+				texture, 0, textureArray.nLayers);
+			glDeleteTextures(1, &textureArray.texture);
+		}
+
+		UniformBuffers::TEXTURE_DATA& textureData = m_pUniformBuffers->GetTextureData();
+		for (size_t i = 0; i < newLayers[index].size(); i++)
+		{
+			int slot = newLayers[index][i];
+			int layer = textureArray.nLayers + (int)i;
+			TEXTURE_RECORD& record = m_textures[slot];
+
+			CopyTextureLayers(textureArray, record.textureID, GL_TEXTURE_2D, 0, texture, layer, 1);
+			m_slotsByTexture.erase(record.textureID);
+			glDeleteTextures(1, &record.textureID);
+			record.textureID = 0;
+			record.bResident = true;
+
+			textureData.textures[slot].arrayIndex = (int)index;
+			textureData.textures[slot].layer = layer;
+		}
+
+		textureArray.texture = texture;
+		textureArray.nLayers = nLayers;
+
+		glActiveTexture(GL_TEXTURE0 + (GLenum)index);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glActiveTexture(g_CopyTextureUnit);
+	}
+
+	glActiveTexture(activeUnit);
+}
+
+/***********************************************************
+ *  CopyTextureLayers()
+ *
+ *  This method is used for copying every level of a range of
+ *  layers into a texture array.  Without direct image copies
+ *  the levels go through a pixel buffer, which still keeps
+ *  the data on the GPU.
+ ***********************************************************/
+void TextureResidency::CopyTextureLayers(
+	const TEXTURE_ARRAY& format,
+	GLuint source, GLenum sourceTarget, int sourceLayer,
+	GLuint destination, int destinationLayer, int nLayers)
+{
+	int channels = 4;
+	GLenum pixelFormat = GetPixelFormat(format.internalFormat, &channels);
+
+	for (GLint level = 0; level < format.nLevels; level++)
+	{
+		GLsizei width = (format.width >> level) > 0 ? (format.width >> level) : 1;
+		GLsizei height = (format.height >> level) > 0 ? (format.height >> level) : 1;
+
+		if (m_bCopyImage)
+		{
+			glCopyImageSubData(
+				source, sourceTarget, level, 0, 0, sourceLayer,
+				destination, GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer,
+				width, height, nLayers);
+			continue;
+		}
+
+		// a whole source is copied, so the layers read back are
+		// exactly the ones written
+		GLsizeiptr size = format.bCompressed ?
+			(GLsizeiptr)format.levelSizes[level] * nLayers :
+			(GLsizeiptr)width * height * channels * nLayers;
+
+		if (0 == m_copyBuffer)
+		{
+			glGenBuffers(1, &m_copyBuffer);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_copyBuffer);
+		if (m_copyBufferSize < size)
+		{
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_COPY);
+			m_copyBufferSize = size;
+		}
+
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		glBindTexture(sourceTarget, source);
+		if (format.bCompressed)
+		{
+			glGetCompressedTexImage(sourceTarget, level, NULL);
+		}
+		else
+		{
+			glGetTexImage(sourceTarget, level, pixelFormat, GL_UNSIGNED_BYTE, NULL);
+		}
+		glBindTexture(sourceTarget, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_copyBuffer);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, destination);
+		if (format.bCompressed)
+		{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer,
+				width, height, nLayers, format.internalFormat, (GLsizei)size, NULL);
+		}
+		else
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, destinationLayer,
+				width, height, nLayers, pixelFormat, GL_UNSIGNED_BYTE, NULL);
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+}
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// textureresidency.h
+// ============
+// make the scene textures available to the shaders without binding a
+// texture for every draw
+//
+//	With bindless textures, the handle of every texture is written into the
+//	texture block of the shaders.  Otherwise the textures are packed into
+//	texture arrays, one for every size and format, that stay bound to the
+//	first texture units.  Either way the shaders find a texture by its
+//	slot in the texture block.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "UniformBuffers.h"
+
+#include <GL/glew.h>
+
+#include <unordered_map>
+#include <vector>
+
+// number of texture arrays in the shaders, bound to the first units
+#define TOTAL_TEXTURE_ARRAYS 8
+
+/***********************************************************
+ *  TextureResidency
+ *
+ *  This class contains the code for owning the scene
+ *  textures and making them resident for the shaders once
+ *  they are loaded, with bindless handles or texture array
+ *  layers.
+ ***********************************************************/
+class TextureResidency
+{
+public:
+	// constructor
+	TextureResidency(UniformBuffers* pUniformBuffers);
+	// destructor
+	~TextureResidency();
+
+	// how the textures are made available to the shaders
+	enum RESIDENCY_MODE
+	{
+		RESIDENCY_NONE,
+		RESIDENCY_BINDLESS,
+		RESIDENCY_ARRAYS
+	};
+
+	// set the mode that the shader program was compiled for
+	void SetMode(RESIDENCY_MODE mode);
+	RESIDENCY_MODE GetMode() const { return m_mode; }
+
+	// take ownership of a texture - returns its slot in the
+	// texture block, or -1 when the block is full
+	int AddTexture(GLuint textureID);
+	// number of added textures
+	int GetTextureCount() const { return (int)m_textures.size(); }
+	// texture object of a slot - 0 once the texture has been
+	// copied into a texture array
+	GLuint GetTextureID(int slot) const;
+
+	// make the passed in textures resident, now that their
+	// images are uploaded
+	void MakeResident(const std::vector<GLuint>& textureIDs);
+
+	// bind the texture arrays to their texture units
+	void BindTextures() const;
+	// free every texture
+	void DestroyTextures();
+
+private:
+	// a texture added to the texture block
+	struct TEXTURE_RECORD
+	{
+		GLuint textureID;
+		// bindless handle once the texture is resident
+		GLuint64 handle;
+		bool bResident;
+	};
+
+	// texture array holding the textures of one size and format
+	struct TEXTURE_ARRAY
+	{
+		GLuint texture;
+		GLsizei width;
+		GLsizei height;
+		GLenum internalFormat;
+		bool bCompressed;
+		GLint nLevels;
+		int nLayers;
+		// bytes per layer of every level of compressed formats
+		std::vector<GLint> levelSizes;
+	};
+
+	// pointer to the uniform buffers holding the texture block
+	UniformBuffers* m_pUniformBuffers;
+	RESIDENCY_MODE m_mode;
+	std::vector<TEXTURE_RECORD> m_textures;
+	// slot of every texture object that is not in an array
+	std::unordered_map<GLuint, int> m_slotsByTexture;
+	std::vector<TEXTURE_ARRAY> m_arrays;
+	// whether textures can be copied on the GPU directly
+	bool m_bCopyImage;
+	// buffer used to copy textures without direct copies
+	GLuint m_copyBuffer;
+	GLsizeiptr m_copyBufferSize;
+
+	// make a texture resident with a bindless handle
+	void MakeHandleResident(int slot);
+	// copy the passed in textures into the texture arrays
+	void PlaceInArrays(const std::vector<int>& slots);
+	// copy texture levels between textures on the GPU
+	void CopyTextureLayers(
+		const TEXTURE_ARRAY& format,
+		GLuint source, GLenum sourceTarget, int sourceLayer,
+		GLuint destination, int destinationLayer, int nLayers);
+};
@@ -0,0 +1,410 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformbatch.cpp
+// ============
+// build the model matrices of many objects at once from their scale, Euler
+// rotation and position, several objects per SIMD instruction
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformBatch.h"
+
+#include <cmath>
+
+// the widest instruction set the compiler was asked for
+#if defined(__AVX2__)
+#define TRANSFORM_BATCH_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TRANSFORM_BATCH_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TRANSFORM_BATCH_NEON
+#include <arm_neon.h>
+#endif
+
+// declaration of global variables and defines
+namespace
+{
+	// degrees to radians
+	const float g_DegreesToRadians = 3.14159265358979f / 180.0f;
+
+	// polynomials of the sine and cosine on [-pi/4, pi/4], from
+	// the Cephes math library
+	const float g_SinCoefficients[3] = { -1.6666654611e-1f, 8.3321608736e-3f, -1.9515295891e-4f };
+	const float g_CosCoefficients[3] = { 4.166664568298827e-2f, -1.388731625493765e-3f, 2.443315711809948e-5f };
+
+	/***********************************************************
+	 *  SinCosDegrees()
+	 *
+	 *  This function is used for finding the sine and cosine of
+	 *  an angle in degrees.  The angle is brought down to the
+	 *  nearest quarter turn first, so quarter turns come out
+	 *  exact, the same as in the SIMD code.
+	 ***********************************************************/
+	void SinCosDegrees(float degrees, float& sine, float& cosine)
+	{
+		float quarter = std::floor(degrees / 90.0f + 0.5f);
+		float radians = (degrees - quarter * 90.0f) * g_DegreesToRadians;
+		float s = std::sin(radians);
+		float c = std::cos(radians);
+
+		switch ((int)quarter & 3)
+		{
+		case 0: sine = s; cosine = c; break;
+		case 1: sine = c; cosine = -s; break;
+		case 2: sine = -s; cosine = -c; break;
+		default: sine = -c; cosine = s; break;
+		}
+	}
+
+#if defined(TRANSFORM_BATCH_AVX2)
+	typedef __m256 SIMD_FLOAT;
+	typedef __m256i SIMD_INT;
+	const size_t g_Lanes = 8;
+
+	inline SIMD_FLOAT SimdSet(float value) { return(_mm256_set1_ps(value)); }
+	inline SIMD_FLOAT SimdLoad(const float* pValues) { return(_mm256_loadu_ps(pValues)); }
+	inline SIMD_FLOAT SimdAdd(SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm256_add_ps(a, b)); }
+	inline SIMD_FLOAT SimdSub(SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm256_sub_ps(a, b)); }
+	inline SIMD_FLOAT SimdMul(SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm256_mul_ps(a, b)); }
+	inline SIMD_INT SimdRound(SIMD_FLOAT a) { return(_mm256_cvtps_epi32(a)); }
+	inline SIMD_FLOAT SimdToFloat(SIMD_INT a) { return(_mm256_cvtepi32_ps(a)); }
+	inline SIMD_INT SimdIntSet(int value) { return(_mm256_set1_epi32(value)); }
+	inline SIMD_INT SimdIntAdd(SIMD_INT a, SIMD_INT b) { return(_mm256_add_epi32(a, b)); }
+	inline SIMD_INT SimdIntAnd(SIMD_INT a, SIMD_INT b) { return(_mm256_and_si256(a, b)); }
+	inline SIMD_INT SimdSignBit(SIMD_INT a) { return(_mm256_slli_epi32(a, 30)); }
+	inline SIMD_FLOAT SimdEqual(SIMD_INT a, SIMD_INT b) { return(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))); }
+	inline SIMD_FLOAT SimdSelect(SIMD_FLOAT mask, SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm256_blendv_ps(b, a, mask)); }
+	inline SIMD_FLOAT SimdFlipSign(SIMD_FLOAT a, SIMD_INT sign) { return(_mm256_xor_ps(a, _mm256_castsi256_ps(sign))); }
+
+	/***********************************************************
+	 *  StoreMatrices()
+	 *
+	 *  This function is used for writing the matrices of the
+	 *  objects in the lanes, by turning every column of the
+	 *  lanes around into the columns of the matrices.
+	 ***********************************************************/
+	void StoreMatrices(const SIMD_FLOAT columns[4][4], float* pMatrices)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			for (int half = 0; half < 2; half++)
+			{
+				__m128 x = half ? _mm256_extractf128_ps(columns[column][0], 1) : _mm256_castps256_ps128(columns[column][0]);
+				__m128 y = half ? _mm256_extractf128_ps(columns[column][1], 1) : _mm256_castps256_ps128(columns[column][1]);
+				__m128 z = half ? _mm256_extractf128_ps(columns[column][2], 1) : _mm256_castps256_ps128(columns[column][2]);
+				__m128 w = half ? _mm256_extractf128_ps(columns[column][3], 1) : _mm256_castps256_ps128(columns[column][3]);
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+
+				float* pFirst = pMatrices + half * 4 * 16 + column * 4;
+				_mm_storeu_ps(pFirst, x);
+				_mm_storeu_ps(pFirst + 16, y);
+				_mm_storeu_ps(pFirst + 32, z);
+				_mm_storeu_ps(pFirst + 48, w);
+			}
+		}
+	}
+#elif defined(TRANSFORM_BATCH_SSE2)
+	typedef __m128 SIMD_FLOAT;
+	typedef __m128i SIMD_INT;
+	const size_t g_Lanes = 4;
+
+	inline SIMD_FLOAT SimdSet(float value) { return(_mm_set1_ps(value)); }
+	inline SIMD_FLOAT SimdLoad(const float* pValues) { return(_mm_loadu_ps(pValues)); }
+	inline SIMD_FLOAT SimdAdd(SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm_add_ps(a, b)); }
+	inline SIMD_FLOAT SimdSub(SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm_sub_ps(a, b)); }
+	inline SIMD_FLOAT SimdMul(SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm_mul_ps(a, b)); }
+	inline SIMD_INT SimdRound(SIMD_FLOAT a) { return(_mm_cvtps_epi32(a)); }
+	inline SIMD_FLOAT SimdToFloat(SIMD_INT a) { return(_mm_cvtepi32_ps(a)); }
+	inline SIMD_INT SimdIntSet(int value) { return(_mm_set1_epi32(value)); }
+	inline SIMD_INT SimdIntAdd(SIMD_INT a, SIMD_INT b) { return(_mm_add_epi32(a, b)); }
+	inline SIMD_INT SimdIntAnd(SIMD_INT a, SIMD_INT b) { return(_mm_and_si128(a, b)); }
+	inline SIMD_INT SimdSignBit(SIMD_INT a) { return(_mm_slli_epi32(a, 30)); }
+	inline SIMD_FLOAT SimdEqual(SIMD_INT a, SIMD_INT b) { return(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))); }
+	inline SIMD_FLOAT SimdSelect(SIMD_FLOAT mask, SIMD_FLOAT a, SIMD_FLOAT b) { return(_mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))); }
+	inline SIMD_FLOAT SimdFlipSign(SIMD_FLOAT a, SIMD_INT sign) { return(_mm_xor_ps(a, _mm_castsi128_ps(sign))); }
+
+	/***********************************************************
+	 *  StoreMatrices()
+	 *
+	 *  This function is used for writing the matrices of the
+	 *  objects in the lanes, by turning every column of the
+	 *  lanes around into the columns of the matrices.
+	 ***********************************************************/
+	void StoreMatrices(const SIMD_FLOAT columns[4][4], float* pMatrices)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			__m128 x = columns[column][0];
+			__m128 y = columns[column][1];
+			__m128 z = columns[column][2];
+			__m128 w = columns[column][3];
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+
+			float* pFirst = pMatrices + column * 4;
+			_mm_storeu_ps(pFirst, x);
+			_mm_storeu_ps(pFirst + 16, y);
+			_mm_storeu_ps(pFirst + 32, z);
+			_mm_storeu_ps(pFirst + 48, w);
+		}
+	}
+#elif defined(TRANSFORM_BATCH_NEON)
+	typedef float32x4_t SIMD_FLOAT;
+	typedef int32x4_t SIMD_INT;
+	const size_t g_Lanes = 4;
+
+	inline SIMD_FLOAT SimdSet(float value) { return(vdupq_n_f32(value)); }
+	inline SIMD_FLOAT SimdLoad(const float* pValues) { return(vld1q_f32(pValues)); }
+	inline SIMD_FLOAT SimdAdd(SIMD_FLOAT a, SIMD_FLOAT b) { return(vaddq_f32(a, b)); }
+	inline SIMD_FLOAT SimdSub(SIMD_FLOAT a, SIMD_FLOAT b) { return(vsubq_f32(a, b)); }
+	inline SIMD_FLOAT SimdMul(SIMD_FLOAT a, SIMD_FLOAT b) { return(vmulq_f32(a, b)); }
+	inline SIMD_INT SimdRound(SIMD_FLOAT a) { return(vcvtnq_s32_f32(a)); }
+	inline SIMD_FLOAT SimdToFloat(SIMD_INT a) { return(vcvtq_f32_s32(a)); }
+	inline SIMD_INT SimdIntSet(int value) { return(vdupq_n_s32(value)); }
+	inline SIMD_INT SimdIntAdd(SIMD_INT a, SIMD_INT b) { return(vaddq_s32(a, b)); }
+	inline SIMD_INT SimdIntAnd(SIMD_INT a, SIMD_INT b) { return(vandq_s32(a, b)); }
+	inline SIMD_INT SimdSignBit(SIMD_INT a) { return(vshlq_n_s32(a, 30)); }
+	inline SIMD_FLOAT SimdEqual(SIMD_INT a, SIMD_INT b) { return(vreinterpretq_f32_u32(vceqq_s32(a, b))); }
+	inline SIMD_FLOAT SimdSelect(SIMD_FLOAT mask, SIMD_FLOAT a, SIMD_FLOAT b) { return(vbslq_f32(vreinterpretq_u32_f32(mask), a, b)); }
+	inline SIMD_FLOAT SimdFlipSign(SIMD_FLOAT a, SIMD_INT sign) { return(vreinterpretq_f32_s32(veorq_s32(vreinterpretq_s32_f32(a), sign))); }
+
+	/***********************************************************
+	 *  StoreMatrices()
+	 *
+	 *  This function is used for writing the matrices of the
+	 *  objects in the lanes, by turning every column of the
+	 *  lanes around into the columns of the matrices.
+	 ***********************************************************/
+	void StoreMatrices(const SIMD_FLOAT columns[4][4], float* pMatrices)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			float32x4x2_t xy = vtrnq_f32(columns[column][0], columns[column][1]);
+			float32x4x2_t zw = vtrnq_f32(columns[column][2], columns[column][3]);
+
+			float* pFirst = pMatrices + column * 4;
+			vst1q_f32(pFirst, vcombine_f32(vget_low_f32(xy.val[0]), vget_low_f32(zw.val[0])));
+			vst1q_f32(pFirst + 16, vcombine_f32(vget_low_f32(xy.val[1]), vget_low_f32(zw.val[1])));
+			vst1q_f32(pFirst + 32, vcombine_f32(vget_high_f32(xy.val[0]), vget_high_f32(zw.val[0])));
+			vst1q_f32(pFirst + 48, vcombine_f32(vget_high_f32(xy.val[1]), vget_high_f32(zw.val[1])));
+		}
+	}
+#endif
+
+#if defined(TRANSFORM_BATCH_AVX2) || defined(TRANSFORM_BATCH_SSE2) || defined(TRANSFORM_BATCH_NEON)
+	/***********************************************************
+	 *  SimdSinCosDegrees()
+	 *
+	 *  This function is used for finding the sines and cosines
+	 *  of the angles in degrees in the lanes.  Every angle is
+	 *  brought down to the nearest quarter turn, the remainder
+	 *  goes through the polynomials, and the quarter turn then
+	 *  swaps the two and flips their signs.
+	 ***********************************************************/
+	void SimdSinCosDegrees(SIMD_FLOAT degrees, SIMD_FLOAT& sine, SIMD_FLOAT& cosine)
+	{
+		SIMD_INT quarter = SimdRound(SimdMul(degrees, SimdSet(1.0f / 90.0f)));
+		SIMD_FLOAT x = SimdMul(
+			SimdSub(degrees, SimdMul(SimdToFloat(quarter), SimdSet(90.0f))),
+			SimdSet(g_DegreesToRadians));
+		SIMD_FLOAT z = SimdMul(x, x);
+
+		SIMD_FLOAT s = SimdAdd(SimdMul(SimdSet(g_SinCoefficients[2]), z), SimdSet(g_SinCoefficients[1]));
+		s = SimdAdd(SimdMul(s, z), SimdSet(g_SinCoefficients[0]));
+		s = SimdAdd(SimdMul(SimdMul(s, z), x), x);
+
+		SIMD_FLOAT c = SimdAdd(SimdMul(SimdSet(g_CosCoefficients[2]), z), SimdSet(g_CosCoefficients[1]));
+		c = SimdAdd(SimdMul(c, z), SimdSet(g_CosCoefficients[0]));
+		c = SimdAdd(SimdSub(SimdMul(SimdMul(c, z), z), SimdMul(z, SimdSet(0.5f))), SimdSet(1.0f));
+
+		// odd quarter turns swap the sine and cosine, the second
+		// and third flip the sine and the first and second the cosine
+		SIMD_INT one = SimdIntSet(1);
+		SIMD_INT two = SimdIntSet(2);
+		SIMD_FLOAT swap = SimdEqual(SimdIntAnd(quarter, one), one);
+		sine = SimdFlipSign(SimdSelect(swap, c, s), SimdSignBit(SimdIntAnd(quarter, two)));
+		cosine = SimdFlipSign(SimdSelect(swap, s, c), SimdSignBit(SimdIntAnd(SimdIntAdd(quarter, one), two)));
+	}
+
+	/***********************************************************
+	 *  SimdComposeMatrices()
+	 *
+	 *  This function is used for building the matrices of the
+	 *  objects in the lanes, starting at the passed in object.
+	 ***********************************************************/
+	void SimdComposeMatrices(const TransformBatch::TRS_ARRAYS& transforms, size_t first, float* pMatrices)
+	{
+		SIMD_FLOAT sx, cx, sy, cy, sz, cz;
+		SimdSinCosDegrees(SimdLoad(transforms.rotation[0] + first), sx, cx);
+		SimdSinCosDegrees(SimdLoad(transforms.rotation[1] + first), sy, cy);
+		SimdSinCosDegrees(SimdLoad(transforms.rotation[2] + first), sz, cz);
+
+		SIMD_FLOAT scaleX = SimdLoad(transforms.scale[0] + first);
+		SIMD_FLOAT scaleY = SimdLoad(transforms.scale[1] + first);
+		SIMD_FLOAT scaleZ = SimdLoad(transforms.scale[2] + first);
+		SIMD_FLOAT szsy = SimdMul(sz, sy);
+		SIMD_FLOAT czsy = SimdMul(cz, sy);
+
+		SIMD_FLOAT columns[4][4];
+		columns[0][0] = SimdMul(SimdMul(cz, cy), scaleX);
+		columns[0][1] = SimdMul(SimdMul(sz, cy), scaleX);
+		columns[0][2] = SimdMul(SimdSub(SimdSet(0.0f), sy), scaleX);
+		columns[0][3] = SimdSet(0.0f);
+		columns[1][0] = SimdMul(SimdSub(SimdMul(czsy, sx), SimdMul(sz, cx)), scaleY);
+		columns[1][1] = SimdMul(SimdAdd(SimdMul(szsy, sx), SimdMul(cz, cx)), scaleY);
+		columns[1][2] = SimdMul(SimdMul(cy, sx), scaleY);
+		columns[1][3] = SimdSet(0.0f);
+		columns[2][0] = SimdMul(SimdAdd(SimdMul(czsy, cx), SimdMul(sz, sx)), scaleZ);
+		columns[2][1] = SimdMul(SimdSub(SimdMul(szsy, cx), SimdMul(cz, sx)), scaleZ);
+		columns[2][2] = SimdMul(SimdMul(cy, cx), scaleZ);
+		columns[2][3] = SimdSet(0.0f);
+		columns[3][0] = SimdLoad(transforms.position[0] + first);
+		columns[3][1] = SimdLoad(transforms.position[1] + first);
+		columns[3][2] = SimdLoad(transforms.position[2] + first);
+		columns[3][3] = SimdSet(1.0f);
+
+		StoreMatrices(columns, pMatrices + first * 16);
+	}
+#endif
+}
+
+/***********************************************************
+ *  TransformBatch()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TransformBatch::TransformBatch()
+{
+}
+
+/***********************************************************
+ *  ComposeMatrices()
+ *
+ *  This method is used for building the model matrices of
+ *  the passed in number of objects, as many at a time as the
+ *  vector registers hold, and the objects left over with the
+ *  scalar code.
+ ***********************************************************/
+void TransformBatch::ComposeMatrices(const TRS_ARRAYS& transforms, size_t count, float* pMatrices)
+{
+	size_t first = 0;
+#if defined(TRANSFORM_BATCH_AVX2) || defined(TRANSFORM_BATCH_SSE2) || defined(TRANSFORM_BATCH_NEON)
+	for (; first + g_Lanes <= count; first += g_Lanes)
+	{
+		SimdComposeMatrices(transforms, first, pMatrices);
+	}
+#endif
+	ComposeMatricesScalar(transforms, first, count - first, pMatrices);
+}
+
+/***********************************************************
+ *  ComposeMatricesScalar()
+ *
+ *  This method is used for building the model matrices of
+ *  the passed in objects one at a time, from the closed form
+ *  of the scale, the X, Y and Z rotations and the
+ *  translation.
+ ***********************************************************/
+void TransformBatch::ComposeMatricesScalar(const TRS_ARRAYS& transforms, size_t first, size_t count, float* pMatrices)
+{
+	for (size_t i = first; i < first + count; i++)
+	{
+		float sx, cx, sy, cy, sz, cz;
+		SinCosDegrees(transforms.rotation[0][i], sx, cx);
+		SinCosDegrees(transforms.rotation[1][i], sy, cy);
+		SinCosDegrees(transforms.rotation[2][i], sz, cz);
+
+		float scaleX = transforms.scale[0][i];
+		float scaleY = transforms.scale[1][i];
+		float scaleZ = transforms.scale[2][i];
+
+		float* pMatrix = pMatrices + i * 16;
+		pMatrix[0] = cz * cy * scaleX;
+		pMatrix[1] = sz * cy * scaleX;
+		pMatrix[2] = -sy * scaleX;
+		pMatrix[3] = 0.0f;
+		pMatrix[4] = (cz * sy * sx - sz * cx) * scaleY;
+		pMatrix[5] = (sz * sy * sx + cz * cx) * scaleY;
+		pMatrix[6] = cy * sx * scaleY;
+		pMatrix[7] = 0.0f;
+		pMatrix[8] = (cz * sy * cx + sz * sx) * scaleZ;
+		pMatrix[9] = (sz * sy * cx - cz * sx) * scaleZ;
+		pMatrix[10] = cy * cx * scaleZ;
+		pMatrix[11] = 0.0f;
+		pMatrix[12] = transforms.position[0][i];
+		pMatrix[13] = transforms.position[1][i];
+		pMatrix[14] = transforms.position[2][i];
+		pMatrix[15] = 1.0f;
+	}
+}
+
+/***********************************************************
+ *  GetInstructionSet()
+ *
+ *  This method is used for naming the instruction set the
+ *  file was compiled for, for the benchmark results.
+ ***********************************************************/
+const char* TransformBatch::GetInstructionSet()
+{
+#if defined(TRANSFORM_BATCH_AVX2)
+	return("AVX2");
+#elif defined(TRANSFORM_BATCH_SSE2)
+	return("SSE2");
+#elif defined(TRANSFORM_BATCH_NEON)
+	return("NEON");
+#else
+	return("scalar");
+#endif
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing the collected
+ *  transformations.
+ ***********************************************************/
+void TransformBatch::Clear()
+{
+	for (int i = 0; i < 9; i++)
+	{
+		m_components[i].clear();
+	}
+}
+
+/***********************************************************
+ *  AddTransform()
+ *
+ *  This method is used for adding the transformation of one
+ *  object, with every component going to its own array.
+ ***********************************************************/
+void TransformBatch::AddTransform(const float scale[3], const float rotation[3], const float position[3])
+{
+	for (int i = 0; i < 3; i++)
+	{
+		m_components[i].push_back(scale[i]);
+		m_components[3 + i].push_back(rotation[i]);
+		m_components[6 + i].push_back(position[i]);
+	}
+}
+
+/***********************************************************
+ *  Compose()
+ *
+ *  This method is used for building the matrices of the
+ *  collected transformations.
+ ***********************************************************/
+void TransformBatch::Compose(float* pMatrices) const
+{
+	if (GetCount() == 0)
+	{
+		return;
+	}
+
+	TRS_ARRAYS transforms;
+	for (int i = 0; i < 3; i++)
+	{
+		transforms.scale[i] = m_components[i].data();
+		transforms.rotation[i] = m_components[3 + i].data();
+		transforms.position[i] = m_components[6 + i].data();
+	}
+	ComposeMatrices(transforms, GetCount(), pMatrices);
+}
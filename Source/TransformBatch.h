@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformbatch.h
+// ============
+// build the model matrices of many objects at once from their scale, Euler
+// rotation and position, several objects per SIMD instruction
+//
+//	The matrix of every object is the scale, then the X, Y and Z rotations
+//	in degrees, then the translation - the same order the scene has always
+//	used - written out in closed form instead of multiplying five matrices.
+//	The components are read from separate arrays, so one vector register
+//	holds the same component of 4 (SSE2, NEON) or 8 (AVX2) objects, and the
+//	sines and cosines of all of them are found with one polynomial.  The
+//	instruction set is picked when the file is compiled, and the objects
+//	left over after the last full register use the scalar code.  Matrices
+//	are written column-major, like glm.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/***********************************************************
+ *  TransformBatch
+ *
+ *  This class contains the code for collecting the
+ *  transformations of many objects and building their model
+ *  matrices together.
+ ***********************************************************/
+class TransformBatch
+{
+public:
+	// constructor
+	TransformBatch();
+
+	// transformations of many objects, one array for every
+	// component - the rotations are in degrees
+	struct TRS_ARRAYS
+	{
+		const float* scale[3];
+		const float* rotation[3];
+		const float* position[3];
+	};
+
+	// build the matrices of the passed in number of objects, with
+	// 16 floats for every matrix
+	static void ComposeMatrices(const TRS_ARRAYS& transforms, size_t count, float* pMatrices);
+	// build the matrices without SIMD instructions
+	static void ComposeMatricesScalar(const TRS_ARRAYS& transforms, size_t first, size_t count, float* pMatrices);
+	// name of the instruction set the matrices are built with
+	static const char* GetInstructionSet();
+
+	// remove the collected transformations
+	void Clear();
+	// add the transformation of one object, as the scale, the
+	// rotation in degrees and the position
+	void AddTransform(const float scale[3], const float rotation[3], const float position[3]);
+	// number of collected transformations
+	size_t GetCount() const { return(m_components[0].size()); }
+	// build the matrices of the collected transformations, in
+	// the order they were added
+	void Compose(float* pMatrices) const;
+
+private:
+	// the scale, rotation and position components of the
+	// collected transformations, one array each
+	std::vector<float> m_components[9];
+};
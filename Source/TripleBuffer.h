@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+// triplebuffer.h
+// ============
+// hand values from one writing thread to one reading thread without locks,
+// through three slots that the two threads swap
+//
+//	The writer fills its back slot and publishes it by swapping it with the
+//	middle slot, and the reader takes the middle slot by swapping it with
+//	its front slot, so neither ever waits for the other.  The middle index
+//	carries a flag telling whether it holds a value the reader has not
+//	taken yet.  A reader that is slower than the writer skips values, and
+//	the writer learns when that happened - its new back slot is then the
+//	value that was skipped, still intact.  The reader may already hold a
+//	newer value by then, so a value that only carries changes has to be
+//	built from what the reader acknowledged instead, not from the slot
+//	that was skipped.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+
+/***********************************************************
+ *  TripleBuffer
+ *
+ *  This class contains the code for the three slots of the
+ *  handed over values and the swaps of the writer and the
+ *  reader.
+ ***********************************************************/
+template <typename T>
+class TripleBuffer
+{
+public:
+	// constructor
+	TripleBuffer() :
+		m_front(0),
+		m_middle(1),
+		m_back(2)
+	{
+	}
+
+	// slot the writer fills, owned by the writing thread
+	T& GetBack() { return(m_slots[m_back]); }
+	// slot the reader was last handed, owned by the reading thread
+	const T& GetFront() const { return(m_slots[m_front]); }
+
+	/***********************************************************
+	 *  Publish()
+	 *
+	 *  This method is used for handing the filled back slot to
+	 *  the reader.  Returns true when the value published before
+	 *  was never taken, in which case the new back slot still
+	 *  holds it.
+	 ***********************************************************/
+	bool Publish()
+	{
+		unsigned int previous = m_middle.exchange(m_back | FRESH_FLAG, std::memory_order_acq_rel);
+		m_back = previous & INDEX_MASK;
+		return((previous & FRESH_FLAG) != 0);
+	}
+
+	/***********************************************************
+	 *  Acquire()
+	 *
+	 *  This method is used for taking the newest published value
+	 *  into the front slot.  Returns false when nothing was
+	 *  published since the last call, so the front slot keeps
+	 *  the value it had.
+	 ***********************************************************/
+	bool Acquire()
+	{
+		if ((m_middle.load(std::memory_order_relaxed) & FRESH_FLAG) == 0)
+		{
+			return(false);
+		}
+
+		unsigned int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = previous & INDEX_MASK;
+		return(true);
+	}
+
+private:
+	// the slot index is kept in the low bits of the middle index,
+	// next to the flag of an untaken value
+	enum
+	{
+		INDEX_MASK = 3,
+		FRESH_FLAG = 4
+	};
+
+	T m_slots[3];
+	// front slot of the reader
+	unsigned int m_front;
+	// slot between the threads, with the flag of an untaken value
+	std::atomic<unsigned int> m_middle;
+	// back slot of the writer
+	unsigned int m_back;
+};
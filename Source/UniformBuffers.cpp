@@ -0,0 +1,284 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniformbuffers.cpp
+// ============
+// manage the uniform buffer objects that hold the camera and lighting values
+// shared by every shader program
+///////////////////////////////////////////////////////////////////////////////
+
+#include "UniformBuffers.h"
+#include "BufferUpload.h"
+#include "FrameProfiler.h"
+
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables and defines
+namespace
+{
+	const char* g_FrameBlockName = "FrameData";
+	const char* g_LightBlockName = "LightData";
+	const char* g_MaterialBlockName = "MaterialData";
+	const char* g_TextureBlockName = "TextureData";
+	const char* g_ShadowBlockName = "ShadowData";
+
+	// the sizes of the std140 blocks in the shaders
+	static_assert(sizeof(UniformBuffers::FRAME_DATA) == 224, "FrameData layout mismatch");
+	static_assert(sizeof(UniformBuffers::DIRECTIONAL_LIGHT) == 64, "DirectionalLight layout mismatch");
+	static_assert(sizeof(UniformBuffers::SPOT_LIGHT) == 96, "SpotLight layout mismatch");
+	static_assert(sizeof(UniformBuffers::LIGHT_DATA) == 160, "LightData layout mismatch");
+	static_assert(sizeof(UniformBuffers::MATERIAL) == 48, "Material layout mismatch");
+	static_assert(sizeof(UniformBuffers::TEXTURE_ENTRY) == 16, "TextureEntry layout mismatch");
+	static_assert(sizeof(UniformBuffers::SHADOW_DATA) == 240, "ShadowData layout mismatch");
+}
+
+/***********************************************************
+ *  UniformBuffers()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+UniformBuffers::UniformBuffers()
+{
+	m_frameBuffer = 0;
+	m_lightBuffer = 0;
+	m_materialBuffer = 0;
+	m_textureBuffer = 0;
+	m_shadowBuffer = 0;
+	m_bFrameDataStreamed = false;
+
+	// every light starts inactive
+	memset((void*)&m_frameData, 0, sizeof(m_frameData));
+	memset((void*)&m_lightData, 0, sizeof(m_lightData));
+	m_frameData.view = glm::mat4(1.0f);
+	m_frameData.projection = glm::mat4(1.0f);
+	m_frameData.inverseViewProjection = glm::mat4(1.0f);
+	m_bLightDataChanged = true;
+
+	// no texture is resident until it is loaded
+	for (int i = 0; i < TOTAL_TEXTURES; i++)
+	{
+		m_textureData.textures[i].handle[0] = 0;
+		m_textureData.textures[i].handle[1] = 0;
+		m_textureData.textures[i].arrayIndex = -1;
+		m_textureData.textures[i].layer = 0;
+	}
+	m_bTextureDataChanged = true;
+
+	// nothing casts a shadow until the shadow maps are created
+	memset((void*)&m_shadowData, 0, sizeof(m_shadowData));
+	m_shadowData.pointShadowIndex = -1;
+	m_bShadowDataChanged = true;
+}
+
+/***********************************************************
+ *  ~UniformBuffers()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+UniformBuffers::~UniformBuffers()
+{
+	if (0 != m_frameBuffer)
+	{
+		glDeleteBuffers(1, &m_frameBuffer);
+		m_frameBuffer = 0;
+	}
+	if (0 != m_lightBuffer)
+	{
+		glDeleteBuffers(1, &m_lightBuffer);
+		m_lightBuffer = 0;
+	}
+	if (0 != m_materialBuffer)
+	{
+		glDeleteBuffers(1, &m_materialBuffer);
+		m_materialBuffer = 0;
+	}
+	if (0 != m_textureBuffer)
+	{
+		glDeleteBuffers(1, &m_textureBuffer);
+		m_textureBuffer = 0;
+	}
+	if (0 != m_shadowBuffer)
+	{
+		glDeleteBuffers(1, &m_shadowBuffer);
+		m_shadowBuffer = 0;
+	}
+}
+
+/***********************************************************
+ *  CreateBuffers()
+ *
+ *  This method is used for creating the uniform buffers and
+ *  attaching them to the binding points of their blocks.
+ ***********************************************************/
+void UniformBuffers::CreateBuffers()
+{
+	glGenBuffers(1, &m_frameBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FRAME_DATA), &m_frameData, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_FRAME_DATA, m_frameBuffer);
+
+	glGenBuffers(1, &m_lightBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_lightBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LIGHT_DATA), &m_lightData, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_LIGHT_DATA, m_lightBuffer);
+
+	glGenBuffers(1, &m_materialBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(MATERIAL_DATA), NULL, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_MATERIAL_DATA, m_materialBuffer);
+
+	glGenBuffers(1, &m_textureBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_textureBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(TEXTURE_DATA), &m_textureData, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_TEXTURE_DATA, m_textureBuffer);
+	m_bTextureDataChanged = false;
+
+	glGenBuffers(1, &m_shadowBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_shadowBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SHADOW_DATA), &m_shadowData, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_SHADOW_DATA, m_shadowBuffer);
+	m_bShadowDataChanged = false;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/***********************************************************
+ *  BindProgramBlocks()
+ *
+ *  This method is used for binding the uniform blocks that a
+ *  linked shader program declares to the shared buffers.
+ *  Programs that leave a block out are skipped for it.
+ ***********************************************************/
+void UniformBuffers::BindProgramBlocks(GLuint programID) const
+{
+	GLuint blockIndex = glGetUniformBlockIndex(programID, g_FrameBlockName);
+	if (GL_INVALID_INDEX != blockIndex)
+	{
+		glUniformBlockBinding(programID, blockIndex, BINDING_FRAME_DATA);
+	}
+
+	blockIndex = glGetUniformBlockIndex(programID, g_LightBlockName);
+	if (GL_INVALID_INDEX != blockIndex)
+	{
+		glUniformBlockBinding(programID, blockIndex, BINDING_LIGHT_DATA);
+	}
+
+	blockIndex = glGetUniformBlockIndex(programID, g_MaterialBlockName);
+	if (GL_INVALID_INDEX != blockIndex)
+	{
+		glUniformBlockBinding(programID, blockIndex, BINDING_MATERIAL_DATA);
+	}
+
+	blockIndex = glGetUniformBlockIndex(programID, g_TextureBlockName);
+	if (GL_INVALID_INDEX != blockIndex)
+	{
+		glUniformBlockBinding(programID, blockIndex, BINDING_TEXTURE_DATA);
+	}
+
+	blockIndex = glGetUniformBlockIndex(programID, g_ShadowBlockName);
+	if (GL_INVALID_INDEX != blockIndex)
+	{
+		glUniformBlockBinding(programID, blockIndex, BINDING_SHADOW_DATA);
+	}
+}
+
+/***********************************************************
+ *  UploadBuffers()
+ *
+ *  This method is used for writing the block values into
+ *  the uniform buffers before the frame is drawn.  The frame
+ *  values change every frame, so they go into a range of the
+ *  passed in stream buffer that the frame block is bound to, and into
+ *  their own buffer when the stream buffer has no room.
+ ***********************************************************/
+void UniformBuffers::UploadBuffers(StreamBuffer* pStreamBuffer)
+{
+	if (0 == m_frameBuffer)
+	{
+		return;
+	}
+
+	StreamBuffer::STREAM_RANGE range;
+	if ((NULL != pStreamBuffer) && pStreamBuffer->Allocate(sizeof(FRAME_DATA), range))
+	{
+		memcpy(range.pData, &m_frameData, sizeof(FRAME_DATA));
+		glBindBufferRange(GL_UNIFORM_BUFFER, BINDING_FRAME_DATA, pStreamBuffer->GetBuffer(), range.offset, range.size);
+		m_bFrameDataStreamed = true;
+	}
+	else
+	{
+		if (m_bFrameDataStreamed)
+		{
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_FRAME_DATA, m_frameBuffer);
+			m_bFrameDataStreamed = false;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, m_frameBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FRAME_DATA), &m_frameData);
+		FrameProfiler::CountUniformUpload(sizeof(FRAME_DATA));
+	}
+
+	if (m_bLightDataChanged)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_lightBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LIGHT_DATA), &m_lightData);
+		FrameProfiler::CountUniformUpload(sizeof(LIGHT_DATA));
+		m_bLightDataChanged = false;
+	}
+
+	if (m_bTextureDataChanged)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_textureBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(TEXTURE_DATA), &m_textureData);
+		FrameProfiler::CountUniformUpload(sizeof(TEXTURE_DATA));
+		m_bTextureDataChanged = false;
+	}
+
+	if (m_bShadowDataChanged)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_shadowBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SHADOW_DATA), &m_shadowData);
+		FrameProfiler::CountUniformUpload(sizeof(SHADOW_DATA));
+		m_bShadowDataChanged = false;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/***********************************************************
+ *  UploadMaterials()
+ *
+ *  This method is used for writing the object materials into
+ *  the material buffer, where the shaders read them by the
+ *  material index of each drawn part.
+ ***********************************************************/
+void UniformBuffers::UploadMaterials(const MATERIAL* pMaterials, int count)
+{
+	if (0 == m_materialBuffer)
+	{
+		return;
+	}
+
+	if (count > TOTAL_MATERIALS)
+	{
+		std::cout << "Only " << TOTAL_MATERIALS << " of " << count << " materials fit in the material buffer" << std::endl;
+		count = TOTAL_MATERIALS;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(MATERIAL), pMaterials);
+	FrameProfiler::CountUniformUpload(count * sizeof(MATERIAL));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/***********************************************************
+ *  UpdateMaterials()
+ *
+ *  This method is used for writing the changed materials
+ *  into the material buffer, with one write for every run
+ *  of neighboring materials.  The indices are sorted in
+ *  place.
+ ***********************************************************/
+void UniformBuffers::UpdateMaterials(const MATERIAL* pMaterials, std::vector<int>& indices)
+{
+	BufferUpload::WriteChangedElements(GL_UNIFORM_BUFFER, m_materialBuffer,
+		pMaterials, sizeof(MATERIAL), TOTAL_MATERIALS, indices);
+}
@@ -0,0 +1,205 @@
+///////////////////////////////////////////////////////////////////////////////
+// uniformbuffers.h
+// ============
+// manage the uniform buffer objects that hold the camera and lighting values
+// shared by every shader program
+//
+//	The structures below mirror the std140 layout of the uniform blocks
+//	declared in the shaders, so each block is written with one buffer
+//	update.  Any change to a block in the shaders must be made here too.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "StreamBuffer.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+#include <vector>
+
+// number of materials in the material block of the shaders
+#define TOTAL_MATERIALS 32
+// number of textures in the texture block of the shaders
+#define TOTAL_TEXTURES 256
+// number of shadow cascades of the directional light
+#define SHADOW_CASCADES 3
+
+/***********************************************************
+ *  UniformBuffers
+ *
+ *  This class contains the code for creating the uniform
+ *  buffers, binding the uniform blocks of shader programs
+ *  to them, and uploading the changed values once per frame.
+ ***********************************************************/
+class UniformBuffers
+{
+public:
+	// constructor
+	UniformBuffers();
+	// destructor
+	~UniformBuffers();
+
+	// binding points of the uniform blocks
+	enum BLOCK_BINDING
+	{
+		BINDING_FRAME_DATA = 0,
+		BINDING_LIGHT_DATA = 1,
+		BINDING_MATERIAL_DATA = 2,
+		BINDING_TEXTURE_DATA = 3,
+		BINDING_SHADOW_DATA = 4
+	};
+
+	// std140 layout of the FrameData block
+	struct FRAME_DATA
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 viewPosition;
+		float padding;
+		// width, height, near plane, far plane
+		glm::vec4 viewport;
+		// inverse of the projection and view, for rebuilding the
+		// world position from the depth
+		glm::mat4 inverseViewProjection;
+	};
+
+	// std140 layout of the DirectionalLight structure
+	struct DIRECTIONAL_LIGHT
+	{
+		glm::vec3 direction;
+		float padding0;
+		glm::vec3 ambient;
+		float padding1;
+		glm::vec3 diffuse;
+		float padding2;
+		glm::vec3 specular;
+		int bActive;
+	};
+
+	// std140 layout of the SpotLight structure
+	struct SPOT_LIGHT
+	{
+		glm::vec3 position;
+		float padding0;
+		glm::vec3 direction;
+		float cutOff;
+		float outerCutOff;
+		float constant;
+		float linear;
+		float quadratic;
+		glm::vec3 ambient;
+		float padding1;
+		glm::vec3 diffuse;
+		float padding2;
+		glm::vec3 specular;
+		int bActive;
+	};
+
+	// std140 layout of the LightData block - the point lights
+	// are held by the light clusters
+	struct LIGHT_DATA
+	{
+		DIRECTIONAL_LIGHT directionalLight;
+		SPOT_LIGHT spotLight;
+	};
+
+	// std140 layout of the Material structure
+	struct MATERIAL
+	{
+		glm::vec3 diffuseColor;
+		float padding0;
+		glm::vec3 specularColor;
+		float padding1;
+		glm::vec3 emissiveColor;
+		float shininess;
+	};
+
+	// std140 layout of the MaterialData block
+	struct MATERIAL_DATA
+	{
+		MATERIAL materials[TOTAL_MATERIALS];
+	};
+
+	// std140 layout of the TextureEntry structure - the handle
+	// is used with bindless textures, the array and layer with
+	// texture arrays, and a texture that is not resident yet
+	// has a zero handle and an array index of -1
+	struct TEXTURE_ENTRY
+	{
+		uint32_t handle[2];
+		int arrayIndex;
+		int layer;
+	};
+
+	// std140 layout of the TextureData block
+	struct TEXTURE_DATA
+	{
+		TEXTURE_ENTRY textures[TOTAL_TEXTURES];
+	};
+
+	// std140 layout of the ShadowData block - the cascade
+	// matrices move world positions into shadow map coordinates,
+	// and a light index of -1 means no point light casts a shadow
+	struct SHADOW_DATA
+	{
+		glm::mat4 cascadeMatrices[SHADOW_CASCADES];
+		// far view depth of every cascade
+		glm::vec4 cascadeSplits;
+		// position and range of the shadow casting point light
+		glm::vec4 pointShadowLight;
+		int cascadeCount;
+		int pointShadowIndex;
+		int padding[2];
+	};
+
+	// create the uniform buffers and attach them to their
+	// binding points
+	void CreateBuffers();
+	// bind the uniform blocks of a linked shader program to
+	// the shared buffers
+	void BindProgramBlocks(GLuint programID) const;
+
+	// values of the blocks - the frame values are uploaded
+	// every frame, the light, texture and shadow values only
+	// after they change
+	FRAME_DATA& GetFrameData() { return m_frameData; }
+	LIGHT_DATA& GetLightData() { m_bLightDataChanged = true; return m_lightData; }
+	// read the light values without marking them changed
+	const LIGHT_DATA& GetLightData() const { return m_lightData; }
+	TEXTURE_DATA& GetTextureData() { m_bTextureDataChanged = true; return m_textureData; }
+	SHADOW_DATA& GetShadowData() { m_bShadowDataChanged = true; return m_shadowData; }
+
+	// write the values of the blocks into the buffers, the frame
+	// values into a range of the passed in stream buffer of the
+	// drawing scene when it has room
+	void UploadBuffers(StreamBuffer* pStreamBuffer);
+	// write the object materials into the material buffer - the
+	// materials do not change while rendering, so this is only
+	// done when they are defined
+	void UploadMaterials(const MATERIAL* pMaterials, int count);
+	// write only the materials with the passed in indices, for
+	// the materials that are animated
+	void UpdateMaterials(const MATERIAL* pMaterials, std::vector<int>& indices);
+
+private:
+	// buffer objects of the blocks
+	GLuint m_frameBuffer;
+	GLuint m_lightBuffer;
+	GLuint m_materialBuffer;
+	GLuint m_textureBuffer;
+	GLuint m_shadowBuffer;
+	// values of the blocks
+	FRAME_DATA m_frameData;
+	LIGHT_DATA m_lightData;
+	TEXTURE_DATA m_textureData;
+	SHADOW_DATA m_shadowData;
+	// whether the values changed since the last upload
+	bool m_bLightDataChanged;
+	bool m_bTextureDataChanged;
+	bool m_bShadowDataChanged;
+	// whether the frame block is bound to a range of a stream
+	// buffer
+	bool m_bFrameDataStreamed;
+};
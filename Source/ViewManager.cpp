@@ -14,14 +14,18 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>    
 
+#include <algorithm>
+
 // declarations for the global variables and defines
 namespace
 {
 	// Variables for window width and height
 	const int WINDOW_WIDTH = 1000;
 	const int WINDOW_HEIGHT = 800;
-	const char* g_ViewName = "view";
-	const char* g_ProjectionName = "projection";
+
+	// clipping planes of the perspective and orthographic views
+	const float g_NearPlane = 0.1f;
+	const float g_FarPlane = 100.0f;
 
 	// camera object used for viewing and interacting with
 	// the 3D scene
@@ -39,6 +43,27 @@ namespace
 	// the following variable is false when orthographic projection
 	// is off and true when it is on
 	bool bOrthographicProjection = false;
+
+	// a key of the scene and the key state bit it is recorded in
+	struct KEY_BINDING
+	{
+		int key;
+		unsigned int input;
+	};
+
+	/***********************************************************
+	 *  AddAtomic()
+	 *
+	 *  This function is used for adding to a value shared with
+	 *  another thread, which has no atomic add for doubles.
+	 ***********************************************************/
+	void AddAtomic(std::atomic<double>& value, double amount)
+	{
+		double current = value.load(std::memory_order_relaxed);
+		while (!value.compare_exchange_weak(current, current + amount, std::memory_order_relaxed))
+		{
+		}
+	}
 }
 
 /***********************************************************
@@ -51,7 +76,27 @@ ViewManager::ViewManager(
 {
 	// initialize the member variables
 	m_pShaderManager = pShaderManager;
+	m_pUniformBuffers = NULL;
 	m_pWindow = NULL;
+	m_viewMatrix = glm::mat4(1.0f);
+	m_projectionMatrix = glm::mat4(1.0f);
+	m_bDepthPrePass = true;
+	m_bDeferred = false;
+	m_bProfilerOverlay = false;
+	m_bDynamicResolution = true;
+	m_bOcclusionCulling = true;
+	m_keysDown = 0;
+	m_keysPressed = 0;
+	m_mouseOffsetX = 0.0;
+	m_mouseOffsetY = 0.0;
+	m_scrollOffset = 0.0;
+	m_viewWidth = WINDOW_WIDTH;
+	m_viewHeight = WINDOW_HEIGHT;
+	m_renderWidth = WINDOW_WIDTH;
+	m_renderHeight = WINDOW_HEIGHT;
+	m_bMinimized = false;
+	m_bOffscreen = false;
+	m_bScripted = false;
 	g_pCamera = new Camera();
 	// default camera view parameters
 	g_pCamera->Position = glm::vec3(0.0f, 5.8f, 9.0f);
@@ -59,6 +104,7 @@ ViewManager::ViewManager(
 	g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
 	g_pCamera->Zoom = 80;
 	g_pCamera->MovementSpeed = 20;
+	GetViewState(m_viewState);
 }
 
 /***********************************************************
@@ -70,6 +116,7 @@ ViewManager::~ViewManager()
 {
 	// free up allocated memory
 	m_pShaderManager = NULL;
+	m_pUniformBuffers = NULL;
 	m_pWindow = NULL;
 	if (NULL != g_pCamera)
 	{
@@ -107,6 +154,28 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
 	// this callback is used to receive mouse scroll wheel events
 	glfwSetScrollCallback(window, &ViewManager::Mouse_Scroll_Wheel_Callback);
 
+	// this callback is used to follow the window when it is resized,
+	// which reaches this object through the window user pointer
+	glfwSetWindowUserPointer(window, this);
+	glfwSetFramebufferSizeCallback(window, &ViewManager::Framebuffer_Size_Callback);
+
+	// this callback is used to record the keys, which are read by
+	// the simulation at its own rate
+	glfwSetKeyCallback(window, &ViewManager::Key_Callback);
+
+	// the framebuffer can be larger than the window on high density
+	// displays, so the view starts at the size of the framebuffer
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	if ((framebufferWidth > 0) && (framebufferHeight > 0))
+	{
+		m_viewWidth = framebufferWidth;
+		m_viewHeight = framebufferHeight;
+		m_renderWidth = framebufferWidth;
+		m_renderHeight = framebufferHeight;
+	}
+
 	// tell GLFW to capture all mouse events
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -119,14 +188,64 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
 	return(window);
 }
 
+/***********************************************************
+ *  CreateOffscreenWindow()
+ *
+ *  This method is used to create a hidden window that only
+ *  holds the OpenGL context, for views that are drawn into
+ *  a framebuffer object of the passed in size.  Mouse input
+ *  is not captured and vsync is turned off.
+ ***********************************************************/
+GLFWwindow* ViewManager::CreateOffscreenWindow(const char* windowTitle, int width, int height)
+{
+	GLFWwindow* window = nullptr;
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	window = glfwCreateWindow(
+		WINDOW_WIDTH,
+		WINDOW_HEIGHT,
+		windowTitle,
+		NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return NULL;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+
+	// enable blending for supporting tranparent rendering
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	m_pWindow = window;
+	m_viewWidth = width;
+	m_viewHeight = height;
+	m_renderWidth = width;
+	m_renderHeight = height;
+	m_bOffscreen = true;
+	m_bScripted = true;
+
+	return(window);
+}
+
 /***********************************************************
  *  Mouse_Position_Callback()
  *
  *  This method is automatically called from GLFW whenever
  *  the mouse is moved within the active GLFW display window.
+ *  The movement is added up until the simulation moves the
+ *  camera by it.
  ***********************************************************/
 void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos, double yMousePos)
 {
+	ViewManager* pViewManager = (ViewManager*)glfwGetWindowUserPointer(window);
+	if (NULL == pViewManager)
+	{
+		return;
+	}
+
 	// when the first mouse move event is received, this needs to be recorded so that
 	// all subsequent mouse moves can correctly calculate the X position offset and Y
 	// position offset for proper operation
@@ -145,8 +264,9 @@ void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos,
 	gLastX = xMousePos;
 	gLastY = yMousePos;
 
-	// move the 3D camera according to the calculated offsets
-	g_pCamera->ProcessMouseMovement(xOffset, yOffset);
+	// record the offsets for moving the 3D camera accordingly
+	AddAtomic(pViewManager->m_mouseOffsetX, xOffset);
+	AddAtomic(pViewManager->m_mouseOffsetY, yOffset);
 }
 
 /***********************************************************
@@ -157,24 +277,172 @@ void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos,
  ***********************************************************/
 void ViewManager::Mouse_Scroll_Wheel_Callback(GLFWwindow* window, double x, double yScrollDistance)
 {
-	// call the camera method to handle the mouse wheel scrolling
-	g_pCamera->ProcessMouseScroll(yScrollDistance);
+	ViewManager* pViewManager = (ViewManager*)glfwGetWindowUserPointer(window);
+	if (NULL == pViewManager)
+	{
+		return;
+	}
+
+	// record the scrolling for the camera to zoom by
+	AddAtomic(pViewManager->m_scrollOffset, yScrollDistance);
+}
+
+/***********************************************************
+ *  Key_Callback()
+ *
+ *  This method is automatically called from GLFW whenever a
+ *  key is pressed or released within the active GLFW display
+ *  window.  The keys of the scene are kept as held down, and
+ *  a press is kept until the simulation reads it, so a key
+ *  tapped between two simulation steps is not missed.
+ ***********************************************************/
+void ViewManager::Key_Callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	ViewManager* pViewManager = (ViewManager*)glfwGetWindowUserPointer(window);
+	if (NULL == pViewManager)
+	{
+		return;
+	}
+
+	static const KEY_BINDING keyBindings[] =
+	{
+		{ GLFW_KEY_ESCAPE, INPUT_EXIT },
+		{ GLFW_KEY_W, INPUT_FORWARD },
+		{ GLFW_KEY_S, INPUT_BACKWARD },
+		{ GLFW_KEY_A, INPUT_LEFT },
+		{ GLFW_KEY_D, INPUT_RIGHT },
+		{ GLFW_KEY_Q, INPUT_UP },
+		{ GLFW_KEY_E, INPUT_DOWN },
+		{ GLFW_KEY_1, INPUT_VIEW_FRONT },
+		{ GLFW_KEY_2, INPUT_VIEW_SIDE },
+		{ GLFW_KEY_3, INPUT_VIEW_TOP },
+		{ GLFW_KEY_4, INPUT_VIEW_PERSPECTIVE },
+		{ GLFW_KEY_Z, INPUT_DEPTH_PREPASS },
+		{ GLFW_KEY_R, INPUT_DEFERRED },
+		{ GLFW_KEY_P, INPUT_PROFILER_OVERLAY },
+		{ GLFW_KEY_V, INPUT_DYNAMIC_RESOLUTION },
+		{ GLFW_KEY_O, INPUT_OCCLUSION_CULLING }
+	};
+
+	for (size_t i = 0; i < sizeof(keyBindings) / sizeof(keyBindings[0]); i++)
+	{
+		if (keyBindings[i].key != key)
+		{
+			continue;
+		}
+
+		if (action == GLFW_PRESS)
+		{
+			pViewManager->m_keysDown.fetch_or(keyBindings[i].input);
+			pViewManager->m_keysPressed.fetch_or(keyBindings[i].input);
+		}
+		else if (action == GLFW_RELEASE)
+		{
+			pViewManager->m_keysDown.fetch_and(~keyBindings[i].input);
+		}
+	}
+}
+
+/***********************************************************
+ *  Framebuffer_Size_Callback()
+ *
+ *  This method is automatically called from GLFW whenever
+ *  the framebuffer of the display window changes size.  The
+ *  viewport and the projection follow the new size, and a
+ *  minimized window keeps its last size so nothing is drawn
+ *  or divided by a size of zero.
+ ***********************************************************/
+void ViewManager::Framebuffer_Size_Callback(GLFWwindow* window, int width, int height)
+{
+	ViewManager* pViewManager = (ViewManager*)glfwGetWindowUserPointer(window);
+	if (NULL == pViewManager)
+	{
+		return;
+	}
+
+	pViewManager->m_bMinimized = ((width <= 0) || (height <= 0));
+	if (pViewManager->m_bMinimized)
+	{
+		return;
+	}
+
+	pViewManager->m_viewWidth = width;
+	pViewManager->m_viewHeight = height;
+	pViewManager->m_renderWidth = width;
+	pViewManager->m_renderHeight = height;
+	glViewport(0, 0, width, height);
+}
+
+/***********************************************************
+ *  SetRenderSize()
+ *
+ *  This method is used for setting the size the view is
+ *  drawn at in the next frame, for the light clusters that
+ *  are split over the drawn pixels.
+ ***********************************************************/
+void ViewManager::SetRenderSize(int width, int height)
+{
+	m_renderWidth = std::max(1, width);
+	m_renderHeight = std::max(1, height);
 }
 
 /***********************************************************
  *  ProcessKeyboardEvents()
  *
- *  This method is called to process any keyboard events
- *  that may be waiting in the event queue.
+ *  This method is called to process the keys recorded by
+ *  the keyboard callback since the last simulation step.
  ***********************************************************/
 void ViewManager::ProcessKeyboardEvents()
 {
+	// keys held down move the camera, while a press since the
+	// last step toggles a setting once
+	unsigned int keysPressed = m_keysPressed.exchange(0);
+	unsigned int keysDown = m_keysDown.load() | keysPressed;
+
 	// close the window if the escape key has been pressed
-	if (glfwGetKey(m_pWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_EXIT))
 	{
 		glfwSetWindowShouldClose(m_pWindow, true);
 	}
 
+	// toggle the depth pre-pass once per key press, to compare
+	// the frame times with and without it
+	if (0 != (keysPressed & INPUT_DEPTH_PREPASS))
+	{
+		m_bDepthPrePass = !m_bDepthPrePass;
+		std::cout << "Depth pre-pass " << (m_bDepthPrePass ? "on" : "off") << std::endl;
+	}
+
+	// switch between the forward and the deferred path the same
+	// way, to find the faster one for the scene
+	if (0 != (keysPressed & INPUT_DEFERRED))
+	{
+		m_bDeferred = !m_bDeferred;
+		std::cout << (m_bDeferred ? "Deferred" : "Forward") << " rendering" << std::endl;
+	}
+
+	// toggle the profiler overlay the same way
+	if (0 != (keysPressed & INPUT_PROFILER_OVERLAY))
+	{
+		m_bProfilerOverlay = !m_bProfilerOverlay;
+	}
+
+	// toggle the dynamic resolution the same way, to compare the
+	// look and frame times against the full size of the window
+	if (0 != (keysPressed & INPUT_DYNAMIC_RESOLUTION))
+	{
+		m_bDynamicResolution = !m_bDynamicResolution;
+		std::cout << "Dynamic resolution " << (m_bDynamicResolution ? "on" : "off") << std::endl;
+	}
+
+	// toggle the occlusion culling the same way, to compare the
+	// frame times and check that no visible part goes missing
+	if (0 != (keysPressed & INPUT_OCCLUSION_CULLING))
+	{
+		m_bOcclusionCulling = !m_bOcclusionCulling;
+		std::cout << "Occlusion culling " << (m_bOcclusionCulling ? "on" : "off") << std::endl;
+	}
+
 	// if the camera object is null, then exit this method
 	if (NULL == g_pCamera)
 	{
@@ -182,38 +450,96 @@ void ViewManager::ProcessKeyboardEvents()
 	}
 
 	// process camera zooming in and out
-	if (glfwGetKey(m_pWindow, GLFW_KEY_W) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_FORWARD))
 	{
 		g_pCamera->ProcessKeyboard(FORWARD, gDeltaTime);
 	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_S) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_BACKWARD))
 	{
 		g_pCamera->ProcessKeyboard(BACKWARD, gDeltaTime);
 	}
 
 	// process camera panning left and right
-	if (glfwGetKey(m_pWindow, GLFW_KEY_A) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_LEFT))
 	{
 		g_pCamera->ProcessKeyboard(LEFT, gDeltaTime);
 	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_D) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_RIGHT))
 	{
 		g_pCamera->ProcessKeyboard(RIGHT, gDeltaTime);
 	}
 
 	// process camera panning up and down
-	if (glfwGetKey(m_pWindow, GLFW_KEY_Q) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_UP))
 	{
 		g_pCamera->ProcessKeyboard(UP, gDeltaTime);
 	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_E) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_DOWN))
 	{
 		g_pCamera->ProcessKeyboard(DOWN, gDeltaTime);
 	}
 
 	// change between different projection views
-	if (glfwGetKey(m_pWindow, GLFW_KEY_1) == GLFW_PRESS)
+	if (0 != (keysDown & INPUT_VIEW_FRONT))
+	{
+		SetViewPreset(VIEW_FRONT);
+	}
+	if (0 != (keysDown & INPUT_VIEW_SIDE))
 	{
+		SetViewPreset(VIEW_SIDE);
+	}
+	if (0 != (keysDown & INPUT_VIEW_TOP))
+	{
+		SetViewPreset(VIEW_TOP);
+	}
+	if (0 != (keysDown & INPUT_VIEW_PERSPECTIVE))
+	{
+		SetViewPreset(VIEW_PERSPECTIVE);
+	}
+}
+
+/***********************************************************
+ *  ProcessMouseEvents()
+ *
+ *  This method is called to move the camera by the mouse
+ *  movement and scrolling recorded since the last step.
+ ***********************************************************/
+void ViewManager::ProcessMouseEvents()
+{
+	double xOffset = m_mouseOffsetX.exchange(0.0);
+	double yOffset = m_mouseOffsetY.exchange(0.0);
+	double scrollOffset = m_scrollOffset.exchange(0.0);
+	if (NULL == g_pCamera)
+	{
+		return;
+	}
+
+	if ((xOffset != 0.0) || (yOffset != 0.0))
+	{
+		g_pCamera->ProcessMouseMovement((float)xOffset, (float)yOffset);
+	}
+	if (scrollOffset != 0.0)
+	{
+		g_pCamera->ProcessMouseScroll((float)scrollOffset);
+	}
+}
+
+/***********************************************************
+ *  SetViewPreset()
+ *
+ *  This method is used for moving the camera to one of the
+ *  fixed views that the number keys switch between.
+ ***********************************************************/
+void ViewManager::SetViewPreset(VIEW_PRESET preset)
+{
+	if (NULL == g_pCamera)
+	{
+		return;
+	}
+
+	switch (preset)
+	{
+	case VIEW_FRONT:
 		// change to a multi-view orthographic projection
 		bOrthographicProjection = true;
 
@@ -221,9 +547,8 @@ void ViewManager::ProcessKeyboardEvents()
 		g_pCamera->Position = glm::vec3(0.0f, 4.0f, 10.0f);
 		g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
 		g_pCamera->Front = glm::vec3(0.0f, 0.0f, -1.0f);
-	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_2) == GLFW_PRESS)
-	{
+		break;
+	case VIEW_SIDE:
 		// change to a multi-view orthographic projection
 		bOrthographicProjection = true;
 
@@ -231,9 +556,8 @@ void ViewManager::ProcessKeyboardEvents()
 		g_pCamera->Position = glm::vec3(10.0f, 4.0f, 0.0f);
 		g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
 		g_pCamera->Front = glm::vec3(-1.0f, 0.0f, 0.0f);
-	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_3) == GLFW_PRESS)
-	{
+		break;
+	case VIEW_TOP:
 		// change to a multi-view orthographic projection
 		bOrthographicProjection = true;
 
@@ -241,9 +565,8 @@ void ViewManager::ProcessKeyboardEvents()
 		g_pCamera->Position = glm::vec3(0.0f, 7.0f, 0.0f);
 		g_pCamera->Up = glm::vec3(-1.0f, 0.0f, 0.0f);
 		g_pCamera->Front = glm::vec3(0.0f, -1.0f, 0.0f);
-	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_4) == GLFW_PRESS)
-	{
+		break;
+	default:
 		// change to perspective projection
 		bOrthographicProjection = false;
 
@@ -252,7 +575,28 @@ void ViewManager::ProcessKeyboardEvents()
 		g_pCamera->Front = glm::vec3(0.0f, -0.5f, -2.0f);
 		g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
 		g_pCamera->Zoom = 80;
+		break;
+	}
+}
+
+/***********************************************************
+ *  SetCameraPose()
+ *
+ *  This method is used for placing the camera of a scripted
+ *  path in the perspective view.
+ ***********************************************************/
+void ViewManager::SetCameraPose(const glm::vec3& position, const glm::vec3& front)
+{
+	if (NULL == g_pCamera)
+	{
+		return;
 	}
+
+	bOrthographicProjection = false;
+	g_pCamera->Position = position;
+	g_pCamera->Front = glm::normalize(front);
+	g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
+	g_pCamera->Zoom = 80;
 }
 
 /***********************************************************
@@ -260,63 +604,132 @@ void ViewManager::ProcessKeyboardEvents()
  *
  *  This method is used for preparing the 3D scene by loading
  *  the shapes, textures in memory to support the 3D scene 
- *  rendering
+ *  rendering.  The view is updated and applied on the same
+ *  thread, for the scripted views that draw every frame from
+ *  a known camera.
  ***********************************************************/
 void ViewManager::PrepareSceneView()
 {
-	glm::mat4 view;
-	glm::mat4 projection;
-
 	// per-frame timing
 	float currentFrame = glfwGetTime();
-	gDeltaTime = currentFrame - gLastFrame;
+	float deltaTime = currentFrame - gLastFrame;
 	gLastFrame = currentFrame;
 
-	// process any keyboard events that may be waiting in the 
-	// event queue
-	ProcessKeyboardEvents();
+	VIEW_STATE state;
+	UpdateView(deltaTime);
+	GetViewState(state);
+	ApplyViewState(state);
+}
 
-	// get the current view matrix from the camera
-	view = g_pCamera->GetViewMatrix();
+/***********************************************************
+ *  UpdateView()
+ *
+ *  This method is used for moving the camera by the input
+ *  recorded since the last update, over the passed in time
+ *  step.  The simulation thread calls it at a fixed rate, so
+ *  the camera moves the same at any frame rate.
+ ***********************************************************/
+void ViewManager::UpdateView(float deltaTime)
+{
+	gDeltaTime = deltaTime;
+
+	// process any keyboard and mouse events that were recorded,
+	// unless the camera follows a scripted path
+	if (m_bScripted == false)
+	{
+		ProcessKeyboardEvents();
+		ProcessMouseEvents();
+	}
+}
+
+/***********************************************************
+ *  GetViewState()
+ *
+ *  This method is used for getting the camera and the view
+ *  settings after the last update, for the render thread to
+ *  draw a frame from.
+ ***********************************************************/
+void ViewManager::GetViewState(VIEW_STATE& state) const
+{
+	state.view = g_pCamera->GetViewMatrix();
+	state.position = g_pCamera->Position;
+	state.front = g_pCamera->Front;
+	state.zoom = g_pCamera->Zoom;
+	state.bOrthographic = bOrthographicProjection;
+	state.bDepthPrePass = m_bDepthPrePass;
+	state.bDeferred = m_bDeferred;
+	state.bProfilerOverlay = m_bProfilerOverlay;
+	state.bDynamicResolution = m_bDynamicResolution;
+	state.bOcclusionCulling = m_bOcclusionCulling;
+}
+
+/***********************************************************
+ *  ApplyViewState()
+ *
+ *  This method is used for building the projection of the
+ *  frame for the current size of the window, and writing the
+ *  camera values of the passed in view state into the
+ *  uniform buffers.
+ ***********************************************************/
+void ViewManager::ApplyViewState(const VIEW_STATE& state)
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+
+	m_viewState = state;
+
+	// get the view matrix of the simulated camera
+	view = state.view;
 
 	// define the current projection matrix
-	if (bOrthographicProjection == false)
+	if (state.bOrthographic == false)
 	{
 		// perspective projection
-		projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+		projection = glm::perspective(glm::radians(state.zoom), (GLfloat)m_viewWidth / (GLfloat)m_viewHeight, g_NearPlane, g_FarPlane);
 	}
 	else
 	{
 		// front-view orthographic projection with correct aspect ratio
 		double scale = 0.0;
-		if (WINDOW_WIDTH > WINDOW_HEIGHT)
+		if (m_viewWidth > m_viewHeight)
 		{
-			scale = (double)WINDOW_HEIGHT / (double)WINDOW_WIDTH;
-			projection = glm::ortho(-5.0f, 5.0f, -5.0f*(float)scale, 5.0f*(float)scale, 0.1f, 100.0f);
+			scale = (double)m_viewHeight / (double)m_viewWidth;
+			projection = glm::ortho(-5.0f, 5.0f, -5.0f*(float)scale, 5.0f*(float)scale, g_NearPlane, g_FarPlane);
 		}
-		else if (WINDOW_WIDTH < WINDOW_HEIGHT)
+		else if (m_viewWidth < m_viewHeight)
 		{
-			scale = (double)WINDOW_WIDTH / (double)WINDOW_HEIGHT;
-			projection = glm::ortho(-5.0f * (float)scale, 5.0f * (float)scale, -5.0f, 5.0f, 0.1f, 100.0f);
+			scale = (double)m_viewWidth / (double)m_viewHeight;
+			projection = glm::ortho(-5.0f * (float)scale, 5.0f * (float)scale, -5.0f, 5.0f, g_NearPlane, g_FarPlane);
 		}
 		else
 		{
-			projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+			projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, g_NearPlane, g_FarPlane);
 		}
 	}
 
-	// if the shader manager object is valid
-	if (NULL != m_pShaderManager)
+	// keep the matrices for the scene to order and cull its parts
+	m_viewMatrix = view;
+	m_projectionMatrix = projection;
+
+	// if the uniform buffers are valid
+	if (NULL != m_pUniformBuffers)
 	{
-		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ViewName, view);
-		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ProjectionName, projection);
-		// set the view position of the camera into the shader for proper rendering
-		m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
-		// attach the spotlight to the camera and aim it towards the front of the camera
-		m_pShaderManager->setVec3Value("spotLight.position", g_pCamera->Position);
-		m_pShaderManager->setVec3Value("spotLight.direction", g_pCamera->Front);
+		// set the camera values into the per-frame block, which is
+		// uploaded once for every shader program
+		UniformBuffers::FRAME_DATA& frameData = m_pUniformBuffers->GetFrameData();
+		frameData.view = view;
+		frameData.projection = projection;
+		frameData.inverseViewProjection = glm::inverse(projection * view);
+		frameData.viewPosition = state.position;
+
+		// the light clusters are split over the drawn pixels and
+		// between the clipping planes, while the projection keeps
+		// the aspect of the window
+		frameData.viewport = glm::vec4((float)m_renderWidth, (float)m_renderHeight, g_NearPlane, g_FarPlane);
 
+		// attach the spotlight to the camera and aim it towards the front of the camera
+		UniformBuffers::LIGHT_DATA& lightData = m_pUniformBuffers->GetLightData();
+		lightData.spotLight.position = state.position;
+		lightData.spotLight.direction = state.front;
 	}
-}
\ No newline at end of file
+}
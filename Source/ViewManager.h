@@ -10,14 +10,42 @@
 #pragma once
 
 #include "ShaderManager.h"
+#include "UniformBuffers.h"
 #include "camera.h"
 
 // GLFW library
 #include "GLFW/glfw3.h" 
 
+#include <atomic>
+
 class ViewManager
 {
 public:
+	// fixed camera views, switched between with the number keys
+	enum VIEW_PRESET
+	{
+		VIEW_FRONT = 0,
+		VIEW_SIDE,
+		VIEW_TOP,
+		VIEW_PERSPECTIVE
+	};
+
+	// camera and view settings of a simulated frame, handed to the
+	// render thread that builds the projection and draws from it
+	struct VIEW_STATE
+	{
+		glm::mat4 view;
+		glm::vec3 position;
+		glm::vec3 front;
+		float zoom;
+		bool bOrthographic;
+		bool bDepthPrePass;
+		bool bDeferred;
+		bool bProfilerOverlay;
+		bool bDynamicResolution;
+		bool bOcclusionCulling;
+	};
+
 	// constructor
 	ViewManager(
 		ShaderManager* pShaderManager);
@@ -30,19 +58,136 @@ public:
 	// mouse scroll wheel callback for mouse interaction with the 3D scene
 	static void Mouse_Scroll_Wheel_Callback(GLFWwindow* window, double x, double yScrollDistance);
 
+	// framebuffer size callback for following the size of the window
+	static void Framebuffer_Size_Callback(GLFWwindow* window, int width, int height);
+
+	// keyboard callback for recording the keys held down and pressed
+	static void Key_Callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+
 private:
+	// keys of the scene, as bits of the recorded key states
+	enum INPUT_KEY
+	{
+		INPUT_EXIT = 1 << 0,
+		INPUT_FORWARD = 1 << 1,
+		INPUT_BACKWARD = 1 << 2,
+		INPUT_LEFT = 1 << 3,
+		INPUT_RIGHT = 1 << 4,
+		INPUT_UP = 1 << 5,
+		INPUT_DOWN = 1 << 6,
+		INPUT_VIEW_FRONT = 1 << 7,
+		INPUT_VIEW_SIDE = 1 << 8,
+		INPUT_VIEW_TOP = 1 << 9,
+		INPUT_VIEW_PERSPECTIVE = 1 << 10,
+		INPUT_DEPTH_PREPASS = 1 << 11,
+		INPUT_DEFERRED = 1 << 12,
+		INPUT_PROFILER_OVERLAY = 1 << 13,
+		INPUT_DYNAMIC_RESOLUTION = 1 << 14,
+		INPUT_OCCLUSION_CULLING = 1 << 15
+	};
+
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
+	// pointer to the uniform buffers shared by the shaders
+	UniformBuffers* m_pUniformBuffers;
 	// active OpenGL display window
 	GLFWwindow* m_pWindow;
+	// view state and matrices the current frame is drawn with
+	VIEW_STATE m_viewState;
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	// whether the opaque depth is drawn before the lit pass,
+	// toggled with a key
+	bool m_bDepthPrePass;
+	// whether the opaque parts are drawn with the deferred path,
+	// toggled with a key
+	bool m_bDeferred;
+	// whether the profiler timings are drawn over the view,
+	// toggled with a key
+	bool m_bProfilerOverlay;
+	// whether the view is drawn at a scale that follows the
+	// frame time, toggled with a key
+	bool m_bDynamicResolution;
+	// whether the parts hidden behind the depth of the last frame
+	// are culled, toggled with a key
+	bool m_bOcclusionCulling;
+	// keys held down, and keys pressed since the simulation last
+	// read them, recorded by the event callbacks of the window
+	std::atomic<unsigned int> m_keysDown;
+	std::atomic<unsigned int> m_keysPressed;
+	// mouse movement and scrolling since the simulation last
+	// read them
+	std::atomic<double> m_mouseOffsetX;
+	std::atomic<double> m_mouseOffsetY;
+	std::atomic<double> m_scrollOffset;
+	// size of the window framebuffer in pixels
+	int m_viewWidth;
+	int m_viewHeight;
+	// size the view is drawn at in pixels, which is smaller than
+	// the window while the resolution is scaled down
+	int m_renderWidth;
+	int m_renderHeight;
+	// whether the window is minimized to a framebuffer of no size
+	bool m_bMinimized;
+	// whether the view is drawn into a framebuffer object
+	// instead of the window
+	bool m_bOffscreen;
+	// whether the camera follows a scripted path instead of
+	// the keyboard
+	bool m_bScripted;
 
 	// process keyboard events for interaction with the 3D scene
 	void ProcessKeyboardEvents();
+	// move the camera by the recorded mouse movement and scrolling
+	void ProcessMouseEvents();
 
 public:
 	// create the initial OpenGL display window
 	GLFWwindow* CreateDisplayWindow(const char* windowTitle);
+	// create a hidden window for drawing into a framebuffer
+	// object of the passed in size
+	GLFWwindow* CreateOffscreenWindow(const char* windowTitle, int width, int height);
+	// set the shared uniform buffers, once the shaders are loaded
+	void SetUniformBuffers(UniformBuffers* pUniformBuffers) { m_pUniformBuffers = pUniformBuffers; }
 	
 	// prepare the conversion from 3D object display to 2D scene display
 	void PrepareSceneView();
+
+	// move the camera by the recorded input over the passed in
+	// time step - called by the simulation thread
+	void UpdateView(float deltaTime);
+	// get the camera and view settings after the last update
+	void GetViewState(VIEW_STATE& state) const;
+	// build the matrices of the frame from a simulated view
+	// state - called by the render thread
+	void ApplyViewState(const VIEW_STATE& state);
+
+	// get the camera view values built for the current frame
+	const glm::mat4& GetViewMatrix() const { return m_viewMatrix; }
+	const glm::mat4& GetProjectionMatrix() const { return m_projectionMatrix; }
+	glm::vec3 GetViewPosition() const { return m_viewState.position; }
+	// whether the depth pre-pass is turned on
+	bool IsDepthPrePassEnabled() const { return m_viewState.bDepthPrePass; }
+	// whether the deferred path is turned on
+	bool IsDeferredEnabled() const { return m_viewState.bDeferred; }
+	// move the camera to one of the fixed views
+	void SetViewPreset(VIEW_PRESET preset);
+	// place the camera of a scripted perspective path
+	void SetCameraPose(const glm::vec3& position, const glm::vec3& front);
+
+	// whether the profiler overlay is turned on
+	bool IsProfilerOverlayEnabled() const { return m_viewState.bProfilerOverlay; }
+	// whether the resolution follows the frame time
+	bool IsDynamicResolutionEnabled() const { return m_viewState.bDynamicResolution; }
+	// whether the hidden parts are culled on the GPU
+	bool IsOcclusionCullingEnabled() const { return m_viewState.bOcclusionCulling; }
+
+	// size of the window framebuffer, kept up to date as the
+	// window is resized
+	int GetViewWidth() const { return m_viewWidth; }
+	int GetViewHeight() const { return m_viewHeight; }
+	// whether the window is minimized, so there is nothing to draw
+	bool IsMinimized() const { return m_bMinimized; }
+	// set the size the view is drawn at in the next frame
+	void SetRenderSize(int width, int height);
 };
\ No newline at end of file
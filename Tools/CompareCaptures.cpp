@@ -0,0 +1,144 @@
+///////////////////////////////////////////////////////////////////////////////
+// comparecaptures.cpp
+// ============
+// offline tool that compares the last frames two benchmark runs captured,
+// to check that a change to the shaders keeps the image the same
+//
+//	Usage: CompareCaptures <reference.ppm> <capture.ppm> [<threshold>]
+//	Run the benchmark of both builds with the same options and --capture,
+//	then compare the two images.  The largest and mean channel difference,
+//	the PSNR and the share of pixels that differ by more than the threshold
+//	(8 by default) are printed, and the tool fails when that share is above
+//	one percent.  A small difference is expected, since the compiler may
+//	order the light terms differently; the flame flicker follows the time,
+//	so the flickering parts differ between any two runs.  Build it as a
+//	console program from this file alone.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// declaration of global variables and defines
+namespace
+{
+	// channel difference a pixel needs to count as changed
+	const int g_DefaultThreshold = 8;
+	// share of changed pixels the comparison still passes with
+	const double g_PassingShare = 0.01;
+
+	/***********************************************************
+	 *  ReadCapture()
+	 *
+	 *  This function is used for reading a binary PPM image as
+	 *  written by the benchmark capture.
+	 ***********************************************************/
+	bool ReadCapture(const char* filename, int& width, int& height, std::vector<unsigned char>& pixels)
+	{
+		std::ifstream file(filename, std::ios::in | std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cout << "Could not open capture file:" << filename << std::endl;
+			return(false);
+		}
+
+		std::string format;
+		int maxValue = 0;
+		file >> format >> width >> height >> maxValue;
+		// one whitespace character separates the header and pixels
+		file.get();
+		if ((format != "P6") || (width <= 0) || (height <= 0) || (maxValue != 255))
+		{
+			std::cout << "Not a benchmark capture:" << filename << std::endl;
+			return(false);
+		}
+
+		pixels.resize((size_t)width * height * 3);
+		file.read((char*)pixels.data(), pixels.size());
+		if ((size_t)file.gcount() != pixels.size())
+		{
+			std::cout << "Capture file is cut short:" << filename << std::endl;
+			return(false);
+		}
+
+		return(true);
+	}
+}
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function gets called after the tool has been
+ *  launched, and compares the two captures passed in.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: CompareCaptures <reference.ppm> <capture.ppm> [<threshold>]" << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	int threshold = (argc > 3) ? atoi(argv[3]) : g_DefaultThreshold;
+	int referenceWidth = 0;
+	int referenceHeight = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> reference;
+	std::vector<unsigned char> capture;
+	if ((ReadCapture(argv[1], referenceWidth, referenceHeight, reference) == false) ||
+		(ReadCapture(argv[2], width, height, capture) == false))
+	{
+		return(EXIT_FAILURE);
+	}
+	if ((width != referenceWidth) || (height != referenceHeight))
+	{
+		std::cout << "The captures differ in size: " << referenceWidth << "x" << referenceHeight
+			<< " and " << width << "x" << height << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	int maxDifference = 0;
+	double totalDifference = 0.0;
+	double squaredError = 0.0;
+	size_t changedPixels = 0;
+	size_t nPixels = (size_t)width * height;
+	for (size_t i = 0; i < nPixels; i++)
+	{
+		int pixelDifference = 0;
+		for (int channel = 0; channel < 3; channel++)
+		{
+			int difference = std::abs((int)reference[i * 3 + channel] - (int)capture[i * 3 + channel]);
+			pixelDifference = std::max(pixelDifference, difference);
+			totalDifference += difference;
+			squaredError += (double)difference * difference;
+		}
+		maxDifference = std::max(maxDifference, pixelDifference);
+		if (pixelDifference > threshold)
+		{
+			changedPixels++;
+		}
+	}
+
+	double meanDifference = totalDifference / (double)(nPixels * 3);
+	double meanSquaredError = squaredError / (double)(nPixels * 3);
+	double changedShare = (double)changedPixels / (double)nPixels;
+	std::cout << "max difference " << maxDifference
+		<< ", mean difference " << meanDifference << std::endl;
+	if (meanSquaredError > 0.0)
+	{
+		std::cout << "PSNR " << 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) << " dB" << std::endl;
+	}
+	else
+	{
+		std::cout << "PSNR infinite, the captures are the same" << std::endl;
+	}
+	std::cout << changedPixels << " of " << nPixels << " pixels ("
+		<< changedShare * 100.0 << "%) differ by more than " << threshold << std::endl;
+
+	return((changedShare <= g_PassingShare) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
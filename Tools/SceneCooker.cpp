@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenecooker.cpp
+// ============
+// offline tool that cooks text scene descriptions into the binary scene
+// files, which the scene manager maps and uses in place
+//
+//	Usage: SceneCooker <scene> [<scene> ...]
+//	Every scene is written next to itself with the .bin extension.  Build
+//	it as a console program from this file together with SceneFile.cpp,
+//	MappedFile.cpp and TransformBatch.cpp, with the same include paths as
+//	the scene project.  Cook again after editing a scene - the loader
+//	parses the text instead of a cooked file older than it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../Source/SceneFile.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function gets called after the tool has been
+ *  launched, and cooks every scene passed in.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: SceneCooker <scene> [<scene> ...]" << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	int nFailed = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		SceneFile scene;
+		std::string cookedName = SceneFile::GetCookedFilename(argv[i]);
+		if ((scene.LoadText(argv[i]) == false) ||
+			(scene.WriteCooked(cookedName.c_str()) == false))
+		{
+			nFailed++;
+			continue;
+		}
+
+		// map the written file again, so a bad file is caught here
+		// instead of in the scene
+		SceneFile cooked;
+		if ((cooked.LoadCooked(cookedName.c_str()) == false) ||
+			(cooked.GetPartCount() != scene.GetPartCount()))
+		{
+			std::cout << "Cooked scene file does not read back:" << cookedName << std::endl;
+			nFailed++;
+			continue;
+		}
+
+		std::cout << argv[i] << " -> " << cookedName << " ("
+			<< scene.GetPartCount() << " parts, "
+			<< scene.GetTextureCount() << " textures, "
+			<< scene.GetMaterialCount() << " materials)" << std::endl;
+	}
+
+	return((nFailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,293 @@
+///////////////////////////////////////////////////////////////////////////////
+// snapshotcheck.cpp
+// ============
+// offline tool that checks the animation changes handed from the simulation
+// to the render thread reach it whole and in order, however many snapshots
+// the render thread skips
+//
+//	Usage: SnapshotCheck [<steps>] [<seed>]
+//	The simulation steps of the frame pipeline are played with a triple
+//	buffer and a change history the same way the simulation thread uses
+//	them, without a window or a GPU.  Every step changes a random few of a
+//	handful of lights, materials and parts, and a render side takes the
+//	snapshots at random, skipping runs of them and acknowledging its steps
+//	late at times, as a render thread that lags behind does.  After every
+//	snapshot it takes, the values it applied have to match the ones of its
+//	step.  The case of an entry changed in a skipped step, changed again in
+//	a taken one and left alone after that is played first on its own.  The
+//	steps (100000 by default) and the seed of the random schedule can be
+//	passed in.  Build it as a console program from this file together with
+//	ChangeHistory.cpp and SceneAnimator.cpp, with the same include paths as
+//	the scene project.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../Source/ChangeHistory.h"
+#include "../Source/SceneAnimator.h"
+#include "../Source/TripleBuffer.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// declaration of global variables and defines
+namespace
+{
+	// steps and seed when none are passed in
+	const int g_DefaultSteps = 100000;
+	const int g_DefaultSeed = 1;
+	// animated entries of each kind
+	const int g_EntryCount = 4;
+
+	// snapshot handed to the render side
+	struct SNAPSHOT
+	{
+		long long step;
+		SceneAnimator::ANIMATION_CHANGES changes;
+	};
+
+	// values of every animated entry, as the render side holds
+	// them or as they were at a step
+	struct ENTRY_VALUES
+	{
+		float lights[g_EntryCount];
+		float materials[g_EntryCount];
+		float parts[g_EntryCount];
+	};
+
+	/***********************************************************
+	 *  SnapshotPipeline
+	 *
+	 *  This class contains the code for the simulation side of
+	 *  the frame pipeline playing its steps on one thread, and
+	 *  the render side taking them.
+	 ***********************************************************/
+	class SnapshotPipeline
+	{
+	public:
+		// constructor
+		SnapshotPipeline()
+		{
+			m_step = 0;
+			m_acknowledgedStep = -1;
+			m_bAcquired = false;
+			for (int i = 0; i < g_EntryCount; i++)
+			{
+				m_current.lights[i] = 0.0f;
+				m_current.materials[i] = 0.0f;
+				m_current.parts[i] = 0.0f;
+				m_applied.lights[i] = 0.0f;
+				m_applied.materials[i] = 0.0f;
+				m_applied.parts[i] = 0.0f;
+			}
+		}
+
+		/***********************************************************
+		 *  Step()
+		 *
+		 *  This method is used for changing the passed in entries
+		 *  to values only this step gives them, and publishing the
+		 *  snapshot of the step like the frame pipeline does.
+		 ***********************************************************/
+		void Step(const std::vector<int>& lights, const std::vector<int>& materials, const std::vector<int>& parts)
+		{
+			float value = (float)(m_step + 1);
+			SceneAnimator::ANIMATION_CHANGES changes;
+			for (size_t i = 0; i < lights.size(); i++)
+			{
+				SceneAnimator::LIGHT_CHANGE change;
+				change.lightIndex = lights[i];
+				change.ambient = glm::vec3(value);
+				change.diffuse = glm::vec3(value);
+				change.specular = glm::vec3(value);
+				changes.lights.push_back(change);
+				m_current.lights[lights[i]] = value;
+			}
+			for (size_t i = 0; i < materials.size(); i++)
+			{
+				SceneAnimator::MATERIAL_CHANGE change;
+				change.materialIndex = materials[i];
+				change.emissiveColor = glm::vec3(value);
+				changes.materials.push_back(change);
+				m_current.materials[materials[i]] = value;
+			}
+			for (size_t i = 0; i < parts.size(); i++)
+			{
+				SceneAnimator::PART_CHANGE change;
+				change.itemIndex = parts[i];
+				change.color = glm::vec4(value);
+				changes.parts.push_back(change);
+				m_current.parts[parts[i]] = value;
+			}
+			m_values.push_back(m_current);
+
+			m_history.Acknowledge(m_acknowledgedStep);
+			m_history.AddStep(m_step, changes);
+			SNAPSHOT& snapshot = m_snapshots.GetBack();
+			snapshot.step = m_step;
+			m_history.CollectChanges(snapshot.changes);
+			m_snapshots.Publish();
+			m_step++;
+		}
+
+		/***********************************************************
+		 *  Acquire()
+		 *
+		 *  This method is used for taking the newest snapshot on
+		 *  the render side and applying its changes, acknowledging
+		 *  its step right away or leaving that to Acknowledge().
+		 *  Returns false when the applied values do not match the
+		 *  ones of the step.
+		 ***********************************************************/
+		bool Acquire(bool bAcknowledge)
+		{
+			if (m_snapshots.Acquire() == false)
+			{
+				return(true);
+			}
+
+			const SNAPSHOT& snapshot = m_snapshots.GetFront();
+			for (size_t i = 0; i < snapshot.changes.lights.size(); i++)
+			{
+				m_applied.lights[snapshot.changes.lights[i].lightIndex] = snapshot.changes.lights[i].diffuse.x;
+			}
+			for (size_t i = 0; i < snapshot.changes.materials.size(); i++)
+			{
+				m_applied.materials[snapshot.changes.materials[i].materialIndex] = snapshot.changes.materials[i].emissiveColor.x;
+			}
+			for (size_t i = 0; i < snapshot.changes.parts.size(); i++)
+			{
+				m_applied.parts[snapshot.changes.parts[i].itemIndex] = snapshot.changes.parts[i].color.x;
+			}
+			m_bAcquired = true;
+			if (bAcknowledge)
+			{
+				Acknowledge();
+			}
+
+			const ENTRY_VALUES& expected = m_values[snapshot.step];
+			for (int i = 0; i < g_EntryCount; i++)
+			{
+				if ((m_applied.lights[i] != expected.lights[i]) ||
+					(m_applied.materials[i] != expected.materials[i]) ||
+					(m_applied.parts[i] != expected.parts[i]))
+				{
+					std::cout << "Entry " << i << " does not match step " << snapshot.step << std::endl;
+					return(false);
+				}
+			}
+			return(true);
+		}
+
+		// let the simulation side know the step of the snapshot
+		// taken last
+		void Acknowledge()
+		{
+			if (m_bAcquired)
+			{
+				m_acknowledgedStep = m_snapshots.GetFront().step;
+			}
+		}
+
+	private:
+		TripleBuffer<SNAPSHOT> m_snapshots;
+		ChangeHistory m_history;
+		long long m_step;
+		long long m_acknowledgedStep;
+		bool m_bAcquired;
+		// values of every step, newest last
+		std::vector<ENTRY_VALUES> m_values;
+		ENTRY_VALUES m_current;
+		// values the render side applied
+		ENTRY_VALUES m_applied;
+	};
+
+	/***********************************************************
+	 *  CheckSkippedChange()
+	 *
+	 *  This function is used for playing an entry changed in a
+	 *  skipped step A, changed again in a taken step B and left
+	 *  alone in step C, after which the render side has to hold
+	 *  the value of B.
+	 ***********************************************************/
+	bool CheckSkippedChange()
+	{
+		SnapshotPipeline pipeline;
+		std::vector<int> entry(1, 0);
+		std::vector<int> none;
+
+		// the render side takes nothing until A is skipped by B,
+		// and takes C right after it is published
+		pipeline.Step(entry, entry, entry);
+		pipeline.Step(entry, entry, entry);
+		if (pipeline.Acquire(true) == false)
+		{
+			return(false);
+		}
+		pipeline.Step(none, none, none);
+		return(pipeline.Acquire(true));
+	}
+}
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function gets called after the tool has been
+ *  launched, and plays the skipped change and the random
+ *  schedule.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	int nSteps = (argc > 1) ? atoi(argv[1]) : g_DefaultSteps;
+	int seed = (argc > 2) ? atoi(argv[2]) : g_DefaultSeed;
+	if (nSteps <= 0)
+	{
+		std::cout << "Usage: SnapshotCheck [<steps>] [<seed>]" << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	if (CheckSkippedChange() == false)
+	{
+		std::cout << "A change of a skipped snapshot overwrote a newer one" << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> entries(0, g_EntryCount - 1);
+	std::uniform_int_distribution<int> changeCounts(0, 2);
+	std::uniform_int_distribution<int> chances(0, 99);
+	std::vector<int> lights;
+	std::vector<int> materials;
+	std::vector<int> parts;
+
+	SnapshotPipeline pipeline;
+	int nTaken = 0;
+	for (int step = 0; step < nSteps; step++)
+	{
+		std::vector<int>* pLists[3] = { &lights, &materials, &parts };
+		for (int list = 0; list < 3; list++)
+		{
+			pLists[list]->clear();
+			for (int i = changeCounts(random); i > 0; i--)
+			{
+				pLists[list]->push_back(entries(random));
+			}
+		}
+		pipeline.Step(lights, materials, parts);
+
+		// the render side takes about every third snapshot, and
+		// acknowledges a quarter of them only after the next step
+		if (chances(random) < 35)
+		{
+			pipeline.Acknowledge();
+			if (pipeline.Acquire(chances(random) >= 25) == false)
+			{
+				return(EXIT_FAILURE);
+			}
+			nTaken++;
+		}
+	}
+
+	std::cout << nSteps << " steps, " << nTaken << " snapshots taken, every one matched" << std::endl;
+	return(EXIT_SUCCESS);
+}
@@ -0,0 +1,385 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecooker.cpp
+// ============
+// offline tool that cooks texture images into block-compressed .ktx files
+// with their mip chains, which the texture loader maps and uploads as is
+//
+//	Usage: TextureCooker <image> [<image> ...]
+//	Every image is written next to itself with the .ktx extension, as BC1
+//	when it has no alpha channel and BC3 otherwise.  Build it as a console
+//	program from this file, with the same stb_image include path as the
+//	scene project.  Cook again after changing an image, since the loader
+//	prefers the cooked file whenever it is there.
+///////////////////////////////////////////////////////////////////////////////
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "../Source/KtxFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// declaration of global variables and defines
+namespace
+{
+	// image being cooked, one mip level at a time
+	struct COOK_IMAGE
+	{
+		int width;
+		int height;
+		// always four channels, alpha is 255 for RGB images
+		std::vector<unsigned char> pixels;
+	};
+}
+
+/***********************************************************
+ *  DownsampleImage()
+ *
+ *  This function is used for creating the next mip level of
+ *  an image by averaging every 2x2 pixel group, clamping at
+ *  the edges of odd sized images.
+ ***********************************************************/
+static COOK_IMAGE DownsampleImage(const COOK_IMAGE& image)
+{
+	COOK_IMAGE level;
+	level.width = (image.width > 1) ? (image.width / 2) : 1;
+	level.height = (image.height > 1) ? (image.height / 2) : 1;
+	level.pixels.resize((size_t)level.width * level.height * 4);
+
+	for (int y = 0; y < level.height; y++)
+	{
+		int y0 = (y * 2 < image.height) ? (y * 2) : (image.height - 1);
+		int y1 = (y0 + 1 < image.height) ? (y0 + 1) : y0;
+		for (int x = 0; x < level.width; x++)
+		{
+			int x0 = (x * 2 < image.width) ? (x * 2) : (image.width - 1);
+			int x1 = (x0 + 1 < image.width) ? (x0 + 1) : x0;
+			for (int c = 0; c < 4; c++)
+			{
+				int sum =
+					image.pixels[((size_t)y0 * image.width + x0) * 4 + c] +
+					image.pixels[((size_t)y0 * image.width + x1) * 4 + c] +
+					image.pixels[((size_t)y1 * image.width + x0) * 4 + c] +
+					image.pixels[((size_t)y1 * image.width + x1) * 4 + c];
+				level.pixels[((size_t)y * level.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+
+	return(level);
+}
+
+/***********************************************************
+ *  PackColor565()
+ *
+ *  This function is used for packing a color into the 16-bit
+ *  endpoint format of the color blocks.
+ ***********************************************************/
+static uint16_t PackColor565(const unsigned char* pColor)
+{
+	return((uint16_t)(((pColor[0] >> 3) << 11) | ((pColor[1] >> 2) << 5) | (pColor[2] >> 3)));
+}
+
+/***********************************************************
+ *  UnpackColor565()
+ *
+ *  This function is used for expanding a 16-bit endpoint to
+ *  the 8-bit color the decoder interpolates from.
+ ***********************************************************/
+static void UnpackColor565(uint16_t packed, int* pColor)
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	pColor[0] = (r << 3) | (r >> 2);
+	pColor[1] = (g << 2) | (g >> 4);
+	pColor[2] = (b << 3) | (b >> 2);
+}
+
+/***********************************************************
+ *  EncodeColorBlock()
+ *
+ *  This function is used for encoding the colors of a 4x4
+ *  block into 8 bytes, with the endpoints at the corners of
+ *  the bounding box of the colors and every pixel set to
+ *  the nearest of the four palette colors.
+ ***********************************************************/
+static void EncodeColorBlock(const unsigned char block[16][4], unsigned char* pOutput)
+{
+	unsigned char minColor[3] = { 255, 255, 255 };
+	unsigned char maxColor[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			if (block[i][c] < minColor[c]) minColor[c] = block[i][c];
+			if (block[i][c] > maxColor[c]) maxColor[c] = block[i][c];
+		}
+	}
+
+	uint16_t color0 = PackColor565(maxColor);
+	uint16_t color1 = PackColor565(minColor);
+	uint32_t indices = 0;
+
+	// the first endpoint must be the greater one for the four
+	// color mode, a solid block uses the first endpoint only
+	if (color0 < color1)
+	{
+		uint16_t swap = color0;
+		color0 = color1;
+		color1 = swap;
+	}
+
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		UnpackColor565(color0, palette[0]);
+		UnpackColor565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestDistance = 0x7FFFFFFF;
+			for (int p = 0; p < 4; p++)
+			{
+				int distance = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int delta = block[i][c] - palette[p][c];
+					distance += delta * delta;
+				}
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					bestIndex = p;
+				}
+			}
+			indices |= (uint32_t)bestIndex << (i * 2);
+		}
+	}
+
+	pOutput[0] = (unsigned char)(color0 & 0xFF);
+	pOutput[1] = (unsigned char)(color0 >> 8);
+	pOutput[2] = (unsigned char)(color1 & 0xFF);
+	pOutput[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+	{
+		pOutput[4 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+	}
+}
+
+/***********************************************************
+ *  EncodeAlphaBlock()
+ *
+ *  This function is used for encoding the alpha values of a
+ *  4x4 block into 8 bytes, with the endpoints at the lowest
+ *  and highest alpha and every pixel set to the nearest of
+ *  the eight interpolated values.
+ ***********************************************************/
+static void EncodeAlphaBlock(const unsigned char block[16][4], unsigned char* pOutput)
+{
+	int alpha0 = 0;
+	int alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		if (block[i][3] > alpha0) alpha0 = block[i][3];
+		if (block[i][3] < alpha1) alpha1 = block[i][3];
+	}
+
+	uint64_t indices = 0;
+	if (alpha0 != alpha1)
+	{
+		int palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int p = 1; p < 7; p++)
+		{
+			palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestDistance = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int distance = abs(block[i][3] - palette[p]);
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					bestIndex = p;
+				}
+			}
+			indices |= (uint64_t)bestIndex << (i * 3);
+		}
+	}
+
+	pOutput[0] = (unsigned char)alpha0;
+	pOutput[1] = (unsigned char)alpha1;
+	for (int i = 0; i < 6; i++)
+	{
+		pOutput[2 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+	}
+}
+
+/***********************************************************
+ *  CompressLevel()
+ *
+ *  This function is used for appending the compressed blocks
+ *  of one mip level to the output data.  Blocks reaching past
+ *  the edge of the level repeat its last row and column.
+ ***********************************************************/
+static void CompressLevel(const COOK_IMAGE& level, bool bAlpha, std::vector<unsigned char>& output)
+{
+	unsigned char block[16][4];
+	for (int blockY = 0; blockY < level.height; blockY += 4)
+	{
+		for (int blockX = 0; blockX < level.width; blockX += 4)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int x = blockX + (i % 4);
+				int y = blockY + (i / 4);
+				x = (x < level.width) ? x : (level.width - 1);
+				y = (y < level.height) ? y : (level.height - 1);
+				memcpy(block[i], &level.pixels[((size_t)y * level.width + x) * 4], 4);
+			}
+
+			size_t offset = output.size();
+			output.resize(offset + (bAlpha ? 16 : 8));
+			if (bAlpha)
+			{
+				EncodeAlphaBlock(block, &output[offset]);
+				offset += 8;
+			}
+			EncodeColorBlock(block, &output[offset]);
+		}
+	}
+}
+
+/***********************************************************
+ *  CookTexture()
+ *
+ *  This function is used for cooking one image file into a
+ *  compressed .ktx file next to it.
+ ***********************************************************/
+static bool CookTexture(const std::string& filename)
+{
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+
+	// flip like the texture loader, so the cooked rows are in
+	// the same order as the uploaded raw images
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* image = stbi_load(filename.c_str(), &width, &height, &colorChannels, 4);
+	if (NULL == image)
+	{
+		std::cout << "Could not load image:" << filename << std::endl;
+		return(false);
+	}
+
+	COOK_IMAGE level;
+	level.width = width;
+	level.height = height;
+	level.pixels.assign(image, image + (size_t)width * height * 4);
+	stbi_image_free(image);
+
+	const bool bAlpha = (colorChannels == 4) || (colorChannels == 2);
+
+	KTX_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	header.endianness = KTX_ENDIANNESS;
+	header.glTypeSize = 1;
+	header.glInternalFormat = bAlpha ? KTX_FORMAT_BC3_RGBA : KTX_FORMAT_BC1_RGB;
+	header.glBaseInternalFormat = bAlpha ? KTX_BASE_FORMAT_RGBA : KTX_BASE_FORMAT_RGB;
+	header.pixelWidth = (uint32_t)width;
+	header.pixelHeight = (uint32_t)height;
+	header.numberOfFaces = 1;
+
+	// compress every level down to 1x1, each after its size
+	std::vector<unsigned char> levels;
+	std::vector<unsigned char> blocks;
+	while (true)
+	{
+		blocks.clear();
+		CompressLevel(level, bAlpha, blocks);
+
+		uint32_t imageSize = (uint32_t)blocks.size();
+		size_t offset = levels.size();
+		levels.resize(offset + sizeof(imageSize) + blocks.size());
+		memcpy(&levels[offset], &imageSize, sizeof(imageSize));
+		memcpy(&levels[offset + sizeof(imageSize)], blocks.data(), blocks.size());
+		header.numberOfMipmapLevels++;
+
+		if ((level.width == 1) && (level.height == 1))
+		{
+			break;
+		}
+		level = DownsampleImage(level);
+	}
+
+	std::string cookedName = filename;
+	size_t extension = cookedName.find_last_of("./\\");
+	if ((std::string::npos != extension) && ('.' == cookedName[extension]))
+	{
+		cookedName.erase(extension);
+	}
+	cookedName += KTX_FILE_EXTENSION;
+
+	FILE* pFile = fopen(cookedName.c_str(), "wb");
+	if (NULL == pFile)
+	{
+		std::cout << "Could not write cooked image:" << cookedName << std::endl;
+		return(false);
+	}
+	bool bWritten =
+		(fwrite(&header, sizeof(header), 1, pFile) == 1) &&
+		(fwrite(levels.data(), levels.size(), 1, pFile) == 1);
+	fclose(pFile);
+
+	if (bWritten == false)
+	{
+		std::cout << "Could not write cooked image:" << cookedName << std::endl;
+		return(false);
+	}
+
+	std::cout << "Cooked image:" << filename << " -> " << cookedName << ", levels:" << header.numberOfMipmapLevels <<
+		", " << (sizeof(header) + levels.size()) << " bytes" << std::endl;
+	return(true);
+}
+
+/***********************************************************
+ *  main()
+ *
+ *  Cook every image file passed on the command line.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: TextureCooker <image> [<image> ...]" << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	int nFailed = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (CookTexture(argv[i]) == false)
+		{
+			nFailed++;
+		}
+	}
+
+	return((0 == nFailed) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformbenchmark.cpp
+// ============
+// offline tool that times building model matrices with the batch transform
+// kernel against multiplying the five glm matrices of every object
+//
+//	Usage: TransformBenchmark [<objects>] [<repeats>]
+//	Random scales, rotations and positions are made for the objects
+//	(100000 by default), and the matrices of all of them are built the
+//	passed in number of times (20 by default) both ways.  The best time of
+//	each per object, the speedup and the largest difference between the
+//	matrices of the two ways are printed.  Build it as an optimized console
+//	program from this file together with TransformBatch.cpp, with the same
+//	include paths as the scene project, and compile both for the
+//	instruction set to measure (for example with /arch:AVX2 or -mavx2).
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../Source/TransformBatch.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// declaration of global variables and defines
+namespace
+{
+	// objects and repeats when none are passed in
+	const int g_DefaultObjects = 100000;
+	const int g_DefaultRepeats = 20;
+
+	/***********************************************************
+	 *  ComposeGlm()
+	 *
+	 *  This function is used for building the matrices the way
+	 *  the scene always has, from five glm matrices.
+	 ***********************************************************/
+	void ComposeGlm(const std::vector<float> components[9], size_t count, float* pMatrices)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::mat4 model =
+				glm::translate(glm::vec3(components[6][i], components[7][i], components[8][i])) *
+				glm::rotate(glm::radians(components[5][i]), glm::vec3(0.0f, 0.0f, 1.0f)) *
+				glm::rotate(glm::radians(components[4][i]), glm::vec3(0.0f, 1.0f, 0.0f)) *
+				glm::rotate(glm::radians(components[3][i]), glm::vec3(1.0f, 0.0f, 0.0f)) *
+				glm::scale(glm::vec3(components[0][i], components[1][i], components[2][i]));
+			memcpy(pMatrices + i * 16, glm::value_ptr(model), 16 * sizeof(float));
+		}
+	}
+
+	/***********************************************************
+	 *  SecondsNow()
+	 *
+	 *  This function is used for reading the steady clock in
+	 *  seconds.
+	 ***********************************************************/
+	double SecondsNow()
+	{
+		return(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+}
+
+/***********************************************************
+ *  main(int, char*)
+ *
+ *  This function gets called after the tool has been
+ *  launched, and times both ways of building the matrices.
+ ***********************************************************/
+int main(int argc, char* argv[])
+{
+	int nObjects = (argc > 1) ? atoi(argv[1]) : g_DefaultObjects;
+	int nRepeats = (argc > 2) ? atoi(argv[2]) : g_DefaultRepeats;
+	if ((nObjects <= 0) || (nRepeats <= 0))
+	{
+		std::cout << "Usage: TransformBenchmark [<objects>] [<repeats>]" << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	// the same ranges as the parts of the scene, with some
+	// rotations outside a single turn
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> scales(0.1f, 10.0f);
+	std::uniform_real_distribution<float> angles(-720.0f, 720.0f);
+	std::uniform_real_distribution<float> positions(-50.0f, 50.0f);
+	std::vector<float> components[9];
+	for (int i = 0; i < 9; i++)
+	{
+		components[i].resize(nObjects);
+	}
+	for (int object = 0; object < nObjects; object++)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			components[i][object] = scales(random);
+			components[3 + i][object] = angles(random);
+			components[6 + i][object] = positions(random);
+		}
+	}
+
+	TransformBatch::TRS_ARRAYS transforms;
+	for (int i = 0; i < 3; i++)
+	{
+		transforms.scale[i] = components[i].data();
+		transforms.rotation[i] = components[3 + i].data();
+		transforms.position[i] = components[6 + i].data();
+	}
+
+	std::vector<float> glmMatrices(nObjects * 16);
+	std::vector<float> batchMatrices(nObjects * 16);
+	double glmBest = 1e30;
+	double batchBest = 1e30;
+	for (int repeat = 0; repeat < nRepeats; repeat++)
+	{
+		double start = SecondsNow();
+		ComposeGlm(components, nObjects, glmMatrices.data());
+		double middle = SecondsNow();
+		TransformBatch::ComposeMatrices(transforms, nObjects, batchMatrices.data());
+		double end = SecondsNow();
+
+		glmBest = std::min(glmBest, middle - start);
+		batchBest = std::min(batchBest, end - middle);
+	}
+
+	// the difference is relative to the scale, which the
+	// entries of the first three columns grow with
+	float largestDifference = 0.0f;
+	for (int object = 0; object < nObjects; object++)
+	{
+		for (int entry = 0; entry < 16; entry++)
+		{
+			float scale = (entry < 12) ? components[entry / 4][object] : 1.0f;
+			float difference = std::fabs(glmMatrices[object * 16 + entry] - batchMatrices[object * 16 + entry]) / scale;
+			largestDifference = std::max(largestDifference, difference);
+		}
+	}
+
+	std::cout << nObjects << " objects, best of " << nRepeats << " runs, batch built with " <<
+		TransformBatch::GetInstructionSet() << std::endl;
+	std::cout << "glm:        " << glmBest * 1e9 / nObjects << " ns per object" << std::endl;
+	std::cout << "batch:      " << batchBest * 1e9 / nObjects << " ns per object" << std::endl;
+	std::cout << "speedup:    " << glmBest / batchBest << "x" << std::endl;
+	std::cout << "difference: " << largestDifference << " at most, per unit of scale" << std::endl;
+
+	return(EXIT_SUCCESS);
+}
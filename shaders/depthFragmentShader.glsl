@@ -0,0 +1,6 @@
+#version 330 core
+
+// only the depth of the opaque parts is written
+void main()
+{
+}
@@ -0,0 +1,47 @@
+#version 430 core
+
+// one invocation per texel of the level being built
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// depth of the opaque parts, copied from the framebuffer
+uniform sampler2D depthMap;
+// level the texels are taken from and the level written,
+// the next smaller one
+layout (r32f, binding = 0) readonly uniform image2D sourceLevel;
+layout (r32f, binding = 1) writeonly uniform image2D targetLevel;
+// whether the first level is copied from the depth map
+uniform bool copyDepth;
+
+void main()
+{
+    ivec2 target = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 targetSize = imageSize(targetLevel);
+    if(any(greaterThanEqual(target, targetSize)))
+    {
+        return;
+    }
+
+    if(copyDepth)
+    {
+        imageStore(targetLevel, target, vec4(texelFetch(depthMap, target, 0).r));
+        return;
+    }
+
+    // every texel keeps the farthest depth of the texels under
+    // it, and the last texel of a row or column also takes the
+    // one left over when the level above has an odd size
+    ivec2 sourceSize = imageSize(sourceLevel);
+    ivec2 first = target * 2;
+    ivec2 last = first + 1 + ivec2(equal(target, targetSize - 1)) * (sourceSize & 1);
+    last = min(last, sourceSize - 1);
+
+    float depth = 0.0f;
+    for(int y = first.y; y <= last.y; y++)
+    {
+        for(int x = first.x; x <= last.x; x++)
+        {
+            depth = max(depth, imageLoad(sourceLevel, ivec2(x, y)).r);
+        }
+    }
+    imageStore(targetLevel, target, vec4(depth));
+}
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 3) in mat4 inInstanceModel;
+
+// the depth must match the lit pass exactly for its GL_EQUAL test
+invariant gl_Position;
+
+// per-frame camera values shared by every shader program
+layout (std140) uniform FrameData
+{
+   mat4 view;
+   mat4 projection;
+   vec3 viewPosition;
+   vec4 viewport;
+   mat4 inverseViewProjection;
+};
+
+void main()
+{
+   vec3 worldPosition = vec3(inInstanceModel * vec4(inVertexPosition, 1.0));
+   gl_Position = projection * view * vec4(worldPosition, 1.0f);
+}
@@ -1,13 +1,35 @@
 #version 330 core
+// bindless textures are sampled from handles that differ between the
+// instances of one draw, which needs the gpu_shader5 extension as well
+#extension GL_ARB_bindless_texture : enable
+#extension GL_NV_gpu_shader5 : enable
+#if defined(GL_ARB_bindless_texture) && defined(GL_NV_gpu_shader5)
+#define USE_BINDLESS_TEXTURES
+#endif
+// the G-buffer variant writes the surface of the opaque parts, and
+// the deferred lighting variant shades it over the whole screen -
+// the other shaders light the parts as they are drawn
+#ifdef GBUFFER_OUTPUT
+layout (location = 0) out vec4 gbufferAlbedo;
+layout (location = 1) out vec4 gbufferNormal;
+#else
 out vec4 fragmentColor;
+#endif
 
+#ifndef DEFERRED_LIGHTING
 in vec3 fragmentPosition;
 in vec3 fragmentVertexNormal;
 in vec2 fragmentTextureCoordinate;
+in vec4 fragmentObjectColor;
+flat in int fragmentMaterialIndex;
+flat in int fragmentTextureSlot;
+flat in vec2 fragmentUVscale;
+#endif
 
 struct Material {
     vec3 diffuseColor;
     vec3 specularColor;
+    vec3 emissiveColor;
     float shininess;
 }; 
 
@@ -21,17 +43,6 @@ struct DirectionalLight {
     bool bActive;
 };
 
-struct PointLight {
-    vec3 position;
-    
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 emissive;
-
-    bool bActive;
-};
-
 struct SpotLight {
     vec3 position;
     vec3 direction;
@@ -49,182 +60,412 @@ struct SpotLight {
     bool bActive;
 };
 
-#define TOTAL_POINT_LIGHTS 5
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define MAX_CLUSTER_LIGHTS 32
+#define TOTAL_MATERIALS 32
+#define TOTAL_TEXTURES 256
+#define TOTAL_TEXTURE_ARRAYS 8
+#define SHADOW_CASCADES 3
+// depth bias of the cube shadow, which is drawn without polygon offset
+#define POINT_SHADOW_BIAS 0.002f
+
+// where a texture is found - the handle with bindless textures, the
+// array and layer otherwise, nothing until the texture is loaded
+struct TextureEntry {
+    uvec2 handle;
+    int arrayIndex;
+    int layer;
+};
 
-uniform bool bUseTexture=false;
 uniform bool bUseLighting=false;
-uniform vec4 objectColor = vec4(1.0f);
-uniform vec3 viewPosition;
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[TOTAL_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform Material material;
-uniform sampler2D objectTexture;
-uniform vec2 UVscale = vec2(1.0f, 1.0f);
+
+#ifdef DEFERRED_LIGHTING
+// surface of the opaque parts - the color, the normal with the
+// material index, and the depth
+uniform sampler2D gbufferAlbedoMap;
+uniform sampler2D gbufferNormalMap;
+uniform sampler2D gbufferDepthMap;
+#endif
+
+// the shader variants define the features of their draw bucket as
+// constants, so the branches on them are compiled out - the shader
+// without a variant decides every feature at run time
+#ifndef SHADER_VARIANT
+#define USE_LIGHTING bUseLighting
+#define USE_TEXTURE (fragmentTextureSlot >= 0)
+#define USE_DIRECTIONAL_LIGHT (directionalLight.bActive)
+#define USE_POINT_LIGHTS true
+#define USE_SPOT_LIGHT (spotLight.bActive)
+#endif
+
+// per-frame camera values shared by every shader program
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    // width, height, near plane, far plane
+    vec4 viewport;
+    // takes the screen back to the world, for the lighting pass
+    mat4 inverseViewProjection;
+};
+
+// light sources shared by every shader program
+layout (std140) uniform LightData
+{
+    DirectionalLight directionalLight;
+    SpotLight spotLight;
+};
+
+// point lights of the scene, four texels each - position and range,
+// then the ambient, diffuse and specular colors with the constant,
+// linear and quadratic attenuation terms in their fourth component
+uniform samplerBuffer pointLightData;
+// light count followed by the light list of every cluster
+uniform isamplerBuffer clusterLightData;
+
+// object materials shared by every shader program, read by
+// the material index of the drawn part
+layout (std140) uniform MaterialData
+{
+    Material materials[TOTAL_MATERIALS];
+};
+
+// scene textures shared by every shader program, read by the
+// texture slot of the drawn part
+layout (std140) uniform TextureData
+{
+    TextureEntry textures[TOTAL_TEXTURES];
+};
+
+// shadow maps of the moonlight and the candle flame shared by every
+// shader program
+layout (std140) uniform ShadowData
+{
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    // far view depth of every cascade
+    vec4 cascadeSplits;
+    // position and range of the shadow casting point light
+    vec4 pointShadowLight;
+    int cascadeCount;
+    int pointShadowIndex;
+};
+
+// depth of the moonlight cascades and of the flame light cube
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform samplerCubeShadow pointShadowMap;
+
+#ifndef USE_BINDLESS_TEXTURES
+// texture arrays holding the scene textures of each size and format
+uniform sampler2DArray textureArrays[TOTAL_TEXTURE_ARRAYS];
+#endif
+
+// material of the drawn part, used by the light calculations
+Material material;
+
+// terms of the shaded fragment that every light shares, found once
+// before the lights are summed
+struct Surface {
+    vec3 position;
+    vec3 normal;
+    vec3 viewDir;
+    // color of the texture or of the part, sampled once
+    vec3 albedo;
+};
 
 // function prototypes
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+void LoadMaterial(int materialIndex);
+vec3 ShadeSurface(Surface surface);
+vec4 SampleObjectTexture(vec2 textureCoordinate);
+int GetClusterIndex(float viewDepth);
+float CalcCascadeShadow(vec3 fragPos, float viewDepth);
+float CalcPointShadow(vec3 fragPos);
+vec3 CalcDirectionalLight(DirectionalLight light, Surface surface, float shadow);
+vec3 CalcPointLight(int lightIndex, Surface surface);
+vec3 CalcSpotLight(SpotLight light, Surface surface);
 
+#if defined(GBUFFER_OUTPUT)
+void main()
+{
+    // the color is sampled once here and kept for the lighting pass
+    vec4 albedo = fragmentObjectColor;
+    if(USE_TEXTURE)
+    {
+        albedo = SampleObjectTexture(fragmentTextureCoordinate * fragmentUVscale);
+    }
+
+    gbufferAlbedo = albedo;
+    gbufferNormal = vec4(normalize(fragmentVertexNormal), float(fragmentMaterialIndex));
+}
+#elif defined(DEFERRED_LIGHTING)
+void main()
+{
+    // the G-buffer is the size of the view, so the pixel is read
+    // without filtering
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbufferDepthMap, texel, 0).r;
+    // nothing opaque was drawn here, the clear color stays
+    if(depth >= 1.0f)
+    {
+        discard;
+    }
+    vec4 albedo = texelFetch(gbufferAlbedoMap, texel, 0);
+    vec4 normalMaterial = texelFetch(gbufferNormalMap, texel, 0);
+
+    // the transparent parts are tested against the opaque depth
+    gl_FragDepth = depth;
+
+    if(USE_LIGHTING)
+    {
+        vec4 clipPosition = vec4(gl_FragCoord.xy / viewport.xy * 2.0f - 1.0f, depth * 2.0f - 1.0f, 1.0f);
+        vec4 worldPosition = inverseViewProjection * clipPosition;
+        vec3 position = worldPosition.xyz / worldPosition.w;
+
+        LoadMaterial(int(round(normalMaterial.w)));
+        Surface surface = Surface(
+            position,
+            normalize(normalMaterial.xyz),
+            normalize(viewPosition - position),
+            albedo.rgb);
+        fragmentColor = vec4(ShadeSurface(surface), albedo.a);
+    }
+    else
+    {
+        fragmentColor = albedo;
+    }
+}
+#else
 void main()
 {    
-    if(bUseLighting == true)
-    {
-        vec3 phongResult = vec3(0.0f);
-        // properties
-        vec3 norm = normalize(fragmentVertexNormal);
-        vec3 viewDir = normalize(viewPosition - fragmentPosition);
-    
-        // == =====================================================
-        // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
-        // For each phase, a calculate function is defined that calculates the corresponding color
-        // per light source. In the main() function we take all the calculated colors and sum them 
-        // up for this fragment's final color.
-        // == =====================================================
-        // phase 1: directional lighting
-        if(directionalLight.bActive == true)
-        {
-            phongResult += CalcDirectionalLight(directionalLight, norm, viewDir);
-        }
-        // phase 2: point lights
-        for(int i = 0; i < TOTAL_POINT_LIGHTS; i++)
-        {
-	    if(pointLights[i].bActive == true)
-            {
-                phongResult += CalcPointLight(pointLights[i], norm, fragmentPosition, viewDir);   
-            }
-        } 
-        // phase 3: spot light
-        if(spotLight.bActive == true)
-        {
-            phongResult += CalcSpotLight(spotLight, norm, fragmentPosition, viewDir);    
-        }
-    
-        if(bUseTexture == true)
-        {
-            fragmentColor = vec4(phongResult, (texture(objectTexture, fragmentTextureCoordinate)).a);
-        }
-        else
-        {
-            fragmentColor = vec4(phongResult, objectColor.a);
-        }
+    // the texture is sampled once for every light, with the same
+    // scaled coordinates in the lit and the unlit path
+    vec4 albedo = fragmentObjectColor;
+    if(USE_TEXTURE)
+    {
+        albedo = SampleObjectTexture(fragmentTextureCoordinate * fragmentUVscale);
+    }
+
+    if(USE_LIGHTING)
+    {
+        LoadMaterial(fragmentMaterialIndex);
+        Surface surface = Surface(
+            fragmentPosition,
+            normalize(fragmentVertexNormal),
+            normalize(viewPosition - fragmentPosition),
+            albedo.rgb);
+        fragmentColor = vec4(ShadeSurface(surface), albedo.a);
     }
     else
     {
-        if(bUseTexture == true)
-        {
-            fragmentColor = texture(objectTexture, fragmentTextureCoordinate * UVscale);
-        }
-        else
+        fragmentColor = albedo;
+    }
+}
+#endif
+
+// reads the material of the part - parts without a material are
+// lit as black and not shiny
+void LoadMaterial(int materialIndex)
+{
+    if(materialIndex >= 0)
+    {
+        material = materials[materialIndex];
+    }
+    else
+    {
+        material = Material(vec3(0.0f), vec3(0.0f), vec3(0.0f), 1.0f);
+    }
+}
+
+// sums the lights reaching a surface, with the glow of its material
+vec3 ShadeSurface(Surface surface)
+{
+    vec3 phongResult = vec3(0.0f);
+    float viewDepth = -(view * vec4(surface.position, 1.0f)).z;
+
+    // == =====================================================
+    // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
+    // For each phase, a calculate function is defined that calculates the corresponding color
+    // per light source. Here we take all the calculated colors and sum them up for this
+    // fragment's final color.
+    // == =====================================================
+    // phase 1: directional lighting
+    if(USE_DIRECTIONAL_LIGHT)
+    {
+        phongResult += CalcDirectionalLight(directionalLight, surface, CalcCascadeShadow(surface.position, viewDepth));
+    }
+    // phase 2: point lights - only the lights reaching the
+    // cluster of the fragment, only the flame light casts a shadow
+    if(USE_POINT_LIGHTS)
+    {
+        int listOffset = GetClusterIndex(viewDepth) * (MAX_CLUSTER_LIGHTS + 1);
+        int lightCount = texelFetch(clusterLightData, listOffset).r;
+        for(int i = 0; i < lightCount; i++)
         {
-            fragmentColor = objectColor;
+            int lightIndex = texelFetch(clusterLightData, listOffset + 1 + i).r;
+            phongResult += CalcPointLight(lightIndex, surface);
         }
     }
+    // phase 3: spot light
+    if(USE_SPOT_LIGHT)
+    {
+        phongResult += CalcSpotLight(spotLight, surface);
+    }
+    // glow of the material itself
+    phongResult += material.emissiveColor;
+
+    return phongResult;
 }
 
-// calculates the color when using a directional light.
-vec3 CalcDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDir)
+#ifndef DEFERRED_LIGHTING
+// samples the texture of the drawn part by its texture slot
+vec4 SampleObjectTexture(vec2 textureCoordinate)
 {
-    vec3 ambient = vec3(0.0f);
-    vec3 diffuse = vec3(0.0f);
-    vec3 specular = vec3(0.0f);
-
-    vec3 lightDirection = normalize(-light.direction);
-    // diffuse shading
-    float diff = max(dot(normal, lightDirection), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDirection, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // combine results
-    if(bUseTexture == true)
+    TextureEntry entry = textures[fragmentTextureSlot];
+#ifdef USE_BINDLESS_TEXTURES
+    if(entry.handle != uvec2(0u))
     {
-        ambient = light.ambient * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        specular = light.specular * spec * material.specularColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
+        return texture(sampler2D(entry.handle), textureCoordinate);
     }
-    else
+#else
+    // samplers in an array can only be indexed by constants here
+    vec3 arrayCoordinate = vec3(textureCoordinate, float(entry.layer));
+    switch(entry.arrayIndex)
     {
-        ambient = light.ambient * vec3(objectColor);
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(objectColor);
-        specular = light.specular * spec * material.specularColor * vec3(objectColor);
+        case 0: return texture(textureArrays[0], arrayCoordinate);
+        case 1: return texture(textureArrays[1], arrayCoordinate);
+        case 2: return texture(textureArrays[2], arrayCoordinate);
+        case 3: return texture(textureArrays[3], arrayCoordinate);
+        case 4: return texture(textureArrays[4], arrayCoordinate);
+        case 5: return texture(textureArrays[5], arrayCoordinate);
+        case 6: return texture(textureArrays[6], arrayCoordinate);
+        case 7: return texture(textureArrays[7], arrayCoordinate);
     }
+#endif
+    // placeholder color until the texture is loaded
+    return vec4(0.5f, 0.5f, 0.5f, 1.0f);
+}
+#endif
+
+// finds the light cluster of the fragment from its screen position
+// and its view depth, split into the same exponential slices as the
+// light binning
+int GetClusterIndex(float viewDepth)
+{
+    float nearPlane = viewport.z;
+    float farPlane = viewport.w;
+    int slice = int(floor(log(max(viewDepth, nearPlane) / nearPlane) / log(farPlane / nearPlane) * float(CLUSTER_GRID_Z)));
+    ivec2 tile = ivec2(gl_FragCoord.xy / viewport.xy * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y));
+    tile = clamp(tile, ivec2(0), ivec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    slice = clamp(slice, 0, CLUSTER_GRID_Z - 1);
+    return tile.x + tile.y * CLUSTER_GRID_X + slice * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+}
 
-    
-    return (ambient + diffuse + specular);
+// finds how much of the moonlight reaches the fragment, from the first
+// cascade reaching past its view depth
+float CalcCascadeShadow(vec3 fragPos, float viewDepth)
+{
+    for(int i = 0; i < cascadeCount; i++)
+    {
+        if(viewDepth <= cascadeSplits[i])
+        {
+            vec4 shadowPosition = cascadeMatrices[i] * vec4(fragPos, 1.0f);
+            return texture(cascadeShadowMap, vec4(shadowPosition.xy, float(i), min(shadowPosition.z, 1.0f)));
+        }
+    }
+    return 1.0f;
 }
 
-// calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// finds how much of the flame light reaches the fragment from the
+// distance stored in the cube shadow
+float CalcPointShadow(vec3 fragPos)
 {
-    vec3 ambient = vec3(0.0f);
-    vec3 diffuse = vec3(0.0f);
-    vec3 specular= vec3(0.0f);
+    vec3 lightToFragment = fragPos - pointShadowLight.xyz;
+    float depth = length(lightToFragment) / pointShadowLight.w;
+    return texture(pointShadowMap, vec4(lightToFragment, depth - POINT_SHADOW_BIAS));
+}
 
-    vec3 lightDir = normalize(light.position - fragPos);
+// calculates the color when using a directional light - the shadow
+// leaves only the ambient light
+vec3 CalcDirectionalLight(DirectionalLight light, Surface surface, float shadow)
+{
+    vec3 lightDirection = normalize(-light.direction);
     // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
+    float diff = max(dot(surface.normal, lightDirection), 0.0);
     // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    // Calculate specular component
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-   
-    // Add emissive color to ambient
-    ambient = light.ambient * vec3(objectColor) + light.emissive;
+    vec3 reflectDir = reflect(-lightDirection, surface.normal);
+    float spec = pow(max(dot(surface.viewDir, reflectDir), 0.0), material.shininess);
 
     // combine results
-    if(bUseTexture == true)
-    {
-        ambient = light.ambient * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        specular = light.specular * specularComponent * material.specularColor;
-    }
-    else
-    {
-        ambient = light.ambient * vec3(objectColor);
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(objectColor);
-        specular = light.specular * specularComponent * material.specularColor;
-    }
-    
-    return (ambient + diffuse + specular);
+    vec3 lit = light.diffuse * diff * material.diffuseColor + light.specular * spec * material.specularColor;
+    return (light.ambient + lit * shadow) * surface.albedo;
 }
 
-// calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// calculates the color when using a point light, read from the light
+// buffer - the position and range are read first, so a light whose
+// range ends before the fragment is skipped without the rest of its
+// values or its shadow, and the shadow leaves only the ambient light
+vec3 CalcPointLight(int lightIndex, Surface surface)
 {
-    vec3 ambient = vec3(0.0f);
-    vec3 diffuse = vec3(0.0f);
-    vec3 specular = vec3(0.0f);
+    vec4 positionRange = texelFetch(pointLightData, lightIndex * 4);
+    vec3 lightVector = positionRange.xyz - surface.position;
+    float distanceSquared = dot(lightVector, lightVector);
+    float rangeSquared = positionRange.w * positionRange.w;
+    if(distanceSquared >= rangeSquared)
+    {
+        return vec3(0.0f);
+    }
 
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec4 ambient = texelFetch(pointLightData, lightIndex * 4 + 1);
+    vec4 diffuse = texelFetch(pointLightData, lightIndex * 4 + 2);
+    vec4 specular = texelFetch(pointLightData, lightIndex * 4 + 3);
+    float shadow = (lightIndex == pointShadowIndex) ? CalcPointShadow(surface.position) : 1.0f;
+
+    vec3 lightDir = lightVector * inversesqrt(distanceSquared);
     // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
+    float diff = max(dot(surface.normal, lightDir), 0.0);
     // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float specularComponent = pow(max(dot(surface.viewDir, reflectDir), 0.0), material.shininess);
+    // attenuation, faded out towards the end of the range so the
+    // light is already gone where it is skipped
+    float distance = sqrt(distanceSquared);
+    float attenuation = 1.0 / (ambient.w + diffuse.w * distance + specular.w * distanceSquared);
+    float distanceRatioSquared = distanceSquared / rangeSquared;
+    float falloff = clamp(1.0 - distanceRatioSquared * distanceRatioSquared, 0.0, 1.0);
+    falloff *= falloff;
+
+    // combine results - the highlight is not tinted by the texture
+    vec3 lit = diffuse.rgb * diff * material.diffuseColor * surface.albedo + specular.rgb * specularComponent * material.specularColor;
+    return (ambient.rgb * surface.albedo + lit * shadow) * (attenuation * falloff);
+}
+
+// calculates the color when using a spot light - fragments outside
+// the cone get no light at all, so they skip the shading
+vec3 CalcSpotLight(SpotLight light, Surface surface)
+{
+    vec3 lightVector = light.position - surface.position;
+    float distance = length(lightVector);
+    vec3 lightDir = lightVector / distance;
     // spotlight intensity
     float theta = dot(lightDir, normalize(-light.direction)); 
+    if(theta <= light.outerCutOff)
+    {
+        return vec3(0.0f);
+    }
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    // attenuation
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+
+    // diffuse shading
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, surface.normal);
+    float spec = pow(max(dot(surface.viewDir, reflectDir), 0.0), material.shininess);
+
     // combine results
-    if(bUseTexture == true)
-    {
-        ambient = light.ambient * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-        specular = light.specular * spec * material.specularColor * vec3(texture(objectTexture, fragmentTextureCoordinate));
-    }
-    else
-    {
-        ambient = light.ambient * vec3(objectColor);
-        diffuse = light.diffuse * diff * material.diffuseColor * vec3(objectColor);
-        specular = light.specular * spec * material.specularColor * vec3(objectColor);
-    }
-    
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
-    return (ambient + diffuse + specular);
+    vec3 lit = light.ambient + light.diffuse * diff * material.diffuseColor + light.specular * spec * material.specularColor;
+    return lit * surface.albedo * (attenuation * intensity);
 }
@@ -0,0 +1,51 @@
+#version 330 core
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 1) in vec3 inVertexNormal;
+layout (location = 2) in vec2 inTextureCoordinate;
+layout (location = 3) in mat4 inInstanceModel;
+layout (location = 7) in vec4 inInstanceColor;
+layout (location = 8) in ivec2 inInstanceMaterial;
+layout (location = 9) in vec2 inInstanceUVscale;
+
+out vec3 fragmentPosition;
+out vec3 fragmentVertexNormal;
+out vec2 fragmentTextureCoordinate;
+out vec4 fragmentObjectColor;
+flat out int fragmentMaterialIndex;
+flat out int fragmentTextureSlot;
+flat out vec2 fragmentUVscale;
+
+// the depth must match the depth pre-pass exactly for its GL_EQUAL test
+invariant gl_Position;
+
+// per-frame camera values shared by every shader program
+layout (std140) uniform FrameData
+{
+   mat4 view;
+   mat4 projection;
+   vec3 viewPosition;
+   vec4 viewport;
+   mat4 inverseViewProjection;
+};
+
+#ifdef DEFERRED_LIGHTING
+// the lighting pass covers the view with one triangle, drawn
+// without any vertex buffer
+void main()
+{
+   vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+   gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
+#else
+void main()
+{
+   fragmentPosition = vec3(inInstanceModel * vec4(inVertexPosition, 1.0));
+   gl_Position = projection * view * vec4(fragmentPosition, 1.0f);
+   fragmentVertexNormal = inVertexNormal;
+   fragmentTextureCoordinate = inTextureCoordinate;
+   fragmentObjectColor = inInstanceColor;
+   fragmentMaterialIndex = inInstanceMaterial.x;
+   fragmentTextureSlot = inInstanceMaterial.y;
+   fragmentUVscale = inInstanceUVscale;
+}
+#endif
@@ -0,0 +1,87 @@
+#version 430 core
+
+// one invocation per cluster of a depth slice
+layout (local_size_x = 16, local_size_y = 9, local_size_z = 1) in;
+
+#define MAX_CLUSTER_LIGHTS 32
+
+struct PointLight {
+    vec4 positionRange;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
+
+layout (std430, binding = 0) readonly buffer PointLightBuffer
+{
+    PointLight pointLights[];
+};
+
+// light count followed by the light list of every cluster
+layout (std430, binding = 1) writeonly buffer ClusterLightBuffer
+{
+    int clusterLights[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+// width, height, near plane, far plane
+uniform vec4 viewport;
+uniform int lightCount;
+
+// view space position of a corner of the cluster
+vec3 UnprojectCorner(mat4 inverseProjection, vec2 tileCorner, float ndcDepth)
+{
+    vec2 ndc = -1.0f + 2.0f * tileCorner / vec2(gl_NumWorkGroups.xy * gl_WorkGroupSize.xy);
+    vec4 position = inverseProjection * vec4(ndc, ndcDepth, 1.0f);
+    return position.xyz / position.w;
+}
+
+void main()
+{
+    uvec3 gridSize = gl_NumWorkGroups * gl_WorkGroupSize;
+    uvec3 cluster = gl_GlobalInvocationID;
+    uint clusterIndex = cluster.x + cluster.y * gridSize.x + cluster.z * gridSize.x * gridSize.y;
+
+    // exponential depth slices, the same as the fragment shader
+    float nearPlane = viewport.z;
+    float farPlane = viewport.w;
+    float ndcDepths[2];
+    for(int i = 0; i < 2; i++)
+    {
+        float sliceDepth = nearPlane * pow(farPlane / nearPlane, float(cluster.z + uint(i)) / float(gridSize.z));
+        vec4 clip = projection * vec4(0.0f, 0.0f, -sliceDepth, 1.0f);
+        ndcDepths[i] = clip.z / clip.w;
+    }
+
+    // bounding box of the cluster, which works for both the
+    // perspective and the orthographic views
+    mat4 inverseProjection = inverse(projection);
+    vec3 boundsMin = vec3(3.4e38f);
+    vec3 boundsMax = vec3(-3.4e38f);
+    for(int corner = 0; corner < 8; corner++)
+    {
+        vec2 tileCorner = vec2(cluster.xy) + vec2(corner & 1, (corner >> 1) & 1);
+        vec3 point = UnprojectCorner(inverseProjection, tileCorner, ndcDepths[corner >> 2]);
+        boundsMin = min(boundsMin, point);
+        boundsMax = max(boundsMax, point);
+    }
+
+    uint listOffset = clusterIndex * uint(MAX_CLUSTER_LIGHTS + 1);
+    int count = 0;
+    for(int i = 0; (i < lightCount) && (count < MAX_CLUSTER_LIGHTS); i++)
+    {
+        vec3 lightPosition = (view * vec4(pointLights[i].positionRange.xyz, 1.0f)).xyz;
+        float range = pointLights[i].positionRange.w;
+
+        // the light reaches the cluster when the closest point
+        // of the box is inside its range
+        vec3 offset = clamp(lightPosition, boundsMin, boundsMax) - lightPosition;
+        if(dot(offset, offset) <= range * range)
+        {
+            clusterLights[listOffset + 1u + uint(count)] = i;
+            count++;
+        }
+    }
+    clusterLights[listOffset] = count;
+}
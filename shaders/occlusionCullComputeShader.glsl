@@ -0,0 +1,133 @@
+#version 430 core
+
+// one invocation per instance, or per draw command while the
+// commands are reset
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// world space box of an instance and the command drawing it
+struct InstanceBounds {
+    vec3 center;
+    uint command;
+    vec3 extent;
+    uint padding;
+};
+
+// per-instance values are copied as they are
+struct InstanceData {
+    vec4 values[6];
+};
+
+layout (std430, binding = 0) readonly buffer BoundsBuffer
+{
+    InstanceBounds bounds[];
+};
+
+layout (std430, binding = 1) readonly buffer InstanceBuffer
+{
+    InstanceData instances[];
+};
+
+layout (std430, binding = 2) buffer CommandBuffer
+{
+    DrawCommand commands[];
+};
+
+layout (std430, binding = 3) writeonly buffer CulledInstanceBuffer
+{
+    InstanceData culledInstances[];
+};
+
+// farthest depth of every texel of the depth pyramid, and
+// the view projection of the frame it was built from
+uniform sampler2D depthPyramid;
+uniform int pyramidLevels;
+uniform mat4 pyramidViewProjection;
+uniform int instanceCount;
+uniform int commandCount;
+// whether the instance counts of the commands are cleared
+uniform bool resetCommands;
+
+// whether a box is hidden behind the depth of the pyramid -
+// a box that reaches behind the camera or out of the view of
+// the pyramid has nothing to be tested against and is kept
+bool IsOccluded(vec3 center, vec3 extent)
+{
+    vec3 ndcMin = vec3(1.0f);
+    vec3 ndcMax = vec3(-1.0f);
+    for(int corner = 0; corner < 8; corner++)
+    {
+        vec3 offset = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1) * 2.0f - 1.0f;
+        vec4 clip = pyramidViewProjection * vec4(center + extent * offset, 1.0f);
+        if(clip.w <= 0.0f)
+        {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+    if(any(lessThan(ndcMin, vec3(-1.0f))) || any(greaterThan(ndcMax.xy, vec2(1.0f))))
+    {
+        return false;
+    }
+
+    // texels of the full size level the box covers
+    ivec2 size = textureSize(depthPyramid, 0);
+    ivec2 first = clamp(ivec2((ndcMin.xy * 0.5f + 0.5f) * vec2(size)), ivec2(0), size - 1);
+    ivec2 last = clamp(ivec2((ndcMax.xy * 0.5f + 0.5f) * vec2(size)), ivec2(0), size - 1);
+
+    // the first level where the box covers at most two texels
+    // across - a texel of a level stands for the texels 2^level
+    // times its index onwards, and the last one for the rest
+    int level = 0;
+    while((level < pyramidLevels - 1) &&
+        (any(greaterThan((last >> level) - (first >> level), ivec2(1)))))
+    {
+        level++;
+    }
+    ivec2 levelLast = textureSize(depthPyramid, level) - 1;
+    ivec2 levelFirst = min(first >> level, levelLast);
+    levelLast = min(last >> level, levelLast);
+
+    float farthest = max(
+        max(texelFetch(depthPyramid, levelFirst, level).r,
+            texelFetch(depthPyramid, ivec2(levelLast.x, levelFirst.y), level).r),
+        max(texelFetch(depthPyramid, ivec2(levelFirst.x, levelLast.y), level).r,
+            texelFetch(depthPyramid, levelLast, level).r));
+
+    // the box is hidden when its nearest point is behind the
+    // farthest depth of every texel it covers
+    return (ndcMin.z * 0.5f + 0.5f) > farthest;
+}
+
+void main()
+{
+    int index = int(gl_GlobalInvocationID.x);
+    if(resetCommands)
+    {
+        if(index < commandCount)
+        {
+            commands[index].instanceCount = 0u;
+        }
+        return;
+    }
+
+    if((index >= instanceCount) || IsOccluded(bounds[index].center, bounds[index].extent))
+    {
+        return;
+    }
+
+    // the visible instances of a command are packed at its first
+    // instance, in whatever order they pass
+    uint command = bounds[index].command;
+    uint slot = atomicAdd(commands[command].instanceCount, 1u);
+    culledInstances[commands[command].baseInstance + slot] = instances[index];
+}
@@ -0,0 +1,20 @@
+#version 330 core
+in vec3 worldPosition;
+
+// position and range of the point light drawing its cube shadow, or
+// a range of zero while the cascades are drawn
+uniform vec4 shadowLight;
+
+void main()
+{
+    // the cube holds the distance to the light over its range, so
+    // every face is compared the same way
+    if(shadowLight.w > 0.0f)
+    {
+        gl_FragDepth = length(worldPosition - shadowLight.xyz) / shadowLight.w;
+    }
+    else
+    {
+        gl_FragDepth = gl_FragCoord.z;
+    }
+}
@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 3) in mat4 inInstanceModel;
+
+out vec3 worldPosition;
+
+// light view and projection of the shadow map being drawn
+uniform mat4 shadowMatrix;
+
+void main()
+{
+   worldPosition = vec3(inInstanceModel * vec4(inVertexPosition, 1.0));
+   gl_Position = shadowMatrix * vec4(worldPosition, 1.0f);
+}
@@ -0,0 +1,42 @@
+#version 330 core
+in vec2 screenCoordinate;
+out vec4 fragmentColor;
+
+// the scaled view, drawn into the lower left of the texture
+uniform sampler2D sourceImage;
+// share of the texture covered by the view, and the size of one
+// texel of the texture
+uniform vec2 sourceRegion;
+uniform vec2 sourceTexel;
+// strength of the sharpening, from none to full
+uniform float sharpness;
+
+// reads the view with bilinear filtering, never past its edge so
+// an earlier larger view left in the texture does not bleed in
+vec3 SampleSource(vec2 textureCoordinate)
+{
+    vec2 lowest = sourceTexel * 0.5f;
+    vec2 highest = sourceRegion - sourceTexel * 0.5f;
+    return texture(sourceImage, clamp(textureCoordinate, lowest, highest)).rgb;
+}
+
+void main()
+{
+    vec2 center = screenCoordinate * sourceRegion;
+    vec3 c = SampleSource(center);
+    vec3 n = SampleSource(center + vec2(0.0f, sourceTexel.y));
+    vec3 s = SampleSource(center - vec2(0.0f, sourceTexel.y));
+    vec3 e = SampleSource(center + vec2(sourceTexel.x, 0.0f));
+    vec3 w = SampleSource(center - vec2(sourceTexel.x, 0.0f));
+
+    // contrast adaptive sharpening - the neighbours are subtracted
+    // less where the contrast is already high, so the edges that
+    // the bilinear filter softened come back without ringing
+    vec3 lowestColor = min(c, min(min(n, s), min(e, w)));
+    vec3 highestColor = max(c, max(max(n, s), max(e, w)));
+    vec3 amplitude = sqrt(clamp(min(lowestColor, 1.0f - highestColor) / max(highestColor, vec3(0.0001f)), 0.0f, 1.0f));
+    vec3 weight = amplitude * (-sharpness / mix(8.0f, 5.0f, sharpness));
+    vec3 color = (c + (n + s + e + w) * weight) / (1.0f + 4.0f * weight);
+
+    fragmentColor = vec4(clamp(color, 0.0f, 1.0f), 1.0f);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+out vec2 screenCoordinate;
+
+// the upscale covers the window with one triangle, drawn without
+// any vertex buffer
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    screenCoordinate = corner;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}